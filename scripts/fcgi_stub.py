@@ -0,0 +1,121 @@
+# Minimal FastCGI responder for testing the server's FastCGI client without a real application server.
+#
+# Usage: python3 fcgi_stub.py unix:/tmp/fcgi.sock
+#        python3 fcgi_stub.py 127.0.0.1:9000
+#
+# Every request is answered with a plain text listing of its parameters and its body. The script named by
+# SCRIPT_FILENAME is not run. A "status" parameter in the querystring sets the Status header of the response, and a
+# "size" parameter appends that many bytes to the body. Connections are kept open when the client asks for it.
+
+import os
+import socket
+import socketserver
+import struct
+import sys
+import urllib.parse
+
+FCGI_BEGIN_REQUEST = 1
+FCGI_END_REQUEST = 3
+FCGI_PARAMS = 4
+FCGI_STDIN = 5
+FCGI_STDOUT = 6
+FCGI_KEEP_CONN = 1
+
+
+def read_exact(conn, length):
+    data = b''
+    while len(data) < length:
+        piece = conn.recv(length - len(data))
+        if not piece:
+            return None
+        data += piece
+    return data
+
+
+def read_record(conn):
+    header = read_exact(conn, 8)
+    if header is None:
+        return None
+    _, record_type, request_id, length, padding, _ = struct.unpack('>BBHHBB', header)
+    content = read_exact(conn, length + padding)
+    if content is None:
+        return None
+    return record_type, request_id, content[:length]
+
+
+def write_record(conn, record_type, request_id, content):
+    for start in range(0, max(len(content), 1), 65535):
+        piece = content[start:start + 65535]
+        conn.sendall(struct.pack('>BBHHBB', 1, record_type, request_id, len(piece), 0, 0) + piece)
+
+
+def decode_length(data, pos):
+    if data[pos] < 128:
+        return data[pos], pos + 1
+    return struct.unpack('>I', data[pos:pos + 4])[0] & 0x7fffffff, pos + 4
+
+
+def decode_params(data):
+    params, pos = {}, 0
+    while pos < len(data):
+        name_len, pos = decode_length(data, pos)
+        value_len, pos = decode_length(data, pos)
+        name = data[pos:pos + name_len].decode()
+        params[name] = data[pos + name_len:pos + name_len + value_len].decode()
+        pos += name_len + value_len
+    return params
+
+
+def respond(conn, request_id, params, body):
+    query = urllib.parse.parse_qs(params.get('QUERY_STRING', ''))
+    lines = ['%s=%s' % item for item in sorted(params.items())]
+    lines.append('STDIN=%s' % body.decode(errors='replace'))
+    text = ('\n'.join(lines) + '\n').encode() + b'x' * int(query.get('size', ['0'])[0])
+
+    head = 'Content-Type: text/plain\r\n'
+    if 'status' in query:
+        head += 'Status: %s\r\n' % query['status'][0]
+    write_record(conn, FCGI_STDOUT, request_id, (head + '\r\n').encode() + text)
+    write_record(conn, FCGI_STDOUT, request_id, b'')
+    write_record(conn, FCGI_END_REQUEST, request_id, struct.pack('>IB3x', 0, 0))
+
+
+class Handler(socketserver.BaseRequestHandler):
+    def handle(self):
+        keep_conn = True
+        while keep_conn:
+            params_data, body, flags = b'', b'', 0
+            while True:
+                record = read_record(self.request)
+                if record is None:
+                    return
+                record_type, request_id, content = record
+                if record_type == FCGI_BEGIN_REQUEST:
+                    flags = content[2]
+                elif record_type == FCGI_PARAMS:
+                    params_data += content
+                elif record_type == FCGI_STDIN:
+                    if not content:
+                        break
+                    body += content
+            respond(self.request, request_id, decode_params(params_data), body)
+            keep_conn = bool(flags & FCGI_KEEP_CONN)
+
+
+def main():
+    address = sys.argv[1] if len(sys.argv) > 1 else '127.0.0.1:9000'
+    if address.startswith('unix:'):
+        path = address[len('unix:'):]
+        if os.path.exists(path):
+            os.unlink(path)
+        server = socketserver.ThreadingUnixStreamServer(path, Handler)
+    else:
+        host, port = address.rsplit(':', 1)
+        socketserver.ThreadingTCPServer.allow_reuse_address = True
+        server = socketserver.ThreadingTCPServer((host, int(port)), Handler)
+    server.daemon_threads = True
+    server.serve_forever()
+
+
+if __name__ == '__main__':
+    main()
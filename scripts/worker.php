@@ -0,0 +1,98 @@
+<?php
+// Persistent worker for the server's PHP worker pool.
+//
+// The server starts this script with a Unix socket as file descriptor 3, and sends it frames made of a one byte type,
+// a four byte big-endian length and the payload. For each request frame (the path of a script, a null byte and the
+// standard input of the script), the script is run in this same interpreter, its output is sent back in output frames,
+// and an end frame with its exit status is sent once it finishes.
+//
+// A script calling exit() ends the whole worker. The end frame is still sent from a shutdown function, and the server
+// replaces the worker once it notices that it's gone.
+//
+// Scripts run inside a function, so their top-level variables aren't globals. Functions and classes stay declared
+// after a script finishes, so a script declaring them fails with "Cannot redeclare" the second time the same worker
+// runs it (which also ends the worker) unless it guards them with function_exists() or class_exists(). The standard
+// input of the worker is empty: the querystring and the body are in the $STDIN stream instead of STDIN or
+// php://stdin. Scripts that rely on any of this must use the cgi kind, which is the default for .php files.
+
+const FRAME_REQUEST = 'R';
+const FRAME_OUTPUT = 'O';
+const FRAME_END = 'E';
+const OUTPUT_BUFFER = 16384;
+
+$server = fopen('php://fd/3', 'r+');
+$running = false;
+
+function recv_exact($length) {
+    global $server;
+    $data = '';
+    while (strlen($data) < $length) {
+        $piece = fread($server, $length - strlen($data));
+        if ($piece === false || $piece === '') return null;
+        $data .= $piece;
+    }
+    return $data;
+}
+
+function send_frame($type, $payload) {
+    global $server;
+    fwrite($server, $type . pack('N', strlen($payload)) . $payload);
+    fflush($server);
+}
+
+function finish_script($status) {
+    global $running;
+    if (!$running) return;
+    while (ob_get_level() > 0) ob_end_flush();
+    $running = false;
+    send_frame(FRAME_END, pack('N', $status));
+}
+
+register_shutdown_function(function () {
+    $error = error_get_last();
+    $fatal = [E_ERROR, E_PARSE, E_CORE_ERROR, E_COMPILE_ERROR];
+    finish_script($error !== null && in_array($error['type'], $fatal, true) ? 255 : 0);
+});
+
+function start_script() {
+    global $running;
+
+    $running = true;
+    ob_start(function ($buffer) {
+        if ($buffer !== '') send_frame(FRAME_OUTPUT, $buffer);
+        return '';
+    }, OUTPUT_BUFFER);
+}
+
+// Runs a script in the scope of this function, where its variables can't replace the ones of the worker. PHP doesn't
+// allow replacing the STDIN constant, so the input is available in the $STDIN variable instead.
+function run_script($__script, $STDIN) {
+    $argv = [$__script];
+    $argc = 1;
+    include $__script;
+}
+
+while (true) {
+    $header = recv_exact(5);
+    if ($header === null) break; // The server closed the socket, so the worker must finish
+
+    $length = unpack('N', substr($header, 1))[1];
+    $payload = $length > 0 ? recv_exact($length) : '';
+    if ($payload === null || $header[0] !== FRAME_REQUEST) break;
+
+    $separator = strpos($payload, "\0");
+    $input = fopen('php://memory', 'r+');
+    fwrite($input, (string) substr($payload, $separator + 1));
+    rewind($input);
+    start_script();
+
+    $status = 0;
+    try {
+        run_script(substr($payload, 0, $separator), $input);
+    } catch (Throwable $e) {
+        fwrite(STDERR, $e . "\n");
+        $status = 1;
+    }
+    finish_script($status);
+    fclose($input);
+}
@@ -0,0 +1,99 @@
+# Persistent worker for the server's Python worker pool.
+#
+# The server starts this script with a Unix socket as file descriptor 3, and sends it frames made of a one byte type,
+# a four byte big-endian length and the payload. For each request frame (the path of a script, a null byte and the
+# standard input of the script), the script is run in this same interpreter, its output is sent back in output frames,
+# and an end frame with its exit status is sent once it finishes.
+
+import io
+import os
+import runpy
+import signal
+import socket
+import struct
+import sys
+import traceback
+
+WORKER_FD = 3
+FRAME_REQUEST = b'R'
+FRAME_OUTPUT = b'O'
+FRAME_END = b'E'
+OUTPUT_BUFFER = 16 * 1024
+
+server = socket.socket(fileno=WORKER_FD)
+real_stdout = sys.stdout
+
+
+def recv_exact(length):
+    data = bytearray()
+    while len(data) < length:
+        piece = server.recv(length - len(data))
+        if not piece:
+            return None
+        data += piece
+    return bytes(data)
+
+
+def send_frame(frame_type, payload):
+    server.sendall(frame_type + struct.pack('>I', len(payload)) + payload)
+
+
+class FrameWriter(io.RawIOBase):
+    """Raw stream sending everything written to it as output frames."""
+
+    def writable(self):
+        return True
+
+    def write(self, data):
+        if data:
+            send_frame(FRAME_OUTPUT, bytes(data))
+        return len(data)
+
+
+def run(path, script_input):
+    stdout = io.TextIOWrapper(io.BufferedWriter(FrameWriter(), OUTPUT_BUFFER), encoding='utf-8')
+    sys.stdout = stdout
+    sys.stdin = io.TextIOWrapper(io.BytesIO(script_input), encoding='utf-8', newline='\n')  # Like the real stdin
+    sys.argv = [path]
+    cwd = os.getcwd()
+
+    status = 0
+    try:
+        runpy.run_path(path, run_name='__main__')
+    except SystemExit as e:
+        status = e.code if isinstance(e.code, int) else (0 if e.code is None else 1)
+    except BaseException:
+        traceback.print_exc()
+        status = 1
+    finally:
+        # Whatever the script changed must not leak into the next one
+        signal.alarm(0)
+        signal.signal(signal.SIGALRM, signal.SIG_DFL)
+        os.chdir(cwd)
+        try:
+            stdout.flush()
+        except (OSError, ValueError):
+            pass
+        sys.stdout = real_stdout
+
+    return status
+
+
+def main():
+    while True:
+        header = recv_exact(5)
+        if header is None:
+            break  # The server closed the socket, so the worker must finish
+
+        frame_type, length = struct.unpack('>cI', header)
+        payload = recv_exact(length)
+        if payload is None or frame_type != FRAME_REQUEST:
+            break
+
+        path, _, script_input = payload.partition(b'\0')
+        status = run(path.decode(), script_input)
+        send_frame(FRAME_END, struct.pack('>I', status & 0xffffffff))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,379 @@
+/**
+ * @file accesslog.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Implementation of the binary access log
+ * @details Segments are reference counted: the log holds one reference to the current segment, and each writer holds
+ * another one while it copies its record. When the log moves to a new segment, it drops its reference, and whoever
+ * drops the last one unmaps the old segment and truncates it to the length of its records. Thanks to that, the lock is
+ * only held while reserving the space of a record, never while copying it.
+ */
+
+#include "accesslog.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+
+#define ACCESSLOG_FIXED_LEN 15 ///< Length of the fixed part of a record
+#define ACCESSLOG_MAX_VARINT 10 ///< Maximum length of a varint
+#define ACCESSLOG_VARINTS 7 ///< Maximum number of varints in a record
+#define ACCESSLOG_MAX_RECORD (ACCESSLOG_FIXED_LEN + ACCESSLOG_VARINTS * ACCESSLOG_MAX_VARINT + 3 * ACCESSLOG_MAX_STRING)
+
+/**
+ * @brief Methods stored as a single byte, whose value is their position plus one
+ */
+const char *accesslog_methods[] = {"GET", "HEAD", "POST", "OPTIONS", "PUT", "DELETE", "PATCH"};
+
+#define ACCESSLOG_METHODS (sizeof(accesslog_methods) / sizeof(accesslog_methods[0])) ///< Number of common methods
+
+/**
+ * @struct accesslog_segment
+ * @brief A segment file mapped in memory
+ */
+struct accesslog_segment {
+    unsigned char *map; ///< Contents of the segment
+    size_t size; ///< Size of the segment
+    size_t used; ///< Bytes reserved so far, protected by the lock of the log
+    int fd; ///< Descriptor of the segment file
+    atomic_int refs; ///< References held by the log and by the writers copying a record
+};
+
+/**
+ * @struct accesslog
+ * @brief Stores a binary access log
+ */
+struct accesslog {
+    char *prefix; ///< Path of the segments, without their number and extension
+    size_t segment_size; ///< Size of each segment
+    int max_segments; ///< Number of segments kept, or 0 to keep all of them
+    unsigned long next_number; ///< Number of the next segment
+    struct accesslog_segment *current; ///< Segment where records are written
+    pthread_mutex_t mutex; ///< Protects the current segment and the space reserved in it
+};
+
+/**
+ * @brief Writes the path of a segment
+ * @param[out] buf Where the path must be written
+ * @param[in] buf_len Size of the buffer
+ * @param[in] log The log
+ * @param[in] number Number of the segment
+ * @return \ref STATUS.SUCCESS if it fit in the buffer, \ref STATUS.ERROR otherwise
+ */
+STATUS accesslog_segment_path(char *buf, size_t buf_len, const accesslog *log, unsigned long number) {
+    int len = snprintf(buf, buf_len, "%s.%lu%s", log->prefix, number, ACCESSLOG_EXTENSION);
+    return len < 0 || (size_t) len >= buf_len ? ERROR : SUCCESS;
+}
+
+/**
+ * @brief Creates the next segment of a log, and deletes the oldest one if there are too many
+ * @param[in,out] log The log
+ * @return The new segment, or NULL if it can't be created
+ */
+struct accesslog_segment *accesslog_segment_create(accesslog *log) {
+    char path[4096];
+    if (accesslog_segment_path(path, sizeof(path), log, log->next_number) == ERROR) return NULL;
+
+    struct accesslog_segment *segment = calloc(1, sizeof(struct accesslog_segment));
+    if (!segment) return NULL;
+
+    segment->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (segment->fd == -1 || ftruncate(segment->fd, (off_t) log->segment_size) != 0 ||
+        (segment->map = mmap(NULL, log->segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0)) ==
+        MAP_FAILED) {
+        if (segment->fd != -1) close(segment->fd);
+        free(segment);
+        return NULL;
+    }
+
+    memcpy(segment->map, ACCESSLOG_MAGIC, 8);
+    uint32_t version = ACCESSLOG_VERSION;
+    for (int i = 0; i < 4; i++) segment->map[8 + i] = (unsigned char) (version >> (8 * i));
+    segment->size = log->segment_size;
+    segment->used = ACCESSLOG_HEADER_LEN;
+    segment->refs = 1; // The reference of the log
+
+    if (log->max_segments > 0 && log->next_number >= (unsigned long) log->max_segments &&
+        accesslog_segment_path(path, sizeof(path), log, log->next_number - log->max_segments) == SUCCESS) {
+        unlink(path); // The oldest segment may have been deleted by hand already
+    }
+    log->next_number++;
+
+    return segment;
+}
+
+/**
+ * @brief Drops a reference to a segment, finishing it if it was the last one
+ * @param[in] segment The segment
+ */
+void accesslog_segment_release(struct accesslog_segment *segment) {
+    if (atomic_fetch_sub(&segment->refs, 1) != 1) return;
+
+    munmap(segment->map, segment->size);
+    if (ftruncate(segment->fd, (off_t) segment->used) != 0) {
+        // The rest is zeros, which readers take as the end of the records anyway
+    }
+    close(segment->fd);
+    free(segment);
+}
+
+/**
+ * @brief Finds the number that follows the last segment of a log that already exists
+ * @param[in] prefix Path of the segments, without their number and extension
+ * @return Number of the next segment
+ */
+unsigned long accesslog_find_next(const char *prefix) {
+    char pattern[4096];
+    if ((size_t) snprintf(pattern, sizeof(pattern), "%s.*%s", prefix, ACCESSLOG_EXTENSION) >= sizeof(pattern)) {
+        return 0;
+    }
+
+    glob_t found;
+    if (glob(pattern, GLOB_NOSORT, NULL, &found) != 0) return 0;
+
+    unsigned long next = 0;
+    size_t prefix_len = strlen(prefix);
+    for (size_t i = 0; i < found.gl_pathc; i++) {
+        char *end;
+        unsigned long number = strtoul(found.gl_pathv[i] + prefix_len + 1, &end, 10);
+        if (strcmp(end, ACCESSLOG_EXTENSION) == 0 && number >= next) next = number + 1;
+    }
+    globfree(&found);
+
+    return next;
+}
+
+accesslog *accesslog_open(const char *prefix, size_t segment_size, int max_segments) {
+    if (!prefix || segment_size < ACCESSLOG_MIN_SEGMENT || max_segments < 0) return NULL;
+
+    accesslog *log = calloc(1, sizeof(struct accesslog));
+    if (!log) return NULL;
+
+    log->prefix = strdup(prefix);
+    log->segment_size = segment_size;
+    log->max_segments = max_segments;
+    if (!log->prefix || pthread_mutex_init(&log->mutex, NULL) != 0) {
+        free(log->prefix);
+        free(log);
+        return NULL;
+    }
+
+    log->next_number = accesslog_find_next(prefix); // Segments of previous runs are never overwritten
+    if (!(log->current = accesslog_segment_create(log))) {
+        accesslog_close(log);
+        return NULL;
+    }
+
+    return log;
+}
+
+void accesslog_close(accesslog *log) {
+    if (!log) return;
+
+    if (log->current) accesslog_segment_release(log->current);
+    pthread_mutex_destroy(&log->mutex);
+    free(log->prefix);
+    free(log);
+}
+
+/**
+ * @brief Writes an unsigned integer as a varint
+ * @param[out] buf Where it must be written
+ * @param[in] value The integer
+ * @return Number of bytes written
+ */
+size_t accesslog_put_varint(unsigned char *buf, uint64_t value) {
+    size_t len = 0;
+    while (value >= 0x80) {
+        buf[len++] = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    buf[len++] = (unsigned char) value;
+
+    return len;
+}
+
+/**
+ * @brief Writes an unsigned integer in little endian order
+ * @param[out] buf Where it must be written
+ * @param[in] value The integer
+ * @param[in] len Number of bytes of the integer
+ */
+void accesslog_put_fixed(unsigned char *buf, uint64_t value, int len) {
+    for (int i = 0; i < len; i++) buf[i] = (unsigned char) (value >> (8 * i));
+}
+
+/**
+ * @brief Encodes a record
+ * @param[out] buf Where it must be written, of at least \ref ACCESSLOG_MAX_RECORD bytes
+ * @param[in] entry The request
+ * @return Length of the record
+ */
+size_t accesslog_encode(unsigned char *buf, const struct accesslog_entry *entry) {
+    size_t method_len = entry->method_len < ACCESSLOG_MAX_STRING ? entry->method_len : ACCESSLOG_MAX_STRING;
+    size_t path_len = entry->path_len < ACCESSLOG_MAX_STRING ? entry->path_len : ACCESSLOG_MAX_STRING;
+    size_t query_len = entry->querystring_len < ACCESSLOG_MAX_STRING ? entry->querystring_len : ACCESSLOG_MAX_STRING;
+    if (!entry->path) path_len = 0;
+    if (!entry->querystring) query_len = 0;
+
+    unsigned char method = ACCESSLOG_METHOD_OTHER;
+    for (size_t i = 0; entry->method && i < ACCESSLOG_METHODS; i++) {
+        if (method_len == strlen(accesslog_methods[i]) &&
+            memcmp(entry->method, accesslog_methods[i], method_len) == 0) {
+            method = (unsigned char) (i + 1);
+            break;
+        }
+    }
+    if (!entry->method) method_len = 0;
+
+    buf[0] = method;
+    accesslog_put_fixed(buf + 1, entry->status, 2);
+    accesslog_put_fixed(buf + 3, entry->time, 8);
+    accesslog_put_fixed(buf + 11, entry->connection, 4);
+    size_t len = ACCESSLOG_FIXED_LEN;
+
+    len += accesslog_put_varint(buf + len, entry->bytes_in);
+    len += accesslog_put_varint(buf + len, entry->bytes_out);
+    len += accesslog_put_varint(buf + len, entry->parse_time);
+    len += accesslog_put_varint(buf + len, entry->response_time);
+    if (method == ACCESSLOG_METHOD_OTHER) len += accesslog_put_varint(buf + len, method_len);
+    len += accesslog_put_varint(buf + len, path_len);
+    len += accesslog_put_varint(buf + len, query_len);
+
+    if (method == ACCESSLOG_METHOD_OTHER && method_len > 0) {
+        memcpy(buf + len, entry->method, method_len);
+        len += method_len;
+    }
+    if (path_len > 0) memcpy(buf + len, entry->path, path_len);
+    len += path_len;
+    if (query_len > 0) memcpy(buf + len, entry->querystring, query_len);
+    len += query_len;
+
+    return len;
+}
+
+STATUS accesslog_write(accesslog *log, const struct accesslog_entry *entry) {
+    if (!log || !entry) return ERROR;
+
+    unsigned char record[ACCESSLOG_MAX_RECORD];
+    size_t len = accesslog_encode(record, entry);
+
+    pthread_mutex_lock(&log->mutex);
+    struct accesslog_segment *segment = log->current;
+    if (!segment || segment->used + len > segment->size) { // Records never span two segments
+        struct accesslog_segment *next = accesslog_segment_create(log);
+        if (!next) {
+            pthread_mutex_unlock(&log->mutex);
+            return ERROR;
+        }
+
+        if (segment) accesslog_segment_release(segment);
+        log->current = segment = next;
+    }
+
+    size_t pos = segment->used;
+    segment->used += len;
+    atomic_fetch_add(&segment->refs, 1);
+    pthread_mutex_unlock(&log->mutex);
+
+    memcpy(segment->map + pos, record, len);
+    accesslog_segment_release(segment);
+
+    return SUCCESS;
+}
+
+STATUS accesslog_check(const unsigned char *data, size_t len) {
+    if (!data || len < ACCESSLOG_HEADER_LEN || memcmp(data, ACCESSLOG_MAGIC, 8) != 0) return ERROR;
+
+    uint32_t version = 0;
+    for (int i = 0; i < 4; i++) version |= (uint32_t) data[8 + i] << (8 * i);
+
+    return version == ACCESSLOG_VERSION ? SUCCESS : ERROR;
+}
+
+/**
+ * @brief Reads a varint
+ * @param[in] data The contents of the segment
+ * @param[in] len Length of the contents
+ * @param[in,out] pos Position of the varint, which is advanced past it
+ * @param[out] value The integer
+ * @return \ref STATUS.SUCCESS if it was read, \ref STATUS.ERROR if it's truncated or too long
+ */
+STATUS accesslog_get_varint(const unsigned char *data, size_t len, size_t *pos, uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64 && *pos < len; shift += 7) {
+        unsigned char byte = data[(*pos)++];
+        *value |= (uint64_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return SUCCESS;
+    }
+
+    return ERROR;
+}
+
+/**
+ * @brief Reads an unsigned integer in little endian order
+ * @param[in] data Where it's stored
+ * @param[in] len Number of bytes of the integer
+ * @return The integer
+ */
+uint64_t accesslog_get_fixed(const unsigned char *data, int len) {
+    uint64_t value = 0;
+    for (int i = 0; i < len; i++) value |= (uint64_t) data[i] << (8 * i);
+
+    return value;
+}
+
+STATUS accesslog_decode(const unsigned char *data, size_t len, size_t *pos, struct accesslog_entry *entry) {
+    if (!data || !pos || !entry || *pos < ACCESSLOG_HEADER_LEN) return ERROR;
+
+    size_t p = *pos;
+    if (p + ACCESSLOG_FIXED_LEN > len || data[p] == 0) return ERROR; // A zero byte marks the end of the records
+
+    unsigned char method = data[p];
+    if (method != ACCESSLOG_METHOD_OTHER && method > ACCESSLOG_METHODS) return ERROR;
+
+    memset(entry, 0, sizeof(struct accesslog_entry));
+    entry->status = (uint16_t) accesslog_get_fixed(data + p + 1, 2);
+    entry->time = accesslog_get_fixed(data + p + 3, 8);
+    entry->connection = (uint32_t) accesslog_get_fixed(data + p + 11, 4);
+    p += ACCESSLOG_FIXED_LEN;
+
+    uint64_t method_len = 0, path_len, query_len;
+    if (accesslog_get_varint(data, len, &p, &entry->bytes_in) == ERROR ||
+        accesslog_get_varint(data, len, &p, &entry->bytes_out) == ERROR ||
+        accesslog_get_varint(data, len, &p, &entry->parse_time) == ERROR ||
+        accesslog_get_varint(data, len, &p, &entry->response_time) == ERROR ||
+        (method == ACCESSLOG_METHOD_OTHER && accesslog_get_varint(data, len, &p, &method_len) == ERROR) ||
+        accesslog_get_varint(data, len, &p, &path_len) == ERROR ||
+        accesslog_get_varint(data, len, &p, &query_len) == ERROR) {
+        return ERROR;
+    }
+    if (method_len > ACCESSLOG_MAX_STRING || path_len > ACCESSLOG_MAX_STRING || query_len > ACCESSLOG_MAX_STRING ||
+        p + method_len + path_len + query_len > len) {
+        return ERROR;
+    }
+
+    if (method == ACCESSLOG_METHOD_OTHER) {
+        entry->method = (const char *) data + p;
+        entry->method_len = method_len;
+        p += method_len;
+    } else {
+        entry->method = accesslog_methods[method - 1];
+        entry->method_len = strlen(entry->method);
+    }
+    entry->path = (const char *) data + p;
+    entry->path_len = path_len;
+    p += path_len;
+    entry->querystring = query_len > 0 ? (const char *) data + p : NULL;
+    entry->querystring_len = query_len;
+    p += query_len;
+
+    *pos = p;
+    return SUCCESS;
+}
\ No newline at end of file
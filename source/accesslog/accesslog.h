@@ -0,0 +1,108 @@
+/**
+ * @file accesslog.h
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Binary access log, written to memory mapped segment files
+ * @details Formatting a text line for each request, and later parsing it again to analyze the log, costs far more than
+ * the request itself for small files. This module stores each request as a compact binary record instead, copied
+ * directly into a file mapped in memory, so that logging a request doesn't involve any formatting or system call.
+ *
+ * The log is split in segments of a fixed size, named prefix.N.alog. When one is full, the next one is created, and
+ * the oldest ones are deleted so that only a given number of them are kept. Each segment starts with a header, followed
+ * by the records, and ends at the first zero byte where a record should start. Each record contains:
+ * - a fixed part: the method (as one byte, see \ref ACCESSLOG_METHOD_OTHER), the status code (2 bytes), the moment the
+ * response was sent (8 bytes, microseconds since the epoch) and the number of the connection (4 bytes)
+ * - the request and response byte counts, the parsing and response times (in microseconds) and the lengths of the
+ * path and querystring, as varints (7 bits per byte, least significant first)
+ * - the method (only if it's not a common one), the path and the querystring, without terminators
+ *
+ * All integers are little endian. The logdecode tool converts segments to text, JSON or CSV.
+ */
+
+#ifndef PRACTICA1_ACCESSLOG_H
+#define PRACTICA1_ACCESSLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "constants.h"
+
+#define ACCESSLOG_MAGIC "HTTPALOG" ///< First bytes of every segment
+#define ACCESSLOG_VERSION 1 ///< Version of the format, stored after the magic
+#define ACCESSLOG_HEADER_LEN 16 ///< Length of the header of a segment (magic, version and 4 reserved bytes)
+#define ACCESSLOG_EXTENSION ".alog" ///< Extension of the segment files
+#define ACCESSLOG_MAX_STRING 4096 ///< Maximum length of the strings of a record, longer ones are truncated
+#define ACCESSLOG_METHOD_OTHER 0xFF ///< Method byte of the methods that are stored as a string
+#define ACCESSLOG_MIN_SEGMENT (64 * 1024) ///< Minimum size of a segment
+
+/**
+ * @brief The binary access log type
+ */
+typedef struct accesslog accesslog;
+
+/**
+ * @struct accesslog_entry
+ * @brief A request of the access log, whose strings aren't null terminated
+ */
+struct accesslog_entry {
+    uint64_t time; ///< Moment when the response was sent, in microseconds since the epoch
+    uint32_t connection; ///< Number of the connection
+    uint16_t status; ///< Code of the response
+    const char *method; ///< Method of the request
+    size_t method_len; ///< Length of the method
+    const char *path; ///< Path of the request
+    size_t path_len; ///< Length of the path
+    const char *querystring; ///< Querystring of the request (can be NULL if its length is 0)
+    size_t querystring_len; ///< Length of the querystring
+    uint64_t bytes_in; ///< Bytes of the request
+    uint64_t bytes_out; ///< Bytes of the response
+    uint64_t parse_time; ///< Microseconds spent reading and parsing the request
+    uint64_t response_time; ///< Microseconds spent producing and sending the response
+};
+
+/**
+ * @brief Opens a binary access log, continuing after the last segment that already exists
+ * @param[in] prefix Path of the segments, without their number and extension
+ * @param[in] segment_size Size of each segment in bytes (at least \ref ACCESSLOG_MIN_SEGMENT)
+ * @param[in] max_segments Number of segments that are kept, including the current one (0 to keep all of them)
+ * @return The log, or NULL if the first segment can't be created
+ */
+accesslog *accesslog_open(const char *prefix, size_t segment_size, int max_segments);
+
+/**
+ * @brief Finishes the current segment of a log, truncating it to the length of its records, and frees the log
+ * @pre No thread can be writing to it
+ * @param[in] log The log
+ */
+void accesslog_close(accesslog *log);
+
+/**
+ * @brief Adds a request to a log
+ * @details Several threads can write at once: each one reserves the space of its record while holding a lock, and
+ * copies it afterwards.
+ * @param[in] log The log
+ * @param[in] entry The request
+ * @return \ref STATUS.SUCCESS if it was written, \ref STATUS.ERROR if a new segment was needed and can't be created
+ */
+STATUS accesslog_write(accesslog *log, const struct accesslog_entry *entry);
+
+/**
+ * @brief Checks that some data is a segment of a binary access log of a supported version
+ * @param[in] data The contents of the segment
+ * @param[in] len Length of the contents
+ * @return \ref STATUS.SUCCESS if it's a segment, \ref STATUS.ERROR otherwise
+ */
+STATUS accesslog_check(const unsigned char *data, size_t len);
+
+/**
+ * @brief Decodes the next record of a segment
+ * @param[in] data The contents of the segment
+ * @param[in] len Length of the contents
+ * @param[in,out] pos Position of the record, which is advanced to the next one (\ref ACCESSLOG_HEADER_LEN for the
+ * first one)
+ * @param[out] entry The request, whose strings point to @p data or to constant strings
+ * @return \ref STATUS.SUCCESS if a record was decoded, \ref STATUS.ERROR at the end of the records or if the rest of
+ * the segment is corrupt
+ */
+STATUS accesslog_decode(const unsigned char *data, size_t len, size_t *pos, struct accesslog_entry *entry);
+
+#endif //PRACTICA1_ACCESSLOG_H
@@ -0,0 +1,186 @@
+/**
+ * @file logdecode.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Converts segments of the binary access log to text, JSON or CSV
+ * @details The segments are read in the order they're passed, and each record is printed in one line. JSON is printed
+ * as one object per line, and CSV with a header line. Times are printed in UTC, with microseconds.
+ * @see accesslog.h
+ *
+ * Usage: logdecode [-f text|json|csv] <segment>...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "accesslog.h"
+
+/**
+ * @brief Formats in which records can be printed
+ */
+typedef enum _DECODE_FORMAT {
+    FORMAT_TEXT, ///< Like the text access log, followed by the byte counts and times
+    FORMAT_JSON, ///< One JSON object per line
+    FORMAT_CSV ///< Comma separated values, with a header line
+} DECODE_FORMAT;
+
+/**
+ * @brief Prints the moment a response was sent, in ISO 8601 format
+ * @param[in] time Microseconds since the epoch
+ */
+void print_time(uint64_t time) {
+    time_t seconds = (time_t) (time / 1000000);
+    struct tm timeinfo;
+    gmtime_r(&seconds, &timeinfo);
+
+    char buf[32];
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &timeinfo);
+    printf("%s.%06luZ", buf, (unsigned long) (time % 1000000));
+}
+
+/**
+ * @brief Prints a string of a record as a quoted JSON or CSV string
+ * @param[in] str The string, which isn't null terminated
+ * @param[in] len Length of the string
+ * @param[in] format \ref FORMAT_JSON or \ref FORMAT_CSV
+ */
+void print_quoted(const char *str, size_t len, DECODE_FORMAT format) {
+    putchar('"');
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char) str[i];
+        if (format == FORMAT_CSV) {
+            if (c == '"') putchar('"'); // Quotes are escaped by doubling them
+            putchar(c);
+        } else if (c == '"' || c == '\\') {
+            printf("\\%c", c);
+        } else if (c < 0x20) {
+            printf("\\u%04x", c);
+        } else {
+            putchar(c);
+        }
+    }
+    putchar('"');
+}
+
+/**
+ * @brief Prints a record
+ * @param[in] entry The request
+ * @param[in] format The format
+ */
+void print_entry(const struct accesslog_entry *entry, DECODE_FORMAT format) {
+    int method_len = (int) entry->method_len, path_len = (int) entry->path_len;
+    int query_len = (int) entry->querystring_len;
+
+    switch (format) {
+        case FORMAT_TEXT:
+            print_time(entry->time);
+            printf(" %.*s %.*s%s%.*s %u in=%llu out=%llu parse=%lluus response=%lluus connection=%u\n", method_len,
+                   entry->method, path_len, entry->path, entry->querystring ? "?" : "", query_len,
+                   entry->querystring ? entry->querystring : "", entry->status, (unsigned long long) entry->bytes_in,
+                   (unsigned long long) entry->bytes_out, (unsigned long long) entry->parse_time,
+                   (unsigned long long) entry->response_time, entry->connection);
+            break;
+        case FORMAT_JSON:
+            printf("{\"time\":\"");
+            print_time(entry->time);
+            printf("\",\"connection\":%u,\"method\":", entry->connection);
+            print_quoted(entry->method, entry->method_len, format);
+            printf(",\"path\":");
+            print_quoted(entry->path, entry->path_len, format);
+            printf(",\"query\":");
+            if (entry->querystring) {
+                print_quoted(entry->querystring, entry->querystring_len, format);
+            } else {
+                printf("null");
+            }
+            printf(",\"status\":%u,\"bytes_in\":%llu,\"bytes_out\":%llu,\"parse_us\":%llu,\"response_us\":%llu}\n",
+                   entry->status, (unsigned long long) entry->bytes_in, (unsigned long long) entry->bytes_out,
+                   (unsigned long long) entry->parse_time, (unsigned long long) entry->response_time);
+            break;
+        case FORMAT_CSV:
+            print_time(entry->time);
+            printf(",%u,", entry->connection);
+            print_quoted(entry->method, entry->method_len, format);
+            putchar(',');
+            print_quoted(entry->path, entry->path_len, format);
+            putchar(',');
+            print_quoted(entry->querystring, entry->querystring_len, format);
+            printf(",%u,%llu,%llu,%llu,%llu\n", entry->status, (unsigned long long) entry->bytes_in,
+                   (unsigned long long) entry->bytes_out, (unsigned long long) entry->parse_time,
+                   (unsigned long long) entry->response_time);
+            break;
+    }
+}
+
+/**
+ * @brief Prints all the records of a segment
+ * @param[in] path Path of the segment
+ * @param[in] format The format
+ * @return Number of records printed, or -1 if the file isn't a segment
+ */
+long decode_segment(const char *path, DECODE_FORMAT format) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0 || st.st_size < ACCESSLOG_HEADER_LEN) {
+        if (fd != -1) close(fd);
+        return -1;
+    }
+
+    const unsigned char *data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -1;
+
+    long count = -1;
+    if (accesslog_check(data, (size_t) st.st_size) == SUCCESS) {
+        size_t pos = ACCESSLOG_HEADER_LEN;
+        struct accesslog_entry entry;
+        for (count = 0; accesslog_decode(data, (size_t) st.st_size, &pos, &entry) == SUCCESS; count++) {
+            print_entry(&entry, format);
+        }
+    }
+
+    munmap((void *) data, (size_t) st.st_size);
+    return count;
+}
+
+int main(int argc, char **argv) {
+    DECODE_FORMAT format = FORMAT_TEXT;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:")) != -1) {
+        if (opt == 'f' && strcmp(optarg, "text") == 0) {
+            format = FORMAT_TEXT;
+        } else if (opt == 'f' && strcmp(optarg, "json") == 0) {
+            format = FORMAT_JSON;
+        } else if (opt == 'f' && strcmp(optarg, "csv") == 0) {
+            format = FORMAT_CSV;
+        } else {
+            optind = argc + 1; // Show the usage
+            break;
+        }
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr, "Usage: %s [-f text|json|csv] <segment>...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (format == FORMAT_CSV) {
+        printf("time,connection,method,path,query,status,bytes_in,bytes_out,parse_us,response_us\n");
+    }
+
+    int status = EXIT_SUCCESS;
+    for (int i = optind; i < argc; i++) {
+        if (decode_segment(argv[i], format) == -1) {
+            fprintf(stderr, "%s is not a segment of the access log\n", argv[i]);
+            status = EXIT_FAILURE;
+        }
+    }
+
+    return status;
+}
\ No newline at end of file
@@ -0,0 +1,374 @@
+/**
+ * @file asynclog.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Implementation of the asynchronous logger
+ * @details Each ring has a single producer (its thread) and a single consumer (the writer thread), so it only needs two
+ * counters: the producer advances the head after copying a line, and the consumer advances the tail after writing it.
+ * They only grow, and their difference is the number of bytes in use. Each line is stored after a small header with
+ * its length and file descriptor.
+ *
+ * The rings are kept in a list, which only changes when a thread logs for the first time or a ring is freed, and is
+ * protected by a mutex that the producers don't take otherwise. When a thread exits, its ring is marked as closed, and
+ * the writer frees it once it's empty.
+ */
+
+#include "asynclog.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/**
+ * @struct asynclog_record
+ * @brief Header of a line stored in a ring
+ */
+struct asynclog_record {
+    unsigned int len; ///< Length of the line
+    int fd; ///< File descriptor where the line must be written
+};
+
+/**
+ * @struct asynclog_ring
+ * @brief Ring buffer where a thread copies its lines
+ */
+struct asynclog_ring {
+    _Alignas(64) atomic_size_t head; ///< Bytes ever copied into the ring, only written by its thread
+    _Alignas(64) atomic_size_t tail; ///< Bytes ever written out of the ring, only written by the writer thread
+    _Alignas(64) atomic_ulong dropped; ///< Number of lines dropped because the ring was full
+    atomic_int closed; ///< 1 once its thread has exited
+    size_t size; ///< Size of the data, a power of two
+    char *data; ///< Data of the ring
+    struct asynclog_ring *next; ///< Next ring of the logger
+};
+
+/**
+ * @struct asynclog
+ * @brief Stores an asynchronous logger
+ */
+struct asynclog {
+    unsigned long id; ///< Identifier of the logger, never reused by another one
+    size_t ring_size; ///< Size of the rings of the threads
+    struct asynclog_ring *rings; ///< List of the rings of the threads
+    pthread_mutex_t mutex; ///< Protects the list of rings
+    pthread_t writer; ///< The writer thread
+    atomic_int stop; ///< 1 when the writer thread must write everything and exit
+    unsigned long freed_dropped; ///< Lines dropped by the rings already freed
+    unsigned long reported; ///< Dropped lines already reported by the writer thread
+    char batch[ASYNCLOG_BATCH]; ///< Lines waiting to be written by the writer thread
+    size_t batch_len; ///< Length of the lines in the batch
+    int batch_fd; ///< File descriptor of the lines in the batch
+};
+
+atomic_ulong asynclog_next_id = 1; ///< Identifier of the next logger created
+
+pthread_key_t asynclog_key; ///< Key whose destructor closes the ring of an exiting thread
+pthread_once_t asynclog_key_once = PTHREAD_ONCE_INIT; ///< Creates the key only once
+
+_Thread_local unsigned long local_log = 0; ///< Identifier of the logger the ring of the thread belongs to
+_Thread_local struct asynclog_ring *local_ring = NULL; ///< Ring of the thread
+
+/**
+ * @brief Destructor of the key, which marks the ring of an exiting thread as closed
+ * @param[in] ring The ring of the thread
+ */
+void asynclog_close_ring(void *ring) {
+    atomic_store_explicit(&((struct asynclog_ring *) ring)->closed, 1, memory_order_release);
+}
+
+/**
+ * @brief Creates the key used to detect when threads exit
+ */
+void asynclog_create_key() {
+    pthread_key_create(&asynclog_key, asynclog_close_ring);
+}
+
+/**
+ * @brief Body of the writer thread
+ * @param[in] arg The logger
+ * @return NULL
+ */
+void *asynclog_writer(void *arg);
+
+asynclog *asynclog_create(size_t ring_size) {
+    if (ring_size < 2 * (sizeof(struct asynclog_record) + ASYNCLOG_MAX_LINE)) return NULL;
+
+    size_t size = 1;
+    while (size < ring_size) size <<= 1; // A power of two, so that positions are found with a mask
+
+    asynclog *log = calloc(1, sizeof(struct asynclog));
+    if (!log) return NULL;
+
+    log->id = atomic_fetch_add(&asynclog_next_id, 1);
+    log->ring_size = size;
+    log->batch_fd = -1;
+    pthread_once(&asynclog_key_once, asynclog_create_key);
+
+    if (pthread_mutex_init(&log->mutex, NULL) != 0) {
+        free(log);
+        return NULL;
+    }
+
+    if (pthread_create(&log->writer, NULL, asynclog_writer, log) != 0) {
+        pthread_mutex_destroy(&log->mutex);
+        free(log);
+        return NULL;
+    }
+
+    return log;
+}
+
+/**
+ * @brief Frees a ring
+ * @param[in] ring The ring to free
+ */
+void asynclog_ring_free(struct asynclog_ring *ring) {
+    free(ring->data);
+    free(ring);
+}
+
+void asynclog_stop(asynclog *log) {
+    if (!log || atomic_exchange(&log->stop, 1)) return; // The writer thread can only be joined once
+
+    pthread_join(log->writer, NULL);
+}
+
+void asynclog_free(asynclog *log) {
+    if (!log) return;
+
+    asynclog_stop(log);
+
+    struct asynclog_ring *ring = log->rings;
+    while (ring) {
+        struct asynclog_ring *next = ring->next;
+        asynclog_ring_free(ring);
+        ring = next;
+    }
+
+    pthread_mutex_destroy(&log->mutex);
+    free(log);
+}
+
+/**
+ * @brief Returns the ring of the calling thread, creating it if it's the first time the thread logs
+ * @param[in] log The logger
+ * @return The ring, or NULL if it can't be created
+ */
+struct asynclog_ring *asynclog_get_ring(asynclog *log) {
+    if (local_log == log->id) return local_ring;
+
+    struct asynclog_ring *ring = calloc(1, sizeof(struct asynclog_ring));
+    if (!ring) return NULL;
+    ring->size = log->ring_size;
+    if (!(ring->data = malloc(ring->size))) {
+        free(ring);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&log->mutex);
+    ring->next = log->rings;
+    log->rings = ring;
+    pthread_mutex_unlock(&log->mutex);
+
+    pthread_setspecific(asynclog_key, ring);
+    local_log = log->id;
+    local_ring = ring;
+
+    return ring;
+}
+
+/**
+ * @brief Copies data into a ring, wrapping around its end
+ * @param[in] ring The ring
+ * @param[in] pos Position where the data must be copied, not masked
+ * @param[in] src The data
+ * @param[in] len Length of the data
+ */
+void asynclog_ring_put(struct asynclog_ring *ring, size_t pos, const void *src, size_t len) {
+    size_t start = pos & (ring->size - 1);
+    size_t first = len < ring->size - start ? len : ring->size - start;
+
+    memcpy(ring->data + start, src, first);
+    memcpy(ring->data, (const char *) src + first, len - first);
+}
+
+/**
+ * @brief Copies data out of a ring, wrapping around its end
+ * @param[in] ring The ring
+ * @param[in] pos Position of the data, not masked
+ * @param[out] dst Where the data must be copied
+ * @param[in] len Length of the data
+ */
+void asynclog_ring_get(const struct asynclog_ring *ring, size_t pos, void *dst, size_t len) {
+    size_t start = pos & (ring->size - 1);
+    size_t first = len < ring->size - start ? len : ring->size - start;
+
+    memcpy(dst, ring->data + start, first);
+    memcpy((char *) dst + first, ring->data, len - first);
+}
+
+STATUS asynclog_write(asynclog *log, int fd, const char *line, size_t len) {
+    if (!log || !line) return ERROR;
+
+    struct asynclog_ring *ring = asynclog_get_ring(log);
+    if (!ring) return ERROR;
+
+    if (len > ASYNCLOG_MAX_LINE) len = ASYNCLOG_MAX_LINE;
+    struct asynclog_record record = {.len = (unsigned int) len, .fd = fd};
+
+    // Only this thread moves the head, and the writer thread only frees space, so the check can't become wrong
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (ring->size - (head - tail) < sizeof(record) + len) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return ERROR;
+    }
+
+    asynclog_ring_put(ring, head, &record, sizeof(record));
+    asynclog_ring_put(ring, head + sizeof(record), line, len);
+    atomic_store_explicit(&ring->head, head + sizeof(record) + len, memory_order_release);
+
+    return SUCCESS;
+}
+
+unsigned long asynclog_dropped(asynclog *log) {
+    if (!log) return 0;
+
+    pthread_mutex_lock(&log->mutex);
+    unsigned long dropped = log->freed_dropped;
+    for (struct asynclog_ring *ring = log->rings; ring; ring = ring->next) {
+        dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&log->mutex);
+
+    return dropped;
+}
+
+/**
+ * @brief Writes the batch of the writer thread
+ * @param[in,out] log The logger
+ */
+void asynclog_flush(asynclog *log) {
+    size_t written = 0;
+    while (written < log->batch_len) {
+        ssize_t ret = write(log->batch_fd, log->batch + written, log->batch_len - written);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret <= 0) break; // Lines that can't be written are lost, logging must not stop the server
+        written += (size_t) ret;
+    }
+
+    log->batch_len = 0;
+}
+
+/**
+ * @brief Makes room for a line in the batch of the writer thread, writing the batch first if needed
+ * @param[in,out] log The logger
+ * @param[in] fd File descriptor where the line must be written
+ * @param[in] len Length of the line
+ * @return Where the line must be copied
+ */
+char *asynclog_batch_reserve(asynclog *log, int fd, size_t len) {
+    if (log->batch_fd != fd || log->batch_len + len > ASYNCLOG_BATCH) asynclog_flush(log);
+
+    log->batch_fd = fd;
+    char *dst = log->batch + log->batch_len;
+    log->batch_len += len;
+
+    return dst;
+}
+
+/**
+ * @brief Moves the lines of a ring to the batch of the writer thread
+ * @param[in,out] log The logger
+ * @param[in,out] ring The ring
+ * @return 1 if there were lines, 0 otherwise
+ */
+int asynclog_drain(asynclog *log, struct asynclog_ring *ring) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail == head) return 0;
+
+    while (tail != head) {
+        struct asynclog_record record;
+        asynclog_ring_get(ring, tail, &record, sizeof(record));
+        asynclog_ring_get(ring, tail + sizeof(record), asynclog_batch_reserve(log, record.fd, record.len), record.len);
+        tail += sizeof(record) + record.len;
+    }
+
+    // The space can only be reused once it has been copied to the batch
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+    return 1;
+}
+
+/**
+ * @brief Reports the lines dropped since the last report
+ * @param[in,out] log The logger
+ * @param[in] dropped Total number of dropped lines
+ */
+void asynclog_report(asynclog *log, unsigned long dropped) {
+    if (dropped == log->reported) return;
+
+    char line[128];
+    int len = snprintf(line, sizeof(line), "%s [Log] %lu log lines were dropped because the output couldn't keep up\n",
+                       asynclog_timestamp(), dropped - log->reported);
+    log->reported = dropped;
+
+    if (len > 0) memcpy(asynclog_batch_reserve(log, STDERR_FILENO, (size_t) len), line, (size_t) len);
+}
+
+void *asynclog_writer(void *arg) {
+    asynclog *log = arg;
+    const struct timespec interval = {0, ASYNCLOG_INTERVAL_MS * 1000000L};
+
+    while (1) {
+        int stop = atomic_load(&log->stop); // Read before draining, so that nothing logged before stopping is lost
+        int found = 0;
+        unsigned long dropped = log->freed_dropped;
+
+        pthread_mutex_lock(&log->mutex);
+        struct asynclog_ring **prev = &log->rings;
+        while (*prev) {
+            struct asynclog_ring *ring = *prev;
+            int closed = atomic_load_explicit(&ring->closed, memory_order_acquire);
+
+            found |= asynclog_drain(log, ring);
+            dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+
+            if (closed) { // Its thread can't log anymore, and everything it logged has been drained
+                log->freed_dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+                *prev = ring->next;
+                asynclog_ring_free(ring);
+            } else {
+                prev = &ring->next;
+            }
+        }
+        pthread_mutex_unlock(&log->mutex);
+
+        asynclog_report(log, dropped);
+        asynclog_flush(log);
+
+        if (stop) return NULL;
+        if (!found) nanosleep(&interval, NULL);
+    }
+}
+
+const char *asynclog_timestamp() {
+    static _Thread_local time_t cached_time = -1;
+    static _Thread_local char cached_str[ASYNCLOG_TIMESTAMP_LEN];
+
+    time_t now = time(NULL);
+    if (now != cached_time) {
+        struct tm timeinfo;
+        localtime_r(&now, &timeinfo);
+        strftime(cached_str, sizeof(cached_str), "%a %b %e %H:%M:%S %Y", &timeinfo); // Same format as asctime()
+        cached_time = now;
+    }
+
+    return cached_str;
+}
\ No newline at end of file
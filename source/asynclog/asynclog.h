@@ -0,0 +1,81 @@
+/**
+ * @file asynclog.h
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Asynchronous logger, which writes the log lines in a background thread
+ * @details Writing a log line directly takes a lock on the output and at least one system call, so every thread that
+ * logs a request waits for the others, and for the terminal or the disk. With this module, each thread copies its lines
+ * into its own ring buffer, which no other thread writes to, without taking any lock or making any system call. A
+ * writer thread empties the rings of all the threads, and writes what they contain in batches, with one write() for
+ * many lines.
+ *
+ * Logging never blocks: if the ring of a thread is full because the output can't keep up, its lines are dropped and
+ * counted, and the writer reports how many were lost. Lines of the same thread are written in order, but lines of
+ * different threads can be interleaved differently than they were logged.
+ */
+
+#ifndef PRACTICA1_ASYNCLOG_H
+#define PRACTICA1_ASYNCLOG_H
+
+#include <stddef.h>
+#include "constants.h"
+
+#define ASYNCLOG_MAX_LINE 1024 ///< Maximum length of a log line, longer lines are truncated
+#define ASYNCLOG_BATCH (64 * 1024) ///< Maximum number of bytes written at once by the writer thread
+#define ASYNCLOG_INTERVAL_MS 10 ///< Milliseconds the writer thread sleeps when there's nothing to write
+#define ASYNCLOG_TIMESTAMP_LEN 32 ///< Size of the timestamps returned by asynclog_timestamp()
+
+/**
+ * @brief The asynchronous logger type
+ */
+typedef struct asynclog asynclog;
+
+/**
+ * @brief Creates an asynchronous logger and starts its writer thread
+ * @param[in] ring_size Size in bytes of the ring buffer of each thread, rounded up to a power of two
+ * @return The new logger, or NULL if an error occurs or @p ring_size is too small for a line
+ */
+asynclog *asynclog_create(size_t ring_size);
+
+/**
+ * @brief Writes everything that was logged, stops the writer thread and frees a logger
+ * @pre No thread can be logging with it, nor log with it afterwards
+ * @param[in] log The logger to free
+ */
+void asynclog_free(asynclog *log);
+
+/**
+ * @brief Writes everything that was logged and stops the writer thread, without freeing the logger
+ * @details Other threads can still log with it, although their lines aren't written anymore, so unlike
+ * asynclog_free() it can be used while they may be logging, such as when the process exits.
+ * @param[in] log The logger to stop
+ */
+void asynclog_stop(asynclog *log);
+
+/**
+ * @brief Logs a line, which is written to a file descriptor by the writer thread
+ * @details The first time a thread logs, its ring buffer is created, which takes a lock. From then on, logging only
+ * copies the line into it.
+ * @param[in] log The logger
+ * @param[in] fd File descriptor where the line must be written
+ * @param[in] line The line, including its newline
+ * @param[in] len Length of the line, truncated to \ref ASYNCLOG_MAX_LINE
+ * @return \ref STATUS.SUCCESS if it was logged, \ref STATUS.ERROR if it was dropped
+ */
+STATUS asynclog_write(asynclog *log, int fd, const char *line, size_t len);
+
+/**
+ * @brief Returns the number of lines dropped because the ring buffer of their thread was full
+ * @param[in] log The logger
+ * @return Number of dropped lines
+ */
+unsigned long asynclog_dropped(asynclog *log);
+
+/**
+ * @brief Returns the current local time, formatted like asctime() without its newline
+ * @details The string is cached by each thread, and only formatted again when the second changes.
+ * @return The timestamp, which is valid until the calling thread calls this function again
+ */
+const char *asynclog_timestamp();
+
+#endif //PRACTICA1_ASYNCLOG_H
@@ -0,0 +1,372 @@
+/**
+ * @file cachepolicy.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Implementation of the caching rules for static responses
+ * @details The extension rules are stored in a hash table keyed by the lowercase extension, and the MIME type rules
+ * are resolved at load time into a hash table keyed by the address of the MIME type strings, which are unique inside
+ * the mimetable module. Both hash tables use the uthash library. The path globs can't be precompiled, so they're kept
+ * in a list and matched with fnmatch(), but only if the rules file contains any.
+ * @see https://troydhanson.github.io/uthash/
+ */
+
+#define _GNU_SOURCE // Required for strcasestr()
+
+#include "uthash.h"
+#include "cachepolicy.h"
+#include "mimetable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <fnmatch.h>
+
+#define MAX_POLICY_LINE 512 ///< Maximum length of a line of the rules file
+#define MAX_EXPIRES_LINE 64 ///< Size of a buffer able to hold the Expires header line
+#define EXPIRES_SLOTS 16 ///< Number of Expires lines cached by each thread
+
+#define HDR_CACHE_CONTROL "Cache-Control" ///< HTTP Cache-Control header name
+#define EXPIRES_FMT "Expires: %a, %d %b %Y %H:%M:%S GMT" ///< Format of the Expires header line
+#define MAX_AGE "max-age=" ///< Cache-Control directive containing the freshness lifetime
+
+/**
+ * @struct cache_policy
+ * @brief Contains the headers sent by the responses matching a rule
+ */
+struct cache_policy {
+    int index; ///< Position of the rule in the file
+    char *line; ///< Preformatted Cache-Control header line
+    size_t len; ///< Length of the Cache-Control header line
+    long max_age; ///< Freshness lifetime in seconds, or -1 if the directives don't have one
+    struct cache_policy *next; ///< Next policy in the table
+};
+
+/**
+ * @struct policy_key
+ * @brief Entry of the hash tables mapping extensions or MIME types to policies
+ */
+struct policy_key {
+    const void *key; ///< Lowercase extension string, or address of the MIME type string
+    char *extension; ///< Owned copy of the extension (NULL for MIME type entries)
+    const struct cache_policy *policy; ///< Policy associated with the key
+    struct UT_hash_handle hh; ///< Handle to be used by @a uthash
+};
+
+/**
+ * @struct policy_pattern
+ * @brief Rule whose selector is a pattern (a path glob or a MIME type prefix)
+ */
+struct policy_pattern {
+    char *pattern; ///< The path glob, or the MIME type prefix
+    size_t len; ///< Length of the pattern
+    const struct cache_policy *policy; ///< Policy associated with the pattern
+    struct policy_pattern *next; ///< Next pattern of the same kind, in file order
+};
+
+/**
+ * @struct policy_table
+ * @brief Contains all the compiled rules
+ */
+struct policy_table {
+    struct cache_policy *policies; ///< List of all the policies, owning them
+    int count; ///< Number of rules
+    struct policy_key *extensions; ///< Hash table mapping extensions to policies
+    struct policy_key *types; ///< Hash table mapping MIME type addresses to policies
+    struct policy_pattern *globs; ///< List of path glob rules
+    struct policy_pattern *prefixes; ///< List of MIME type prefix rules (only used while loading)
+};
+
+/**
+ * @struct expires_slot
+ * @brief Expires header line cached by a thread for a policy
+ */
+struct expires_slot {
+    const struct cache_policy *policy; ///< Policy the line belongs to
+    time_t second; ///< Time at which the line was formatted
+    size_t len; ///< Length of the line
+    char line[MAX_EXPIRES_LINE]; ///< The Expires header line
+};
+
+static _Thread_local struct expires_slot expires_cache[EXPIRES_SLOTS]; ///< Expires lines cached by the current thread
+
+/**
+ * @brief Creates a policy from the Cache-Control directives of a rule
+ * @param[in] directives The directives
+ * @param[in] index Position of the rule in the file
+ * @return The new policy, or NULL if an error occurs
+ */
+struct cache_policy *policy_create(const char *directives, int index) {
+    struct cache_policy *policy = calloc(1, sizeof(struct cache_policy));
+    if (!policy) return NULL;
+
+    size_t needed_size = snprintf(NULL, 0, "%s: %s", HDR_CACHE_CONTROL, directives) + 1;
+    policy->line = malloc(needed_size);
+    if (!policy->line) {
+        free(policy);
+        return NULL;
+    }
+    snprintf(policy->line, needed_size, "%s: %s", HDR_CACHE_CONTROL, directives);
+    policy->len = needed_size - 1;
+    policy->index = index;
+
+    policy->max_age = -1;
+    for (const char *pos = directives; (pos = strcasestr(pos, MAX_AGE)) != NULL; pos++) {
+        // Only the max-age directive itself counts, not others ending the same way (s-maxage is spelled differently)
+        if (pos == directives || pos[-1] == ' ' || pos[-1] == ',') {
+            policy->max_age = strtol(pos + strlen(MAX_AGE), NULL, 10);
+            break;
+        }
+    }
+
+    return policy;
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "hicpp-signed-bitwise"
+#pragma ide diagnostic ignored "hicpp-multiway-paths-covered"
+
+/**
+ * @brief Adds a rule to the policy table
+ * @param[in,out] table The table where the rule must be added
+ * @param[in] selector The selector of the rule
+ * @param[in] directives The Cache-Control directives of the rule
+ * @return \ref STATUS.SUCCESS if the rule was added, \ref STATUS.ERROR otherwise
+ */
+STATUS cachepolicy_add_rule(policy_table *table, char *selector, const char *directives) {
+    struct cache_policy *policy = policy_create(directives, table->count);
+    if (!policy) return ERROR;
+
+    // The list is kept in file order, so the policies are appended at the end
+    struct cache_policy **last = &table->policies;
+    while (*last) last = &(*last)->next;
+    *last = policy;
+    table->count++;
+
+    if (selector[0] == '.') { // Extension rule
+        char *extension = selector + 1;
+        size_t len = strlen(extension);
+        if (len == 0 || len >= MAX_EXTENSION) return ERROR;
+        for (char *c = extension; *c; c++) *c = (char) tolower((unsigned char) *c);
+
+        struct policy_key *entry = NULL;
+        HASH_FIND(hh, table->extensions, extension, len, entry);
+        if (entry) return SUCCESS; // The first rule for an extension wins
+
+        entry = calloc(1, sizeof(struct policy_key));
+        if (!entry) return ERROR;
+        entry->extension = strdup(extension);
+        entry->key = entry->extension;
+        entry->policy = policy;
+        HASH_ADD_KEYPTR(hh, table->extensions, entry->extension, len, entry);
+        return SUCCESS;
+    }
+
+    struct policy_pattern *pattern = calloc(1, sizeof(struct policy_pattern));
+    if (!pattern) return ERROR;
+    pattern->policy = policy;
+
+    struct policy_pattern **list;
+    if (selector[0] == '/') { // Path glob rule
+        list = &table->globs;
+    } else if (strchr(selector, '/')) { // MIME type prefix rule, where a trailing wildcard is optional
+        size_t len = strlen(selector);
+        if (selector[len - 1] == '*') selector[len - 1] = '\0';
+        list = &table->prefixes;
+    } else {
+        free(pattern);
+        return ERROR;
+    }
+    pattern->pattern = strdup(selector);
+    pattern->len = strlen(selector);
+
+    while (*list) list = &(*list)->next;
+    *list = pattern;
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Resolves the MIME type prefix rules for a MIME type, adding the result to the type table
+ * @details This function is called by mime_foreach_type() for every type known by the mimetable module.
+ * @param[in] type The MIME type
+ * @param[in,out] arg The policy table
+ */
+void cachepolicy_compile_type(const char *type, void *arg) {
+    policy_table *table = arg;
+
+    struct policy_key *entry = NULL;
+    HASH_FIND_PTR(table->types, &type, entry);
+    if (entry) return; // Types associated with several extensions are only resolved once
+
+    for (struct policy_pattern *prefix = table->prefixes; prefix; prefix = prefix->next) {
+        if (strncasecmp(type, prefix->pattern, prefix->len) == 0) {
+            entry = calloc(1, sizeof(struct policy_key));
+            if (!entry) return;
+            entry->key = type;
+            entry->policy = prefix->policy;
+            HASH_ADD_PTR(table->types, key, entry);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Frees a list of pattern rules
+ * @param[in] pattern First pattern of the list
+ */
+void policy_patterns_free(struct policy_pattern *pattern) {
+    while (pattern) {
+        struct policy_pattern *next = pattern->next;
+        free(pattern->pattern);
+        free(pattern);
+        pattern = next;
+    }
+}
+
+policy_table *cachepolicy_load(const char *filename) {
+    if (!filename) return NULL;
+
+    FILE *rules = fopen(filename, "re");
+    if (!rules) {
+#if DEBUG >= 1
+        printf("Error while opening the cache policy file: %s\n", strerror(errno));
+#endif
+        return NULL;
+    }
+
+    policy_table *table = calloc(1, sizeof(policy_table));
+    if (!table) {
+        fclose(rules);
+        return NULL;
+    }
+
+    char line[MAX_POLICY_LINE];
+    int line_n = 0, errors = 0;
+    while (fgets(line, sizeof(line), rules) != NULL) {
+        line_n++;
+        line[strcspn(line, "\r\n")] = '\0'; // Remove the line terminator
+        if (line[0] == '\0' || line[0] == '#') continue; // Skip empty lines and comments
+
+        char *selector = strtok(line, "\t");
+        char *directives = strtok(NULL, "\t");
+        if (!selector || !directives || cachepolicy_add_rule(table, selector, directives) == ERROR) {
+            printf("Error in line %i of the cache policy file\n", line_n);
+            errors++;
+        }
+    }
+    fclose(rules);
+
+    if (errors > 0) {
+        cachepolicy_free(table);
+        return NULL;
+    }
+
+    // Resolve the MIME type rules for every known type, as they won't be needed anymore afterwards
+    mime_foreach_type(cachepolicy_compile_type, table);
+    policy_patterns_free(table->prefixes);
+    table->prefixes = NULL;
+
+    return table;
+}
+
+void cachepolicy_free(policy_table *table) {
+    if (!table) return;
+
+    struct policy_key *entry, *tmp;
+    HASH_ITER(hh, table->extensions, entry, tmp) {
+        HASH_DEL(table->extensions, entry);
+        free(entry->extension);
+        free(entry);
+    }
+    HASH_ITER(hh, table->types, entry, tmp) {
+        HASH_DEL(table->types, entry);
+        free(entry);
+    }
+
+    policy_patterns_free(table->globs);
+    policy_patterns_free(table->prefixes);
+
+    struct cache_policy *policy = table->policies;
+    while (policy) {
+        struct cache_policy *next = policy->next;
+        free(policy->line);
+        free(policy);
+        policy = next;
+    }
+
+    free(table);
+}
+
+const struct cache_policy *cachepolicy_find(const policy_table *table, const char *request_path, const char *filename,
+                                            const char *type) {
+    if (!table) return NULL;
+
+    if (request_path) {
+        for (const struct policy_pattern *glob = table->globs; glob; glob = glob->next) {
+            if (fnmatch(glob->pattern, request_path, 0) == 0) return glob->policy;
+        }
+    }
+
+    struct policy_key *entry = NULL;
+    if (filename && table->extensions) {
+        const char *name = strrchr(filename, '/');
+        name = name ? name + 1 : filename;
+        size_t name_len = strlen(name);
+
+        // The extensions are tried from the longest to the shortest, like in the mimetable module
+        for (const char *dot = strchr(name, '.'); dot; dot = strchr(dot + 1, '.')) {
+            size_t len = name_len - (dot + 1 - name);
+            if (len == 0 || len >= MAX_EXTENSION) continue;
+
+            char key[MAX_EXTENSION];
+            for (size_t i = 0; i < len; i++) key[i] = (char) tolower((unsigned char) dot[1 + i]);
+
+            HASH_FIND(hh, table->extensions, key, len, entry);
+            if (entry) return entry->policy;
+        }
+    }
+
+    if (type) {
+        HASH_FIND_PTR(table->types, &type, entry);
+        if (entry) return entry->policy;
+    }
+
+    return NULL;
+}
+
+#pragma clang diagnostic pop
+
+const char *cachepolicy_cache_control(const struct cache_policy *policy, size_t *len) {
+    if (!policy) return NULL;
+
+    if (len) *len = policy->len;
+    return policy->line;
+}
+
+const char *cachepolicy_expires(const struct cache_policy *policy, size_t *len) {
+    if (!policy || policy->max_age < 0) return NULL;
+
+    time_t now = time(NULL);
+    struct expires_slot *slot = &expires_cache[policy->index % EXPIRES_SLOTS];
+
+    if (slot->policy != policy || slot->second != now) { // The cached line is outdated
+        time_t expires = now + policy->max_age;
+        struct tm tm;
+        slot->len = strftime(slot->line, sizeof(slot->line), EXPIRES_FMT, gmtime_r(&expires, &tm));
+        slot->policy = policy;
+        slot->second = now;
+    }
+
+    if (len) *len = slot->len;
+    return slot->line;
+}
+
+int cachepolicy_count(const policy_table *table) {
+    if (!table) return -1;
+
+    return table->count;
+}
\ No newline at end of file
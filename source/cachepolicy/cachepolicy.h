@@ -0,0 +1,89 @@
+/**
+ * @file cachepolicy.h
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Rules deciding the caching headers (Cache-Control and Expires) of static responses
+ * @details The rules are read from a tab separated file, where each line contains a selector and the Cache-Control
+ * directives that must be sent for the responses matching it: <selector>\\t<directives>\\n. Lines starting with '#'
+ * are comments. There are three kinds of selectors:
+ * - File extensions, starting with a dot (".css", ".tar.gz")
+ * - Request path globs, starting with a slash, in fnmatch() syntax ("/static/" followed by an asterisk)
+ * - MIME type prefixes, containing a slash anywhere else ("image/", "application/json"), optionally followed by an
+ * asterisk
+ *
+ * Path globs take precedence over extensions, and extensions take precedence over MIME types. Among the rules of the
+ * same kind, the first one in the file wins. When the directives contain a max-age, an Expires header with the same
+ * meaning is also sent, for HTTP/1.0 caches.
+ *
+ * Everything is compiled when the rules are loaded: the MIME type rules are resolved for every type known by the
+ * mimetable module, and the header lines are preformatted, so that finding and adding the headers of a response
+ * doesn't require any formatting or allocation.
+ */
+
+#ifndef PRACTICA1_CACHEPOLICY_H
+#define PRACTICA1_CACHEPOLICY_H
+
+#include <stddef.h>
+#include "constants.h"
+
+/**
+ * @brief The table containing the compiled rules
+ */
+typedef struct policy_table policy_table;
+
+/**
+ * @brief A caching policy, which contains the headers sent by the responses matching a rule
+ */
+struct cache_policy;
+
+/**
+ * @brief Reads a file with caching rules and compiles them into a policy table
+ * @pre The MIME table must have been filled in, as the MIME type rules are resolved when loading
+ * @param[in] filename Path of the file containing the rules
+ * @return The newly created table, or NULL if the file can't be read or contains errors
+ */
+policy_table *cachepolicy_load(const char *filename);
+
+/**
+ * @brief Frees all the memory associated with a policy table
+ * @param[in] table The table to free
+ */
+void cachepolicy_free(policy_table *table);
+
+/**
+ * @brief Finds the policy that applies to a response
+ * @param[in] table The policy table
+ * @param[in] request_path Path of the request, matched against the path globs
+ * @param[in] filename Name or path of the file being served, whose extension is matched against the extensions
+ * @param[in] type MIME type of the file, exactly as returned by the mimetable module (can be NULL)
+ * @return The policy to apply, or NULL if no rule matches
+ */
+const struct cache_policy *cachepolicy_find(const policy_table *table, const char *request_path, const char *filename,
+                                            const char *type);
+
+/**
+ * @brief Returns the preformatted Cache-Control header line of a policy
+ * @param[in] policy The policy
+ * @param[out] len Variable where the length of the line must be stored
+ * @return The full header line, without line terminator
+ */
+const char *cachepolicy_cache_control(const struct cache_policy *policy, size_t *len);
+
+/**
+ * @brief Returns the Expires header line of a policy for the current time
+ * @details The line is formatted at most once per second for each policy and thread, and stored in thread local
+ * storage, so it remains valid until the same thread calls this function again.
+ * @param[in] policy The policy
+ * @param[out] len Variable where the length of the line must be stored
+ * @return The full header line, without line terminator, or NULL if the policy doesn't have a max-age
+ */
+const char *cachepolicy_expires(const struct cache_policy *policy, size_t *len);
+
+/**
+ * @brief Returns the number of rules in a policy table
+ * @param[in] table The table to check
+ * @return Number of rules, or -1 if the table is NULL
+ */
+int cachepolicy_count(const policy_table *table);
+
+#endif //PRACTICA1_CACHEPOLICY_H
@@ -0,0 +1,803 @@
+/**
+ * @file cgi.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Implementation of the execution of scripts and the relaying of their output
+ * @details Each script is run with two pipes, one for its standard input and another for its standard output. Both are
+ * non-blocking and handled in a single poll() loop, so that writing a big input can't deadlock with a script that is
+ * writing a big output. The amount of output available in the pipe is obtained with FIONREAD, which allows moving
+ * exactly that much to the socket with splice() and framing it as a single chunk.
+ */
+
+#define _GNU_SOURCE // Required for splice(), pipe2() and pidfd_open()
+
+#include "cgi.h"
+#include "metrics.h"
+#include "probes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/pidfd.h>
+#include <sys/socket.h>
+
+#define CGI_INPUT_PARTS 4 ///< Number of pieces of the input of a script (querystring, body and their terminators)
+#define CGI_CAPTURE_INITIAL 4096 ///< Initial size of the buffer holding a captured body
+#define CGI_STATUS_LINE 32 ///< Length of the beginning of the output of NPH scripts where their status code is searched
+
+int reaper_epoll = -1; ///< Epoll instance where the reaper waits for finished scripts, or -1 if there's no reaper
+
+/**
+ * @struct cgi_input
+ * @brief Input of a script, which is written to it in pieces as its pipe accepts it
+ */
+struct cgi_input {
+    const char *parts[CGI_INPUT_PARTS]; ///< Pieces of the input
+    size_t lens[CGI_INPUT_PARTS]; ///< Length of each piece
+    int n_parts; ///< Number of pieces
+    int current; ///< Piece being written
+    size_t written; ///< Bytes of the current piece written until now
+};
+
+void cgi_capture_init(struct cgi_capture *capture, size_t max_len) {
+    memset(capture, 0, sizeof(struct cgi_capture));
+    capture->max_len = max_len;
+}
+
+void cgi_capture_free(struct cgi_capture *capture) {
+    free(capture->head);
+    free(capture->body);
+    capture->head = capture->body = NULL;
+    capture->head_len = capture->body_len = capture->body_cap = 0;
+}
+
+/**
+ * @brief Checks whether a header line is one of the headers a capture leaves out
+ * @details The date and the server signature are set again for every response, and the framing of the body depends on
+ * how it's sent each time.
+ * @param[in] line The header line
+ * @param[in] len Length of the line
+ * @return 1 if it must be left out, 0 otherwise
+ */
+int cgi_capture_skips(const char *line, size_t len) {
+    const char *skipped[] = {HDR_DATE, HDR_SERVER_ORIGIN, HDR_CONTENT_LENGTH, HDR_TRANSFER_ENCODING};
+
+    for (size_t i = 0; i < sizeof(skipped) / sizeof(skipped[0]); i++) {
+        size_t name_len = strlen(skipped[i]);
+        if (len > name_len && line[name_len] == ':' && strncasecmp(line, skipped[i], name_len) == 0) return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Stores the status line and the headers of a response in its capture
+ * @param[in,out] capture The capture
+ * @param[in] code Response code
+ * @param[in] message Message of the status line (can be NULL)
+ * @param[in] headers Headers of the response
+ */
+void cgi_capture_start(struct cgi_capture *capture, HTTP_RESPONSE_CODE code, const char *message,
+                       const struct httpres_headers *headers) {
+    capture->code = code;
+    snprintf(capture->message, sizeof(capture->message), "%s", message ? message : "");
+
+    size_t len = 0;
+    for (int i = 0; i < headers->num_headers; i++) len += headers->headers[i].len + 2;
+    if (!(capture->head = malloc(len + 1))) {
+        capture->overflow = 1; // A response without its headers can't be sent again
+        return;
+    }
+
+    capture->head_len = 0;
+    for (int i = 0; i < headers->num_headers; i++) {
+        const struct httpres_header *header = &headers->headers[i];
+        if (cgi_capture_skips(header->line, header->len)) continue;
+
+        memcpy(capture->head + capture->head_len, header->line, header->len);
+        memcpy(capture->head + capture->head_len + header->len, "\r\n", 2);
+        capture->head_len += header->len + 2;
+    }
+    capture->head[capture->head_len] = '\0';
+}
+
+/**
+ * @brief Makes room at the end of the captured body for a new piece
+ * @details If the body would grow past the maximum length, it's discarded and the capture is marked as overflowed.
+ * @param[in,out] capture The capture
+ * @param[in] len Length of the new piece
+ * @return Pointer where the piece must be stored, or NULL if it can't be captured
+ */
+char *cgi_capture_reserve(struct cgi_capture *capture, size_t len) {
+    if (capture->overflow) return NULL;
+
+    if (capture->body_len + len > capture->body_cap) {
+        size_t cap = capture->body_cap ? capture->body_cap : CGI_CAPTURE_INITIAL;
+        while (cap < capture->body_len + len) cap *= 2;
+        if (cap > capture->max_len) cap = capture->max_len;
+
+        char *body = capture->body_len + len <= cap ? realloc(capture->body, cap) : NULL;
+        if (!body) {
+            free(capture->body);
+            capture->body = NULL;
+            capture->body_len = capture->body_cap = 0;
+            capture->overflow = 1;
+            return NULL;
+        }
+        capture->body = body;
+        capture->body_cap = cap;
+    }
+
+    char *dest = capture->body + capture->body_len;
+    capture->body_len += len;
+    return dest;
+}
+
+void cgi_output_init(struct cgi_output *out, int socket, struct httpres_headers *headers,
+                     const struct request *request, struct cgi_capture *capture) {
+    out->socket = socket;
+    out->headers = headers;
+    out->chunked = request->minor_version >= 1; // HTTP/1.0 clients don't understand chunks
+    out->headers_only = request->headers_only;
+    out->started = 0;
+    out->body_len = 0;
+    out->capture = capture;
+    out->nph = 0;
+    out->code = 0;
+    out->head_len = 0;
+}
+
+void cgi_output_nph(struct cgi_output *out, const char *fullpath) {
+    const char *name = strrchr(fullpath, '/');
+    name = name ? name + 1 : fullpath;
+    if (strncmp(name, CGI_NPH_PREFIX, strlen(CGI_NPH_PREFIX)) != 0) return;
+
+    out->nph = 1;
+    out->chunked = 0; // The script frames the body by itself
+    out->headers_only = 0; // Even for HEAD requests, the script decides what to send
+    out->capture = NULL; // Its response can't be sent again with other headers
+}
+
+STATUS cgi_output_start(struct cgi_output *out, HTTP_RESPONSE_CODE code, const char *message) {
+    out->code = code;
+    if (out->capture) cgi_capture_start(out->capture, code, message, out->headers);
+
+    out->started = 1;
+    if (out->socket == -1) return SUCCESS; // The response is only being captured
+
+    if (out->chunked) set_header(out->headers, HDR_TRANSFER_ENCODING, "chunked");
+    return send_response_header(out->socket, code, message, out->headers) == -1 ? ERROR : SUCCESS;
+}
+
+/**
+ * @brief Sends the header of a chunk of the body, if the body is chunked
+ * @param[in] out The response
+ * @param[in] len Length of the chunk
+ * @return \ref STATUS.SUCCESS if everything was sent, \ref STATUS.ERROR otherwise
+ */
+STATUS cgi_output_chunk_header(struct cgi_output *out, size_t len) {
+    if (!out->chunked) return SUCCESS;
+
+    char chunk_header[CGI_CHUNK_HEADER];
+    int header_len = snprintf(chunk_header, sizeof(chunk_header), "%zx\r\n", len);
+    return send_to_client(out->socket, chunk_header, header_len, MSG_MORE) == -1 ? ERROR : SUCCESS;
+}
+
+/**
+ * @brief Sends a piece of the body of the response from a buffer, without capturing it
+ * @param[in,out] out The response
+ * @param[in] data The piece of the body
+ * @param[in] len Length of the piece
+ * @return \ref STATUS.SUCCESS if everything was sent, \ref STATUS.ERROR otherwise
+ */
+STATUS cgi_output_send(struct cgi_output *out, const char *data, size_t len) {
+    if (out->socket != -1 && (cgi_output_chunk_header(out, len) == ERROR ||
+                              send_to_client(out->socket, data, len, out->chunked ? MSG_MORE : 0) == -1 ||
+                              (out->chunked && send_to_client(out->socket, "\r\n", 2, 0) == -1))) {
+        return ERROR;
+    }
+
+    out->body_len += len;
+    return SUCCESS;
+}
+
+STATUS cgi_output_write(struct cgi_output *out, const char *data, size_t len) {
+    if (out->headers_only || len == 0) return SUCCESS; // An empty chunk would end the body
+
+    if (out->capture) {
+        char *dest = cgi_capture_reserve(out->capture, len);
+        if (dest) {
+            memcpy(dest, data, len);
+        } else if (out->socket == -1) {
+            return ERROR; // Nobody is interested in the rest of the output
+        }
+    }
+
+    return cgi_output_send(out, data, len);
+}
+
+STATUS cgi_output_splice(struct cgi_output *out, int pipe_fd, size_t len) {
+    if (out->headers_only || len == 0) return SUCCESS;
+
+    // A captured piece has to be copied to user space anyway, so it's read and then sent from the capture
+    char *dest = out->capture ? cgi_capture_reserve(out->capture, len) : NULL;
+    if (dest) {
+        for (size_t done = 0; done < len;) {
+            ssize_t ret = read(pipe_fd, dest + done, len - done);
+            if (ret == -1 && errno == EINTR) continue;
+            if (ret <= 0) return ERROR; // The pipe had less data than announced
+
+            done += ret;
+        }
+        return cgi_output_send(out, dest, len);
+    }
+    if (out->socket == -1) return ERROR; // Nobody is interested in the rest of the output
+
+    if (cgi_output_chunk_header(out, len) == ERROR) return ERROR;
+
+    size_t remaining = len;
+    while (remaining > 0) {
+        ssize_t moved = splice(pipe_fd, NULL, out->socket, NULL, remaining, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (moved == -1) {
+            if (errno == EINTR) continue;
+            return ERROR;
+        }
+        if (moved == 0) return ERROR; // The pipe had less data than announced
+
+        remaining -= moved;
+        count_bytes_sent((size_t) moved);
+    }
+
+    if (out->chunked && send_to_client(out->socket, "\r\n", 2, 0) == -1) return ERROR;
+
+    out->body_len += len;
+    return SUCCESS;
+}
+
+/**
+ * @brief Checks whether the first line of the output of a script is a CGI header
+ * @details The output of scripts written before the headers were parsed starts directly with the body, which is
+ * detected by its first line not being made of a header name and a colon.
+ * @param[in] line The output
+ * @param[in] len Length of the output
+ * @return 1 if it starts with a header or with the empty line that ends the headers, 0 otherwise
+ */
+int cgi_is_header_line(const char *line, size_t len) {
+    size_t i = 0;
+    while (i < len && (isalnum((unsigned char) line[i]) || line[i] == '-' || line[i] == '_')) i++;
+
+    if (i == 0) return len > 0 && (line[0] == '\n' || line[0] == '\r'); // An empty line means there are no headers
+    return i < len && line[i] == ':';
+}
+
+/**
+ * @brief Starts the response with the CGI headers at the beginning of the output
+ * @details Status sets the code of the response, and Location without Status turns it into a redirect. Headers that
+ * control the connection are dropped, as the framing of the body is decided by the server, and the rest of them are
+ * passed to the client as they are.
+ * @param[in,out] out The response
+ * @param[in] head_end Length of the headers, including the empty line that ends them
+ * @return \ref STATUS.SUCCESS if the response was started, \ref STATUS.ERROR otherwise
+ */
+STATUS cgi_output_start_head(struct cgi_output *out, size_t head_end) {
+    HTTP_RESPONSE_CODE code = OK;
+    const char *message = "OK";
+    int has_status = 0, has_location = 0, has_type = 0;
+
+    char *line = out->head;
+    char *end = out->head + head_end;
+    while (line < end) {
+        char *eol = memchr(line, '\n', end - line);
+        if (!eol) break;
+        *eol = '\0';
+        if (eol > line && eol[-1] == '\r') eol[-1] = '\0';
+
+        char *colon = strchr(line, ':');
+        if (colon) {
+            *colon = '\0';
+            char *value = colon + 1;
+            while (*value == ' ' || *value == '\t') value++;
+
+            if (strcasecmp(line, "Status") == 0) { // "Status: 404 Not Found"
+                char *msg;
+                long status = strtol(value, &msg, 10);
+                if (status >= 100 && status <= 999) {
+                    code = (HTTP_RESPONSE_CODE) status;
+                    while (*msg == ' ') msg++;
+                    message = *msg ? msg : NULL;
+                    has_status = 1;
+                }
+            } else if (strcasecmp(line, "Connection") == 0 || strcasecmp(line, "Keep-Alive") == 0 ||
+                       strcasecmp(line, HDR_TRANSFER_ENCODING) == 0) {
+                continue; // Hop-by-hop headers only make sense to the server
+            } else {
+                if (strcasecmp(line, HDR_LOCATION) == 0) has_location = 1;
+                if (strcasecmp(line, HDR_CONTENT_TYPE) == 0) has_type = 1;
+                // A length set by the script delimits the body by itself
+                if (strcasecmp(line, HDR_CONTENT_LENGTH) == 0) out->chunked = 0;
+                set_header(out->headers, line, value);
+            }
+        }
+
+        line = eol + 1;
+    }
+
+    if (has_location && !has_status) { // A redirection to another document, which the client must follow
+        code = FOUND;
+        message = "Found";
+    }
+    if (code == NO_CONTENT || code == NOT_MODIFIED) { // These responses can't have a body
+        out->chunked = 0;
+        out->headers_only = 1;
+    } else if (!has_type && !has_location) {
+        set_header(out->headers, HDR_CONTENT_TYPE, CGI_DEFAULT_TYPE);
+    }
+    return cgi_output_start(out, code, message);
+}
+
+/**
+ * @brief Starts the response of a non-parsed header script, taking its code from the status line of its output
+ * @param[in,out] out The response
+ * @param[in] data Beginning of the output
+ * @param[in] len Length of the output
+ */
+void cgi_output_start_nph(struct cgi_output *out, const char *data, size_t len) {
+    char status_line[CGI_STATUS_LINE];
+    int status_len = (int) (len < sizeof(status_line) ? len : sizeof(status_line) - 1);
+    snprintf(status_line, sizeof(status_line), "%.*s", status_len, data);
+
+    int code;
+    out->code = sscanf(status_line, "HTTP/%*d.%*d %d", &code) == 1 ? (HTTP_RESPONSE_CODE) code : OK; // For the log
+    out->started = 1;
+}
+
+STATUS cgi_output_relay(struct cgi_output *out, const char *data, size_t len) {
+    if (len == 0) return SUCCESS;
+
+    if (out->nph) {
+        if (!out->started) cgi_output_start_nph(out, data, len);
+        return cgi_output_send(out, data, len);
+    }
+    if (out->started) return cgi_output_write(out, data, len);
+
+    // Only the beginning of the piece may belong to the headers, the rest is body once their end is found
+    size_t taken = len < CGI_MAX_HEAD - out->head_len ? len : CGI_MAX_HEAD - out->head_len;
+    memcpy(out->head + out->head_len, data, taken);
+    size_t searched = out->head_len > 3 ? out->head_len - 3 : 0; // The separator may span two pieces
+    out->head_len += taken;
+
+    size_t head_end = 0;
+    const char *first_eol = memchr(out->head, '\n', out->head_len);
+    if ((first_eol || taken < len) && !cgi_is_header_line(out->head, out->head_len)) {
+        // Output without headers is the body of an HTML page, as it was before they were parsed
+        set_header(out->headers, HDR_CONTENT_TYPE, CGI_DEFAULT_TYPE);
+        if (cgi_output_start(out, OK, "OK") == ERROR) return ERROR;
+    } else {
+        // The headers end with an empty line, which scripts often write with bare LFs
+        if (out->head[0] == '\n') head_end = 1;
+        if (out->head_len >= 2 && memcmp(out->head, "\r\n", 2) == 0) head_end = 2;
+        for (size_t i = searched; i < out->head_len && !head_end; i++) {
+            if (out->head_len - i >= 4 && memcmp(out->head + i, "\r\n\r\n", 4) == 0) {
+                head_end = i + 4;
+            } else if (out->head_len - i >= 2 && memcmp(out->head + i, "\n\n", 2) == 0) {
+                head_end = i + 2;
+            }
+        }
+        if (!head_end) return taken < len ? ERROR : SUCCESS; // Either the headers are too long, or they continue later
+
+        if (cgi_output_start_head(out, head_end) == ERROR) return ERROR;
+    }
+
+    // The part of the buffer after the headers, and the part of the piece that didn't fit in it, are body
+    if (cgi_output_write(out, out->head + head_end, out->head_len - head_end) == ERROR ||
+        (taken < len && cgi_output_write(out, data + taken, len - taken) == ERROR)) {
+        return ERROR;
+    }
+
+    return SUCCESS;
+}
+
+STATUS cgi_output_relay_pipe(struct cgi_output *out, int pipe_fd, size_t len) {
+    // Until the response has been started, the output must be inspected, so it's read into user space
+    while (len > 0 && !out->started) {
+        char buf[CGI_MAX_HEAD];
+        size_t piece = len < sizeof(buf) ? len : sizeof(buf);
+
+        for (size_t done = 0; done < piece;) {
+            ssize_t ret = read(pipe_fd, buf + done, piece - done);
+            if (ret == -1 && errno == EINTR) continue;
+            if (ret <= 0) return ERROR; // The pipe had less data than announced
+
+            done += ret;
+        }
+        if (cgi_output_relay(out, buf, piece) == ERROR) return ERROR;
+
+        len -= piece;
+    }
+
+    return cgi_output_splice(out, pipe_fd, len);
+}
+
+STATUS cgi_output_end(struct cgi_output *out) {
+    if (out->started) return SUCCESS;
+    if (out->head_len == 0) return ERROR; // The script didn't write anything
+
+    if (cgi_is_header_line(out->head, out->head_len)) { // Headers without the empty line, and therefore without body
+        if (out->head_len == CGI_MAX_HEAD) return ERROR; // The headers were too long to be parsed
+
+        out->head[out->head_len] = '\n'; // So that the last header is parsed too
+        return cgi_output_start_head(out, out->head_len + 1);
+    }
+
+    set_header(out->headers, HDR_CONTENT_TYPE, CGI_DEFAULT_TYPE);
+    if (cgi_output_start(out, OK, "OK") == ERROR) return ERROR;
+    return cgi_output_write(out, out->head, out->head_len);
+}
+
+void cgi_output_finish(struct cgi_output *out) {
+    if (out->socket == -1) return;
+
+    if (out->started && out->chunked && !out->headers_only) {
+        send_to_client(out->socket, "0\r\n\r\n", 5, 0); // The last chunk is empty
+    }
+
+    close_connection(out->socket);
+}
+
+HTTP_RESPONSE_CODE cgi_output_timeout(struct cgi_output *out) {
+    if (!out->started) return respond(out->socket, GATEWAY_TIMEOUT, "Gateway Timeout", out->headers, NULL, 0);
+
+    if (out->capture) out->capture->overflow = 1; // An incomplete response must never be sent again
+    if (out->socket != -1) close_connection(out->socket); // Without the last chunk, or before the announced length
+
+    return GATEWAY_TIMEOUT;
+}
+
+void cgi_deadline_init(struct timespec *deadline, const struct cgi_limits *limits) {
+    if (!limits || limits->timeout <= 0) {
+        deadline->tv_sec = 0;
+        deadline->tv_nsec = 0;
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += limits->timeout;
+}
+
+int cgi_deadline_left(const struct timespec *deadline) {
+    if (deadline->tv_sec == 0 && deadline->tv_nsec == 0) return -1;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long left = (long long) (deadline->tv_sec - now.tv_sec) * 1000 + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+
+    return left > 0 ? (int) left : 0;
+}
+
+STATUS cgi_wait_readable(int fd, const struct timespec *deadline) {
+    if (deadline->tv_sec == 0 && deadline->tv_nsec == 0) return SUCCESS; // Without a deadline, reads just block
+
+    while (1) {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        int ret = poll(&pfd, 1, cgi_deadline_left(deadline));
+        if (ret == -1 && errno == EINTR) continue;
+
+        return ret == 0 ? ERROR : SUCCESS; // Errors are left for the read itself to report
+    }
+}
+
+STATUS cgi_recv_all(int fd, void *buf, size_t len, const struct timespec *deadline) {
+    size_t received = 0;
+    while (received < len) {
+        if (cgi_wait_readable(fd, deadline) == ERROR) return ERROR;
+
+        ssize_t ret = recv(fd, (char *) buf + received, len - received, 0);
+        if (ret == -1 && errno == EINTR) continue;
+        if (ret <= 0) return ERROR;
+        received += ret;
+    }
+
+    return SUCCESS;
+}
+
+STATUS cgi_limits_apply(pid_t pid, const struct cgi_limits *limits, int with_cpu) {
+    if (!limits) return SUCCESS;
+
+    STATUS ret = SUCCESS;
+    if (with_cpu && limits->cpu > 0) { // The soft limit sends SIGXCPU, and the hard one a second later SIGKILL
+        struct rlimit limit = {.rlim_cur = (rlim_t) limits->cpu, .rlim_max = (rlim_t) limits->cpu + 1};
+        if (prlimit(pid, RLIMIT_CPU, &limit, NULL) == -1) ret = ERROR;
+    }
+    if (limits->memory > 0) {
+        struct rlimit limit = {.rlim_cur = (rlim_t) limits->memory * 1024 * 1024,
+                               .rlim_max = (rlim_t) limits->memory * 1024 * 1024};
+        if (prlimit(pid, RLIMIT_AS, &limit, NULL) == -1) ret = ERROR;
+    }
+    if (limits->files > 0) {
+        struct rlimit limit = {.rlim_cur = (rlim_t) limits->files, .rlim_max = (rlim_t) limits->files};
+        if (prlimit(pid, RLIMIT_NOFILE, &limit, NULL) == -1) ret = ERROR;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Main function of the reaper thread, which waits for the scripts that finish
+ * @param[in] arg Unused
+ * @return Never returns
+ */
+void *cgi_reaper(void *arg) {
+    (void) arg;
+
+    struct epoll_event events[CGI_REAPER_EVENTS];
+    while (1) {
+        int n_events = epoll_wait(reaper_epoll, events, CGI_REAPER_EVENTS, -1);
+        for (int i = 0; i < n_events; i++) {
+            int pidfd = events[i].data.fd;
+
+            // The descriptor becomes readable once the process has finished, so this never blocks
+            siginfo_t info;
+            if (waitid(P_PIDFD, pidfd, &info, WEXITED) == 0) PROBE3(cgi_exit, info.si_pid, probe_tid(), info.si_status);
+            close(pidfd); // Closing it also removes it from the epoll instance
+        }
+    }
+}
+
+STATUS cgi_init() {
+    if (reaper_epoll != -1) return SUCCESS;
+
+    if ((reaper_epoll = epoll_create1(EPOLL_CLOEXEC)) == -1) return ERROR;
+
+    pthread_t reaper;
+    if (pthread_create(&reaper, NULL, cgi_reaper, NULL) != 0) {
+        close(reaper_epoll);
+        reaper_epoll = -1;
+        return ERROR;
+    }
+    pthread_detach(reaper);
+
+    return SUCCESS;
+}
+
+void cgi_reap(pid_t pid) {
+    if (reaper_epoll != -1) {
+        int pidfd = pidfd_open(pid, 0);
+        if (pidfd != -1) {
+            struct epoll_event event = {.events = EPOLLIN, .data.fd = pidfd};
+            if (epoll_ctl(reaper_epoll, EPOLL_CTL_ADD, pidfd, &event) == 0) return;
+            close(pidfd);
+        }
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0); // Without the reaper, the only option is waiting for it here
+    PROBE3(cgi_exit, pid, probe_tid(), status);
+}
+
+STATUS cgi_find_command(const char *command, char *path, size_t path_len) {
+    if (strchr(command, '/')) { // Paths are used as they are
+        if (access(command, X_OK) != 0) return ERROR;
+        snprintf(path, path_len, "%s", command);
+        return SUCCESS;
+    }
+
+    const char *dirs = getenv("PATH");
+    if (!dirs) return ERROR;
+
+    while (*dirs) {
+        size_t dir_len = strcspn(dirs, ":");
+        if ((size_t) snprintf(path, path_len, "%.*s/%s", (int) dir_len, dirs, command) < path_len &&
+            access(path, X_OK) == 0) {
+            return SUCCESS;
+        }
+
+        dirs += dir_len;
+        if (*dirs == ':') dirs++;
+    }
+
+    return ERROR;
+}
+
+/**
+ * @brief Spawns a child process executing the provided command, and routes its stdin and stdout to pipes
+ * @details This function is similar to popen(), but supports bidirectional communication with the spawned
+ * process. It creates pipes in both directions, so that the caller can later write to the spawned process'
+ * stdin, and read from its stdout. Heavily inspired in code by <psimerda@redhat.com>
+ *
+ * The process is created with posix_spawn(), which glibc implements with a vfork-like clone that shares the memory of
+ * the server instead of copying its page tables, so its cost doesn't grow with the size of the server. The pipes are
+ * created with close-on-exec, and only the ends moved to stdin and stdout by the file actions survive in the child.
+ * @author Diego Ortín Fernández
+ * @see https://github.com/crossdistro/netresolve/blob/master/backends/exec.c#L46
+ * @param[in]  command The argv of the command to be executed
+ * @param[out] pid Variable to store the process ID of the spawned process
+ * @param[out] infd Variable to store the descriptor number for writing to the process' stdin
+ * @param[out] outfd Variable to store the descriptor number for reading from the process' stdout
+ * @return 0 if something goes wrong, 1 otherwise
+ */
+int popen2(char *const command[], int *pid, int *infd, int *outfd) {
+    int pipe_in[2], pipe_out[2];
+
+    if (!pid || !infd || !outfd) return 0;
+
+    uint64_t start = metrics_now();
+    if (pipe2(pipe_in, O_CLOEXEC) == -1) goto pipe1_error;
+    if (pipe2(pipe_out, O_CLOEXEC) == -1) goto pipe2_error;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipe_in[0], STDIN_FILENO); // Read end of pipe_in as stdin
+    posix_spawn_file_actions_adddup2(&actions, pipe_out[1], STDOUT_FILENO); // Write end of pipe_out as stdout
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t signals;
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attr, &signals); // Scripts mustn't inherit the signal mask of the calling thread
+    sigaddset(&signals, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &signals); // The server ignores it, but scripts should die if the client goes
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    extern char **environ;
+    int ret = posix_spawnp(pid, command[0], &actions, &attr, command, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (ret != 0) goto spawn_error;
+    metrics_add(METRIC_CGI_SPAWNS, 1);
+    metrics_observe_since(PHASE_SPAWN, start);
+    PROBE3(cgi_spawn, *pid, probe_tid(), command[0]);
+
+    *infd = pipe_in[1]; // Set the input descriptor to the write end of pipe_in
+    *outfd = pipe_out[0]; // Set the output descriptor to the read end of pipe_out
+
+    close(pipe_in[0]); // Close the read end of pipe_in, as we're not using it
+    close(pipe_out[1]); // Close the write end of pipe_out, as we're not using it
+
+    return 1;
+
+    spawn_error:
+    close(pipe_out[1]);
+    close(pipe_out[0]);
+    pipe2_error:
+    close(pipe_in[1]);
+    close(pipe_in[0]);
+    pipe1_error:
+    return 0;
+}
+
+/**
+ * @brief Writes as much of the input of a script as its pipe accepts without blocking
+ * @param[in] fd Write end of the pipe
+ * @param[in,out] input The input, which is advanced past the written bytes
+ * @return 1 if the whole input has been written, 0 if there's more left, -1 if the script doesn't accept more input
+ */
+int cgi_write_input(int fd, struct cgi_input *input) {
+    while (input->current < input->n_parts) {
+        const char *part = input->parts[input->current] + input->written;
+        size_t left = input->lens[input->current] - input->written;
+
+        ssize_t ret = write(fd, part, left);
+        if (ret == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return 0; // The pipe is full, wait until the script reads
+            return -1;
+        }
+
+        input->written += ret;
+        if (input->written == input->lens[input->current]) {
+            input->current++;
+            input->written = 0;
+        }
+    }
+
+    return 1;
+}
+
+HTTP_RESPONSE_CODE cgi_run(int socket, struct httpres_headers *headers, struct request *request,
+                           struct _srvutils *utils, const char *exec_cmd, const char *fullpath,
+                           const struct cgi_limits *limits, struct cgi_capture *capture) {
+    if (!fullpath || !exec_cmd || !utils || !request || !headers) {
+        return respond(socket, INTERNAL_ERROR, "Internal error", NULL, NULL, 0);
+    }
+
+    const char *command[] = {exec_cmd, fullpath, NULL};
+
+    pid_t pid;
+    int infd, outfd;
+    if (popen2((char *const *) command, &pid, &infd, &outfd) == 0) {
+        return respond(socket, INTERNAL_ERROR, "Execution error", headers, NULL, 0);
+    }
+
+    struct timespec deadline;
+    cgi_deadline_init(&deadline, limits);
+    // The process file descriptor refers to this very process, even if its PID is reused after it dies
+    int pidfd = cgi_deadline_left(&deadline) != -1 ? pidfd_open(pid, 0) : -1;
+    if (cgi_limits_apply(pid, limits, 1) == ERROR) utils->log(stderr, "Could not limit the resources of %s", fullpath);
+
+    // The querystring and the body are written to the script's stdin, each one in its own line
+    struct cgi_input input = {.n_parts = 0};
+    if (request->querystring) {
+        input.parts[input.n_parts] = request->querystring;
+        input.lens[input.n_parts++] = strlen(request->querystring);
+        input.parts[input.n_parts] = "\r\n";
+        input.lens[input.n_parts++] = 2;
+    }
+    if (request->body) {
+        input.parts[input.n_parts] = request->body;
+        input.lens[input.n_parts++] = request->body_len;
+        input.parts[input.n_parts] = "\r\n";
+        input.lens[input.n_parts++] = 2;
+    }
+
+    fcntl(infd, F_SETFL, fcntl(infd, F_GETFL) | O_NONBLOCK);
+    fcntl(outfd, F_SETFL, fcntl(outfd, F_GETFL) | O_NONBLOCK);
+
+    struct cgi_output out;
+    cgi_output_init(&out, socket, headers, request, capture);
+    cgi_output_nph(&out, fullpath);
+
+    STATUS relaying = SUCCESS;
+    int timed_out = 0;
+    while (relaying == SUCCESS) {
+        struct pollfd fds[2] = {{.fd = outfd, .events = POLLIN},
+                                {.fd = infd, .events = POLLOUT}};
+        int n_fds = infd != -1 ? 2 : 1; // Once the input is complete, only the output is watched
+
+        int ready = poll(fds, n_fds, cgi_deadline_left(&deadline));
+        if (ready == -1) {
+            if (errno == EINTR) continue;
+            break;
+        } else if (ready == 0) { // Out of time
+            // Until it's reaped, its PID can't be reused, so it's a safe fallback
+            if (pidfd == -1 || pidfd_send_signal(pidfd, SIGKILL, NULL, 0) == -1) kill(pid, SIGKILL);
+            timed_out = 1;
+            break;
+        }
+
+        if (n_fds == 2 && fds[1].revents) { // The script can accept more input
+            if (cgi_write_input(infd, &input) != 0) { // Either everything was written, or it won't read anymore
+                close(infd);
+                infd = -1;
+            }
+        }
+
+        if (fds[0].revents) { // The script has written something, or closed its output
+            int available = 0;
+            if (ioctl(outfd, FIONREAD, &available) == -1 || available <= 0) break; // End of the output
+
+            relaying = cgi_output_relay_pipe(&out, outfd, available); // Stops relaying if the client has gone away
+            if (out.started && out.headers_only) break; // HEAD responses are complete once the headers are sent
+        }
+    }
+
+    if (infd != -1) close(infd);
+    close(outfd); // If the script is still writing, it receives a SIGPIPE
+    if (pidfd != -1) close(pidfd);
+    cgi_reap(pid);
+
+#if DEBUG >= 2
+    utils->log(stdout, "Relayed %lld bytes of output from %s", (long long) out.body_len, fullpath);
+#endif
+
+    if (timed_out) return cgi_output_timeout(&out);
+
+    // Output that ended in the middle of the headers still makes a response, as long as there was some
+    if (relaying == SUCCESS) cgi_output_end(&out);
+    if (!out.started) return respond(socket, INTERNAL_ERROR, "Execution error", headers, NULL, 0);
+
+    cgi_output_finish(&out);
+    return out.code;
+}
\ No newline at end of file
@@ -0,0 +1,291 @@
+/**
+ * @file cgi.h
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Module for running scripts and relaying their output to the client as it's produced
+ * @details The output of a script is sent to the client while the script is still running, instead of waiting for it
+ * to finish, so that scripts can produce any amount of output without it having to fit in memory. When possible, the
+ * output is moved from the pipe of the script to the socket with splice(), without copying it to user space.
+ *
+ * The output begins with CGI/1.1 response headers (RFC 3875), which are lifted into the HTTP response: Status sets its
+ * code, Location without Status makes it a redirect, Content-Length delimits the body by itself, and the rest of the
+ * headers (such as Content-Type or Cache-Control) are passed to the client. Scripts whose name starts with "nph-"
+ * write the whole HTTP response by themselves, which is relayed untouched. For compatibility with older scripts,
+ * output whose first line isn't a header is sent as an HTML body.
+ *
+ * Since the length of the output isn't known in advance, HTTP/1.1 responses use chunked transfer encoding (unless the
+ * script sets Content-Length), and HTTP/1.0 responses are delimited by closing the connection. The @ref cgi_output
+ * functions take care of this, and can be used for relaying the output of any other kind of CGI-like backend.
+ *
+ * Finished scripts are reaped by a dedicated thread, which waits on a process file descriptor for each of them, so that
+ * the threads serving requests never wait for a script to exit.
+ *
+ * Scripts can be bounded by @ref cgi_limits: a wall-clock timeout, after which the script is killed through its
+ * process file descriptor, and resource limits (CPU time, memory and open files) applied to its process right after
+ * spawning it.
+ */
+
+#ifndef PRACTICA1_CGI_H
+#define PRACTICA1_CGI_H
+
+#include <time.h>
+#include <sys/types.h>
+#include "httputils.h"
+#include "server.h"
+#include "constants.h"
+
+#define CGI_CHUNK_HEADER 20 ///< Size of a buffer able to hold the header of a chunk (its length in hex and a CRLF)
+#define CGI_REAPER_EVENTS 16 ///< Maximum number of finished scripts reaped at once
+#define CGI_CAPTURE_MESSAGE 64 ///< Size of the buffer holding the message of the status line of a captured response
+#define CGI_MAX_HEAD (8 * 1024) ///< Maximum length of the CGI headers at the beginning of the output
+#define CGI_NPH_PREFIX "nph-" ///< Prefix of the names of the scripts that write the whole HTTP response
+#define CGI_DEFAULT_TYPE "text/html" ///< Content type of the output of scripts that don't set one
+
+/**
+ * @struct cgi_capture
+ * @brief Copy of a response kept while it's relayed, so that it can be stored and sent again later
+ */
+struct cgi_capture {
+    size_t max_len; ///< Maximum length of the body that can be captured
+    int overflow; ///< 1 if the body grew longer than @p max_len, in which case it has been discarded
+    HTTP_RESPONSE_CODE code; ///< Code of the response, or 0 if it hasn't been started
+    char message[CGI_CAPTURE_MESSAGE]; ///< Message of the status line
+    char *head; ///< Headers set by the backend, each one ended by a CRLF (without Date, Server and the framing ones)
+    size_t head_len; ///< Length of the headers
+    char *body; ///< Body of the response
+    size_t body_len; ///< Length of the body
+    size_t body_cap; ///< Size of the buffer holding the body
+};
+
+/**
+ * @struct cgi_limits
+ * @brief Bounds on the execution of a script (a limit of 0 means that it's unbounded)
+ */
+struct cgi_limits {
+    int timeout; ///< Seconds a script can run before being stopped
+    long cpu; ///< Seconds of CPU time the process of a script can use
+    long memory; ///< Megabytes of memory (address space) the process of a script can use
+    long files; ///< Number of files the process of a script can have open at once
+};
+
+/**
+ * @struct cgi_output
+ * @brief State of a response whose body is sent as it's produced
+ */
+struct cgi_output {
+    int socket; ///< Socket to which the response is sent
+    struct httpres_headers *headers; ///< Headers sent together with the status line
+    int chunked; ///< 1 if the body is sent with chunked transfer encoding
+    int headers_only; ///< 1 if the body must not be sent (for HEAD requests)
+    int started; ///< 1 once the status line and the headers have been sent
+    off_t body_len; ///< Number of bytes of the body relayed until now
+    struct cgi_capture *capture; ///< Where a copy of the response is kept, or NULL if none is kept
+    int nph; ///< 1 if the output is the whole HTTP response, which must be relayed untouched
+    HTTP_RESPONSE_CODE code; ///< Code of the response, once it has been started
+    char head[CGI_MAX_HEAD]; ///< Beginning of the output, until the end of the CGI headers is found
+    size_t head_len; ///< Length of the beginning of the output
+};
+
+/**
+ * @brief Initializes an empty capture
+ * @param[out] capture Structure to initialize
+ * @param[in] max_len Maximum length of the body that can be captured
+ */
+void cgi_capture_init(struct cgi_capture *capture, size_t max_len);
+
+/**
+ * @brief Frees the buffers of a capture (but not the structure itself)
+ * @param[in] capture The capture
+ */
+void cgi_capture_free(struct cgi_capture *capture);
+
+/**
+ * @brief Initializes the state of a response whose body will be sent as it's produced
+ * @param[out] out Structure to initialize
+ * @param[in] socket Socket to which the response must be sent
+ * @param[in] headers Headers of the response, which can still be modified until the response is started
+ * @param[in] request The request being answered, which decides how the body is delimited
+ * @param[out] capture Where a copy of the response must be kept (can be NULL). If @p socket is -1, the response is only
+ * captured, and relaying stops as soon as the capture overflows.
+ */
+void cgi_output_init(struct cgi_output *out, int socket, struct httpres_headers *headers,
+                     const struct request *request, struct cgi_capture *capture);
+
+/**
+ * @brief Marks a response as the output of a non-parsed header script, if the name of the script says so
+ * @details The output of those scripts is relayed as it is, without adding any header or framing, and it's never
+ * captured. It must be called right after cgi_output_init().
+ * @param[in,out] out The response
+ * @param[in] fullpath Path of the script
+ */
+void cgi_output_nph(struct cgi_output *out, const char *fullpath);
+
+/**
+ * @brief Relays a piece of the output of a script, parsing the CGI headers at its beginning
+ * @details The response is started once the end of the headers is found, and the rest of the output is sent as its
+ * body. Nothing is sent to the client while the headers are incomplete.
+ * @param[in,out] out The response
+ * @param[in] data The piece of output
+ * @param[in] len Length of the piece
+ * @return \ref STATUS.SUCCESS if the piece was relayed, \ref STATUS.ERROR if the client has gone away or the headers
+ * are too long (in which case the rest of the output must be discarded)
+ */
+STATUS cgi_output_relay(struct cgi_output *out, const char *data, size_t len);
+
+/**
+ * @brief Relays a piece of the output of a script from a pipe, parsing the CGI headers at its beginning
+ * @details The headers have to be read into user space, but once the response has been started, the body is moved from
+ * the pipe to the socket with splice().
+ * @pre The pipe must contain at least @p len bytes
+ * @param[in,out] out The response
+ * @param[in] pipe_fd Read end of the pipe
+ * @param[in] len Number of bytes to relay
+ * @return \ref STATUS.SUCCESS if the piece was relayed, \ref STATUS.ERROR if the client has gone away or the headers
+ * are too long (in which case the rest of the output must be discarded)
+ */
+STATUS cgi_output_relay_pipe(struct cgi_output *out, int pipe_fd, size_t len);
+
+/**
+ * @brief Starts the response with the output received until now, once the script has ended
+ * @details This is only needed for output that ended before the end of the CGI headers: it's taken as a response
+ * made only of headers, or as the body of a response if its first line isn't a header.
+ * @param[in,out] out The response
+ * @return \ref STATUS.SUCCESS if the response has been started, \ref STATUS.ERROR if there was no output
+ */
+STATUS cgi_output_end(struct cgi_output *out);
+
+/**
+ * @brief Sends the status line and the headers of the response, adding the ones required for delimiting the body
+ * @param[in,out] out The response
+ * @param[in] code Response code
+ * @param[in] message Message of the status line
+ * @return \ref STATUS.SUCCESS if everything was sent, \ref STATUS.ERROR otherwise
+ */
+STATUS cgi_output_start(struct cgi_output *out, HTTP_RESPONSE_CODE code, const char *message);
+
+/**
+ * @brief Sends a piece of the body of the response from a buffer
+ * @pre The response must have been started with cgi_output_start()
+ * @param[in,out] out The response
+ * @param[in] data The piece of the body
+ * @param[in] len Length of the piece
+ * @return \ref STATUS.SUCCESS if everything was sent, \ref STATUS.ERROR otherwise
+ */
+STATUS cgi_output_write(struct cgi_output *out, const char *data, size_t len);
+
+/**
+ * @brief Moves a piece of the body of the response from a pipe to the socket, without copying it to user space
+ * @pre The response must have been started with cgi_output_start()
+ * @pre The pipe must contain at least @p len bytes
+ * @param[in,out] out The response
+ * @param[in] pipe_fd Read end of the pipe
+ * @param[in] len Number of bytes to move
+ * @return \ref STATUS.SUCCESS if everything was sent, \ref STATUS.ERROR otherwise
+ */
+STATUS cgi_output_splice(struct cgi_output *out, int pipe_fd, size_t len);
+
+/**
+ * @brief Ends the body of the response and closes the connection
+ * @param[in,out] out The response
+ */
+void cgi_output_finish(struct cgi_output *out);
+
+/**
+ * @brief Stops a response whose script ran out of time
+ * @details If the response hasn't been started, a 504 response is sent instead. Otherwise, the connection is closed
+ * without ending the body, so that the client knows it's incomplete, and the capture (if any) is discarded.
+ * @param[in,out] out The response
+ * @return \ref HTTP_RESPONSE_CODE.GATEWAY_TIMEOUT
+ */
+HTTP_RESPONSE_CODE cgi_output_timeout(struct cgi_output *out);
+
+/**
+ * @brief Computes the moment at which a script must be stopped
+ * @param[out] deadline Where the moment must be stored (zero if there's no timeout)
+ * @param[in] limits Bounds of the script (can be NULL)
+ */
+void cgi_deadline_init(struct timespec *deadline, const struct cgi_limits *limits);
+
+/**
+ * @brief Returns the time left until a deadline, in the format expected by poll()
+ * @param[in] deadline The deadline, obtained with cgi_deadline_init()
+ * @return Milliseconds left, 0 if the deadline has passed, or -1 if there's no deadline
+ */
+int cgi_deadline_left(const struct timespec *deadline);
+
+/**
+ * @brief Waits until a descriptor can be read without blocking, or a deadline passes
+ * @param[in] fd The descriptor
+ * @param[in] deadline The deadline, obtained with cgi_deadline_init()
+ * @return \ref STATUS.SUCCESS if it can be read, \ref STATUS.ERROR if the deadline passed first
+ */
+STATUS cgi_wait_readable(int fd, const struct timespec *deadline);
+
+/**
+ * @brief Receives exactly the requested number of bytes from a socket, waiting for each piece until a deadline
+ * @param[in] fd The socket
+ * @param[out] buf Buffer where the bytes must be stored
+ * @param[in] len Number of bytes to receive
+ * @param[in] deadline The deadline, obtained with cgi_deadline_init()
+ * @return \ref STATUS.SUCCESS if all the bytes were received, \ref STATUS.ERROR otherwise
+ */
+STATUS cgi_recv_all(int fd, void *buf, size_t len, const struct timespec *deadline);
+
+/**
+ * @brief Applies resource limits to a process that has just been spawned
+ * @details posix_spawn() can't set resource limits, so they're set with prlimit() as soon as it returns. Since the
+ * server waits while the child execs, this happens before the interpreter has started running the script.
+ * @param[in] pid Process ID of the child
+ * @param[in] limits Bounds to apply (can be NULL)
+ * @param[in] with_cpu 1 if the CPU time must be limited too, 0 otherwise (for long-lived processes, whose CPU time
+ * accumulates over many scripts)
+ * @return \ref STATUS.SUCCESS if every limit was applied, \ref STATUS.ERROR otherwise
+ */
+STATUS cgi_limits_apply(pid_t pid, const struct cgi_limits *limits, int with_cpu);
+
+/**
+ * @brief Starts the thread that reaps finished scripts
+ * @details If this function isn't called, or it fails, scripts are waited for synchronously once their output ends.
+ * @return \ref STATUS.SUCCESS if the thread was started, \ref STATUS.ERROR otherwise
+ */
+STATUS cgi_init();
+
+/**
+ * @brief Makes sure that a child process is reaped once it finishes, without waiting for it
+ * @param[in] pid Process ID of the child
+ */
+void cgi_reap(pid_t pid);
+
+/**
+ * @brief Finds the absolute path of a command, searching in the PATH like execvp() does
+ * @details This is meant for resolving interpreters once at startup, so that running a script doesn't involve
+ * searching the PATH.
+ * @param[in] command The command to find
+ * @param[out] path Buffer where the path must be stored
+ * @param[in] path_len Size of the buffer
+ * @return \ref STATUS.SUCCESS if an executable file was found, \ref STATUS.ERROR otherwise
+ */
+STATUS cgi_find_command(const char *command, char *path, size_t path_len);
+
+/**
+ * @brief Executes the script in the request path using the provided command, passing arguments to it via stdin
+ * @details This function runs the provided command with the path as its first parameter. It then writes the
+ * querystring and the POST parameters to its standard input, while relaying its standard output to the socket as an
+ * HTTP response. Both things are done at once, so scripts can produce output before reading all of their input, and
+ * any amount of it.
+ * @param[out] socket The socket to which the response must be sent
+ * @param[in] headers Structure containing the headers for the response
+ * @param[in] request Request from which the data must be obtained
+ * @param[in] utils Structure containing utilities (used for logging)
+ * @param[in] exec_cmd Command to be used
+ * @param[in] fullpath Absolute path of the executable file in the system
+ * @param[in] limits Bounds of the script (can be NULL)
+ * @param[out] capture Where a copy of the response must be kept (can be NULL)
+ * @return code of the HTTP response sent to the socket, or \ref HTTP_RESPONSE_CODE.GATEWAY_TIMEOUT if the script was
+ * killed because of its timeout
+ */
+HTTP_RESPONSE_CODE cgi_run(int socket, struct httpres_headers *headers, struct request *request,
+                           struct _srvutils *utils, const char *exec_cmd, const char *fullpath,
+                           const struct cgi_limits *limits, struct cgi_capture *capture);
+
+#endif //PRACTICA1_CGI_H
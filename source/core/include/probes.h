@@ -0,0 +1,67 @@
+/**
+ * @file probes.h
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Static tracepoints (USDT) on the lifecycle of requests, for DTrace, SystemTap, bpftrace and perf
+ * @details Each probe compiles to a single nop instruction, plus a note in the binary that tells the tracers where it
+ * is and where its arguments are. Until a tracer attaches to it, the only cost is keeping the arguments in registers,
+ * so they're always cheap values (descriptors, sizes, thread IDs, pointers to existing strings). They all belong to
+ * the http_server provider, and their first arguments are the descriptor of the connection (or the PID of the script)
+ * and the ID of the calling thread:
+ *
+ * - accept(fd, tid)
+ * - queue_push(fd, tid) / queue_pop(fd, tid, microseconds waited)
+ * - parse_start(fd, tid) / parse_end(fd, tid, \ref parse_result, bytes of the header)
+ * - route(fd, tid, type of the target, path)
+ * - send_start(fd, tid, offset, length) / send_end(fd, tid, bytes sent, \ref STATUS)
+ * - cgi_spawn(pid, tid, path of the command) / cgi_exit(pid, tid, wait status)
+ * - close(fd, tid, bytes sent by the thread)
+ *
+ * For example, `bpftrace -e 'usdt:./server-main:http_server:send_end { @[arg3] = hist(arg2); }'`.
+ *
+ * The probes need the sys/sdt.h header of SystemTap (systemtap-sdt-dev or systemtap-sdt-devel). Without it, or if
+ * NO_PROBES is defined, they compile to nothing.
+ */
+
+#ifndef PRACTICA1_PROBES_H
+#define PRACTICA1_PROBES_H
+
+#if !defined(NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+
+#include <sys/sdt.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define PROBES_ENABLED 1 ///< Defined if the probes are compiled into the binary
+
+#endif
+#endif
+
+#ifdef PROBES_ENABLED
+
+/**
+ * @brief Returns the ID of the calling thread, as seen by the kernel and the tracers
+ * @details It's obtained once per thread, since the system call would be the most expensive part of a probe.
+ * @return The thread ID
+ */
+static inline long probe_tid(void) {
+    static _Thread_local long tid = 0;
+    if (!tid) tid = syscall(SYS_gettid);
+
+    return tid;
+}
+
+#define PROBE2(name, a1, a2) DTRACE_PROBE2(http_server, name, a1, a2) ///< Probe with two arguments
+#define PROBE3(name, a1, a2, a3) DTRACE_PROBE3(http_server, name, a1, a2, a3) ///< Probe with three arguments
+#define PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(http_server, name, a1, a2, a3, a4) ///< Probe with four arguments
+
+#else
+
+#define PROBE2(name, a1, a2) do {} while (0) ///< Probe with two arguments, which compiles to nothing
+#define PROBE3(name, a1, a2, a3) do {} while (0) ///< Probe with three arguments, which compiles to nothing
+#define PROBE4(name, a1, a2, a3, a4) do {} while (0) ///< Probe with four arguments, which compiles to nothing
+
+#endif
+
+#endif //PRACTICA1_PROBES_H
@@ -0,0 +1,76 @@
+/**
+ * @file tsc.h
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Reading the time stamp counter of the processor, to timestamp the phases of requests cheaply
+ * @details Reading the counter takes a few nanoseconds, without entering the kernel or even the vDSO, so requests can
+ * be timed in every phase without a noticeable cost. It can only replace the monotonic clock if it's invariant, which
+ * means that it ticks at the same rate whatever the frequency or sleep state of the cores. Its rate is measured
+ * against the monotonic clock when the program starts.
+ *
+ * On other architectures, or if the counter isn't invariant, tsc_available() returns 0 and callers keep using the
+ * monotonic clock.
+ */
+
+#ifndef PRACTICA1_TSC_H
+#define PRACTICA1_TSC_H
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <x86intrin.h>
+#include <cpuid.h>
+
+#endif
+
+/**
+ * @brief Returns the current value of the time stamp counter
+ * @return Cycles since an arbitrary moment, or 0 if there's no counter
+ */
+static inline uint64_t tsc_read(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Checks whether the time stamp counter ticks at a constant rate, so that it can be used as a clock
+ * @return 1 if it's invariant, 0 otherwise
+ */
+static inline int tsc_available(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0x80000000, NULL) < 0x80000007) return 0;
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+
+    return (edx >> 8) & 1; // Invariant TSC bit
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Measures the rate of the time stamp counter against the monotonic clock
+ * @details The calling thread sleeps during the measurement, so this should only be called once, at startup.
+ * @param[in] ms Milliseconds during which the counter is measured (longer is more precise)
+ * @return Cycles per second, or 0 if the counter can't be used as a clock
+ */
+static inline uint64_t tsc_calibrate(unsigned int ms) {
+    if (!tsc_available()) return 0;
+
+    struct timespec start, end, pause = {.tv_sec = ms / 1000, .tv_nsec = (long) (ms % 1000) * 1000000};
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t cycles = tsc_read();
+    nanosleep(&pause, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    cycles = tsc_read() - cycles;
+
+    int64_t ns = (int64_t) (end.tv_sec - start.tv_sec) * 1000000000 + (end.tv_nsec - start.tv_nsec);
+    return ns > 0 ? (uint64_t) ((double) cycles * 1e9 / (double) ns) : 0;
+}
+
+#endif //PRACTICA1_TSC_H
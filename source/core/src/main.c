@@ -16,7 +16,9 @@ int main(int argc, char *argv[]) {
 
     Server *server = server_init(project_path, (SERVERCMD (*)(int, const struct _srvutils *)) processHTTPRequest);
     if (server) {
-        server_start(server);
+        if (httpserver_init(server_get_utils(server)) == SUCCESS) {
+            server_start(server);
+        }
         server_free(server);
     }
 }
@@ -0,0 +1,446 @@
+/**
+ * @file fastcgi.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Implementation of the FastCGI client
+ * @details The idle connections of each upstream are kept in a stack protected by a mutex, so that the most recently
+ * used connection is reused first. A connection that was idle may have been closed by the application server in the
+ * meantime, so a request that fails on a reused connection before receiving anything is retried once on a new one.
+ */
+
+#include "fastcgi.h"
+#include "cgi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define FCGI_UNIX_PREFIX "unix:" ///< Prefix of the addresses of upstreams listening on a Unix socket
+#define FCGI_MAX_NAME 128 ///< Maximum length of a parameter name generated from a request header name
+
+/**
+ * @struct fcgi_upstream
+ * @brief Contains the address of an application server and the idle connections to it
+ */
+struct fcgi_upstream {
+    struct sockaddr_storage addr; ///< Address of the application server
+    socklen_t addr_len; ///< Length of the address
+    int *idle; ///< Stack of idle connections
+    int n_idle; ///< Number of idle connections
+    int max_idle; ///< Maximum number of idle connections
+    pthread_mutex_t mutex; ///< Mutex protecting the idle connections
+};
+
+/**
+ * @struct fcgi_response
+ * @brief State of the response built from the output of the application
+ */
+struct fcgi_response {
+    struct cgi_output out; ///< The response sent to the client
+    int client_gone; ///< 1 if the client can't receive more output
+};
+
+fcgi_upstream *fcgi_upstream_create(const char *address, int max_idle) {
+    if (!address) return NULL;
+
+    fcgi_upstream *upstream = calloc(1, sizeof(fcgi_upstream));
+    if (!upstream) return NULL;
+
+    if (strncmp(address, FCGI_UNIX_PREFIX, strlen(FCGI_UNIX_PREFIX)) == 0) {
+        struct sockaddr_un *addr = (struct sockaddr_un *) &upstream->addr;
+        const char *path = address + strlen(FCGI_UNIX_PREFIX);
+        if (strlen(path) >= sizeof(addr->sun_path)) {
+            free(upstream);
+            return NULL;
+        }
+
+        addr->sun_family = AF_UNIX;
+        strcpy(addr->sun_path, path);
+        upstream->addr_len = sizeof(struct sockaddr_un);
+    } else { // host:port
+        const char *colon = strrchr(address, ':');
+        if (!colon || colon == address) {
+            free(upstream);
+            return NULL;
+        }
+
+        char host[NI_MAXHOST];
+        snprintf(host, sizeof(host), "%.*s", (int) (colon - address), address);
+
+        struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM}, *res;
+        if (getaddrinfo(host, colon + 1, &hints, &res) != 0) {
+            free(upstream);
+            return NULL;
+        }
+        memcpy(&upstream->addr, res->ai_addr, res->ai_addrlen);
+        upstream->addr_len = res->ai_addrlen;
+        freeaddrinfo(res);
+    }
+
+    upstream->max_idle = max_idle > 0 ? max_idle : FCGI_DEFAULT_MAX_IDLE;
+    upstream->idle = calloc(upstream->max_idle, sizeof(int));
+    if (!upstream->idle) {
+        free(upstream);
+        return NULL;
+    }
+    pthread_mutex_init(&upstream->mutex, NULL);
+
+    return upstream;
+}
+
+void fcgi_upstream_free(fcgi_upstream *upstream) {
+    if (!upstream) return;
+
+    for (int i = 0; i < upstream->n_idle; i++) close(upstream->idle[i]);
+
+    pthread_mutex_destroy(&upstream->mutex);
+    free(upstream->idle);
+    free(upstream);
+}
+
+/**
+ * @brief Opens a new connection to an upstream
+ * @param[in] upstream The upstream
+ * @return The connected socket, or -1 if an error occurs
+ */
+int fcgi_connect(fcgi_upstream *upstream) {
+    int fd = socket(upstream->addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+
+    if (connect(fd, (struct sockaddr *) &upstream->addr, upstream->addr_len) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    if (upstream->addr.ss_family != AF_UNIX) { // Records are small and sent in pieces, so they mustn't be delayed
+        int flag = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Obtains a connection to an upstream, reusing an idle one if possible
+ * @param[in] upstream The upstream
+ * @param[out] reused Variable set to 1 if the connection was idle, 0 if it's new
+ * @return The connected socket, or -1 if an error occurs
+ */
+int fcgi_acquire(fcgi_upstream *upstream, int *reused) {
+    pthread_mutex_lock(&upstream->mutex);
+    if (upstream->n_idle > 0) {
+        int fd = upstream->idle[--upstream->n_idle];
+        pthread_mutex_unlock(&upstream->mutex);
+        *reused = 1;
+        return fd;
+    }
+    pthread_mutex_unlock(&upstream->mutex);
+
+    *reused = 0;
+    return fcgi_connect(upstream);
+}
+
+/**
+ * @brief Returns a connection to the idle connections of an upstream, or closes it
+ * @param[in] upstream The upstream
+ * @param[in] fd The connection
+ * @param[in] keep 1 if the connection can be reused, 0 if it must be closed
+ */
+void fcgi_release(fcgi_upstream *upstream, int fd, int keep) {
+    if (keep) {
+        pthread_mutex_lock(&upstream->mutex);
+        if (upstream->n_idle < upstream->max_idle) {
+            upstream->idle[upstream->n_idle++] = fd;
+            pthread_mutex_unlock(&upstream->mutex);
+            return;
+        }
+        pthread_mutex_unlock(&upstream->mutex);
+    }
+
+    close(fd);
+}
+
+/**
+ * @brief Sends a record to the application
+ * @param[in] fd Connection to the application
+ * @param[in] type Type of the record
+ * @param[in] content Content of the record (can be NULL if @p len is 0)
+ * @param[in] len Length of the content, which must be at most @ref FCGI_MAX_CONTENT
+ * @return \ref STATUS.SUCCESS if the record was sent, \ref STATUS.ERROR otherwise
+ */
+STATUS fcgi_send_record(int fd, unsigned char type, const void *content, size_t len) {
+    unsigned char header[FCGI_HEADER_LEN] = {FCGI_VERSION_1, type, 0, FCGI_REQUEST_ID,
+                                             (unsigned char) (len >> 8), (unsigned char) (len & 0xff), 0, 0};
+
+    if (send_all(fd, header, sizeof(header), len > 0 ? MSG_MORE : 0) == -1) return ERROR;
+    if (len > 0 && send_all(fd, content, len, 0) == -1) return ERROR;
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Sends a stream (the parameters or the body) to the application, split in records, and its closing record
+ * @param[in] fd Connection to the application
+ * @param[in] type Type of the records
+ * @param[in] data Contents of the stream
+ * @param[in] len Length of the contents
+ * @return \ref STATUS.SUCCESS if everything was sent, \ref STATUS.ERROR otherwise
+ */
+STATUS fcgi_send_stream(int fd, unsigned char type, const char *data, size_t len) {
+    while (len > 0) {
+        size_t piece = len < FCGI_MAX_CONTENT ? len : FCGI_MAX_CONTENT;
+        if (fcgi_send_record(fd, type, data, piece) == ERROR) return ERROR;
+        data += piece;
+        len -= piece;
+    }
+
+    return fcgi_send_record(fd, type, NULL, 0); // An empty record closes the stream
+}
+
+/**
+ * @brief Appends a length in the name-value pair encoding of FastCGI (one byte if it's small, four otherwise)
+ * @param[out] buf Buffer where the length must be written
+ * @param[in] len The length
+ * @return Number of bytes written
+ */
+size_t fcgi_encode_length(unsigned char *buf, size_t len) {
+    if (len < 128) {
+        buf[0] = (unsigned char) len;
+        return 1;
+    }
+
+    buf[0] = (unsigned char) ((len >> 24) | 0x80);
+    buf[1] = (unsigned char) (len >> 16);
+    buf[2] = (unsigned char) (len >> 8);
+    buf[3] = (unsigned char) len;
+    return 4;
+}
+
+/**
+ * @brief Appends a parameter to the parameters of a request
+ * @param[out] buf Buffer containing the parameters
+ * @param[in,out] pos Length of the parameters, which is advanced past the new one
+ * @param[in] name Name of the parameter
+ * @param[in] name_len Length of the name
+ * @param[in] value Value of the parameter
+ * @param[in] value_len Length of the value
+ * @return \ref STATUS.SUCCESS if the parameter was added, \ref STATUS.ERROR if it doesn't fit
+ */
+STATUS fcgi_add_param(unsigned char *buf, size_t *pos, const char *name, size_t name_len, const char *value,
+                      size_t value_len) {
+    if (*pos + 8 + name_len + value_len > FCGI_MAX_PARAMS) return ERROR;
+
+    *pos += fcgi_encode_length(buf + *pos, name_len);
+    *pos += fcgi_encode_length(buf + *pos, value_len);
+    memcpy(buf + *pos, name, name_len);
+    *pos += name_len;
+    memcpy(buf + *pos, value, value_len);
+    *pos += value_len;
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Builds the CGI parameters of a request
+ * @param[out] buf Buffer of @ref FCGI_MAX_PARAMS bytes where the parameters must be written
+ * @param[in] request The request
+ * @param[in] document_root The webroot of the server
+ * @param[in] fullpath Absolute path of the script
+ * @return Length of the parameters
+ */
+size_t fcgi_build_params(unsigned char *buf, const struct request *request, const char *document_root,
+                         const char *fullpath) {
+    size_t pos = 0;
+    char value[MAX_BUFFER];
+
+#define ADD_PARAM(name, val) fcgi_add_param(buf, &pos, name, strlen(name), val, strlen(val))
+    ADD_PARAM("GATEWAY_INTERFACE", "CGI/1.1");
+    ADD_PARAM("SERVER_SOFTWARE", "httpServer");
+    snprintf(value, sizeof(value), "HTTP/1.%i", request->minor_version);
+    ADD_PARAM("SERVER_PROTOCOL", value);
+    ADD_PARAM("REQUEST_METHOD", request->method);
+    ADD_PARAM("SCRIPT_FILENAME", fullpath);
+    ADD_PARAM("SCRIPT_NAME", request->path);
+    ADD_PARAM("DOCUMENT_ROOT", document_root);
+    ADD_PARAM("QUERY_STRING", request->querystring ? request->querystring : "");
+    if (request->querystring) {
+        snprintf(value, sizeof(value), "%s?%s", request->path, request->querystring);
+    } else {
+        snprintf(value, sizeof(value), "%s", request->path);
+    }
+    ADD_PARAM("REQUEST_URI", value);
+    if (request->body) {
+        snprintf(value, sizeof(value), "%lu", request->body_len);
+        ADD_PARAM("CONTENT_LENGTH", value);
+    }
+#undef ADD_PARAM
+
+    // Request headers are passed as HTTP_<NAME>, except the ones that have their own parameter
+    for (size_t i = 0; i < request->num_headers; i++) {
+        const struct phr_header *header = &request->headers[i];
+        if (!header->name || header->name_len + strlen("HTTP_") >= FCGI_MAX_NAME) continue;
+
+        char name[FCGI_MAX_NAME];
+        size_t name_len;
+        if (header->name_len == strlen(HDR_CONTENT_TYPE) &&
+            strncasecmp(header->name, HDR_CONTENT_TYPE, header->name_len) == 0) {
+            name_len = (size_t) snprintf(name, sizeof(name), "CONTENT_TYPE");
+        } else if ((header->name_len == strlen(HDR_CONTENT_LENGTH) &&
+                    strncasecmp(header->name, HDR_CONTENT_LENGTH, header->name_len) == 0) ||
+                   (header->name_len == strlen("Proxy") && strncasecmp(header->name, "Proxy", header->name_len) == 0)) {
+            continue; // As HTTP_PROXY, Proxy would make applications send their own requests through it (httpoxy)
+        } else {
+            name_len = (size_t) snprintf(name, sizeof(name), "HTTP_");
+            for (size_t j = 0; j < header->name_len; j++) {
+                name[name_len++] = header->name[j] == '-' ? '_' : (char) toupper((unsigned char) header->name[j]);
+            }
+        }
+
+        // Headers that don't fit are left out, as the rest of the request can still be served
+        fcgi_add_param(buf, &pos, name, name_len, header->value, header->value_len);
+    }
+
+    return pos;
+}
+
+/**
+ * @brief Processes a piece of the standard output of the application
+ * @details The CGI headers at its beginning are parsed by the @ref cgi_output functions, exactly like the ones of the
+ * scripts run by the server itself.
+ * @param[in,out] response The response
+ * @param[in] data The piece of output
+ * @param[in] len Length of the piece
+ */
+void fcgi_output(struct fcgi_response *response, const char *data, size_t len) {
+    if (response->client_gone) return; // The rest of the output is discarded
+
+    if (cgi_output_relay(&response->out, data, len) == ERROR) response->client_gone = 1;
+}
+
+/**
+ * @brief Writes the error output of the application to the server log, one entry per line
+ * @param[in] utils Structure containing the server utilities (for logging)
+ * @param[in] fullpath Absolute path of the script, which the entries start with
+ * @param[in] data Content of an FCGI_STDERR record
+ * @param[in] len Length of the content
+ */
+void fcgi_log_stderr(const struct _srvutils *utils, const char *fullpath, const char *data, size_t len) {
+    const char *end = data + len;
+    while (data < end) {
+        const char *newline = memchr(data, '\n', (size_t) (end - data));
+        const char *line_end = newline ? newline : end;
+
+        if (line_end > data) utils->log(stderr, "%s: %.*s", fullpath, (int) (line_end - data), data);
+        data = line_end + 1;
+    }
+}
+
+/**
+ * @brief Runs a request through a connection, relaying the output of the application until the end of the request
+ * @param[in] fd Connection to the application
+ * @param[in,out] response The response
+ * @param[in] request The request
+ * @param[in] utils Structure containing the server utilities (for logging the error output of the application)
+ * @param[in] fullpath Absolute path of the script
+ * @param[in] params The parameters of the request
+ * @param[in] params_len Length of the parameters
+ * @param[in] deadline Moment by which the request must have ended
+ * @param[out] received Variable set to 1 once anything has been received from the application
+ * @return \ref STATUS.SUCCESS if the request ended normally, \ref STATUS.ERROR if the connection failed or the
+ * application ran out of time
+ */
+STATUS fcgi_execute(int fd, struct fcgi_response *response, const struct request *request,
+                    const struct _srvutils *utils, const char *fullpath, const unsigned char *params,
+                    size_t params_len, const struct timespec *deadline, int *received) {
+    unsigned char begin[8] = {0, FCGI_RESPONDER, FCGI_KEEP_CONN};
+
+    if (fcgi_send_record(fd, FCGI_BEGIN_REQUEST, begin, sizeof(begin)) == ERROR ||
+        fcgi_send_stream(fd, FCGI_PARAMS, (const char *) params, params_len) == ERROR ||
+        fcgi_send_stream(fd, FCGI_STDIN, request->body, request->body ? request->body_len : 0) == ERROR) {
+        return ERROR;
+    }
+
+    char buf[FCGI_MAX_CONTENT + 255]; // Content and padding of the biggest record
+    while (1) {
+        unsigned char header[FCGI_HEADER_LEN];
+        if (cgi_recv_all(fd, header, sizeof(header), deadline) == ERROR) return ERROR;
+        *received = 1;
+
+        size_t content_len = ((size_t) header[4] << 8) | header[5];
+        size_t record_len = content_len + header[6]; // The padding is received and discarded with the content
+        if (cgi_recv_all(fd, buf, record_len, deadline) == ERROR) return ERROR;
+
+        switch (header[1]) {
+            case FCGI_STDOUT:
+                fcgi_output(response, buf, content_len);
+                break;
+            case FCGI_STDERR:
+                fcgi_log_stderr(utils, fullpath, buf, content_len);
+                break;
+            case FCGI_END_REQUEST:
+                return SUCCESS;
+            default: // Other records aren't expected, and can be safely ignored
+                break;
+        }
+    }
+}
+
+HTTP_RESPONSE_CODE fcgi_run(fcgi_upstream *upstream, int socket, struct httpres_headers *headers,
+                            struct request *request, const struct _srvutils *utils, const char *fullpath,
+                            const struct cgi_limits *limits, struct cgi_capture *capture) {
+    if (!upstream || !headers || !request || !utils || !fullpath) {
+        return respond(socket, INTERNAL_ERROR, "Internal error", NULL, NULL, 0);
+    }
+
+    unsigned char params[FCGI_MAX_PARAMS];
+    size_t params_len = fcgi_build_params(params, request, utils->webroot, fullpath);
+
+    struct fcgi_response *response = calloc(1, sizeof(struct fcgi_response));
+    if (!response) return respond(socket, INTERNAL_ERROR, "Internal error", headers, NULL, 0);
+    cgi_output_init(&response->out, socket, headers, request, capture);
+
+    struct timespec deadline;
+    cgi_deadline_init(&deadline, limits);
+
+    // A reused connection may have been closed by the application, which is only noticed when using it
+    STATUS ret = ERROR;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int reused, received = 0;
+        int fd = fcgi_acquire(upstream, &reused);
+        if (fd == -1) break;
+
+        ret = fcgi_execute(fd, response, request, utils, fullpath, params, params_len, &deadline, &received);
+        fcgi_release(upstream, fd, ret == SUCCESS); // Closing it aborts a request that ran out of time
+
+        if (ret == ERROR && cgi_deadline_left(&deadline) == 0) {
+            HTTP_RESPONSE_CODE code = cgi_output_timeout(&response->out);
+            free(response);
+            return code;
+        }
+
+        if (ret == SUCCESS || received || !reused) break;
+    }
+
+    HTTP_RESPONSE_CODE code;
+    // Output that ended in the middle of the headers still makes a response, unless the connection broke
+    if (ret == SUCCESS && !response->client_gone) cgi_output_end(&response->out);
+    if (response->out.started) {
+        cgi_output_finish(&response->out);
+        code = response->out.code;
+    } else {
+        code = respond(socket, BAD_GATEWAY, "Bad Gateway", headers, NULL, 0);
+    }
+
+    free(response);
+    return code;
+}
\ No newline at end of file
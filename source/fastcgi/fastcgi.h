@@ -0,0 +1,82 @@
+/**
+ * @file fastcgi.h
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief FastCGI client, for running scripts in external application servers such as php-fpm
+ * @details Each upstream application server is represented by an @ref fcgi_upstream, which keeps a pool of idle
+ * connections to it. Requests ask the application server to keep the connection open, so that the next request can
+ * reuse it instead of connecting again.
+ *
+ * The parameters and the body of the request are sent to the application server, and its standard output is relayed
+ * to the client as it arrives, after parsing the CGI headers at its beginning. Connections aren't multiplexed: php-fpm
+ * and most other application servers don't support it (they answer FCGI_MPXS_CONNS with 0), so each connection
+ * carries a single request at a time, and concurrency comes from having several connections.
+ * @see https://fast-cgi.github.io/spec
+ */
+
+#ifndef PRACTICA1_FASTCGI_H
+#define PRACTICA1_FASTCGI_H
+
+#include "httputils.h"
+#include "cgi.h"
+#include "constants.h"
+
+#define FCGI_VERSION_1 1 ///< Version of the FastCGI protocol
+#define FCGI_HEADER_LEN 8 ///< Length of the header of a record
+#define FCGI_MAX_CONTENT 65535 ///< Maximum length of the content of a record
+#define FCGI_REQUEST_ID 1 ///< Request ID used in every connection, as they carry a single request at a time
+
+#define FCGI_BEGIN_REQUEST 1 ///< Record type starting a request
+#define FCGI_END_REQUEST 3 ///< Record type ending a request
+#define FCGI_PARAMS 4 ///< Record type carrying parameters of a request
+#define FCGI_STDIN 5 ///< Record type carrying the body of a request
+#define FCGI_STDOUT 6 ///< Record type carrying the output of the application
+#define FCGI_STDERR 7 ///< Record type carrying the error output of the application
+
+#define FCGI_RESPONDER 1 ///< Role of the application in a normal request
+#define FCGI_KEEP_CONN 1 ///< Flag asking the application to keep the connection open after the request
+
+#define FCGI_MAX_PARAMS (4 * 1024) ///< Maximum length of the parameters of a request
+#define FCGI_DEFAULT_MAX_IDLE 16 ///< Default maximum number of idle connections kept for each upstream
+
+/**
+ * @brief The FastCGI upstream type
+ */
+typedef struct fcgi_upstream fcgi_upstream;
+
+/**
+ * @brief Creates an upstream application server
+ * @details No connection is made until the first request.
+ * @param[in] address Address of the application server: "unix:/path/to/socket", or "host:port" for TCP
+ * @param[in] max_idle Maximum number of idle connections kept open
+ * @return The new upstream, or NULL if an error occurs or the address is invalid
+ */
+fcgi_upstream *fcgi_upstream_create(const char *address, int max_idle);
+
+/**
+ * @brief Closes the idle connections of an upstream and frees it
+ * @pre No requests can be running in the upstream
+ * @param[in] upstream The upstream to free
+ */
+void fcgi_upstream_free(fcgi_upstream *upstream);
+
+/**
+ * @brief Runs a script in an upstream application server, relaying its output to the socket as an HTTP response
+ * @param[in] upstream The upstream that must run the script
+ * @param[out] socket The socket to which the response must be sent
+ * @param[in] headers Structure containing the headers for the response
+ * @param[in] request The request
+ * @param[in] utils Structure containing the server utilities (for the webroot, and for logging the error output of the
+ * application)
+ * @param[in] fullpath Absolute path of the script
+ * @param[in] limits Bounds of the script (can be NULL). Only the timeout applies, after which the connection to the
+ * application is closed, which makes it abort the request.
+ * @param[out] capture Where a copy of the response must be kept (can be NULL)
+ * @return code of the HTTP response sent to the socket, or \ref HTTP_RESPONSE_CODE.GATEWAY_TIMEOUT if the application
+ * didn't finish before the timeout
+ */
+HTTP_RESPONSE_CODE fcgi_run(fcgi_upstream *upstream, int socket, struct httpres_headers *headers,
+                            struct request *request, const struct _srvutils *utils, const char *fullpath,
+                            const struct cgi_limits *limits, struct cgi_capture *capture);
+
+#endif //PRACTICA1_FASTCGI_H
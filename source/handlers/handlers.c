@@ -0,0 +1,362 @@
+/**
+ * @file handlers.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Implementation of the registry of handlers
+ * @details The handlers are kept in an array, so that they can be referred to by their index (which is what the path
+ * cache stores for each script). Extensions are keys of a uthash table pointing to those indexes, while path prefixes
+ * are kept in a list sorted from the longest to the shortest one, so that the first match is the most specific one.
+ * @see https://troydhanson.github.io/uthash/
+ */
+
+#include "uthash.h"
+#include "handlers.h"
+#include "cgi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/**
+ * @brief Names of the kinds of handlers, in the order of @ref HANDLER_KIND
+ */
+const char *handler_kind_names[] = {"cgi", "pool", "fastcgi", "plugin"};
+
+/**
+ * @struct handler_key
+ * @brief Entry of the hash table of extensions
+ */
+struct handler_key {
+    char *extension; ///< Extension, without its dot, which acts as the key
+    int index; ///< Index of the handler
+    struct UT_hash_handle hh; ///< Handle to be used by @a uthash
+};
+
+/**
+ * @struct handler_prefix
+ * @brief Element of the list of path prefixes
+ */
+struct handler_prefix {
+    const char *prefix; ///< The prefix (owned by the handler)
+    size_t len; ///< Length of the prefix
+    int index; ///< Index of the handler
+    struct handler_prefix *next; ///< Next prefix, which isn't longer than this one
+};
+
+/**
+ * @struct handler_table
+ * @brief Contains the handlers and the structures used to find them
+ */
+struct handler_table {
+    struct handler **handlers; ///< Array of handlers
+    int n_handlers; ///< Number of handlers
+    struct handler_key *extensions; ///< Hash table of extensions
+    struct handler_prefix *prefixes; ///< List of path prefixes, from the longest to the shortest one
+};
+
+handler_table *handlers_create() {
+    return calloc(1, sizeof(handler_table));
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "hicpp-signed-bitwise"
+#pragma ide diagnostic ignored "hicpp-multiway-paths-covered"
+
+/**
+ * @brief Frees a handler
+ * @param[in] handler The handler to free
+ */
+void handler_free(struct handler *handler) {
+    if (handler->max_concurrency > 0) sem_destroy(&handler->slots);
+    free(handler->selector);
+    free(handler->shim);
+    free(handler);
+}
+
+/**
+ * @brief Binds a selector to the index of a handler
+ * @param[in,out] table The registry
+ * @param[in] selector The selector, owned by the handler
+ * @param[in] index Index of the handler
+ * @return \ref STATUS.SUCCESS if it was bound, \ref STATUS.ERROR if it's already bound or an error occurs
+ */
+STATUS handlers_bind(handler_table *table, const char *selector, int index) {
+    if (selector[0] == '.') { // ".py"
+        struct handler_key *key = NULL;
+        HASH_FIND_STR(table->extensions, selector + 1, key);
+        if (key || !(key = calloc(1, sizeof(struct handler_key)))) return ERROR;
+
+        if (!(key->extension = strdup(selector + 1))) {
+            free(key);
+            return ERROR;
+        }
+        key->index = index;
+        HASH_ADD_KEYPTR(hh, table->extensions, key->extension, strlen(key->extension), key);
+        return SUCCESS;
+    }
+
+    // "/cgi-bin/"
+    struct handler_prefix **pos = &table->prefixes;
+    size_t len = strlen(selector);
+    while (*pos && (*pos)->len >= len) {
+        if (strcmp((*pos)->prefix, selector) == 0) return ERROR;
+        pos = &(*pos)->next;
+    }
+
+    struct handler_prefix *prefix = calloc(1, sizeof(struct handler_prefix));
+    if (!prefix) return ERROR;
+    prefix->prefix = selector;
+    prefix->len = len;
+    prefix->index = index;
+    prefix->next = *pos;
+    *pos = prefix;
+
+    return SUCCESS;
+}
+
+void handler_options_init(struct handler_options *options) {
+    memset(options, 0, sizeof(struct handler_options));
+    options->max_queue = HANDLER_UNLIMITED_QUEUE;
+    options->limits.timeout = HANDLER_DEFAULT_TIMEOUT;
+}
+
+STATUS handlers_add(handler_table *table, const char *selector, HANDLER_KIND kind, const char *target,
+                    const struct handler_options *options) {
+    if (!table || !selector || !target || (selector[0] != '.' && selector[0] != '/') || selector[1] == '\0') {
+        return ERROR;
+    }
+
+    struct handler_options defaults;
+    if (!options) {
+        handler_options_init(&defaults);
+        options = &defaults;
+    }
+    if (kind == HANDLER_POOL && !options->shim) return ERROR;
+
+    struct handler *handler = calloc(1, sizeof(struct handler));
+    if (!handler) return ERROR;
+
+    handler->kind = kind;
+    handler->max_concurrency = options->max_concurrency > 0 ? options->max_concurrency : 0;
+    handler->max_queue = options->max_queue >= 0 ? options->max_queue : HANDLER_UNLIMITED_QUEUE;
+    handler->limits = options->limits;
+    atomic_init(&handler->waiting, 0);
+    atomic_init(&handler->timeouts, 0);
+    atomic_init(&handler->rejections, 0);
+    handler->selector = strdup(selector);
+    handler->shim = options->shim ? strdup(options->shim) : NULL;
+    if (!handler->selector || (options->shim && !handler->shim) ||
+        (handler->max_concurrency > 0 && sem_init(&handler->slots, 0, handler->max_concurrency) != 0)) {
+        handler->max_concurrency = 0; // So that the semaphore isn't destroyed
+        handler_free(handler);
+        return ERROR;
+    }
+
+    // Interpreters are searched only once, so running a script never involves a PATH search
+    if (kind == HANDLER_FASTCGI || kind == HANDLER_PLUGIN ||
+        cgi_find_command(target, handler->target, sizeof(handler->target)) == ERROR) {
+        snprintf(handler->target, sizeof(handler->target), "%s", target);
+    }
+
+    struct handler **handlers = realloc(table->handlers, (table->n_handlers + 1) * sizeof(struct handler *));
+    if (!handlers) {
+        handler_free(handler);
+        return ERROR;
+    }
+    table->handlers = handlers;
+
+    if (handlers_bind(table, handler->selector, table->n_handlers) == ERROR) {
+        handler_free(handler);
+        return ERROR;
+    }
+    table->handlers[table->n_handlers++] = handler;
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Parses a line of the handlers file and adds the handler it describes
+ * @param[in,out] table The registry
+ * @param[in] line The line, without its terminator (it's modified)
+ * @param[in] project_root Path of the root folder of the project, for relative shim and plugin paths
+ * @return \ref STATUS.SUCCESS if the handler was added, \ref STATUS.ERROR otherwise
+ */
+STATUS handlers_parse_line(handler_table *table, char *line, const char *project_root) {
+    char *saveptr = NULL;
+    char *selector = strtok_r(line, "\t", &saveptr);
+    char *kind_name = strtok_r(NULL, "\t", &saveptr);
+    char *target = strtok_r(NULL, "\t", &saveptr);
+    char *options = strtok_r(NULL, "\t", &saveptr);
+    if (!selector || !kind_name || !target) return ERROR;
+
+    int kind = -1;
+    for (int i = 0; i < (int) (sizeof(handler_kind_names) / sizeof(handler_kind_names[0])); i++) {
+        if (strcmp(kind_name, handler_kind_names[i]) == 0) kind = i;
+    }
+    if (kind == -1) return ERROR;
+
+    struct handler_options settings;
+    handler_options_init(&settings);
+    char shim[PATH_MAX] = "";
+    for (char *option = options ? strtok_r(options, " ", &saveptr) : NULL; option;
+         option = strtok_r(NULL, " ", &saveptr)) {
+        char *value = strchr(option, '=');
+        if (!value) return ERROR;
+        *value++ = '\0';
+
+        char *end;
+        long number = strtol(value, &end, 10);
+        int is_number = *value != '\0' && *end == '\0' && number >= 0 && number <= INT_MAX;
+
+        if (strcmp(option, "shim") == 0) {
+            snprintf(shim, sizeof(shim), "%s%s", value[0] == '/' ? "" : project_root, value);
+            settings.shim = shim;
+        } else if (!is_number) {
+            return ERROR;
+        } else if (strcmp(option, "max") == 0) {
+            settings.max_concurrency = (int) number;
+        } else if (strcmp(option, "queue") == 0) {
+            settings.max_queue = (int) number;
+        } else if (strcmp(option, "timeout") == 0) {
+            settings.limits.timeout = (int) number;
+        } else if (strcmp(option, "cpu") == 0) {
+            settings.limits.cpu = number;
+        } else if (strcmp(option, "memory") == 0) {
+            settings.limits.memory = number;
+        } else if (strcmp(option, "files") == 0) {
+            settings.limits.files = number;
+        } else {
+            return ERROR;
+        }
+    }
+
+    char plugin_path[PATH_MAX];
+    if (kind == HANDLER_PLUGIN && target[0] != '/') {
+        snprintf(plugin_path, sizeof(plugin_path), "%s%s", project_root, target);
+        target = plugin_path;
+    }
+
+    return handlers_add(table, selector, (HANDLER_KIND) kind, target, &settings);
+}
+
+handler_table *handlers_load(const char *filename, const char *project_root) {
+    if (!filename || !project_root) return NULL;
+
+    FILE *file = fopen(filename, "re");
+    if (!file) {
+#if DEBUG >= 1
+        printf("Error while opening the handlers file: %s\n", strerror(errno));
+#endif
+        return NULL;
+    }
+
+    handler_table *table = handlers_create();
+    if (!table) {
+        fclose(file);
+        return NULL;
+    }
+
+    char line[MAX_HANDLER_LINE];
+    int line_n = 0, errors = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_n++;
+        line[strcspn(line, "\r\n")] = '\0'; // Remove the line terminator
+        if (line[0] == '\0' || line[0] == '#') continue; // Skip empty lines and comments
+
+        if (handlers_parse_line(table, line, project_root) == ERROR) {
+            printf("Error in line %i of the handlers file\n", line_n);
+            errors++;
+        }
+    }
+    fclose(file);
+
+    if (errors > 0) {
+        handlers_free(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+void handlers_free(handler_table *table) {
+    if (!table) return;
+
+    struct handler_key *key, *tmp;
+    HASH_ITER(hh, table->extensions, key, tmp) {
+        HASH_DEL(table->extensions, key);
+        free(key->extension);
+        free(key);
+    }
+
+    struct handler_prefix *prefix = table->prefixes;
+    while (prefix) {
+        struct handler_prefix *next = prefix->next;
+        free(prefix);
+        prefix = next;
+    }
+
+    for (int i = 0; i < table->n_handlers; i++) handler_free(table->handlers[i]);
+    free(table->handlers);
+    free(table);
+}
+
+int handlers_find(const handler_table *table, const char *path, const char *fullpath) {
+    if (!table) return HANDLER_NONE;
+
+    if (path) {
+        for (const struct handler_prefix *prefix = table->prefixes; prefix; prefix = prefix->next) {
+            if (strncmp(path, prefix->prefix, prefix->len) == 0) return prefix->index;
+        }
+    }
+
+    if (!fullpath) return HANDLER_NONE;
+
+    const char *name = strrchr(fullpath, '/'); // A dot in a directory name isn't an extension
+    const char *ext = strrchr(name ? name : fullpath, '.');
+    if (!ext) return HANDLER_NONE;
+
+    struct handler_key *key = NULL;
+    HASH_FIND_STR(table->extensions, ext + 1, key);
+    return key ? key->index : HANDLER_NONE;
+}
+
+#pragma clang diagnostic pop
+
+struct handler *handlers_get(const handler_table *table, int index) {
+    if (!table || index < 0 || index >= table->n_handlers) return NULL;
+
+    return table->handlers[index];
+}
+
+int handlers_count(const handler_table *table) {
+    if (!table) return -1;
+
+    return table->n_handlers;
+}
+
+STATUS handler_acquire(struct handler *handler) {
+    if (handler->max_concurrency == 0 || sem_trywait(&handler->slots) == 0) return SUCCESS;
+
+    // The request has to wait, as long as there's room for it in the queue
+    if (atomic_fetch_add(&handler->waiting, 1) >= handler->max_queue && handler->max_queue != HANDLER_UNLIMITED_QUEUE) {
+        atomic_fetch_sub(&handler->waiting, 1);
+        atomic_fetch_add(&handler->rejections, 1);
+        return ERROR;
+    }
+
+    while (sem_wait(&handler->slots) == -1 && errno == EINTR); // Retry if interrupted by a signal
+    atomic_fetch_sub(&handler->waiting, 1);
+
+    return SUCCESS;
+}
+
+void handler_release(struct handler *handler) {
+    if (handler->max_concurrency == 0) return;
+
+    sem_post(&handler->slots);
+}
+
+const char *handler_kind_name(HANDLER_KIND kind) {
+    return handler_kind_names[kind];
+}
\ No newline at end of file
@@ -0,0 +1,177 @@
+/**
+ * @file handlers.h
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Registry of the handlers that produce the responses for dynamic content
+ * @details Each handler is bound to a selector, which is either a file extension (".py") or a request path prefix
+ * ("/cgi-bin/"), and says how the matching scripts are run:
+ * - @ref HANDLER_CGI: in a new process of an interpreter
+ * - @ref HANDLER_POOL: in a pool of persistent processes of an interpreter, running a shim script
+ * - @ref HANDLER_FASTCGI: in an external FastCGI application server
+ * - @ref HANDLER_PLUGIN: by a native plugin, inside the server itself (the request path doesn't need to be a file)
+ *
+ * The registry is built once at startup, either from a file or by the server itself, and everything that can be
+ * resolved in advance is: interpreters are searched in the PATH only then, and extensions are stored in a hash table,
+ * so that finding the handler of a request doesn't involve comparing strings one by one.
+ *
+ * Handlers can limit the number of requests they run at once, so that a burst of requests to one kind of script
+ * doesn't start an unbounded number of processes, and the number of requests waiting for a turn, beyond which requests
+ * are rejected at once instead of tying up the threads of the server. Their scripts are bounded by a timeout and by
+ * resource limits, so that a misbehaving script can't hold a thread or the machine forever.
+ */
+
+#ifndef PRACTICA1_HANDLERS_H
+#define PRACTICA1_HANDLERS_H
+
+#include <limits.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include "cgi.h"
+#include "constants.h"
+
+#define MAX_HANDLER_LINE 1024 ///< Maximum length of a line of the handlers file
+#define HANDLER_NONE (-1) ///< Index returned when no handler matches
+#define HANDLER_UNLIMITED_QUEUE (-1) ///< Queue length of the handlers whose requests always wait for a turn
+#define HANDLER_DEFAULT_TIMEOUT 30 ///< Seconds scripts can run by default before being stopped
+
+/**
+ * @brief Ways of running the scripts of a handler
+ */
+typedef enum _HANDLER_KIND {
+    HANDLER_CGI, ///< A new interpreter process for each request
+    HANDLER_POOL, ///< A pool of persistent interpreter processes
+    HANDLER_FASTCGI, ///< An external FastCGI application server
+    HANDLER_PLUGIN ///< A native plugin loaded by the server
+} HANDLER_KIND;
+
+/**
+ * @struct handler
+ * @brief Stores how the scripts bound to a selector are run
+ */
+struct handler {
+    char *selector; ///< Extension (with its dot) or request path prefix the handler is bound to
+    HANDLER_KIND kind; ///< Way of running the scripts
+    char target[PATH_MAX]; ///< Absolute path of the interpreter or plugin, or address of the FastCGI server
+    char *shim; ///< Absolute path of the script run by the workers of a pool (NULL for other kinds)
+    int max_concurrency; ///< Maximum number of requests run at once (0 for no limit)
+    int max_queue; ///< Maximum number of requests waiting for a slot, or @ref HANDLER_UNLIMITED_QUEUE
+    struct cgi_limits limits; ///< Bounds of the scripts
+    sem_t slots; ///< Free slots for running requests, if the concurrency is limited
+    atomic_int waiting; ///< Number of requests waiting for a slot
+    atomic_ulong timeouts; ///< Number of requests whose script was stopped because of the timeout
+    atomic_ulong rejections; ///< Number of requests rejected because the queue was full
+    void *backend; ///< Pool, FastCGI upstream or plugin created for the handler by its user, or NULL
+};
+
+/**
+ * @struct handler_options
+ * @brief Optional settings of a handler
+ */
+struct handler_options {
+    const char *shim; ///< Absolute path of the script run by the workers of a pool (NULL for other kinds)
+    int max_concurrency; ///< Maximum number of requests run at once (0 for no limit)
+    int max_queue; ///< Maximum number of requests waiting for a slot, or @ref HANDLER_UNLIMITED_QUEUE
+    struct cgi_limits limits; ///< Bounds of the scripts
+};
+
+/**
+ * @brief The handler registry type
+ */
+typedef struct handler_table handler_table;
+
+/**
+ * @brief Creates an empty handler registry
+ * @return The new registry, or NULL if an error occurs
+ */
+handler_table *handlers_create();
+
+/**
+ * @brief Fills the options of a handler with their default values
+ * @details By default, the concurrency and the queue are unlimited, scripts are stopped after
+ * @ref HANDLER_DEFAULT_TIMEOUT seconds and their resources aren't limited.
+ * @param[out] options The options
+ */
+void handler_options_init(struct handler_options *options);
+
+/**
+ * @brief Adds a handler to a registry
+ * @details The interpreters of CGI and pool handlers are searched in the PATH if they aren't paths. If they can't be
+ * found, the handler is still added, so that its scripts are never sent as plain files, but they fail when run.
+ * @param[in,out] table The registry
+ * @param[in] selector Extension (".py") or request path prefix ("/cgi-bin/") of the scripts
+ * @param[in] kind Way of running the scripts
+ * @param[in] target Interpreter (for CGI and pool handlers), address of the FastCGI server or path of the plugin
+ * @param[in] options Optional settings (NULL for the default ones)
+ * @return \ref STATUS.SUCCESS if it was added, \ref STATUS.ERROR if the selector is invalid or repeated, or an error
+ * occurs
+ */
+STATUS handlers_add(handler_table *table, const char *selector, HANDLER_KIND kind, const char *target,
+                    const struct handler_options *options);
+
+/**
+ * @brief Loads a handler registry from a file
+ * @details Each line contains a selector, a kind (cgi, pool, fastcgi or plugin), its target and, optionally, a space
+ * separated list of options, separated by tabs. The options are shim=path for pools, max=N for the concurrency limit,
+ * queue=N for the maximum number of waiting requests, timeout=S for the seconds scripts can run (0 for no limit), and
+ * cpu=S, memory=MB and files=N for their resource limits. Empty lines and lines starting with # are ignored. Relative
+ * shim and plugin paths are relative to the project root.
+ * @param[in] filename Path of the file
+ * @param[in] project_root Path of the root folder of the project, ending with a slash
+ * @return The new registry, or NULL if the file can't be read or contains errors
+ */
+handler_table *handlers_load(const char *filename, const char *project_root);
+
+/**
+ * @brief Frees all the memory associated with a registry
+ * @details The backends of the handlers must have been freed by their user.
+ * @param[in] table The registry to free
+ */
+void handlers_free(handler_table *table);
+
+/**
+ * @brief Finds the handler that must run a request
+ * @details Path prefixes take precedence over extensions, and longer prefixes over shorter ones.
+ * @param[in] table The registry
+ * @param[in] path The request path
+ * @param[in] fullpath Full path of the file the request resolves to
+ * @return Index of the handler, or \ref HANDLER_NONE if the file isn't a script
+ */
+int handlers_find(const handler_table *table, const char *path, const char *fullpath);
+
+/**
+ * @brief Returns a handler of a registry
+ * @param[in] table The registry
+ * @param[in] index Index of the handler
+ * @return The handler, or NULL if the index is out of range
+ */
+struct handler *handlers_get(const handler_table *table, int index);
+
+/**
+ * @brief Returns the number of handlers in a registry
+ * @param[in] table The registry
+ * @return Number of handlers, or -1 if the registry is NULL
+ */
+int handlers_count(const handler_table *table);
+
+/**
+ * @brief Takes a slot for running a request in a handler, waiting until one is free if its concurrency is limited
+ * @details If no slot is free and the queue of the handler is full, the request is rejected at once, and counted.
+ * @param[in,out] handler The handler
+ * @return \ref STATUS.SUCCESS if a slot was taken, \ref STATUS.ERROR if the request must be rejected
+ */
+STATUS handler_acquire(struct handler *handler);
+
+/**
+ * @brief Gives back a slot taken with handler_acquire()
+ * @param[in,out] handler The handler
+ */
+void handler_release(struct handler *handler);
+
+/**
+ * @brief Returns the name of a kind of handler, as written in the handlers file
+ * @param[in] kind The kind
+ * @return The name of the kind
+ */
+const char *handler_kind_name(HANDLER_KIND kind);
+
+#endif //PRACTICA1_HANDLERS_H
@@ -17,17 +17,111 @@
 #include <errno.h>
 #include <string.h>
 #include <glob.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "httpserver.h"
+#include "accesslog.h"
+#include "livestats.h"
+#include "metrics.h"
+#include "probes.h"
+#include "cachepolicy.h"
+#include "cgi.h"
+#include "fastcgi.h"
+#include "handlers.h"
+#include "pathcache.h"
+#include "plugins.h"
+#include "respcache.h"
+#include "workerpool.h"
+#include "readconfig.h"
 
 
-enum EXECUTABLE {
-    PYTHON,
-    PHP,
-    NON_EXECUTABLE
+/**
+ * @brief Handlers used when the configuration doesn't have a handlers file: selector, interpreter and pool shim (NULL
+ * to run each script in a new process, since not every PHP script can share an interpreter)
+ */
+const char *default_handlers[][3] = {{".py", "python", "scripts/worker.py"},
+                                     {".php", "php",    NULL}};
+
+handler_table *script_handlers = NULL; ///< Handlers of the scripts, which decide how each one is run
+
+int plugin_handlers = 0; ///< Number of handlers that are plugins, which are checked before resolving any path
+
+pathcache *path_cache = NULL; ///< Cache of resolved request paths, or NULL if it's disabled
+
+iopool *io_pool_threads = NULL; ///< Threads sending the files that aren't in memory, or NULL if it's disabled
+
+policy_table *cache_policies = NULL; ///< Caching rules for static responses, or NULL if there are none
+
+respcache *script_cache = NULL; ///< Cache of script responses, or NULL if it's disabled
+accesslog *access_log = NULL; ///< Binary access log, or NULL if requests are logged as text
+livestats *live_stats = NULL; ///< Live statistics segment, or NULL if it's disabled
+int class_thread_count = 0; ///< Number of threads of all the request classes
+atomic_ulong connections = 0; ///< Number of connections whose request has been parsed
+
+/**
+ * @brief Classes of requests, each one served by its own threads, so that cheap requests never wait behind expensive
+ * ones
+ */
+typedef enum _REQUEST_CLASS {
+    CLASS_STATIC, ///< Files and everything else, served by the connection threads of the server
+    CLASS_DYNAMIC, ///< Scripts, which can block for a long time
+    CLASS_ADMIN, ///< Requests under the admin prefix, which must be answered even when the rest are overloaded
+    REQUEST_CLASSES ///< Number of classes
+} REQUEST_CLASS;
+
+const char *request_class_names[] = {"static", "dynamic", "admin"}; ///< Names of the classes, for the log
+
+iopool *class_threads[REQUEST_CLASSES] = {NULL}; ///< Threads of each class, or NULL if the connection threads serve it
+
+char *admin_prefix = NULL; ///< Prefix of the paths of admin requests, or NULL if there are none
+
+char *metrics_path = NULL; ///< Path where the metrics are served, or NULL if they aren't
+uint64_t slow_request_ns = 0; ///< Nanoseconds after which a request is logged as slow, or 0 if they aren't
+
+/**
+ * @brief Counters of the requests queued, the time they waited and the requests rejected in each class (\ref METRICS
+ * for the static class, whose queue is the one of the connections)
+ */
+const METRIC class_metrics[REQUEST_CLASSES][3] = {
+        {METRICS, METRICS, METRICS},
+        {METRIC_DYNAMIC_QUEUED, METRIC_DYNAMIC_WAIT, METRIC_DYNAMIC_REJECTED},
+        {METRIC_ADMIN_QUEUED, METRIC_ADMIN_WAIT, METRIC_ADMIN_REJECTED}
+};
+
+_Thread_local int in_class_thread = 0; ///< 1 in the threads of the classes, which serve their requests themselves
+
+#define ROUTE_DEFERRED RESPONSE_OFFLOADED ///< Code returned by route() when another thread logs and frees the request
+#define ROUTE_INLINE (-1) ///< Code returned by hand_off() when the request must be served by the calling thread
+
+/**
+ * @struct classified_request
+ * @brief A request handed to the threads of its class, which owns it from then on
+ */
+struct classified_request {
+    REQUEST_CLASS class; ///< The class of the request
+    struct timespec queued; ///< Moment (CLOCK_MONOTONIC) when it was handed to the threads of its class
+    struct metrics_trace trace; ///< Phases of the request before it was handed off, which its thread continues
+    int socket; ///< The socket of the connection
+    struct request *request; ///< The parsed request
+    struct _srvutils *utils; ///< Structure containing the server utilities
+    int resolved; ///< 1 if its path has been resolved to \ref target already, 0 if its thread must route it
+    struct path_target target; ///< The script the request was resolved to, if \ref resolved
 };
 
-char *executable_cmd[] = {"python", "php"};
+/**
+ * @struct script_refresh
+ * @brief A stale response of the script cache, being refreshed in the background
+ */
+struct script_refresh {
+    respcache_entry *entry; ///< The stale entry, which the job completes and releases
+    struct request *request; ///< The request that found it stale, which the job frees
+    struct _srvutils *utils; ///< Structure containing the server utilities
+    struct path_target target; ///< The resolved script
+};
 
 int route(int socket, struct request *request, struct _srvutils *utils);
 
@@ -37,38 +131,758 @@ int resolution_post(int socket, struct request *request, struct _srvutils *utils
 
 int resolution_options(int socket);
 
-enum EXECUTABLE executable_type(const char *path);
+/**
+ * @brief Writes a request to the access log, as a text line or to the binary access log if it's enabled
+ * @param[in] utils Structure containing the server utilities (for logging)
+ * @param[in] request The request
+ * @param[in] code Code of the response
+ * @param[in] bytes_sent Bytes of the response sent to the client
+ */
+void log_request(const struct _srvutils *utils, const struct request *request, int code, unsigned long long bytes_sent);
+
+/**
+ * @brief Logs and frees a request whose body has been sent by the I/O pool, from the thread of the pool that sent it
+ * @param[in] request The request
+ * @param[in] code Code of the response
+ * @param[in] bytes_sent Bytes of the response actually sent to the client
+ * @param[in] arg Structure containing the server utilities
+ */
+void finish_transfer(struct request *request, int code, unsigned long long bytes_sent, void *arg);
+
+/**
+ * @brief Opens the binary access log, if it's enabled in the configuration
+ * @param[in] utils Structure containing the server utilities (for the configuration)
+ * @return \ref STATUS.SUCCESS if it's disabled or was opened, \ref STATUS.ERROR otherwise
+ */
+STATUS open_access_log(const struct _srvutils *utils);
+
+/**
+ * @brief Creates the live statistics segment, if it's enabled, with a slot for each thread that serves requests
+ * @param[in] utils Structure containing the server utilities
+ * @return \ref STATUS.SUCCESS if it was created or it's disabled, \ref STATUS.ERROR otherwise
+ */
+STATUS open_live_stats(const struct _srvutils *utils);
+
+/**
+ * @brief Answers a request for the metrics of the server, in the Prometheus text format
+ * @param[out] socket The socket of the connection
+ * @param[in] request The request
+ * @return code of the HTTP response sent to the socket
+ */
+int serve_metrics(int socket, const struct request *request);
+
+/**
+ * @brief Hands a request to the threads of its class, unless it's already in one of them or the class has none
+ * @details If the class has too many requests waiting, the request is rejected with a 503 response at once.
+ * @param[in] class The class of the request
+ * @param[out] socket The socket of the connection
+ * @param[in] request The request, which is owned by the class threads if it's handed to them
+ * @param[in] utils Structure containing the server utilities
+ * @param[in] target The script the request was resolved to, which the class threads run without routing the request
+ * again, or NULL if they must route it
+ * @return \ref ROUTE_DEFERRED if it was handed off, \ref ROUTE_INLINE if the calling thread must serve it, or the
+ * code of the response sent if it was rejected
+ */
+int hand_off(REQUEST_CLASS class, int socket, struct request *request, struct _srvutils *utils,
+             const struct path_target *target);
+
+/**
+ * @brief Job run by the threads of a class, which serves a request handed to them
+ * @param[in] arg The \ref classified_request
+ */
+void run_classified(void *arg);
+
+/**
+ * @brief Returns the nanoseconds between two moments
+ * @param[in] from The first moment
+ * @param[in] to The second moment
+ * @return Nanoseconds elapsed, or 0 if @p to is before @p from
+ */
+uint64_t elapsed_ns(const struct timespec *from, const struct timespec *to);
+
+/**
+ * @brief Logs a request with the time spent in each of its phases, if it took longer than the threshold
+ * @param[in] utils Structure containing the server utilities
+ * @param[in] request The request
+ * @param[in] code Code of the response
+ * @param[in] bytes_sent Bytes sent to the client
+ */
+void log_if_slow(const struct _srvutils *utils, const struct request *request, int code,
+                 unsigned long long bytes_sent);
+
+/**
+ * @brief Thread that periodically logs the quantiles of the durations of the phases of the requests
+ * @param[in] arg Structure containing the server utilities
+ * @return NULL, although it never returns
+ */
+void *log_latency_summary(void *arg);
+
+/**
+ * @brief Starts the thread that logs the durations of the phases, if it's enabled
+ * @param[in] utils Structure containing the server utilities
+ */
+void start_latency_summary(const struct _srvutils *utils);
+
+/**
+ * @brief Starts the threads of the classes of requests configured to have them
+ * @param[in] utils Structure containing the server utilities (for the configuration)
+ * @return \ref STATUS.SUCCESS if the threads were started, \ref STATUS.ERROR otherwise
+ */
+STATUS start_classes(const struct _srvutils *utils);
+
+/**
+ * @brief Resolves a request path into the target that must be served for it
+ * @details The full path is built from the webroot and the request path. If it's a directory, its index file is used
+ * instead. The result is obtained from the path cache if possible, and stored in it otherwise.
+ * @param[in] utils Structure containing the server utilities (for the webroot)
+ * @param[in] path The request path
+ * @param[out] target Structure where the resolved target must be stored
+ */
+void resolve_path(const struct _srvutils *utils, const char *path, struct path_target *target);
+
+/**
+ * @brief Obtains an integer option for the HTTP server from the configuration, or a default value if it's missing
+ * @param[in] utils Structure containing the server utilities (for the configuration)
+ * @param[in] option The option to obtain
+ * @param[in] default_value Value to use if the option isn't in the configuration
+ * @return The value of the option
+ */
+int get_option_int(const struct _srvutils *utils, enum USER_PARAMS option, int default_value);
+
+/**
+ * @brief Adds the Cache-Control and Expires headers of the caching policy matching a static response, if any
+ * @param[in] path The request path
+ * @param[in] fullpath The full path of the file being served
+ * @param[in,out] headers The headers structure where the headers must be added
+ */
+void add_cache_policy(const char *path, const char *fullpath, struct httpres_headers *headers);
+
+/**
+ * @brief Answers a request that a handler can't take because its queue is full
+ * @param[out] socket The socket to which the response must be sent
+ * @param[in] headers Structure containing the headers for the response
+ * @param[in] request The request
+ * @param[in] utils Structure containing the server utilities (for logging)
+ * @param[in] handler The handler
+ * @return code of the HTTP response sent to the socket
+ */
+int reject_request(int socket, struct httpres_headers *headers, const struct request *request,
+                   const struct _srvutils *utils, struct handler *handler);
+
+/**
+ * @brief Runs a script with its handler, in a new process, in a worker of a pool or in a FastCGI server
+ * @details If the handler limits its concurrency, this waits until it can run another request, or rejects the request
+ * if too many are waiting already. Scripts that run out of time are counted in their handler.
+ * @param[out] socket The socket to which the response must be sent
+ * @param[in] headers Structure containing the headers for the response
+ * @param[in] request The request
+ * @param[in] utils Structure containing the server utilities
+ * @param[in] target The resolved script
+ * @param[out] capture Where a copy of the response must be kept (can be NULL)
+ * @return code of the HTTP response sent to the socket
+ */
+int run_script(int socket, struct httpres_headers *headers, struct request *request, struct _srvutils *utils,
+               const struct path_target *target, struct cgi_capture *capture);
+
+/**
+ * @brief Answers a request with the plugin of its handler
+ * @details If the handler limits its concurrency, this waits until it can run another request, or rejects the request
+ * if too many are waiting already.
+ * @param[out] socket The socket to which the response must be sent
+ * @param[in] request The request
+ * @param[in] utils Structure containing the server utilities (for logging)
+ * @param[in] handler The handler of the plugin
+ * @return code of the HTTP response sent to the socket
+ */
+int run_plugin(int socket, struct request *request, const struct _srvutils *utils, struct handler *handler);
+
+/**
+ * @brief Job that runs a script again to refresh its stale response in the script cache
+ * @param[in] arg The \ref script_refresh, which is freed afterwards
+ */
+void run_refresh(void *arg);
+
+/**
+ * @brief Runs the script a request was resolved to, through the script cache if the request can use it
+ * @param[out] socket The socket to which the response must be sent
+ * @param[in] headers Structure containing the headers for the response
+ * @param[in] request The request
+ * @param[in] utils Structure containing the server utilities
+ * @param[in] target The resolved script
+ * @return code of the HTTP response sent to the socket, or \ref ROUTE_DEFERRED if the request is freed by another
+ * thread
+ */
+int serve_script(int socket, struct httpres_headers *headers, struct request *request, struct _srvutils *utils,
+                 const struct path_target *target);
+
+/**
+ * @brief Sends a response found in the script cache
+ * @details When the response is stale and the request has to refresh it, it's sent anyway, and the script is run
+ * again in the background, by the threads of the dynamic class (or after answering, if there are none), so that
+ * nobody has to wait for the refreshed copy. The request is then logged right away, and freed by the
+ * job that refreshes it.
+ * @param[out] socket The socket to which the response must be sent
+ * @param[in] headers Structure containing the headers for the response
+ * @param[in] request The request (a GET or HEAD without body)
+ * @param[in] utils Structure containing the server utilities
+ * @param[in] target The resolved script
+ * @param[in] entry The entry found, which is released
+ * @param[in] result \ref RESPCACHE_RESULT.RESPCACHE_HIT, or \ref RESPCACHE_RESULT.RESPCACHE_REFRESH if the request
+ * must refresh it
+ * @return code of the HTTP response sent to the socket, or \ref ROUTE_DEFERRED if the request has been logged and
+ * is freed by the refresh
+ */
+int send_cached_script(int socket, struct httpres_headers *headers, struct request *request, struct _srvutils *utils,
+                       const struct path_target *target, respcache_entry *entry, RESPCACHE_RESULT result);
+
+/**
+ * @brief Sends the response of a script from the script cache if possible, and runs it otherwise
+ * @details Stale responses are sent and refreshed as in send_cached_script().
+ * @param[out] socket The socket to which the response must be sent
+ * @param[in] headers Structure containing the headers for the response
+ * @param[in] request The request (a GET or HEAD without body)
+ * @param[in] utils Structure containing the server utilities
+ * @param[in] target The resolved script
+ * @return code of the HTTP response sent to the socket, or \ref ROUTE_DEFERRED if the request has been logged and
+ * is freed by the refresh
+ */
+int run_cached_script(int socket, struct httpres_headers *headers, struct request *request, struct _srvutils *utils,
+                      const struct path_target *target);
+
+/**
+ * @brief Builds the handler registry, from the handlers file if the configuration has one, or with the default
+ * handlers otherwise
+ * @details The default handlers run Python and PHP scripts in pools of workers, or PHP scripts in the FastCGI server
+ * set in the configuration, if any.
+ * @param[in] utils Structure containing the server utilities (for the configuration and the project root)
+ * @return The registry, or NULL if an error occurs
+ */
+handler_table *load_handlers(const struct _srvutils *utils);
+
+/**
+ * @brief Creates the worker pools, FastCGI upstreams and plugins of the handlers that need them
+ * @details Pools whose interpreter isn't installed (or every pool, if the pools are disabled in the configuration)
+ * are replaced by running each script in a new process.
+ * @param[in] utils Structure containing the server utilities (for the configuration)
+ * @return \ref STATUS.SUCCESS if every handler can run its scripts, \ref STATUS.ERROR otherwise
+ */
+STATUS start_handlers(const struct _srvutils *utils);
+
+STATUS httpserver_init(const struct _srvutils *utils) {
+    if (!utils) return ERROR;
+
+    // Before any thread is started, since the threads that time phases read the calibration without locking
+    if (metrics_clock_init() == ERROR) { // Phases are timed either way, only more cheaply with the counter
+        utils->log(stdout, "The time stamp counter isn't invariant, phases are timed with the monotonic clock");
+    }
+
+    int cache_size = get_option_int(utils, PARAMS_PATH_CACHE_SIZE, DEFAULT_PATH_CACHE_SIZE);
+    if (cache_size > 0) {
+        path_cache = pathcache_create(cache_size, get_option_int(utils, PARAMS_PATH_CACHE_TTL, DEFAULT_PATH_CACHE_TTL),
+                                      get_option_int(utils, PARAMS_PATH_CACHE_NEG_TTL, DEFAULT_PATH_CACHE_NEG_TTL));
+        if (!path_cache) {
+            utils->log(stderr, "ERROR: could not create the path cache");
+            return ERROR;
+        }
+    }
+
+    if (cgi_init() == ERROR) { // Scripts still work without the reaper, they're just waited for synchronously
+        utils->log(stderr, "Could not start the script reaper thread, scripts will be waited for after running them");
+    }
+
+    set_stream_rate_limit(get_option_int(utils, PARAMS_STREAM_RATE_LIMIT, 0));
+
+    int io_threads = get_option_int(utils, PARAMS_IO_THREADS, DEFAULT_IO_THREADS);
+    if (io_threads > 0) {
+        io_pool_threads = iopool_create(io_threads, io_threads * IO_JOBS_PER_THREAD);
+        if (!io_pool_threads) {
+            utils->log(stderr, "ERROR: could not create the I/O threads");
+            return ERROR;
+        }
+        set_io_pool(io_pool_threads, finish_transfer, (void *) utils);
+    }
+
+    if (!(script_handlers = load_handlers(utils)) || start_handlers(utils) == ERROR) {
+        utils->log(stderr, "ERROR: could not set up the script handlers");
+        return ERROR;
+    }
+
+    if (start_classes(utils) == ERROR) {
+        utils->log(stderr, "ERROR: could not start the threads of the request classes");
+        return ERROR;
+    }
+
+    if (open_access_log(utils) == ERROR || open_live_stats(utils) == ERROR) return ERROR;
+
+    if (config_getparam_str(utils->config, PARAMS_METRICS_PATH, &metrics_path) == 0) {
+        utils->log(stdout, "Metrics are served at %s", metrics_path);
+    }
+
+    start_latency_summary(utils);
+
+    set_server_timing(get_option_int(utils, PARAMS_SERVER_TIMING, 0));
+    slow_request_ns = (uint64_t) get_option_int(utils, PARAMS_SLOW_REQUEST_MS, 0) * 1000000;
+
+    int script_cache_size = get_option_int(utils, PARAMS_CGI_CACHE_SIZE, 0);
+    if (script_cache_size > 0) { // Caching script responses is only safe when the scripts are known to allow it
+        char *vary = NULL;
+        config_getparam_str(utils->config, PARAMS_CGI_CACHE_VARY, &vary);
+
+        script_cache = respcache_create(script_cache_size,
+                                        get_option_int(utils, PARAMS_CGI_CACHE_TTL, DEFAULT_CGI_CACHE_TTL),
+                                        get_option_int(utils, PARAMS_CGI_CACHE_STALE, DEFAULT_CGI_CACHE_STALE),
+                                        vary, CGI_CACHE_MAX_BODY);
+        if (!script_cache) {
+            utils->log(stderr, "ERROR: could not create the script response cache");
+            return ERROR;
+        }
+    }
+
+    char *policy_file;
+    if (config_getparam_str(utils->config, PARAMS_CACHE_POLICY_FILE, &policy_file) == 0) {
+        char *policy_path = server_get_path(utils->project_root, policy_file);
+        cache_policies = policy_path ? cachepolicy_load(policy_path) : NULL;
+        if (!cache_policies) {
+            utils->log(stderr, "ERROR: could not load the cache policy file (%s)", policy_file);
+            free(policy_path);
+            return ERROR;
+        }
+        free(policy_path);
+        utils->log(stdout, "Loaded %i cache policy rules", cachepolicy_count(cache_policies));
+    }
+
+    return SUCCESS;
+}
+
+STATUS open_access_log(const struct _srvutils *utils) {
+    char *prefix;
+    if (config_getparam_str(utils->config, PARAMS_ACCESS_LOG, &prefix) != 0) return SUCCESS;
+
+    char *path = server_get_path(utils->project_root, prefix);
+    int segment_size = get_option_int(utils, PARAMS_ACCESS_LOG_SEGMENT, DEFAULT_ACCESS_LOG_SEGMENT);
+    int segments = get_option_int(utils, PARAMS_ACCESS_LOG_SEGMENTS, DEFAULT_ACCESS_LOG_SEGMENTS);
+    if (!path || segment_size <= 0 ||
+        !(access_log = accesslog_open(path, (size_t) segment_size * 1024 * 1024, segments))) {
+        utils->log(stderr, "ERROR: could not open the binary access log (%s)", prefix);
+        free(path);
+        return ERROR;
+    }
+    utils->log(stdout, "Requests are logged to %s.N%s", path, ACCESSLOG_EXTENSION);
+    free(path);
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Deletes the live statistics segment when the server exits
+ */
+void close_live_stats() {
+    livestats_free(live_stats);
+    live_stats = NULL;
+}
+
+STATUS open_live_stats(const struct _srvutils *utils) {
+    char *name;
+    if (config_getparam_str(utils->config, PARAMS_LIVE_STATS, &name) != 0) return SUCCESS;
+
+    int workers = get_option_int(utils, PARAMS_NTHREADS, DEFAULT_NTHREADS) + class_thread_count;
+    if (workers <= 0 || !(live_stats = livestats_create(name, (unsigned int) workers))) {
+        utils->log(stderr, "ERROR: could not create the live statistics segment (%s)", name);
+        return ERROR;
+    }
+    atexit(close_live_stats); // A server that is killed leaves it behind, and the next one replaces it
+    utils->log(stdout, "Live statistics are published in %s, run server-top %s to see them", name, name);
+
+    return SUCCESS;
+}
+
+handler_table *load_handlers(const struct _srvutils *utils) {
+    char *handlers_file;
+    if (config_getparam_str(utils->config, PARAMS_HANDLERS_FILE, &handlers_file) == 0) {
+        char *handlers_path = server_get_path(utils->project_root, handlers_file);
+        handler_table *table = handlers_path ? handlers_load(handlers_path, utils->project_root) : NULL;
+        if (!table) utils->log(stderr, "ERROR: could not load the handlers file (%s)", handlers_file);
+        free(handlers_path);
+        return table;
+    }
+
+    handler_table *table = handlers_create();
+    if (!table) return NULL;
+
+    char *fastcgi_php = NULL;
+    config_getparam_str(utils->config, PARAMS_FASTCGI_PHP, &fastcgi_php);
+
+    for (size_t i = 0; i < sizeof(default_handlers) / sizeof(default_handlers[0]); i++) {
+        struct handler_options options;
+        handler_options_init(&options);
+
+        STATUS ret;
+        if (fastcgi_php && strcmp(default_handlers[i][0], ".php") == 0) {
+            ret = handlers_add(table, default_handlers[i][0], HANDLER_FASTCGI, fastcgi_php, &options);
+        } else if (!default_handlers[i][2]) {
+            ret = handlers_add(table, default_handlers[i][0], HANDLER_CGI, default_handlers[i][1], &options);
+        } else {
+            char *shim_path = server_get_path(utils->project_root, default_handlers[i][2]);
+            options.shim = shim_path;
+            ret = shim_path ? handlers_add(table, default_handlers[i][0], HANDLER_POOL, default_handlers[i][1],
+                                           &options) : ERROR;
+            free(shim_path);
+        }
+
+        if (ret == ERROR) {
+            handlers_free(table);
+            return NULL;
+        }
+    }
+
+    return table;
+}
+
+STATUS start_handlers(const struct _srvutils *utils) {
+    int max_workers = get_option_int(utils, PARAMS_POOL_MAX_WORKERS, DEFAULT_POOL_MAX_WORKERS);
+    int min_workers = get_option_int(utils, PARAMS_POOL_MIN_WORKERS, DEFAULT_POOL_MIN_WORKERS);
+    int max_requests = get_option_int(utils, PARAMS_POOL_MAX_REQUESTS, DEFAULT_POOL_MAX_REQUESTS);
+
+    for (int i = 0; i < handlers_count(script_handlers); i++) {
+        struct handler *handler = handlers_get(script_handlers, i);
+
+        if (handler->kind == HANDLER_FASTCGI) {
+            if (!(handler->backend = fcgi_upstream_create(handler->target, FCGI_DEFAULT_MAX_IDLE))) {
+                utils->log(stderr, "ERROR: invalid FastCGI address for %s (%s)", handler->selector, handler->target);
+                return ERROR;
+            }
+        } else if (handler->kind == HANDLER_PLUGIN) {
+            if (!(handler->backend = plugin_load(handler->target))) {
+                utils->log(stderr, "ERROR: could not load the plugin for %s (%s)", handler->selector, handler->target);
+                return ERROR;
+            }
+            plugin_handlers++;
+        } else if (handler->kind == HANDLER_POOL && max_workers > 0) {
+            handler->backend = workerpool_create(handler->target, handler->shim, min_workers, max_workers,
+                                                 max_requests, &handler->limits);
+        }
+
+        // Without a pool, the scripts still run, each one in a new process
+        if (handler->kind == HANDLER_POOL && !handler->backend) handler->kind = HANDLER_CGI;
+
+        if ((handler->kind == HANDLER_CGI || handler->kind == HANDLER_POOL) && handler->target[0] != '/') {
+            utils->log(stderr, "The interpreter for %s scripts (%s) isn't installed, they will fail",
+                       handler->selector, handler->target);
+        } else if (handler->kind == HANDLER_POOL) {
+            utils->log(stdout, "%s scripts run in %i %s workers", handler->selector,
+                       workerpool_size(handler->backend), handler->target);
+        } else {
+            utils->log(stdout, "%s scripts run with %s %s", handler->selector, handler_kind_name(handler->kind),
+                       handler->target);
+        }
+    }
+
+    return SUCCESS;
+}
+
+STATUS start_classes(const struct _srvutils *utils) {
+    int threads[REQUEST_CLASSES] = {0, get_option_int(utils, PARAMS_DYNAMIC_THREADS, DEFAULT_DYNAMIC_THREADS), 0};
+    int queues[REQUEST_CLASSES] = {0, get_option_int(utils, PARAMS_DYNAMIC_QUEUE, DEFAULT_DYNAMIC_QUEUE), 0};
+
+    if (config_getparam_str(utils->config, PARAMS_ADMIN_PREFIX, &admin_prefix) == 0) {
+        threads[CLASS_ADMIN] = get_option_int(utils, PARAMS_ADMIN_THREADS, DEFAULT_ADMIN_THREADS);
+        queues[CLASS_ADMIN] = get_option_int(utils, PARAMS_ADMIN_QUEUE, DEFAULT_ADMIN_QUEUE);
+    }
+
+    // Static requests are served by the connection threads, whose number and queue are set in the server options
+    for (int i = CLASS_DYNAMIC; i < REQUEST_CLASSES; i++) {
+        if (threads[i] <= 0) continue; // The connection threads serve them too
+
+        if (queues[i] <= 0) queues[i] = 1;
+        if (!(class_threads[i] = iopool_create(threads[i], queues[i]))) return ERROR;
+        class_thread_count += threads[i];
+        utils->log(stdout, "%i threads serve %s requests, with up to %i waiting", threads[i], request_class_names[i],
+                   queues[i]);
+    }
+
+    return SUCCESS;
+}
+
+int hand_off(REQUEST_CLASS class, int socket, struct request *request, struct _srvutils *utils,
+             const struct path_target *target) {
+    if (in_class_thread || !class_threads[class]) return ROUTE_INLINE;
+
+    struct classified_request *classified = malloc(sizeof(struct classified_request));
+    if (classified) {
+        classified->class = class;
+        classified->socket = socket;
+        classified->request = request;
+        classified->utils = utils;
+        if ((classified->resolved = target != NULL)) classified->target = *target;
+        clock_gettime(CLOCK_MONOTONIC, &classified->queued);
+        classified->trace = *metrics_trace();
+        if (iopool_submit(class_threads[class], run_classified, classified) == SUCCESS) {
+            metrics_add(class_metrics[class][0], 1);
+            return ROUTE_DEFERRED;
+        }
+        free(classified);
+    }
+    metrics_add(class_metrics[class][2], 1);
+
+    // Waiting for a turn would tie up a connection thread, so the client is told to come back later instead
+    struct httpres_headers *headers = create_header_struct();
+    setDefaultHeaders(headers);
+    set_header(headers, HDR_RETRY_AFTER, "1");
+    int ret = respond(socket, SERVICE_UNAVAILABLE, "Service Unavailable", headers, NULL, 0);
+    headers_free(headers);
+
+    return ret;
+}
+
+void run_classified(void *arg) {
+    struct classified_request *classified = arg;
+    in_class_thread = 1;
+    *metrics_trace() = classified->trace;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    metrics_add(class_metrics[classified->class][1], elapsed_ns(&classified->queued, &now) / 1000);
+
+    classified->request->sent_before = bytes_sent_by_thread();
+    livestats_request_start(live_stats, classified->request->method, classified->request->path,
+                            classified->request->connection);
+    int code;
+    if (classified->resolved) { // Routing it again would resolve its path twice
+        struct httpres_headers *headers = create_header_struct();
+        setDefaultHeaders(headers);
+        code = serve_script(classified->socket, headers, classified->request, classified->utils, &classified->target);
+        headers_free(headers);
+    } else {
+        code = route(classified->socket, classified->request, classified->utils);
+    }
+    if (code != ROUTE_DEFERRED) { // Otherwise, the I/O pool logs and frees it
+        log_request(classified->utils, classified->request, code,
+                    bytes_sent_by_thread() - classified->request->sent_before);
+        freeRequest(classified->request);
+    }
+    livestats_request_end(live_stats);
+
+    free(classified);
+}
+
+int run_script(int socket, struct httpres_headers *headers, struct request *request, struct _srvutils *utils,
+               const struct path_target *target, struct cgi_capture *capture) {
+    struct handler *handler = handlers_get(script_handlers, target->data);
+    if (!handler) return respond(socket, INTERNAL_ERROR, "Internal error", headers, NULL, 0);
+
+    // Waits while the handler is running as many requests as it can
+    if (handler_acquire(handler) == ERROR) return reject_request(socket, headers, request, utils, handler);
+
+    int ret;
+    uint64_t start = metrics_now();
+    metrics_trace()->started[PHASE_SCRIPT] = start; // So that the Server-Timing header can tell how long it's run
+    switch (handler->kind) {
+        case HANDLER_FASTCGI:
+            ret = fcgi_run(handler->backend, socket, headers, request, utils, target->fullpath, &handler->limits,
+                           capture);
+            break;
+        case HANDLER_POOL:
+            ret = workerpool_run(handler->backend, socket, headers, request, target->fullpath, capture);
+            break;
+        case HANDLER_PLUGIN: // Plugins are run by route() before resolving the path, so this is only a safeguard
+            ret = plugin_run(handler->backend, socket, headers, request);
+            break;
+        default:
+            ret = cgi_run(socket, headers, request, utils, handler->target, target->fullpath, &handler->limits,
+                          capture);
+            break;
+    }
+    handler_release(handler);
+    metrics_trace()->started[PHASE_SCRIPT] = 0;
+    metrics_observe_since(PHASE_SCRIPT, start);
+
+    if (ret == GATEWAY_TIMEOUT) {
+        unsigned long timeouts = atomic_fetch_add(&handler->timeouts, 1) + 1;
+        utils->log(stderr, "%s ran out of time (%lu timeouts in the %s handler)", target->fullpath, timeouts,
+                   handler->selector);
+    }
+
+    return ret;
+}
+
+int reject_request(int socket, struct httpres_headers *headers, const struct request *request,
+                   const struct _srvutils *utils, struct handler *handler) {
+    utils->log(stderr, "Rejected %s %s, the %s handler is full (%lu rejections)", request->method, request->path,
+               handler->selector, atomic_load(&handler->rejections));
+
+    set_header(headers, HDR_RETRY_AFTER, "1"); // The queue is short, so it will probably have room very soon
+    return respond(socket, SERVICE_UNAVAILABLE, "Service Unavailable", headers, NULL, 0);
+}
+
+int run_plugin(int socket, struct request *request, const struct _srvutils *utils, struct handler *handler) {
+    struct httpres_headers *headers = create_header_struct();
+    setDefaultHeaders(headers);
+
+    int ret;
+    if (handler_acquire(handler) == ERROR) {
+        ret = reject_request(socket, headers, request, utils, handler);
+    } else {
+        ret = plugin_run(handler->backend, socket, headers, request);
+        handler_release(handler);
+    }
+
+    headers_free(headers);
+    return ret;
+}
+
+int serve_script(int socket, struct httpres_headers *headers, struct request *request, struct _srvutils *utils,
+                 const struct path_target *target) {
+    if (script_cache && !request->body && strcmp(request->method, POST) != 0) { // Only GET and HEAD may be cached
+        return run_cached_script(socket, headers, request, utils, target);
+    }
+
+    return run_script(socket, headers, request, utils, target, NULL);
+}
+
+int run_cached_script(int socket, struct httpres_headers *headers, struct request *request, struct _srvutils *utils,
+                      const struct path_target *target) {
+    respcache_entry *entry;
+    // A HEAD request doesn't produce the body, so it can only use a response produced by another request
+    RESPCACHE_RESULT result = respcache_lookup(script_cache, request, target->fullpath, !request->headers_only, &entry);
+    const METRIC result_metrics[] = {METRIC_SCRIPT_CACHE_HITS, METRIC_SCRIPT_CACHE_STALE, METRIC_SCRIPT_CACHE_MISSES,
+                                     METRIC_SCRIPT_CACHE_BYPASSES}; // In the order of RESPCACHE_RESULT
+    metrics_add(result_metrics[result], 1);
+    if (result == RESPCACHE_BYPASS) return run_script(socket, headers, request, utils, target, NULL);
+
+    if (result != RESPCACHE_LEAD) return send_cached_script(socket, headers, request, utils, target, entry, result);
+
+    struct cgi_capture capture; // The client receives the response while it's captured
+    cgi_capture_init(&capture, CGI_CACHE_MAX_BODY);
+    int ret = run_script(socket, headers, request, utils, target, &capture);
+    respcache_complete(script_cache, entry, &capture);
+
+    respcache_release(script_cache, entry);
+    cgi_capture_free(&capture);
+    return ret;
+}
+
+int send_cached_script(int socket, struct httpres_headers *headers, struct request *request, struct _srvutils *utils,
+                       const struct path_target *target, respcache_entry *entry, RESPCACHE_RESULT result) {
+    int ret = respcache_send(entry, socket, headers, request);
+
+    if (result == RESPCACHE_REFRESH) { // The client already has its response, so the request is done
+        log_request(utils, request, ret, bytes_sent_by_thread() - request->sent_before);
+
+        // Only the request that found the response stale refreshes it, so it's never refreshed twice at once
+        iopool *pool = class_threads[CLASS_DYNAMIC]; // The I/O threads are kept for the bodies of files
+        struct script_refresh *refresh = malloc(sizeof(struct script_refresh));
+        if (refresh) {
+            refresh->entry = entry;
+            refresh->request = request;
+            refresh->utils = utils;
+            refresh->target = *target;
+        }
+        if (refresh && (!pool || iopool_submit(pool, run_refresh, refresh) == SUCCESS)) {
+            if (!pool) run_refresh(refresh); // Without threads to run it, the client has been answered already
+            return ROUTE_DEFERRED;
+        }
+        free(refresh);
+
+        struct cgi_capture capture; // Completing it with an empty copy lets another request try again later
+        cgi_capture_init(&capture, CGI_CACHE_MAX_BODY);
+        respcache_complete(script_cache, entry, &capture);
+        cgi_capture_free(&capture);
+        respcache_release(script_cache, entry);
+        freeRequest(request);
+        return ROUTE_DEFERRED;
+    }
+
+    respcache_release(script_cache, entry);
+    return ret;
+}
+
+void run_refresh(void *arg) {
+    struct script_refresh *refresh = arg;
+    metrics_trace_reset(); // The phases of the script don't belong to the request the thread served before
+
+    struct cgi_capture capture;
+    cgi_capture_init(&capture, CGI_CACHE_MAX_BODY);
+
+    struct httpres_headers *headers = create_header_struct();
+    if (headers) { // There's no connection, so the script only runs for the cache
+        run_script(-1, headers, refresh->request, refresh->utils, &refresh->target, &capture);
+        headers_free(headers);
+    }
+    respcache_complete(script_cache, refresh->entry, &capture);
+    respcache_release(script_cache, refresh->entry);
+
+    cgi_capture_free(&capture);
+    freeRequest(refresh->request);
+    free(refresh);
+}
+
+void add_cache_policy(const char *path, const char *fullpath, struct httpres_headers *headers) {
+    const struct cache_policy *policy = cachepolicy_find(cache_policies, path, fullpath, get_mime_type(fullpath));
+    if (!policy) return;
+
+    size_t len;
+    const char *line = cachepolicy_cache_control(policy, &len);
+    set_header_preformatted(headers, line, len);
+
+    // The Expires line lives in a per-thread buffer, which stays valid until this thread handles another request
+    if ((line = cachepolicy_expires(policy, &len)) != NULL) set_header_preformatted(headers, line, len);
+}
+
+int get_option_int(const struct _srvutils *utils, enum USER_PARAMS option, int default_value) {
+    int value;
+    if (config_getparam_int(utils->config, option, &value) != 0) return default_value;
+
+    return value;
+}
 
 SERVERCMD processHTTPRequest(int socket, struct _srvutils *utils) {
     int routecode;
 
     struct request *request = NULL;
+    livestats_set_state(live_stats, LIVESTATS_READING);
+    PROBE2(parse_start, socket, probe_tid());
     parse_result pres = parseRequest(socket, &request);
+    PROBE4(parse_end, socket, probe_tid(), pres, request ? request->request_len : 0);
+    if (pres != PARSE_OK) livestats_set_state(live_stats, LIVESTATS_IDLE);
     switch (pres) {
         case PARSE_OK:
+            request->connection = atomic_fetch_add_explicit(&connections, 1, memory_order_relaxed);
+            metrics_observe(PHASE_PARSE, elapsed_ns(&request->received, &request->parsed));
+            request->sent_before = bytes_sent_by_thread();
+            livestats_request_start(live_stats, request->method, request->path, request->connection);
             routecode = route(socket, request, utils);
-            if (request->querystring) {
-                utils->log(stdout, "%s %s?%s %i", request->method, request->path, request->querystring, routecode);
-            } else {
-                utils->log(stdout, "%s %s %i", request->method, request->path, routecode);
+            if (routecode == ROUTE_DEFERRED) { // The threads of its class, or the I/O pool, log it and free it
+                livestats_set_state(live_stats, LIVESTATS_IDLE);
+                return CONTINUE;
             }
+
+            log_request(utils, request, routecode, bytes_sent_by_thread() - request->sent_before);
             freeRequest(request);
+            livestats_request_end(live_stats);
 
             return CONTINUE; /// Tell the server to continue accepting requests
         case PARSE_ERROR:
+            metrics_add(METRIC_PARSE_ERROR, 1);
+            metrics_add(METRIC_CONNECTIONS_FINISHED, 1);
             respond(socket, BAD_REQUEST, "Bad request", NULL, NULL, 0);
             utils->log(stdout, "%s %i", "Bad request", BAD_REQUEST);
             return CONTINUE;
         case PARSE_REQTOOLONG:
+            metrics_add(METRIC_PARSE_TOO_LONG, 1);
+            metrics_add(METRIC_CONNECTIONS_FINISHED, 1);
             respond(socket, BAD_REQUEST, "Request too long", NULL, NULL, 0);
             utils->log(stdout, "%s %i", "Request too long", BAD_REQUEST);
             return CONTINUE;
         case PARSE_IOERROR:
+            metrics_add(METRIC_PARSE_IO_ERROR, 1);
+            metrics_add(METRIC_CONNECTIONS_FINISHED, 1);
             utils->log(stderr, "Error while reading from socket %i: %s", socket, strerror(errno));
             respond(socket, INTERNAL_ERROR, "Internal server error", NULL, NULL, 0);
             utils->log(stdout, "%s %i", "Internal error", INTERNAL_ERROR);
             return CONTINUE; // TODO: stop?
         default:
+            metrics_add(METRIC_PARSE_INTERNAL_ERROR, 1);
+            metrics_add(METRIC_CONNECTIONS_FINISHED, 1);
             utils->log(stderr, "Error while parsing request");
             respond(socket, INTERNAL_ERROR, "Internal server error", NULL, NULL, 0);
             utils->log(stdout, "%s %i", "Internal error", INTERNAL_ERROR);
@@ -76,9 +890,71 @@ SERVERCMD processHTTPRequest(int socket, struct _srvutils *utils) {
     }
 }
 
+void finish_transfer(struct request *request, int code, unsigned long long bytes_sent, void *arg) {
+    log_request(arg, request, code, bytes_sent);
+    freeRequest(request);
+}
+
+uint64_t elapsed_ns(const struct timespec *from, const struct timespec *to) {
+    long long ns = (to->tv_sec - from->tv_sec) * 1000000000LL + (to->tv_nsec - from->tv_nsec);
+    return ns > 0 ? (uint64_t) ns : 0;
+}
+
+void
+log_request(const struct _srvutils *utils, const struct request *request, int code, unsigned long long bytes_sent) {
+    metrics_count_request(request->method, code);
+    metrics_add(METRIC_BYTES_IN, request->request_len);
+    metrics_add(METRIC_BYTES_OUT, bytes_sent);
+    metrics_add(METRIC_CONNECTIONS_FINISHED, 1);
+    if (slow_request_ns) log_if_slow(utils, request, code, bytes_sent);
+
+    if (access_log) { // Nothing is formatted, the request is copied as it is
+        struct timespec now, done;
+        clock_gettime(CLOCK_REALTIME, &now);
+        clock_gettime(CLOCK_MONOTONIC, &done);
+
+        struct accesslog_entry entry = {
+                .time = (uint64_t) now.tv_sec * 1000000 + (uint64_t) now.tv_nsec / 1000,
+                .connection = (uint32_t) request->connection,
+                .status = (uint16_t) code,
+                .method = request->method, .method_len = strlen(request->method),
+                .path = request->path, .path_len = strlen(request->path),
+                .querystring = request->querystring,
+                .querystring_len = request->querystring ? strlen(request->querystring) : 0,
+                .bytes_in = request->request_len,
+                .bytes_out = bytes_sent,
+                .parse_time = elapsed_ns(&request->received, &request->parsed) / 1000,
+                .response_time = elapsed_ns(&request->parsed, &done) / 1000
+        };
+        if (accesslog_write(access_log, &entry) == SUCCESS) return;
+    }
+
+    if (request->querystring) {
+        utils->log(stdout, "%s %s?%s %i", request->method, request->path, request->querystring, code);
+    } else {
+        utils->log(stdout, "%s %s %i", request->method, request->path, code);
+    }
+}
+
 int route(int socket, struct request *request, struct _srvutils *utils) {
-    if (strcmp(request->method, GET) == 0) {
-        return resolution_get(socket, request, utils);
+    if (metrics_path && strcmp(request->path, metrics_path) == 0) { // Scrapes are admin requests, wherever they are
+        int ret = hand_off(CLASS_ADMIN, socket, request, utils, NULL);
+        return ret != ROUTE_INLINE ? ret : serve_metrics(socket, request);
+    }
+
+    if (admin_prefix && strncmp(request->path, admin_prefix, strlen(admin_prefix)) == 0) {
+        int ret = hand_off(CLASS_ADMIN, socket, request, utils, NULL);
+        if (ret != ROUTE_INLINE) return ret;
+    }
+
+    if (plugin_handlers > 0) { // Plugins answer every request to their paths, whether they're files or not
+        struct handler *handler = handlers_get(script_handlers,
+                                               handlers_find(script_handlers, request->path, request->path));
+        if (handler && handler->kind == HANDLER_PLUGIN) return run_plugin(socket, request, utils, handler);
+    }
+
+    if (strcmp(request->method, GET) == 0 || strcmp(request->method, HEAD) == 0) {
+        return resolution_get(socket, request, utils); // HEAD is resolved exactly like GET, just without body
     } else if (strcmp(request->method, POST) == 0) {
         return resolution_post(socket, request, utils);
     } else if (strcmp(request->method, OPTIONS) == 0) {
@@ -93,36 +969,39 @@ int resolution_get(int socket, struct request *request, struct _srvutils *utils)
     struct httpres_headers *headers = create_header_struct();
     setDefaultHeaders(headers);
 
-    // Calculate the size that the full path will have
-    size_t fullpath_size = strlen(utils->webroot) + strlen(request->path) + 1;
-
-    // Allocate enough space for the entire path and the null terminator
-    char *fullpath = calloc(sizeof(char), fullpath_size);
-
-    // Concatenate both parts of the path to obtain the full path
-    strcat(fullpath, utils->webroot);
-    strcat(fullpath, request->path);
+    struct path_target target;
+    uint64_t start = metrics_now();
+    resolve_path(utils, request->path, &target);
+    metrics_observe_since(PHASE_ROUTE, start);
+    PROBE4(route, socket, probe_tid(), target.type, request->path);
 
 #if DEBUG >= 2
-    utils->log(stdout, "Full path: %s", fullpath);
+    utils->log(stdout, "Full path: %s", target.fullpath);
 #endif
 
-    if (is_directory(fullpath)) { // If it's a directory, attempt to serve an index.html
-        size_t newfullpath_size = fullpath_size + strlen(INDEX_PATH);
-        fullpath = realloc(fullpath, newfullpath_size); // Reallocate with size for the index
-        strncat(fullpath, INDEX_PATH, newfullpath_size); // Concatenate the index.html path at the end
+    // Responses already in the script cache are sent at once, instead of waiting behind the scripts being run
+    respcache_entry *entry;
+    RESPCACHE_RESULT cached = RESPCACHE_BYPASS;
+    if (target.type == TARGET_EXECUTABLE && script_cache && !request->body) {
+        cached = respcache_peek(script_cache, request, target.fullpath, !request->headers_only, &entry);
     }
 
-    enum EXECUTABLE type = executable_type(fullpath); // Check if the file is one of the executable extensions
-
     int ret;
-    if (type != NON_EXECUTABLE) { // If the file is of one of the executable types
-        ret = run_executable(socket, headers, request, utils, executable_cmd[type], fullpath);
+    if (cached != RESPCACHE_BYPASS) {
+        metrics_add(cached == RESPCACHE_HIT ? METRIC_SCRIPT_CACHE_HITS : METRIC_SCRIPT_CACHE_STALE, 1);
+        ret = send_cached_script(socket, headers, request, utils, &target, entry, cached);
+    } else if (target.type == TARGET_EXECUTABLE &&
+               (ret = hand_off(CLASS_DYNAMIC, socket, request, utils, &target)) != ROUTE_INLINE) {
+        // The threads of the dynamic class run the script, so that it doesn't hold a connection thread
+    } else if (target.type == TARGET_EXECUTABLE) { // If the file is of one of the executable types
+        ret = serve_script(socket, headers, request, utils, &target);
+    } else if (target.type == TARGET_NOT_FOUND) { // Only regular files can be served
+        ret = respond(socket, NOT_FOUND, "Not found", headers, NULL, 0);
     } else {
-        ret = send_file(socket, headers, fullpath); // Attempt to serve the index file
+        add_cache_policy(request->path, target.fullpath, headers); // A 304 must carry the same caching headers
+        ret = send_file(socket, headers, request, target.fullpath, &target.st); // Attempt to serve the file
     }
 
-    free(fullpath);
     headers_free(headers);
     return ret;
 }
@@ -132,41 +1011,69 @@ int resolution_post(int socket, struct request *request, struct _srvutils *utils
     struct httpres_headers *headers = create_header_struct();
     setDefaultHeaders(headers);
 
-    // Calculate the size that the full path will have
-    size_t fullpath_size = strlen(utils->webroot) + strlen(request->path) + 1;
-
-    // Allocate enough space for the entire path and the null terminator
-    char *fullpath = calloc(sizeof(char), fullpath_size);
-
-    // Concatenate both parts of the path to obtain the full path
-    strcat(fullpath, utils->webroot);
-    strcat(fullpath, request->path);
+    struct path_target target;
+    uint64_t start = metrics_now();
+    resolve_path(utils, request->path, &target);
+    metrics_observe_since(PHASE_ROUTE, start);
+    PROBE4(route, socket, probe_tid(), target.type, request->path);
 
 #if DEBUG >= 2
-    utils->log(stdout, "Full path: %s", fullpath);
+    utils->log(stdout, "Full path: %s", target.fullpath);
 #endif
 
     int ret;
-
-    if (is_directory(fullpath)) { // If it's a directory, return a forbidden code
+    if (target.is_directory) { // If it's a directory, return a forbidden code
         ret = respond(socket, FORBIDDEN, "Can't POST there", headers, NULL, 0);
-        goto end;
-    }
-
-    enum EXECUTABLE type = executable_type(fullpath); // Check if the file is one of the executable extensions
-
-    if (type != NON_EXECUTABLE) { // If the file is of one of the executable types
-        ret = run_executable(socket, headers, request, utils, executable_cmd[type], fullpath);
+    } else if (target.type == TARGET_EXECUTABLE &&
+               (ret = hand_off(CLASS_DYNAMIC, socket, request, utils, &target)) != ROUTE_INLINE) {
+        // The threads of the dynamic class run the script, so that it doesn't hold a connection thread
+    } else if (target.type == TARGET_EXECUTABLE) { // If the file is of one of the executable types
+        ret = run_script(socket, headers, request, utils, &target, NULL);
     } else { // If it's not an executable extension, return a forbidden code
         ret = respond(socket, FORBIDDEN, "Can't POST there", headers, NULL, 0);
     }
 
-    end:
-    free(fullpath);
     headers_free(headers);
     return ret;
 }
 
+void resolve_path(const struct _srvutils *utils, const char *path, struct path_target *target) {
+    if (pathcache_get(path_cache, path, target) == SUCCESS) { // Repeated paths resolve with a single lookup
+        metrics_add(METRIC_PATH_CACHE_HITS, 1);
+        return;
+    }
+    if (path_cache) metrics_add(METRIC_PATH_CACHE_MISSES, 1);
+
+    memset(&target->st, 0, sizeof(struct stat));
+    target->is_directory = 0;
+    target->data = HANDLER_NONE;
+
+    // Concatenate the webroot and the request path to obtain the full path
+    size_t len = (size_t) snprintf(target->fullpath, sizeof(target->fullpath), "%s%s", utils->webroot, path);
+    if (len + strlen(INDEX_PATH) >= sizeof(target->fullpath)) { // Paths that don't fit can't exist anyway
+        target->type = TARGET_NOT_FOUND;
+        return;
+    }
+
+    int found = stat(target->fullpath, &target->st) == 0;
+
+    if (found && S_ISDIR(target->st.st_mode)) { // If it's a directory, attempt to serve an index.html
+        target->is_directory = 1;
+        strcat(target->fullpath, INDEX_PATH); // Concatenate the index.html path at the end
+        found = stat(target->fullpath, &target->st) == 0;
+    }
+
+    if (!found || !S_ISREG(target->st.st_mode)) { // Only regular files can be served
+        target->type = TARGET_NOT_FOUND;
+    } else if ((target->data = handlers_find(script_handlers, path, target->fullpath)) != HANDLER_NONE) {
+        target->type = TARGET_EXECUTABLE; // Its handler produces the response
+    } else {
+        target->type = target->is_directory ? TARGET_INDEX : TARGET_FILE;
+    }
+
+    pathcache_put(path_cache, path, target);
+}
+
 int resolution_options(int socket) {
     struct httpres_headers *headers = create_header_struct();
     setDefaultHeaders(headers);
@@ -179,20 +1086,153 @@ int resolution_options(int socket) {
     return NO_CONTENT;
 }
 
-enum EXECUTABLE executable_type(const char *path) {
-    if (!path) return -1;
+int serve_metrics(int socket, const struct request *request) {
+    struct httpres_headers *headers = create_header_struct();
+    setDefaultHeaders(headers);
+
+    if (strcmp(request->method, GET) != 0 && strcmp(request->method, HEAD) != 0) {
+        set_header(headers, HDR_ALLOW, "GET, HEAD");
+        respond(socket, METHOD_NOT_ALLOWED, "Method Not Allowed", headers, NULL, 0);
+        headers_free(headers);
+        return METHOD_NOT_ALLOWED;
+    }
+
+    struct metrics_text text = {0};
+    metrics_render(&text);
+
+    // Values that are read where they're kept, instead of being counted
+    metrics_family(&text, "http_class_queue_depth", "gauge", "Requests waiting for a thread of their class");
+    for (int class = CLASS_DYNAMIC; class < REQUEST_CLASSES; class++) {
+        if (class_threads[class]) {
+            metrics_printf(&text, "http_class_queue_depth{class=\"%s\"} %i\n", request_class_names[class],
+                           iopool_pending(class_threads[class]));
+        }
+    }
+
+    metrics_family(&text, "http_handler_waiting", "gauge", "Requests waiting for a slot of their handler");
+    for (int i = 0; i < handlers_count(script_handlers); i++) {
+        struct handler *handler = handlers_get(script_handlers, i);
+        metrics_printf(&text, "http_handler_waiting{handler=\"%s\"} %i\n", handler->selector,
+                       atomic_load(&handler->waiting));
+    }
+
+    metrics_family(&text, "http_script_timeouts_total", "counter", "Scripts stopped because they ran out of time");
+    for (int i = 0; i < handlers_count(script_handlers); i++) {
+        struct handler *handler = handlers_get(script_handlers, i);
+        metrics_printf(&text, "http_script_timeouts_total{handler=\"%s\"} %lu\n", handler->selector,
+                       atomic_load(&handler->timeouts));
+    }
+
+    metrics_family(&text, "http_script_rejections_total", "counter", "Requests rejected because a handler was full");
+    for (int i = 0; i < handlers_count(script_handlers); i++) {
+        struct handler *handler = handlers_get(script_handlers, i);
+        metrics_printf(&text, "http_script_rejections_total{handler=\"%s\"} %lu\n", handler->selector,
+                       atomic_load(&handler->rejections));
+    }
 
-    char *ext = strrchr(path, '.'); // Find the extension
-    if (!ext) return -1; // If there's no extension
-    ext++; // skip the '.'
+    int ret = OK;
+    if (text.failed) {
+        ret = respond(socket, INTERNAL_ERROR, "Internal error", headers, NULL, 0);
+    } else {
+        char length[32];
+        snprintf(length, sizeof(length), "%zu", text.len);
+        set_header(headers, HDR_CONTENT_TYPE, METRICS_CONTENT_TYPE);
+        set_header(headers, HDR_CONTENT_LENGTH, length);
+        respond(socket, OK, "OK", headers, request->headers_only ? NULL : text.data, text.len);
+    }
+
+    metrics_text_free(&text);
+    headers_free(headers);
+    return ret;
+}
 
-    // Return the executable type, or -1 if it's not an executable file
-    if (strcmp(ext, "py") == 0) {
-        return PYTHON;
-    } else if (strcmp(ext, "php") == 0) {
-        return PHP;
+/**
+ * @brief Formats a duration with the unit that suits it
+ * @param[out] buf Buffer where the duration must be written
+ * @param[in] buf_len Size of the buffer
+ * @param[in] ns The duration in nanoseconds
+ * @return @p buf
+ */
+char *format_duration(char *buf, size_t buf_len, uint64_t ns) {
+    if (ns < 1000) {
+        snprintf(buf, buf_len, "%luns", (unsigned long) ns);
+    } else if (ns < 1000000) {
+        snprintf(buf, buf_len, "%.1fus", (double) ns / 1e3);
+    } else if (ns < 1000000000) {
+        snprintf(buf, buf_len, "%.1fms", (double) ns / 1e6);
     } else {
-        return NON_EXECUTABLE;
+        snprintf(buf, buf_len, "%.2fs", (double) ns / 1e9);
+    }
+
+    return buf;
+}
+
+void *log_latency_summary(void *arg) {
+    const struct _srvutils *utils = arg;
+    int interval = get_option_int(utils, PARAMS_LATENCY_SUMMARY, DEFAULT_LATENCY_SUMMARY);
+
+    // Each summary only covers the requests since the previous one, so the last totals are kept
+    struct metrics_histogram *previous = calloc(PHASES, sizeof(struct metrics_histogram));
+    struct metrics_histogram *current = malloc(sizeof(struct metrics_histogram));
+    if (!previous || !current) {
+        utils->log(stderr, "Could not allocate the latency histograms, the summary won't be logged");
+        free(previous);
+        free(current);
+        return NULL;
+    }
+
+    while (1) {
+        sleep((unsigned int) interval);
+
+        for (int phase = 0; phase < PHASES; phase++) {
+            metrics_histogram_read(phase, current);
+            struct metrics_histogram totals = *current;
+            metrics_histogram_subtract(current, &previous[phase]);
+            previous[phase] = totals;
+            if (current->count == 0) continue;
+
+            char p50[16], p90[16], p99[16], p999[16], max[16];
+            utils->log(stdout, "Latency of %s over %is: n=%lu p50=%s p90=%s p99=%s p99.9=%s max=%s",
+                       metrics_phase_name(phase), interval, current->count,
+                       format_duration(p50, sizeof(p50), metrics_histogram_quantile(current, 0.5)),
+                       format_duration(p90, sizeof(p90), metrics_histogram_quantile(current, 0.9)),
+                       format_duration(p99, sizeof(p99), metrics_histogram_quantile(current, 0.99)),
+                       format_duration(p999, sizeof(p999), metrics_histogram_quantile(current, 0.999)),
+                       format_duration(max, sizeof(max), metrics_histogram_quantile(current, 1)));
+        }
+    }
+}
+
+void start_latency_summary(const struct _srvutils *utils) {
+    if (get_option_int(utils, PARAMS_LATENCY_SUMMARY, DEFAULT_LATENCY_SUMMARY) <= 0) return;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, log_latency_summary, (void *) utils) != 0) {
+        utils->log(stderr, "Could not start the thread that logs the latency summary");
+        return;
+    }
+    pthread_detach(thread);
+}
+
+void log_if_slow(const struct _srvutils *utils, const struct request *request, int code,
+                 unsigned long long bytes_sent) {
+    const struct metrics_trace *trace = metrics_trace();
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t total = trace->phases[PHASE_QUEUE] + elapsed_ns(&request->received, &now); // As the client saw it
+    if (total < slow_request_ns) return;
+
+    // The phases are written as "name=duration", leaving out the ones that didn't happen
+    char phases[256] = "", duration[16];
+    size_t len = 0;
+    for (int phase = 0; phase < PHASES && len < sizeof(phases); phase++) {
+        if (trace->phases[phase] == 0) continue;
+        len += (size_t) snprintf(phases + len, sizeof(phases) - len, " %s=%s", metrics_phase_name(phase),
+                                 format_duration(duration, sizeof(duration), trace->phases[phase]));
     }
 
+    utils->log(stderr, "Slow request (%s): %s %s%s%s %i%s connection=%lu sent=%llu",
+               format_duration(duration, sizeof(duration), total), request->method, request->path,
+               request->querystring ? "?" : "", request->querystring ? request->querystring : "", code, phases,
+               request->connection, bytes_sent);
 }
\ No newline at end of file
@@ -16,6 +16,33 @@
 #include "server.h"
 #include "httputils.h"
 
+#define DEFAULT_PATH_CACHE_SIZE 1024 ///< Number of resolved paths cached by default
+#define DEFAULT_PATH_CACHE_TTL 2000 ///< Milliseconds during which a resolved path is cached by default
+#define DEFAULT_PATH_CACHE_NEG_TTL 1000 ///< Milliseconds during which a path that wasn't found is cached by default
+#define DEFAULT_IO_THREADS 4 ///< Default number of threads sending the files that aren't in memory
+#define IO_JOBS_PER_THREAD 16 ///< Number of files that can wait for each I/O thread before they're sent directly
+#define DEFAULT_POOL_MIN_WORKERS 1 ///< Default number of interpreter workers always running for each language
+#define DEFAULT_POOL_MAX_WORKERS 4 ///< Default maximum number of interpreter workers for each language
+#define DEFAULT_POOL_MAX_REQUESTS 1000 ///< Default number of requests served by a worker before it's replaced
+#define DEFAULT_CGI_CACHE_TTL 5 ///< Default seconds during which a script response is cached, if it doesn't set its own
+#define DEFAULT_CGI_CACHE_STALE 30 ///< Default seconds during which an expired script response is sent while refreshed
+#define CGI_CACHE_MAX_BODY (1024 * 1024) ///< Maximum length of the body of a cached script response
+#define DEFAULT_DYNAMIC_THREADS 4 ///< Default number of threads running scripts
+#define DEFAULT_DYNAMIC_QUEUE 64 ///< Default number of script requests that can wait for a thread
+#define DEFAULT_ADMIN_THREADS 1 ///< Default number of threads serving the requests under the admin prefix
+#define DEFAULT_ADMIN_QUEUE 16 ///< Default number of admin requests that can wait for a thread
+#define DEFAULT_ACCESS_LOG_SEGMENT 64 ///< Default size in megabytes of the segments of the binary access log
+#define DEFAULT_ACCESS_LOG_SEGMENTS 8 ///< Default number of segments of the binary access log that are kept
+#define DEFAULT_LATENCY_SUMMARY 60 ///< Default seconds between the summaries of the durations of the phases
+
+/**
+ * @brief Initializes the structures of the HTTP server from the options in the server configuration
+ * @details This must be called once, before the #Server starts accepting connections.
+ * @param[in] utils Structure containing the utilities of the #Server (including its configuration)
+ * @return \ref STATUS.SUCCESS if everything went well, \ref STATUS.ERROR otherwise
+ */
+STATUS httpserver_init(const struct _srvutils *utils);
+
 /**
  * @brief Processes the request in the provided socket
  * @param[in,out] socket The socket where the connection of the request has been established.
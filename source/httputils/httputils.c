@@ -5,24 +5,55 @@
  * @date February 2020
  */
 
+#define _GNU_SOURCE // Required for strptime() and timegm()
+
 #include "httputils.h"
 #include "constants.h"
 #include "mimetable.h"
+#include "iopool.h"
+#include "metrics.h"
+#include "probes.h"
 
 #include <errno.h>
 #include <stdio.h>
 #include <sys/socket.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <time.h>
 #include <sys/stat.h>
-#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <assert.h>
-#include <wait.h>
 
 #define CRLF_LEN strlen("\r\n") ///< Length of the string containing the response code (always three digit)
 
+long stream_rate_limit = 0; ///< Maximum number of bytes per second sent for each file, or 0 if it's unlimited
+int server_timing = 0; ///< 1 if responses carry a Server-Timing header
+
+iopool *io_pool = NULL; ///< Pool where the bodies of files that aren't in memory are sent, or NULL if there's none
+transfer_done io_pool_done = NULL; ///< Reports the requests whose bodies have been sent by the pool
+void *io_pool_done_arg = NULL; ///< Last argument of \ref io_pool_done
+
+_Thread_local unsigned long long thread_bytes_sent = 0; ///< Bytes of responses sent to clients by the thread
+
+/**
+ * @struct file_transfer
+ * @brief Body of a response that is sent by the I/O pool
+ */
+struct file_transfer {
+    int socket; ///< Socket to which the body must be sent
+    int fd; ///< Descriptor of the file to send
+    off_t offset; ///< Position of the first byte to send
+    off_t length; ///< Number of bytes to send
+    struct request *request; ///< The request, which is reported and freed once the body is sent
+    int code; ///< Code of the response
+    unsigned long long bytes_sent; ///< Bytes of the response sent before the body was handed to the pool
+    struct metrics_trace trace; ///< Phases of the request before the body was handed over, which the pool continues
+};
+
 /**
  * @brief Attempts to get the content length of an HTTP request from its headers
  * @param[in] headers Structure containing the headers of the request
@@ -62,7 +93,7 @@ const char *get_querystring(const char *path, size_t path_len) {
 
 parse_result
 readParse(int socket, char *buf, size_t buf_size, int *minor_version, struct phr_header headers[], size_t *num_headers,
-          size_t *method_len, size_t *path_len, const char **method, const char **path) {
+          size_t *method_len, size_t *path_len, const char **method, const char **path, size_t *header_len) {
     if (socket < 0 || !buf || buf_size <= 0 || num_headers < 0) {
         return PARSE_ERROR;
     }
@@ -90,6 +121,7 @@ readParse(int socket, char *buf, size_t buf_size, int *minor_version, struct phr
         if (buflen == sizeof(buf)) return PARSE_REQTOOLONG;
     }
 
+    *header_len = (size_t) pret;
     return PARSE_OK;
 }
 
@@ -112,12 +144,13 @@ parse_result parseRequest(int socket, struct request **request) {
 
     // Temporal variables to store the method and path positions before copying them to the new structure
     const char *tmp_method, *tmp_fullpath;
-    size_t tmp_method_len, tmp_fullpath_len, path_len, qs_len;
+    size_t tmp_method_len, tmp_fullpath_len, path_len, qs_len, header_len;
 
 
+    clock_gettime(CLOCK_MONOTONIC, &newreq->received);
     parse_result pret = readParse(socket, newreq->reqbuf, MAX_HTTPREQ / sizeof(char), &newreq->minor_version,
-                                  newreq->headers,
-                                  &newreq->num_headers, &tmp_method_len, &tmp_fullpath_len, &tmp_method, &tmp_fullpath);
+                                  newreq->headers, &newreq->num_headers, &tmp_method_len, &tmp_fullpath_len,
+                                  &tmp_method, &tmp_fullpath, &header_len);
     if (pret != PARSE_OK) { // If parsing failed
         freeRequest(newreq); // Free the memory associated with the request
         return pret; // Return the error code
@@ -151,6 +184,8 @@ parse_result parseRequest(int socket, struct request **request) {
     strncpy((char *) newreq->method, tmp_method, tmp_method_len);
     strncpy((char *) newreq->path, tmp_fullpath, path_len);
 
+    newreq->headers_only = strcmp(newreq->method, HEAD) == 0; // HEAD responses mustn't have a body
+
     // If the request is POST, check its body length
     if (strcmp(newreq->method, POST) == 0) {
         newreq->body_len = get_content_length(newreq->headers, newreq->num_headers);
@@ -171,6 +206,8 @@ parse_result parseRequest(int socket, struct request **request) {
         newreq->body = NULL; // If there's no body, set it to NULL
     }
 
+    newreq->request_len = header_len + newreq->body_len;
+    clock_gettime(CLOCK_MONOTONIC, &newreq->parsed);
     *request = newreq;
 
     return PARSE_OK;
@@ -190,7 +227,63 @@ STATUS freeRequest(struct request *request) {
     return SUCCESS;
 }
 
+ssize_t send_to_client(int socket, const void *buf, size_t len, int flags) {
+    ssize_t ret = send_all(socket, buf, len, flags);
+    if (ret > 0) thread_bytes_sent += (unsigned long long) ret;
+
+    return ret;
+}
+
+void count_bytes_sent(size_t len) {
+    thread_bytes_sent += len;
+}
+
+unsigned long long bytes_sent_by_thread() {
+    return thread_bytes_sent;
+}
+
+ssize_t send_all(int socket, const void *buf, size_t len, int flags) {
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t ret = send(socket, (const char *) buf + sent, len - sent, flags);
+        if (ret == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        sent += ret; // The socket buffer may have been full, so the rest is sent in the next iteration
+    }
+
+    return (ssize_t) sent;
+}
+
+/**
+ * @brief Writes the Server-Timing header line of the response being sent by the calling thread
+ * @param[out] buf Buffer where the line must be written, without CRLF
+ * @param[in] buf_len Size of the buffer
+ * @return Length of the line, or 0 if there's nothing to report
+ */
+size_t format_server_timing(char *buf, size_t buf_len) {
+    const struct metrics_trace *trace = metrics_trace();
+    uint64_t script = trace->phases[PHASE_SCRIPT]; // The script is usually still running while its header is sent
+    if (trace->started[PHASE_SCRIPT]) script += metrics_now() - trace->started[PHASE_SCRIPT];
+
+    const char *names[] = {"parse", "resolve", "io", "cgi"};
+    uint64_t values[] = {trace->phases[PHASE_PARSE], trace->phases[PHASE_ROUTE], trace->phases[PHASE_OPEN], script};
+
+    size_t len = (size_t) snprintf(buf, buf_len, "%s: ", HDR_SERVER_TIMING);
+    int empty = 1;
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]) && len < buf_len; i++) {
+        if (values[i] == 0) continue;
+        len += (size_t) snprintf(buf + len, buf_len - len, "%s%s;dur=%.3f", empty ? "" : ", ", names[i],
+                                 (double) values[i] / 1e6);
+        empty = 0;
+    }
+
+    return empty || len >= buf_len ? 0 : len;
+}
+
 int send_response_header(int socket, unsigned int code, const char *message, struct httpres_headers *headers) {
+    uint64_t start = metrics_now();
     char *status_line = NULL;
     size_t status_line_len = 0;
 
@@ -207,29 +300,44 @@ int send_response_header(int socket, unsigned int code, const char *message, str
         sprintf(status_line, "%s %i\r\n", HTTP_VER, code); // Print the status line
     }
 
+    char timing[MAX_BUFFER];
+    size_t timing_len = server_timing ? format_server_timing(timing, sizeof(timing)) : 0;
+
     // Size for the status line and headers
     size_t header_size = status_line_len + headers_getlen(headers) + CRLF_LEN;
+    if (timing_len) header_size += timing_len + CRLF_LEN;
 
     char *buffer = calloc(header_size + 1, sizeof(char)); // Allocate a buffer with the required memory
     if (!buffer) return -1;
 
-    strcpy(buffer, status_line); // Copy the status line to the response buffer
+    memcpy(buffer, status_line, status_line_len); // Copy the status line to the response buffer
+    size_t pos = status_line_len;
 
     if (headers) {
         for (int i = 0; i < headers->num_headers; i++) {
-            strcat(buffer + status_line_len, headers->headers[i]); // Add the header
-            strcat(buffer, "\r\n"); // Add the header CRLF
+            memcpy(buffer + pos, headers->headers[i].line, headers->headers[i].len); // Add the header
+            pos += headers->headers[i].len;
+            memcpy(buffer + pos, "\r\n", CRLF_LEN); // Add the header CRLF
+            pos += CRLF_LEN;
         }
     }
 
+    if (timing_len) { // Added here, so that it's as late as possible
+        memcpy(buffer + pos, timing, timing_len);
+        pos += timing_len;
+        memcpy(buffer + pos, "\r\n", CRLF_LEN);
+        pos += CRLF_LEN;
+    }
+
     // Empty line before response body
-    strcat(buffer, "\r\n");
+    memcpy(buffer + pos, "\r\n", CRLF_LEN);
+    metrics_observe_since(PHASE_HEADER, start);
 
 #if DEBUG >= 3
     printf("Sending response header:\n%s\n", buffer);
 #endif
 
-    int ret = send(socket, buffer, header_size, 0);
+    int ret = (int) send_to_client(socket, buffer, header_size, 0);
 
     free(buffer);
     free(status_line);
@@ -243,7 +351,18 @@ int send_response_body(int socket, const char *body, unsigned long body_len) {
 #if DEBUG >= 3
     printf("Sending response body:\n%s\n", body);
 #endif
-    return send(socket, body, body_len/* + 1*/, 0);
+    uint64_t start = metrics_now();
+    int ret = (int) send_to_client(socket, body, body_len, 0);
+    metrics_observe_since(PHASE_SEND, start);
+
+    return ret;
+}
+
+void close_connection(int socket) {
+    PROBE3(close, socket, probe_tid(), thread_bytes_sent);
+    shutdown(socket, SHUT_WR);
+    shutdown(socket, SHUT_RD);
+    close(socket);
 }
 
 HTTP_RESPONSE_CODE
@@ -273,9 +392,7 @@ respond(int socket, HTTP_RESPONSE_CODE code, const char *message, struct httpres
         printf("Sent %li bytes\n", bytes_sent);
     }
 #endif
-    shutdown(socket, SHUT_WR);
-    shutdown(socket, SHUT_RD);
-    close(socket);
+    close_connection(socket);
 
     return code;
 }
@@ -288,7 +405,7 @@ STATUS setDefaultHeaders(struct httpres_headers *headers) {
     char timeStr[100];
     time_t now = time(0);
     gmtime_r(&now, &tm);
-    strftime(timeStr, sizeof timeStr, "%a, %d %b %Y %H:%M:%S %Z", &tm);
+    strftime(timeStr, sizeof timeStr, HTTP_DATE_FMT, &tm);
     //create date header
     set_header(headers, HDR_DATE, timeStr);
     //create server header
@@ -311,174 +428,557 @@ int is_directory(const char *path) {
     return S_ISDIR(path_stat.st_mode); // NOLINT(hicpp-signed-bitwise)
 }
 
+const char *get_request_header(const struct request *request, const char *name, size_t *value_len) {
+    if (!request || !name) return NULL;
+
+    size_t name_len = strlen(name);
+    for (size_t i = 0; i < request->num_headers; i++) {
+        const struct phr_header *header = &request->headers[i];
+        // Multiline headers have a NULL name in their continuation lines, so those must be skipped
+        if (header->name && header->name_len == name_len && strncasecmp(header->name, name, name_len) == 0) {
+            if (value_len) *value_len = header->value_len;
+            return header->value;
+        }
+    }
+
+    return NULL; // The request doesn't contain the header
+}
+
 /**
- * @brief Returns the size of the provided file
- * @param[in] fd File descriptor whose size must be found out
- * @return Size of the file, or -1 if an error occurs
+ * @brief Parses an HTTP date (in the IMF-fixdate format) into a timestamp
+ * @param[in] value String containing the date (not necessarily null-terminated)
+ * @param[in] value_len Length of the date string
+ * @param[out] out Variable where the resulting timestamp must be stored
+ * @return \ref STATUS.SUCCESS if the date was valid, \ref STATUS.ERROR otherwise
  */
-off_t get_file_size(FILE *fd) {
-    if (!fd) return -1;
+STATUS parse_http_date(const char *value, size_t value_len, time_t *out) {
+    char date[MAX_HTTP_DATE + 1];
+    if (!value || !out || value_len >= sizeof(date)) return ERROR;
 
-    struct stat s;
-    memset(&s, 0, sizeof(struct stat)); // Zero out the structure
+    memcpy(date, value, value_len); // Copy the date so that it's null-terminated
+    date[value_len] = '\0';
 
-    if (fstat(fileno(fd), &s) == -1) { // Obtain the stats for the file
-        return -1; // Error while executing stat
-    }
+    struct tm tm;
+    memset(&tm, 0, sizeof(struct tm));
+    char *end = strptime(date, HTTP_DATE_FMT, &tm);
+    if (!end || *end != '\0') return ERROR; // The whole string must match the format
+
+    *out = timegm(&tm); // HTTP dates are always expressed in GMT
+    return SUCCESS;
+}
+
+int format_etag(const struct stat *st, char *buf, size_t buf_len) {
+    if (!st || !buf) return -1;
 
-    return s.st_size; // Return the file size
+    // The modification time is included with nanosecond precision, so that quick successive writes change the tag
+    unsigned long long mtime_ns = (unsigned long long) st->st_mtim.tv_sec * 1000000000ULL + st->st_mtim.tv_nsec;
+
+    int len = snprintf(buf, buf_len, "\"%llx-%llx-%llx\"", (unsigned long long) st->st_ino,
+                       (unsigned long long) st->st_size, mtime_ns);
+    if (len < 0 || (size_t) len >= buf_len) return -1;
+
+    return len;
 }
 
 /**
- * @brief Spawns a child process executing the provided command, and routes its stdin and stdout to pipes
- * @details This function is similar to popen(), but supports bidirectional communication with the spawned
- * process. It creates pipes in both directions, so that the caller can later write to the spawned process'
- * stdin, and read from its stdout. Heavily inspired in code by <psimerda@redhat.com>
- * @author Diego Ortín Fernández
- * @see https://github.com/crossdistro/netresolve/blob/master/backends/exec.c#L46
- * @param[in]  command The argv of the command to be executed
- * @param[out] pid Variable to store the process ID of the spawned process
- * @param[out] infd Variable to store the descriptor number for writing to the process' stdin
- * @param[out] outfd Variable to store the descriptor number for reading from the process' stdout
- * @return 0 if something goes wrong, 1 otherwise
+ * @brief Checks if an entity tag is contained in a list of entity tags, such as the one in If-None-Match
+ * @details The weak comparison function is used, so the "W/" prefix of the tags in the list is ignored.
+ * @param[in] list Comma separated list of entity tags (not necessarily null-terminated), or "*"
+ * @param[in] list_len Length of the list
+ * @param[in] etag Null-terminated entity tag (including its quotes) to look for
+ * @return 1 if the tag is in the list, 0 otherwise
  */
-int popen2(char *const command[], int *pid, int *infd, int *outfd) {
-    int pipe_in[2], pipe_out[2];
-
-    if (!pid || !infd || !outfd) return 0;
+int etag_list_matches(const char *list, size_t list_len, const char *etag) {
+    size_t etag_len = strlen(etag);
+    const char *pos = list, *end = list + list_len;
 
-    if (pipe(pipe_in) == -1) goto pipe1_error;
-    if (pipe(pipe_out) == -1) goto pipe2_error;
-    if ((*pid = fork()) == -1) goto fork_error;
+    while (pos < end) {
+        while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == ',')) pos++; // Skip separators
 
-    if (*pid) { // If we're inside the parent process
-        *infd = pipe_in[1]; // Set the input descriptor to the write end of pipe_in
-        *outfd = pipe_out[0]; // Set the output descriptor to the read end of pipe_out
+        const char *tag_end = memchr(pos, ',', end - pos); // Find the end of the current tag
+        if (!tag_end) tag_end = end;
 
-        close(pipe_in[0]); // Close the read end of pipe_in, as we're not using it
-        close(pipe_out[1]); // Close the write end of pipe_out, as we're not using it
+        const char *tag = pos;
+        const char *last = tag_end;
+        while (last > tag && (last[-1] == ' ' || last[-1] == '\t')) last--; // Trim the trailing whitespace
 
-        return 1;
-    } else { // If we're inside the child process
-        dup2(pipe_in[0], STDIN_FILENO); // Replace the process' stdin by the read end of pipe_in
-        dup2(pipe_out[1], STDOUT_FILENO); // Replace the process' stdout by the write end of pipe_in
+        if (last - tag == 1 && *tag == '*') return 1; // The wildcard matches any current representation
 
-        // Close all the pipes
-        close(pipe_in[0]);
-        close(pipe_in[1]);
-        close(pipe_out[0]);
-        close(pipe_out[1]);
+        if (last - tag > 2 && tag[0] == 'W' && tag[1] == '/') tag += 2; // Skip the weak indicator
 
-        execvp(*command, command); // Execute the provided command
+        if ((size_t) (last - tag) == etag_len && memcmp(tag, etag, etag_len) == 0) return 1;
 
-        // If an error occurs
-        fprintf(stderr, "Error executing %s: %s", *command, strerror(errno));
-        abort();
+        pos = tag_end + 1;
     }
 
-    fork_error:
-    close(pipe_out[1]);
-    close(pipe_out[0]);
-    pipe2_error:
-    close(pipe_in[1]);
-    close(pipe_in[0]);
-    pipe1_error:
     return 0;
 }
 
-int run_executable(int socket, struct httpres_headers *headers, struct request *request, struct _srvutils *utils,
-                   const char *exec_cmd, const char *fullpath) {
-    if (!fullpath || !exec_cmd || !utils || !request || !headers) return 0;
+int is_not_modified(const struct request *request, const struct stat *st) {
+    if (!request || !st) return 0;
 
-    //char *command = NULL;
+    size_t value_len;
+    const char *value = get_request_header(request, HDR_IF_NONE_MATCH, &value_len);
+    if (value) { // If-None-Match takes precedence over If-Modified-Since
+        char etag[MAX_ETAG];
+        if (format_etag(st, etag, sizeof(etag)) == -1) return 0;
 
-    const char *command[3];
-    command[0] = exec_cmd;
-    command[1] = fullpath;
-    command[2] = NULL;
+        return etag_list_matches(value, value_len, etag);
+    }
 
-    // Calculate required size for the command string and its null terminator
-    //size_t command_size = snprintf(NULL, 0, "%s %s", exec_cmd, path) + 1;
-    //command = malloc(sizeof(char) * command_size); // Allocate space for the command string
-    //snprintf(command, command_size, "%s %s", exec_cmd, path); // Print the command string
+    value = get_request_header(request, HDR_IF_MODIFIED_SINCE, &value_len);
+    if (value) {
+        time_t since;
+        // Invalid dates, and dates in the future, must be ignored
+        if (parse_http_date(value, value_len, &since) == ERROR || since > time(NULL)) return 0;
 
+        return st->st_mtime <= since;
+    }
 
-    pid_t pid;
-    int infd, outfd;
+    return 0; // The request isn't conditional
+}
 
-    if (popen2((char *const *) command, &pid, &infd, &outfd) == 0) return 0;
-    //free(command);
-    //if (!fd) return 0;
+void set_io_pool(iopool *pool, transfer_done done, void *arg) {
+    io_pool_done = done;
+    io_pool_done_arg = arg;
+    io_pool = pool;
+}
+
+void set_server_timing(int enabled) {
+    server_timing = enabled ? 1 : 0;
+}
 
-    // If the request had a querystring, write it to the script's stdin
-    if (request->querystring) {
-        write(infd, request->querystring, strlen(request->querystring));
-        write(infd, "\r\n", 2);
+void set_stream_rate_limit(long bytes_per_second) {
+    stream_rate_limit = bytes_per_second > 0 ? bytes_per_second : 0;
+}
+
+/**
+ * @brief Waits until sending the given amount of bytes complies with the stream rate limit
+ * @param[in] start Time at which the transfer started (in the \a CLOCK_MONOTONIC clock)
+ * @param[in] sent Number of bytes sent since then
+ */
+void stream_pace(const struct timespec *start, off_t sent) {
+    // Time at which the transfer would have sent these bytes at exactly the maximum rate
+    long long target_ns = (long long) sent * 1000000000LL / stream_rate_limit;
+    struct timespec target = {
+            .tv_sec = start->tv_sec + (time_t) (target_ns / 1000000000LL),
+            .tv_nsec = start->tv_nsec + (long) (target_ns % 1000000000LL)
+    };
+    if (target.tv_nsec >= 1000000000L) {
+        target.tv_sec++;
+        target.tv_nsec -= 1000000000L;
     }
 
-    // If the request has a body, write it to the script's stdin
-    if (request->body) {
-        write(infd, request->body, request->body_len);
-        write(infd, "\r\n", 2);
+    // Sleeping until an absolute time doesn't accumulate the error of each iteration, and returns at once if it's late
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, NULL) == EINTR);
+}
+
+/**
+ * @brief Sends a section of a file to the provided socket with sendfile(), retrying until all of it has been sent
+ * @details The section is sent in chunks of at most \ref STREAM_CHUNK bytes, so that files of any size are streamed
+ * with constant memory and the kernel can be told in advance which chunk comes next. Big sections are announced as
+ * sequential reads, which makes the kernel use a bigger readahead window, and the chunk after the current one is
+ * requested before sending, so that disk reads overlap with network writes. If a rate limit is set, the transfer is
+ * paced after each chunk.
+ * @param[out] socket The socket to which the contents must be sent
+ * @param[in] fd Descriptor of the file to send
+ * @param[in] offset Position of the first byte to send
+ * @param[in] length Number of bytes to send
+ * @return \ref STATUS.SUCCESS if everything was sent, \ref STATUS.ERROR otherwise
+ */
+STATUS send_file_contents(int socket, int fd, off_t offset, off_t length) {
+    uint64_t start_ns = metrics_now(); // Includes the pauses of the rate limit, which the client also waits for
+    PROBE4(send_start, socket, probe_tid(), offset, length);
+    off_t chunk = STREAM_CHUNK;
+    if (stream_rate_limit > 0 && stream_rate_limit / STREAM_PACE_STEPS < chunk) { // Slow streams need smaller chunks
+        chunk = stream_rate_limit / STREAM_PACE_STEPS > 0 ? stream_rate_limit / STREAM_PACE_STEPS : 1;
     }
 
-    close(infd);
+    int streaming = length > STREAM_CHUNK; // Small sections are sent in a single call, without any hints
+    if (streaming) posix_fadvise(fd, offset, length, POSIX_FADV_SEQUENTIAL);
 
-    char result[MAX_BUFFER + 1]; // Buffer to hold the result of the execution
+    struct timespec start;
+    if (stream_rate_limit > 0) clock_gettime(CLOCK_MONOTONIC, &start);
 
-    waitpid(pid, NULL, 0); // Wait for the script to finish execution
+    off_t sent_total = 0;
+    while (length > 0) {
+        off_t to_send = length < chunk ? length : chunk;
+        if (streaming && length > to_send) { // Start reading the next chunk while this one is being sent
+            posix_fadvise(fd, offset + to_send, length - to_send < STREAM_CHUNK ? length - to_send : STREAM_CHUNK,
+                          POSIX_FADV_WILLNEED);
+        }
 
-    unsigned long n_read = read(outfd, result, sizeof(result) / sizeof(result[0])); // Read from the pipe
+        while (to_send > 0) {
+            ssize_t sent = sendfile(socket, fd, &offset, to_send); // The offset is advanced by sendfile itself
+            if (sent == -1 && errno == EINTR) continue;
+            if (sent <= 0) { // Either the client has gone away, or the file was truncated while sending it
+                PROBE4(send_end, socket, probe_tid(), sent_total, ERROR);
+                return ERROR;
+            }
+
+            to_send -= sent;
+            length -= sent;
+            sent_total += sent;
+            count_bytes_sent((size_t) sent);
+        }
 
-    if (n_read > 0) { // If reading from the pipe goes well
-#if DEBUG >= 2
-        utils->log(stdout, "Command output: \n%s", result);
-#endif
-        // Always set html content type, as requested by the specs
-        set_header(headers, "Content-Type", "text/html");
-        return respond(socket, OK, "OK", headers, result, n_read);
+        if (stream_rate_limit > 0 && length > 0) stream_pace(&start, sent_total);
+    }
+
+    metrics_observe_since(PHASE_SEND, start_ns);
+    PROBE4(send_end, socket, probe_tid(), sent_total, SUCCESS);
+    return SUCCESS;
+}
+
+/**
+ * @brief Sends the body of a response from the I/O pool, then closes both the file and the connection and reports the
+ * request
+ * @param[in] arg The \ref file_transfer to perform, which is freed afterwards
+ */
+void file_transfer_run(void *arg) {
+    struct file_transfer *transfer = arg;
+    *metrics_trace() = transfer->trace;
+
+    unsigned long long sent = thread_bytes_sent;
+    send_file_contents(transfer->socket, transfer->fd, transfer->offset, transfer->length);
+    close(transfer->fd);
+    close_connection(transfer->socket);
+
+    // If the client went away, only the part of the body that it received is counted
+    sent = transfer->bytes_sent + (thread_bytes_sent - sent);
+    io_pool_done(transfer->request, transfer->code, sent, io_pool_done_arg);
+    free(transfer);
+}
+
+/**
+ * @brief Sends a section of a file as the body of a response, then closes the connection
+ * @details If the beginning of the section isn't in the page cache, it's sent by the I/O pool instead, so that the
+ * current thread can go on serving other requests instead of waiting for the disk. In that case, the pool takes
+ * ownership of the file, the socket and the request, which it reports once the body is sent. If there's no pool, or
+ * it's full, the section is sent right away.
+ * @param[out] socket The socket to which the contents must be sent
+ * @param[in] fd Descriptor of the file to send, or -1 if there's no body
+ * @param[in] offset Position of the first byte to send
+ * @param[in] length Number of bytes to send
+ * @param[in] request The request being answered
+ * @param[in] code Code of the response
+ * @return 1 if the body was handed to the I/O pool, so neither @p fd nor @p request can be used anymore, 0 otherwise
+ */
+int send_body(int socket, int fd, off_t offset, off_t length, struct request *request, HTTP_RESPONSE_CODE code) {
+    if (fd != -1 && io_pool && io_pool_done && !iopool_is_resident(fd, offset, length)) {
+        struct file_transfer *transfer = malloc(sizeof(struct file_transfer));
+        if (transfer) {
+            transfer->socket = socket;
+            transfer->fd = fd;
+            transfer->offset = offset;
+            transfer->length = length;
+            transfer->request = request;
+            transfer->code = code;
+            transfer->bytes_sent = thread_bytes_sent - request->sent_before;
+            transfer->trace = *metrics_trace();
+
+            // Ask for the data right away, so that the disk is already busy when the pool picks the job up
+            posix_fadvise(fd, offset, length < STREAM_CHUNK ? length : STREAM_CHUNK, POSIX_FADV_WILLNEED);
+            if (iopool_submit(io_pool, file_transfer_run, transfer) == SUCCESS) return 1;
+            free(transfer);
+        }
+    }
+
+    if (fd != -1) send_file_contents(socket, fd, offset, length);
+    close_connection(socket);
+
+    return 0;
+}
+
+/**
+ * @brief Writes the headers that precede each part of a multipart/byteranges body, including the boundary
+ * @param[out] buf Buffer where the part headers must be written (can be NULL to calculate the length)
+ * @param[in] buf_len Size of the buffer
+ * @param[in] boundary The multipart boundary
+ * @param[in] type MIME type of the file (can be NULL)
+ * @param[in] range Range of the file contained in the part
+ * @param[in] size Total size of the file
+ * @return Length of the part headers, as returned by snprintf()
+ */
+int format_part_header(char *buf, size_t buf_len, const char *boundary, const char *type,
+                       const struct byte_range *range, off_t size) {
+    if (type) {
+        return snprintf(buf, buf_len, "\r\n--%s\r\n%s: %s\r\n%s: %s %lld-%lld/%lld\r\n\r\n", boundary,
+                        HDR_CONTENT_TYPE, type, HDR_CONTENT_RANGE, RANGE_UNIT, (long long) range->first,
+                        (long long) range->last, (long long) size);
     } else {
-        return respond(socket, INTERNAL_ERROR, "Execution error", headers, NULL, 0);
+        return snprintf(buf, buf_len, "\r\n--%s\r\n%s: %s %lld-%lld/%lld\r\n\r\n", boundary,
+                        HDR_CONTENT_RANGE, RANGE_UNIT, (long long) range->first, (long long) range->last,
+                        (long long) size);
     }
 }
 
-HTTP_RESPONSE_CODE send_file(int socket, struct httpres_headers *headers, const char *path) {
-    if (!headers || !path) {
-        return respond(socket, INTERNAL_ERROR, "Internal error", NULL, NULL, 0);
+/**
+ * @brief Sends a 206 response with a single range of the file as its body
+ * @param[out] socket The socket to which the response must be sent
+ * @param[in] headers Structure containing the headers for the response
+ * @param[in] request The request being answered
+ * @param[in] fd Descriptor of the file to send, or -1 if only the headers must be sent
+ * @param[in] path Path of the file
+ * @param[in] st Metadata of the file
+ * @param[in] range The range to send
+ * @param[out] offloaded Variable set to 1 if the body was handed to the I/O pool, which then owns @p fd and @p request
+ * @return code of the HTTP response sent to the socket
+ */
+HTTP_RESPONSE_CODE send_single_range(int socket, struct httpres_headers *headers, struct request *request, int fd,
+                                     const char *path, const struct stat *st, const struct byte_range *range,
+                                     int *offloaded) {
+    char content_range[MAX_BUFFER];
+    snprintf(content_range, sizeof(content_range), "%s %lld-%lld/%lld", RANGE_UNIT, (long long) range->first,
+             (long long) range->last, (long long) st->st_size);
+
+    set_header(headers, HDR_CONTENT_RANGE, content_range);
+    add_content_type(path, headers);
+    add_content_length(range->last - range->first + 1, headers);
+
+    send_response_header(socket, PARTIAL_CONTENT, "Partial Content", headers);
+    *offloaded = send_body(socket, fd, range->first, range->last - range->first + 1, request, PARTIAL_CONTENT);
+
+    return PARTIAL_CONTENT;
+}
+
+/**
+ * @brief Sends a 206 response with several ranges of the file, as a multipart/byteranges body
+ * @details The length of the whole body is calculated beforehand, so that the part headers can be sent as they're
+ * generated, interleaved with the file contents, without having to hold the body in memory.
+ * @param[out] socket The socket to which the response must be sent
+ * @param[in] headers Structure containing the headers for the response
+ * @param[in] fd Descriptor of the file to send, or -1 if only the headers must be sent
+ * @param[in] path Path of the file
+ * @param[in] st Metadata of the file
+ * @param[in] ranges The ranges to send
+ * @param[in] n_ranges Number of ranges in the array
+ * @return code of the HTTP response sent to the socket
+ */
+HTTP_RESPONSE_CODE send_multiple_ranges(int socket, struct httpres_headers *headers, int fd, const char *path,
+                                        const struct stat *st, const struct byte_range *ranges, int n_ranges) {
+    // The boundary is random so that it can't be predicted and placed inside the file
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    char boundary[17];
+    snprintf(boundary, sizeof(boundary), "%08lx%08lx", random() ^ now.tv_nsec, random());
+
+    const char *type = get_mime_type(path);
+
+    // Calculate the length of the body: every part with its headers, and the closing boundary
+    char closing[32];
+    int closing_len = snprintf(closing, sizeof(closing), "\r\n--%s--\r\n", boundary);
+    off_t body_len = closing_len;
+    for (int i = 0; i < n_ranges; i++) {
+        body_len += format_part_header(NULL, 0, boundary, type, &ranges[i], st->st_size);
+        body_len += ranges[i].last - ranges[i].first + 1;
     }
 
-    if (!is_regular_file(path)) { // If it's not a regular file (i.e. is a directory, pipe, link...)
-        return respond(socket, NOT_FOUND, "Not found", headers, NULL, 0);
+    char content_type[64];
+    snprintf(content_type, sizeof(content_type), "multipart/byteranges; boundary=%s", boundary);
+    set_header(headers, HDR_CONTENT_TYPE, content_type);
+    add_content_length(body_len, headers);
+
+    send_response_header(socket, PARTIAL_CONTENT, "Partial Content", headers);
+    if (fd == -1) { // Only the headers must be sent
+        close_connection(socket);
+        return PARTIAL_CONTENT;
     }
 
-    FILE *f = fopen(path, "r");
-    if (f) {
-        long length = get_file_size(f);
+    for (int i = 0; i < n_ranges; i++) {
+        char part_header[MAX_BUFFER];
+        int part_header_len = format_part_header(part_header, sizeof(part_header), boundary, type, &ranges[i],
+                                                 st->st_size);
 
-        // Copy the entire file to the buffer
-        char *buffer = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fileno(f), 0);
-        if (buffer == MAP_FAILED) {
-            return respond(socket, INTERNAL_ERROR, "Internal error", headers, NULL, 0);
+        if (send_to_client(socket, part_header, part_header_len, MSG_MORE) == -1 ||
+            send_file_contents(socket, fd, ranges[i].first, ranges[i].last - ranges[i].first + 1) == ERROR) {
+            break; // If the client went away, there's no point in sending the rest of the parts
         }
+    }
+    send_to_client(socket, closing, closing_len, 0);
+    close_connection(socket);
 
-        // Add the file headers
-        add_last_modified(path, headers);
-        add_content_type(path, headers);
-        add_content_length(length, headers);
+    return PARTIAL_CONTENT;
+}
 
-        respond(socket, OK, "OK", headers, buffer, length);
+HTTP_RESPONSE_CODE
+send_file(int socket, struct httpres_headers *headers, struct request *request, const char *path,
+          const struct stat *st) {
+    if (!headers || !request || !path || !st) {
+        return respond(socket, INTERNAL_ERROR, "Internal error", NULL, NULL, 0);
+    }
 
-        munmap(buffer, length); // Free the mapping
+    if (!S_ISREG(st->st_mode)) { // If it's not a regular file (i.e. is a directory, pipe, link...)
+        return respond(socket, NOT_FOUND, "Not found", headers, NULL, 0);
+    }
 
-        fclose(f);
-        return OK;
-    } else {
+    int fd = -1; // HEAD requests don't need the contents of the file, so it's only opened otherwise
+    uint64_t start = metrics_now();
+    if (!request->headers_only && (fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
         if (errno == ENOENT) {
             return respond(socket, NOT_FOUND, "Not found", NULL, NULL, 0);
         } else {
             return respond(socket, INTERNAL_ERROR, "Not found", NULL, NULL, 0);
         }
     }
+
+    // The metadata of the caller may come from the path cache, so the file could have been replaced since then
+    struct stat current;
+    if ((fd != -1 ? fstat(fd, &current) : stat(path, &current)) == -1) {
+        HTTP_RESPONSE_CODE code = errno == ENOENT ? NOT_FOUND : INTERNAL_ERROR;
+        if (fd != -1) close(fd);
+        return respond(socket, code, "Not found", NULL, NULL, 0);
+    }
+    st = &current;
+
+    if (fd != -1) metrics_observe_since(PHASE_OPEN, start);
+
+    if (!S_ISREG(st->st_mode)) {
+        if (fd != -1) close(fd);
+        return respond(socket, NOT_FOUND, "Not found", headers, NULL, 0);
+    }
+
+    // Add the file headers
+    add_last_modified(st, headers);
+    add_etag(st, headers);
+    set_header(headers, HDR_ACCEPT_RANGES, RANGE_UNIT);
+
+    // Ranges are only taken into account if the file hasn't changed since the client obtained its validator
+    struct byte_range ranges[MAX_RANGES];
+    int n_ranges = -1;
+    size_t range_len;
+    const char *range = get_request_header(request, HDR_RANGE, &range_len);
+    if (range && if_range_matches(request, st)) {
+        n_ranges = parse_range(range, range_len, st->st_size, ranges, MAX_RANGES);
+    }
+
+    HTTP_RESPONSE_CODE ret;
+    int offloaded = 0; // Once the body is handed to the I/O pool, the file and the request belong to it
+    if (is_not_modified(request, st)) { // The client's copy is still valid
+        ret = respond(socket, NOT_MODIFIED, "Not Modified", headers, NULL, 0);
+    } else if (n_ranges == 0) { // None of the requested ranges overlap the file
+        char content_range[MAX_BUFFER];
+        snprintf(content_range, sizeof(content_range), "%s */%lld", RANGE_UNIT, (long long) st->st_size);
+        set_header(headers, HDR_CONTENT_RANGE, content_range);
+
+        ret = respond(socket, RANGE_NOT_SATISFIABLE, "Range Not Satisfiable", headers, NULL, 0);
+    } else if (n_ranges == 1) {
+        ret = send_single_range(socket, headers, request, fd, path, st, &ranges[0], &offloaded);
+    } else if (n_ranges > 1) {
+        ret = send_multiple_ranges(socket, headers, fd, path, st, ranges, n_ranges);
+    } else { // There's no (valid) range, so the whole file is sent
+        add_content_type(path, headers);
+        add_content_length(st->st_size, headers);
+
+        send_response_header(socket, OK, "OK", headers);
+        offloaded = send_body(socket, fd, 0, st->st_size, request, OK);
+
+        ret = OK;
+    }
+
+    if (offloaded) return RESPONSE_OFFLOADED;
+
+    if (fd != -1) close(fd);
+    return ret;
+}
+
+/**
+ * @brief Parses a non-negative decimal number that is part of a byte range
+ * @param[in,out] pos Pointer to the current position in the string, which is advanced past the number
+ * @param[in] end Pointer to the end of the string
+ * @param[out] out Variable where the number must be stored
+ * @return Number of digits parsed, or -1 if the number doesn't fit in an off_t
+ */
+int parse_range_offset(const char **pos, const char *end, off_t *out) {
+    int digits = 0;
+    long long value = 0;
+
+    while (*pos < end && **pos >= '0' && **pos <= '9') {
+        if (value > (LLONG_MAX - 9) / 10) return -1; // Check for overflow before it happens
+        value = value * 10 + (**pos - '0');
+        (*pos)++;
+        digits++;
+    }
+
+    *out = (off_t) value;
+    return digits;
+}
+
+int parse_range(const char *value, size_t value_len, off_t size, struct byte_range *ranges, int max_ranges) {
+    if (!value || !ranges || max_ranges <= 0) return -1;
+
+    const char *pos = value, *end = value + value_len;
+    size_t unit_len = strlen(RANGE_UNIT);
+
+    // The value must start with the range unit followed by '='
+    if (value_len <= unit_len || strncasecmp(value, RANGE_UNIT, unit_len) != 0 || value[unit_len] != '=') return -1;
+    pos += unit_len + 1;
+
+    int n_specs = 0, n_ranges = 0;
+    while (pos < end) {
+        while (pos < end && (*pos == ' ' || *pos == '\t')) pos++; // Skip the whitespace before the range
+        if (pos < end && *pos == ',') { // Empty list elements are allowed
+            pos++;
+            continue;
+        }
+        if (pos == end) break;
+
+        off_t first, last;
+        if (*pos == '-') { // Suffix range: the last n bytes of the file
+            pos++;
+            off_t suffix;
+            if (parse_range_offset(&pos, end, &suffix) <= 0) return -1;
+
+            first = suffix >= size ? 0 : size - suffix;
+            last = size - 1;
+            if (suffix == 0) first = size; // A zero-length suffix can never be satisfied
+        } else {
+            if (parse_range_offset(&pos, end, &first) <= 0) return -1;
+            if (pos == end || *pos != '-') return -1;
+            pos++;
+
+            int digits = parse_range_offset(&pos, end, &last);
+            if (digits == -1) return -1;
+            if (digits == 0 || last >= size) last = size - 1; // Open ranges, or ranges past the end, are truncated
+            else if (last < first) return -1;
+        }
+
+        while (pos < end && (*pos == ' ' || *pos == '\t')) pos++; // Skip the whitespace after the range
+        if (pos < end && *pos != ',') return -1; // Ranges must be separated by commas
+
+        if (++n_specs > max_ranges) return -1; // Too many ranges are ignored altogether
+
+        if (first < size) { // Ranges that start past the end of the file can't be satisfied
+            ranges[n_ranges].first = first;
+            ranges[n_ranges].last = last;
+            n_ranges++;
+        }
+    }
+
+    if (n_specs == 0) return -1; // The header didn't contain any range
+
+    return n_ranges;
+}
+
+int if_range_matches(const struct request *request, const struct stat *st) {
+    if (!request || !st) return 0;
+
+    size_t value_len;
+    const char *value = get_request_header(request, HDR_IF_RANGE, &value_len);
+    if (!value) return 1; // Without precondition, the ranges are always valid
+
+    if (value_len > 0 && value[0] == '"') { // The validator is an entity tag, which must be compared strongly
+        char etag[MAX_ETAG];
+        int etag_len = format_etag(st, etag, sizeof(etag));
+        return etag_len > 0 && (size_t) etag_len == value_len && memcmp(value, etag, value_len) == 0;
+    }
+
+    if (value_len > 1 && value[0] == 'W' && value[1] == '/') return 0; // Weak entity tags never match
+
+    time_t date; // Otherwise, the validator is a date, which must match the last modification exactly
+    if (parse_http_date(value, value_len, &date) == ERROR) return 0;
+
+    return date == st->st_mtime;
 }
 
 STATUS add_content_type(const char *filePath, struct httpres_headers *headers) {
@@ -490,34 +990,33 @@ STATUS add_content_type(const char *filePath, struct httpres_headers *headers) {
     return set_header(headers, HDR_CONTENT_TYPE, content_name);
 }
 
-STATUS add_last_modified(const char *filePath, struct httpres_headers *headers) {
-    char t[100] = "";
-    struct stat b;
-    memset(&b, 0, sizeof(struct stat));
-
-    stat(filePath, &b);
+STATUS add_last_modified(const struct stat *st, struct httpres_headers *headers) {
+    if (!st) return ERROR;
 
+    char t[MAX_HTTP_DATE] = "";
     struct tm tm;
-    strftime(t, sizeof t, "%a, %d %b %Y %H:%M:%S %Z", localtime_r(&b.st_mtime, &tm));
+    strftime(t, sizeof t, HTTP_DATE_FMT, gmtime_r(&st->st_mtime, &tm)); // HTTP dates are always in GMT
     return set_header(headers, HDR_LAST_MODIFIED, t);
 }
 
+STATUS add_etag(const struct stat *st, struct httpres_headers *headers) {
+    char etag[MAX_ETAG];
+    if (format_etag(st, etag, sizeof(etag)) == -1) return ERROR;
+
+    return set_header(headers, HDR_ETAG, etag);
+}
+
 
-STATUS add_content_length(long length, struct httpres_headers *headers) {
-    char len_str[10];
-    sprintf(len_str, "%li", length);
+STATUS add_content_length(off_t length, struct httpres_headers *headers) {
+    char len_str[MAX_CONTENT_LENGTH];
+    snprintf(len_str, sizeof(len_str), "%lld", (long long) length);
     return set_header(headers, HDR_CONTENT_LENGTH, len_str);
 }
 
 const char *get_mime_type(const char *name) {
     if (!name) return NULL;
 
-    char *ext = strrchr(name, '.');
-
-    if (!ext) return NULL;
-    ext++; // skip the '.';
-
-    return mime_get_association(ext);
+    return mime_get_type(name);
 }
 
 struct httpres_headers *create_header_struct() {
@@ -528,25 +1027,54 @@ struct httpres_headers *create_header_struct() {
     return new;
 }
 
+/**
+ * @brief Makes room for a new header in the header structure
+ * @param[in,out] headers Header structure that must be enlarged
+ * @return Pointer to the new (uninitialized) header, or NULL if an error happens
+ */
+struct httpres_header *headers_append(struct httpres_headers *headers) {
+    struct httpres_header *new = realloc(headers->headers, (headers->num_headers + 1) * sizeof(struct httpres_header));
+    if (!new) return NULL;
+
+    headers->headers = new;
+    return &headers->headers[headers->num_headers++];
+}
+
 STATUS set_header(struct httpres_headers *headers, const char *name, const char *value) {
     if (!headers || !name || !value) return ERROR;
 
-    if (headers->num_headers == 0) { // If the array didn't exist, create it
-        headers->headers = calloc(1, sizeof(char *));
-    } else {
-        headers->headers = realloc(headers->headers, (headers->num_headers + 1) * sizeof(char *));
-    }
-
     // Calculate the needed size for allocating the header string plus the null terminator
     size_t needed_size = snprintf(NULL, 0, "%s: %s", name, value) + 1;
 
     // Allocate space for the string
-    headers->headers[headers->num_headers] = malloc(sizeof(char) * needed_size);
+    char *line = malloc(sizeof(char) * needed_size);
+    if (!line) return ERROR;
 
     // Produce the header string
-    snprintf(headers->headers[headers->num_headers], needed_size, "%s: %s", name, value);
+    snprintf(line, needed_size, "%s: %s", name, value);
+
+    struct httpres_header *header = headers_append(headers);
+    if (!header) {
+        free(line);
+        return ERROR;
+    }
+    header->line = line;
+    header->len = needed_size - 1;
+    header->owned = 1;
+
+    return SUCCESS;
+}
+
+STATUS set_header_preformatted(struct httpres_headers *headers, const char *line, size_t len) {
+    if (!headers || !line) return ERROR;
+
+    struct httpres_header *header = headers_append(headers);
+    if (!header) return ERROR;
+
+    header->line = line; // The line is neither copied nor freed
+    header->len = len;
+    header->owned = 0;
 
-    headers->num_headers++;
     return SUCCESS;
 }
 
@@ -555,7 +1083,7 @@ void headers_free(struct httpres_headers *headers) {
 
     if (headers->headers) {
         for (int i = 0; i < headers->num_headers; i++) {
-            if (headers->headers[i]) free(headers->headers[i]);
+            if (headers->headers[i].owned) free((char *) headers->headers[i].line);
         }
         free(headers->headers);
     }
@@ -567,7 +1095,7 @@ int headers_getlen(struct httpres_headers *headers) {
     if (!headers) return 0;
     int counter = 0;
     for (int i = 0; i < headers->num_headers; i++) {
-        counter += (int) strlen(headers->headers[i]);
+        counter += (int) headers->headers[i].len;
         counter += CRLF_LEN; // also add the size of the CRLF header line terminator
     }
 
@@ -10,9 +10,12 @@
 #define PRACTICA1_HTTPUTILS_H
 
 #include <stdio.h>
+#include <time.h>
+#include <sys/stat.h>
 #include "../picohttpparser/picohttpparser.h"
 #include "server.h"
 #include "constants.h"
+#include "iopool.h"
 
 #define HTTP_VER "HTTP/1.1" ///< HTTP version used by the server
 
@@ -20,9 +23,10 @@
 #define MAX_HEADERS 100 ///< Maximum number of HTTP headers supported
 
 #define GET "GET" ///< String for the GET method
+#define HEAD "HEAD" ///< String for the HEAD method
 #define POST "POST" ///< String for the POST method
 #define OPTIONS "OPTIONS" ///< String for the OPTIONS method
-#define ALLOWED_OPTIONS "GET, POST, OPTIONS" ///< String representing the allowed HTTP methods
+#define ALLOWED_OPTIONS "GET, HEAD, POST, OPTIONS" ///< String representing the allowed HTTP methods
 
 #define HDR_DATE "Date" ///< HTTP Date header name
 #define HDR_SERVER_ORIGIN "Server" ///< HTTP Server header name
@@ -30,9 +34,34 @@
 #define HDR_CONTENT_LENGTH "Content-Length" ///< HTTP Content-Length header name
 #define HDR_CONTENT_TYPE "Content-Type" ///< HTTP Content-Type header name
 #define HDR_ALLOW "Allow" ///< HTTP Allow header name
+#define HDR_ETAG "ETag" ///< HTTP ETag header name
+#define HDR_IF_NONE_MATCH "If-None-Match" ///< HTTP If-None-Match request header name
+#define HDR_IF_MODIFIED_SINCE "If-Modified-Since" ///< HTTP If-Modified-Since request header name
+#define HDR_RANGE "Range" ///< HTTP Range request header name
+#define HDR_IF_RANGE "If-Range" ///< HTTP If-Range request header name
+#define HDR_ACCEPT_RANGES "Accept-Ranges" ///< HTTP Accept-Ranges header name
+#define HDR_CONTENT_RANGE "Content-Range" ///< HTTP Content-Range header name
+#define HDR_TRANSFER_ENCODING "Transfer-Encoding" ///< HTTP Transfer-Encoding header name
+#define HDR_AGE "Age" ///< HTTP Age header name
+#define HDR_LOCATION "Location" ///< HTTP Location header name
+#define HDR_RETRY_AFTER "Retry-After" ///< HTTP Retry-After header name
+#define HDR_SERVER_TIMING "Server-Timing" ///< HTTP Server-Timing header name
+
+#define HTTP_DATE_FMT "%a, %d %b %Y %H:%M:%S GMT" ///< Format of the dates used in HTTP headers (always in GMT)
+#define MAX_HTTP_DATE 30 ///< Size of a buffer able to hold an HTTP date and its null terminator
+#define MAX_ETAG 64 ///< Size of a buffer able to hold an entity tag generated by the server
+
+#define RANGE_UNIT "bytes" ///< The only range unit supported by the server
+#define MAX_RANGES 16 ///< Maximum number of ranges served in a single response (more than that are ignored)
+#define MAX_CONTENT_LENGTH 21 ///< Size of a buffer able to hold any 64 bit length and its null terminator
+
+#define STREAM_CHUNK (2 * 1024 * 1024) ///< Maximum number of bytes of a file sent with a single call
+#define STREAM_PACE_STEPS 10 ///< Number of chunks per second used when the stream rate is limited
 
 #define INDEX_PATH "/index.html" ///< Default path of the index file in a folder
 
+#define RESPONSE_OFFLOADED 0 ///< Code returned by send_file() when the body is being sent by the I/O pool
+
 /**
  * @brief Codes representing the result of the parsing operation
  */
@@ -52,13 +81,20 @@ typedef enum _HTTP_RESPONSE_CODE {
     OK = 200,
     //CREATED = 201,
             NO_CONTENT = 204,
+    PARTIAL_CONTENT = 206,
+    FOUND = 302,
+    NOT_MODIFIED = 304,
     BAD_REQUEST = 400,
     //UNAUTHORIZED = 401,
             FORBIDDEN = 403,
     NOT_FOUND = 404,
     METHOD_NOT_ALLOWED = 405,
+    RANGE_NOT_SATISFIABLE = 416,
     INTERNAL_ERROR = 500,
     //NOT_IMPLEMENTED = 501,
+    BAD_GATEWAY = 502,
+    SERVICE_UNAVAILABLE = 503,
+    GATEWAY_TIMEOUT = 504,
     //HTTP_VERSION_UNSUPPORTED = 505,
 } HTTP_RESPONSE_CODE;
 
@@ -76,6 +112,40 @@ struct request {
     int minor_version; ///< HTTP version of the request
     struct phr_header headers[MAX_HEADERS]; ///< Structure containing the request headers
     size_t num_headers; ///< Number of headers in the request
+    int headers_only; ///< 1 if only the headers of the response must be sent (HEAD requests), 0 otherwise
+    size_t request_len; ///< Number of bytes of the request, including its body
+    unsigned long connection; ///< Number of the connection, set by the user of the request
+    unsigned long long sent_before; ///< bytes_sent_by_thread() when the request started being answered, set by its user
+    struct timespec received; ///< Moment (CLOCK_MONOTONIC) when the server started reading the request
+    struct timespec parsed; ///< Moment (CLOCK_MONOTONIC) when the request was parsed
+};
+
+/**
+ * @brief Function that reports and frees a request whose body has been sent by the I/O pool
+ * @param[in] request The request
+ * @param[in] code Code of the response
+ * @param[in] bytes_sent Bytes of the response actually sent to the client
+ * @param[in] arg Argument given to set_io_pool()
+ */
+typedef void (*transfer_done)(struct request *request, int code, unsigned long long bytes_sent, void *arg);
+
+/**
+ * @struct byte_range
+ * @brief Stores a range of bytes of a file requested by the client, with both ends included
+ */
+struct byte_range {
+    off_t first; ///< Position of the first byte of the range
+    off_t last; ///< Position of the last byte of the range
+};
+
+/**
+ * @struct httpres_header
+ * @brief Stores a single header of an HTTP response
+ */
+struct httpres_header {
+    const char *line; ///< String containing the full header ("Name: value"), without line terminator
+    size_t len; ///< Length of the header string
+    int owned; ///< 1 if the string belongs to the structure and must be freed with it, 0 if it's preformatted
 };
 
 /**
@@ -84,7 +154,7 @@ struct request {
  */
 struct httpres_headers {
     int num_headers; ///< Number of headers in the structure
-    char **headers; ///< Array of strings containing the full headers
+    struct httpres_header *headers; ///< Array containing the headers
 };
 
 /**
@@ -132,6 +202,17 @@ struct httpres_headers *create_header_struct();
  */
 STATUS set_header(struct httpres_headers *headers, const char *name, const char *value);
 
+/**
+ * @brief Adds a preformatted header to the header structure, without copying or formatting it
+ * @details This is meant for headers whose full line is computed once and reused by many responses. The line isn't
+ * freed together with the structure, so it must remain valid until the response has been sent.
+ * @param[out] headers Header structure where the new one must be added
+ * @param[in] line String containing the full header ("Name: value"), without line terminator
+ * @param[in] len Length of the header string
+ * @return \ref STATUS.SUCCESS if everything went well, \ref STATUS.ERROR otherwise
+ */
+STATUS set_header_preformatted(struct httpres_headers *headers, const char *line, size_t len);
+
 /**
  * @brief Frees all the memory associated with a header structure
  * @param[in] headers Header structure to free
@@ -146,6 +227,17 @@ void headers_free(struct httpres_headers *headers);
  */
 int headers_getlen(struct httpres_headers *headers);
 
+/**
+ * @brief Finds the value of the request header with the provided name
+ * @details Header names are compared case-insensitively, as specified by the HTTP standard. The returned value points
+ * into the request buffer, so it is not null-terminated.
+ * @param[in] request Request whose headers must be searched
+ * @param[in] name Name of the header to find
+ * @param[out] value_len Variable where the length of the value must be stored
+ * @return Pointer to the beginning of the header value, or NULL if the request doesn't contain that header
+ */
+const char *get_request_header(const struct request *request, const char *name, size_t *value_len);
+
 /**
  * @brief Checks if the provided path is a regular file
  * @param[in] path The path to be checked
@@ -162,38 +254,83 @@ int is_directory(const char *path);
 
 /**
  * @brief Sends the file at the given path to the provided socket as an HTTP response with the appropiate headers
+ * @details If the request contains a valid Range header (and its If-Range precondition, if any, holds), only the
+ * requested ranges are sent in a 206 response: a single range is sent as is, while several ranges are sent as a
+ * multipart/byteranges body. The file contents are sent with sendfile(), so they're never copied into user space.
+ * For HEAD requests, the same headers are sent, but the file isn't even opened. The length and validators in the
+ * headers, and the conditional headers of the request, are checked against the metadata of the opened file, since the
+ * one obtained while resolving the path may be cached and older than the file; if the client's copy is still valid,
+ * a 304 response is sent instead.
  * @param[out] socket The socket to which the response must be sent
  * @param[in] headers Structure containing the headers for the response
+ * @param[in] request The request being answered
  * @param[in] path Path where the file to be sent resides
- * @return code of the HTTP response sent to the socket
+ * @param[in] st Metadata of the file, as obtained by the caller while resolving the path
+ * @return code of the HTTP response sent to the socket, or \ref RESPONSE_OFFLOADED if its body is being sent by the
+ * I/O pool, which then owns @p request (see set_io_pool())
  */
-HTTP_RESPONSE_CODE send_file(int socket, struct httpres_headers *headers, const char *path);
+HTTP_RESPONSE_CODE
+send_file(int socket, struct httpres_headers *headers, struct request *request, const char *path,
+          const struct stat *st);
 
 /**
- * @brief Executes the script in the request path using the provided command, passing arguments to it via stdin
- * @details This function runs the provided command with the path as its first parameter. It then writes the
- * querystring and the POST parameters to its standard input. Finally, it reads the result of the script execution,
- * and sends it to the socket as an HTTP response.
- * @author Diego Ortín Fernández
- * @param[out] socket The socket to which the response must be sent
- * @param[in] headers Structure containing the headers for the response
- * @param[in] request Request from which the data must be obtained
- * @param[in] utils Structure containing utilities (used for logging)
- * @param[in] exec_cmd Command to be used
- * @param[in[ fullpath Absolute path of the executable file in the system
- * @return 0 if an error occurs, 1 otherwise
+ * @brief Parses the value of a Range header for a file of the provided size
+ * @details Both regular (a-b, a-) and suffix (-n) byte ranges are supported. Ranges that can't be satisfied are
+ * skipped, and ranges past the end of the file are truncated to its size.
+ * @param[in] value Value of the Range header (not necessarily null-terminated)
+ * @param[in] value_len Length of the value
+ * @param[in] size Size of the file the ranges refer to
+ * @param[out] ranges Array where the satisfiable ranges must be stored
+ * @param[in] max_ranges Size of the \p ranges array
+ * @return Number of satisfiable ranges found, 0 if none of them can be satisfied, or -1 if the header is invalid or
+ * has more than \p max_ranges ranges (and therefore must be ignored)
+ */
+int parse_range(const char *value, size_t value_len, off_t size, struct byte_range *ranges, int max_ranges);
+
+/**
+ * @brief Checks the If-Range precondition of a request against the metadata of the requested file
+ * @param[in] request The request whose If-Range header must be evaluated
+ * @param[in] st Metadata of the file the request refers to
+ * @return 1 if the request has no If-Range header or if its validator matches the file, 0 otherwise
+ */
+int if_range_matches(const struct request *request, const struct stat *st);
+
+/**
+ * @brief Checks the conditional headers of a request (If-None-Match and If-Modified-Since) against the metadata of
+ * the requested file
+ * @details If-None-Match takes precedence: when it's present, If-Modified-Since is ignored, as required by RFC 7232.
+ * The entity tags are compared using the weak comparison function.
+ * @param[in] request The request whose conditional headers must be evaluated
+ * @param[in] st Metadata of the file the request refers to
+ * @return 1 if the client's copy is still valid and a 304 response must be sent, 0 otherwise
+ */
+int is_not_modified(const struct request *request, const struct stat *st);
+
+/**
+ * @brief Writes the strong entity tag for a file, derived from its inode, size and modification time
+ * @param[in] st Metadata of the file
+ * @param[out] buf Buffer where the entity tag (including its quotes) must be written
+ * @param[in] buf_len Size of the buffer (\ref MAX_ETAG is always enough)
+ * @return Length of the entity tag, or -1 if it didn't fit in the buffer
  */
-int run_executable(int socket, struct httpres_headers *headers, struct request *request, struct _srvutils *utils,
-                   const char *exec_cmd, const char *fullpath);
+int format_etag(const struct stat *st, char *buf, size_t buf_len);
 
 /**
- * @brief Sets the Last-Modified header to the last modified date of the provided date
+ * @brief Sets the ETag header to the entity tag of the provided file
+ * @param[in] st Metadata of the file
+ * @param[out] headers Structure where the header must be set
+ * @return \ref STATUS.SUCCESS if everything went well, \ref STATUS.ERROR otherwise
+ */
+STATUS add_etag(const struct stat *st, struct httpres_headers *headers);
+
+/**
+ * @brief Sets the Last-Modified header to the last modified date of the provided file
  * @author Mario López
- * @param[in] filePath Path of the file
+ * @param[in] st Metadata of the file
  * @param[out] headers Structure where the header must be set
  * @return \ref STATUS.SUCCESS if everything went well, \ref STATUS.ERROR otherwise
  */
-STATUS add_last_modified(const char *filePath, struct httpres_headers *headers);
+STATUS add_last_modified(const struct stat *st, struct httpres_headers *headers);
 
 /**
  * @brief Obtains the MIME type of a file name
@@ -210,6 +347,85 @@ const char *get_mime_type(const char *name);
  */
 STATUS add_content_type(const char *filePath, struct httpres_headers *headers);
 
+/**
+ * @brief Sends the status line and the headers of a response to the provided socket
+ * @details This allows sending the body separately, for responses whose body isn't available at once.
+ * @param[out] socket The socket to send the header to
+ * @param[in] code Response code for the status line
+ * @param[in] message Message for the status line (can be NULL)
+ * @param[in] headers Structure containing the headers for the response (can be NULL)
+ * @return Number of bytes sent, or -1 if an error occurs
+ */
+int send_response_header(int socket, unsigned int code, const char *message, struct httpres_headers *headers);
+
+/**
+ * @brief Shuts down and closes the connection in the provided socket, once the response has been sent
+ * @param[in] socket The socket to close
+ */
+void close_connection(int socket);
+
+/**
+ * @brief Sends a whole buffer to the provided socket, continuing after partial writes
+ * @param[out] socket The socket to send the buffer to
+ * @param[in] buf The buffer to send
+ * @param[in] len Number of bytes to send
+ * @param[in] flags Flags for send()
+ * @return Number of bytes sent (always @p len), or -1 if an error occurs
+ */
+ssize_t send_all(int socket, const void *buf, size_t len, int flags);
+
+/**
+ * @brief Sends a whole buffer of a response to a client, counting it in the bytes sent by the calling thread
+ * @param[out] socket The socket of the client
+ * @param[in] buf The buffer to send
+ * @param[in] len Number of bytes to send
+ * @param[in] flags Flags for send()
+ * @return Number of bytes sent (always @p len), or -1 if an error occurs
+ */
+ssize_t send_to_client(int socket, const void *buf, size_t len, int flags);
+
+/**
+ * @brief Adds bytes sent to a client by other means than send_to_client() to the ones sent by the calling thread
+ * @param[in] len Number of bytes sent
+ */
+void count_bytes_sent(size_t len);
+
+/**
+ * @brief Returns the number of bytes of responses the calling thread has sent to clients
+ * @details The difference between two calls is what was sent for the requests the thread processed in between, except
+ * for the bodies handed to the I/O pool, which are counted by the thread of the pool that sends them.
+ * @return Number of bytes sent
+ */
+unsigned long long bytes_sent_by_thread();
+
+/**
+ * @brief Sets the pool where the contents of files that aren't in the page cache are sent
+ * @details Without a pool, every file is sent by the thread that processes the request, even if that means waiting for
+ * the disk. When a body is handed to the pool, so is its request: once the body has been sent, or the client has gone
+ * away, the pool calls @p done with the bytes of the response actually sent, and @p done must free the request.
+ * @param[in] pool The pool to use, or NULL to send every file from the calling thread
+ * @param[in] done Function that reports and frees the requests whose bodies the pool has sent
+ * @param[in] arg Last argument passed to @p done
+ */
+void set_io_pool(iopool *pool, transfer_done done, void *arg);
+
+/**
+ * @brief Sets the maximum rate at which the contents of each file are sent
+ * @details The limit applies to every file sent afterwards by any thread, and is meant to keep big downloads from
+ * saturating the link.
+ * @param[in] bytes_per_second The maximum rate, or 0 to send as fast as possible
+ */
+void set_stream_rate_limit(long bytes_per_second);
+
+/**
+ * @brief Sets whether responses carry a Server-Timing header
+ * @details The header contains the milliseconds spent by the thread sending the response in parsing the request
+ * (parse), resolving its path (resolve), opening the file (io) and running the script until its header was produced
+ * (cgi), taken from its trace in the metrics. Phases that didn't happen are left out.
+ * @param[in] enabled 1 to add the header to every response, 0 otherwise
+ */
+void set_server_timing(int enabled);
+
 /**
  * @brief Sets the Content-Length header to the provided one
  * @author Mario López
@@ -217,7 +433,7 @@ STATUS add_content_type(const char *filePath, struct httpres_headers *headers);
  * @param[out] headers Structure where the header must be set
  * @return \ref STATUS.SUCCESS if everything went well, \ref STATUS.ERROR otherwise
  */
-STATUS add_content_length(long length, struct httpres_headers *headers);
+STATUS add_content_length(off_t length, struct httpres_headers *headers);
 
 /**
  * @brief Sets the date and server signature headers
@@ -0,0 +1,188 @@
+/**
+ * @file iopool.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Implementation of the pool of threads dedicated to blocking disk I/O
+ * @details The jobs are stored in a bounded first-in-first-out linked list, protected by a mutex, and the threads
+ * wait on a condition variable until there are jobs available.
+ */
+
+#include "iopool.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+/**
+ * @struct iopool_job
+ * @brief Job waiting to be run by the pool
+ */
+struct iopool_job {
+    void (*run)(void *arg); ///< Function to run
+    void *arg; ///< Argument for the function
+    struct iopool_job *next; ///< Next job in the list, or NULL if it's the last
+};
+
+/**
+ * @struct iopool
+ * @brief Contains the threads of the pool and the jobs waiting for them
+ */
+struct iopool {
+    pthread_t *threads; ///< Threads of the pool
+    int nthreads; ///< Number of threads of the pool
+    struct iopool_job *first; ///< First job waiting to be run
+    struct iopool_job *last; ///< Last job waiting to be run
+    int pending; ///< Number of jobs waiting to be run
+    int max_jobs; ///< Maximum number of jobs waiting to be run
+    int stop; ///< 1 if the threads must finish
+    pthread_mutex_t mutex; ///< Mutex protecting the list of jobs
+    pthread_cond_t available; ///< Condition signalled when a job is added or the threads must finish
+};
+
+/**
+ * @brief Main function of the threads of the pool, which runs jobs until the pool is stopped
+ * @param[in] p The pool
+ * @return Always NULL
+ */
+void *iopool_thread(void *p) {
+    iopool *pool = p;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (1) {
+        while (!pool->first && !pool->stop) pthread_cond_wait(&pool->available, &pool->mutex);
+        if (pool->stop) break;
+
+        struct iopool_job *job = pool->first;
+        pool->first = job->next;
+        if (!pool->first) pool->last = NULL;
+        pool->pending--;
+
+        // The job is run without the lock, as it's expected to block
+        pthread_mutex_unlock(&pool->mutex);
+        job->run(job->arg);
+        free(job);
+        pthread_mutex_lock(&pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+iopool *iopool_create(int nthreads, int max_jobs) {
+    if (nthreads <= 0 || max_jobs <= 0) return NULL;
+
+    iopool *pool = calloc(1, sizeof(iopool));
+    if (!pool) return NULL;
+
+    pool->threads = calloc(nthreads, sizeof(pthread_t));
+    if (!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+    pool->max_jobs = max_jobs;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->available, NULL);
+
+    for (int i = 0; i < nthreads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, iopool_thread, pool) != 0) {
+            iopool_free(pool); // Stop the threads created until now
+            return NULL;
+        }
+        pool->nthreads++;
+    }
+
+    return pool;
+}
+
+void iopool_free(iopool *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->available);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < pool->nthreads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    while (pool->first) {
+        struct iopool_job *next = pool->first->next;
+        free(pool->first);
+        pool->first = next;
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->available);
+    free(pool->threads);
+    free(pool);
+}
+
+STATUS iopool_submit(iopool *pool, void (*job)(void *arg), void *arg) {
+    if (!pool || !job) return ERROR;
+
+    struct iopool_job *new = malloc(sizeof(struct iopool_job));
+    if (!new) return ERROR;
+    new->run = job;
+    new->arg = arg;
+    new->next = NULL;
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->pending >= pool->max_jobs || pool->stop) { // Waiting for a free slot would defeat the purpose
+        pthread_mutex_unlock(&pool->mutex);
+        free(new);
+        return ERROR;
+    }
+
+    if (pool->last) {
+        pool->last->next = new;
+    } else {
+        pool->first = new;
+    }
+    pool->last = new;
+    pool->pending++;
+
+    pthread_cond_signal(&pool->available);
+    pthread_mutex_unlock(&pool->mutex);
+
+    return SUCCESS;
+}
+
+int iopool_pending(iopool *pool) {
+    if (!pool) return -1;
+
+    pthread_mutex_lock(&pool->mutex);
+    int pending = pool->pending;
+    pthread_mutex_unlock(&pool->mutex);
+
+    return pending;
+}
+
+int iopool_is_resident(int fd, off_t offset, off_t length) {
+    if (length <= 0) return 1;
+    if (length > IOPOOL_CHECK_MAX) length = IOPOOL_CHECK_MAX;
+
+    // Mappings must start at a page boundary
+    long page_size = sysconf(_SC_PAGESIZE);
+    off_t start = offset - offset % page_size;
+    size_t map_len = (size_t) (length + (offset - start));
+
+    void *map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, start);
+    if (map == MAP_FAILED) return 1; // If it can't be checked, assume it's resident, as it was before the pool existed
+
+    size_t n_pages = (map_len + page_size - 1) / page_size;
+    unsigned char pages[(IOPOOL_CHECK_MAX / 4096) + 2]; // The smallest page size is 4 KiB
+    int resident = 1;
+    if (mincore(map, map_len, pages) == 0) {
+        for (size_t i = 0; i < n_pages; i++) {
+            if (!(pages[i] & 1)) { // The lowest bit tells whether the page is resident
+                resident = 0;
+                break;
+            }
+        }
+    }
+
+    munmap(map, map_len);
+    return resident;
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+/**
+ * @file iopool.h
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Pool of threads dedicated to blocking disk I/O
+ * @details Reading a file that isn't in the page cache blocks the calling thread until the disk answers, which can take
+ * milliseconds. If that happens in one of the threads that process connections, every other client that thread could
+ * be serving in the meantime has to wait. This module offers a separate set of threads where those blocking operations
+ * can be run, so that the connection threads can keep serving requests whose data is already in memory.
+ *
+ * The module also provides a function for checking whether a section of a file is resident in the page cache, so that
+ * only the operations that would actually block are sent to the pool.
+ *
+ * Nothing in the pool is specific to I/O, so it's also used for running any other kind of job away from the connection
+ * threads, such as the requests of a scheduling class.
+ */
+
+#ifndef PRACTICA1_IOPOOL_H
+#define PRACTICA1_IOPOOL_H
+
+#include <sys/types.h>
+#include "constants.h"
+
+#define IOPOOL_CHECK_MAX (2 * 1024 * 1024) ///< Maximum number of bytes checked by iopool_is_resident()
+
+/**
+ * @brief The I/O pool type
+ */
+typedef struct iopool iopool;
+
+/**
+ * @brief Creates a new I/O pool and starts its threads
+ * @param[in] nthreads Number of threads of the pool
+ * @param[in] max_jobs Maximum number of jobs waiting to be run
+ * @return The new pool, or NULL if an error occurs or @p nthreads is not positive
+ */
+iopool *iopool_create(int nthreads, int max_jobs);
+
+/**
+ * @brief Stops the threads of an I/O pool once they finish their current jobs, and frees it
+ * @details Jobs that haven't started yet are discarded without being run.
+ * @param[in] pool The pool to free
+ */
+void iopool_free(iopool *pool);
+
+/**
+ * @brief Schedules a job to be run by one of the threads of the pool
+ * @details This function never blocks: if the pool already has the maximum number of waiting jobs, it fails and the
+ * caller is expected to run the job itself.
+ * @param[in] pool The pool that must run the job
+ * @param[in] job Function to run
+ * @param[in] arg Argument for the function, which is owned by the job from now on
+ * @return \ref STATUS.SUCCESS if the job was scheduled, \ref STATUS.ERROR otherwise
+ */
+STATUS iopool_submit(iopool *pool, void (*job)(void *arg), void *arg);
+
+/**
+ * @brief Returns the number of jobs waiting to be run
+ * @param[in] pool The pool to check
+ * @return Number of waiting jobs, or -1 if the pool is NULL
+ */
+int iopool_pending(iopool *pool);
+
+/**
+ * @brief Checks whether a section of a file is resident in the page cache, so that reading it won't block
+ * @details The check is done with mincore() over a mapping of the section, which is never accessed, so it doesn't
+ * cause any disk reads itself. Only the first @ref IOPOOL_CHECK_MAX bytes of the section are checked, as later pages
+ * can be read ahead while the first ones are being sent.
+ * @param[in] fd Descriptor of the file
+ * @param[in] offset Position of the first byte of the section
+ * @param[in] length Number of bytes of the section
+ * @return 1 if the section is resident (or can't be checked), 0 otherwise
+ */
+int iopool_is_resident(int fd, off_t offset, off_t length);
+
+#endif //PRACTICA1_IOPOOL_H
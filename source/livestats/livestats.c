@@ -0,0 +1,296 @@
+/**
+ * @file livestats.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Implementation of the live statistics segment
+ * @details Threads take a slot the first time they record their state, and keep it until the server exits. Writing a
+ * slot is a few stores to cache lines that only its thread writes, so it doesn't slow down the requests; the counters,
+ * which would be expensive to sum on every request, are copied by a separate thread.
+ */
+
+#include "livestats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define LIVESTATS_CACHE_LINE 64 ///< Size of a cache line, to which the slots are aligned
+#define LIVESTATS_READ_RETRIES 1000 ///< Times a reader retries a copy that was being written before giving up
+
+/**
+ * @struct _livestats
+ * @brief Segment of the server and its publisher thread
+ */
+struct _livestats {
+    char *name; ///< Name of the segment
+    struct livestats_header *header; ///< The mapped segment
+    size_t size; ///< Size of the segment
+    atomic_uint next_worker; ///< Index of the next slot to be taken
+    pthread_t publisher; ///< Thread that copies the counters
+    atomic_int stop; ///< Set to stop the publisher
+};
+
+_Thread_local struct livestats_worker *local_worker = NULL; ///< Slot of the calling thread
+_Thread_local int local_worker_taken = 0; ///< 1 if the calling thread has already looked for a slot
+
+/**
+ * @brief Returns the current time
+ * @return Microseconds since the epoch
+ */
+uint64_t livestats_time() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return (uint64_t) now.tv_sec * 1000000 + (uint64_t) now.tv_nsec / 1000;
+}
+
+/**
+ * @brief Returns the offset of the first slot in the segment
+ * @return The offset
+ */
+size_t livestats_header_size() {
+    return (sizeof(struct livestats_header) + LIVESTATS_CACHE_LINE - 1) / LIVESTATS_CACHE_LINE * LIVESTATS_CACHE_LINE;
+}
+
+/**
+ * @brief Returns a slot of a segment
+ * @param[in] header The segment
+ * @param[in] index Index of the slot, which must exist
+ * @return The slot
+ */
+struct livestats_worker *livestats_worker_at(const struct livestats_header *header, unsigned int index) {
+    return (struct livestats_worker *) ((char *) header + header->header_size + (size_t) index * header->worker_size);
+}
+
+/**
+ * @brief Starts writing data protected by a sequence lock, making its sequence odd
+ * @param[in,out] seq The sequence
+ */
+void livestats_write_begin(atomic_uint *seq) {
+    atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); // The data can't be written before the sequence is seen as odd
+}
+
+/**
+ * @brief Finishes writing data protected by a sequence lock, making its sequence even again
+ * @param[in,out] seq The sequence
+ */
+void livestats_write_end(atomic_uint *seq) {
+    atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1, memory_order_release);
+}
+
+/**
+ * @brief Copies data protected by a sequence lock, retrying until the copy is consistent
+ * @param[in] seq The sequence
+ * @param[out] copy Where the data must be copied
+ * @param[in] data The data
+ * @param[in] len Length of the data
+ */
+void livestats_read(const atomic_uint *seq, void *copy, const void *data, size_t len) {
+    for (int i = 0; i < LIVESTATS_READ_RETRIES; i++) {
+        unsigned int before = atomic_load_explicit((atomic_uint *) seq, memory_order_acquire);
+        if (before & 1) continue; // Being written
+
+        memcpy(copy, data, len);
+        atomic_thread_fence(memory_order_acquire); // The data must be read before the sequence is checked again
+        if (atomic_load_explicit((atomic_uint *) seq, memory_order_relaxed) == before) return;
+    }
+    // A writer that stopped in the middle of an update (it can only be killed) leaves the last copy, which is stale
+}
+
+/**
+ * @brief Main function of the thread that copies the counters to the segment
+ * @param[in] arg The live statistics
+ * @return NULL
+ */
+void *livestats_publish(void *arg) {
+    livestats *stats = arg;
+    struct livestats_header *header = stats->header;
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = LIVESTATS_INTERVAL_MS * 1000000L};
+
+    while (!atomic_load(&stats->stop)) {
+        uint64_t values[METRICS];
+        for (int i = 0; i < METRICS; i++) values[i] = metrics_value(i); // Summed outside of the lock
+
+        unsigned int used = atomic_load_explicit(&stats->next_worker, memory_order_relaxed);
+        livestats_write_begin(&header->seq);
+        memcpy(header->values, values, sizeof(values));
+        header->workers_used = used < header->workers ? used : header->workers;
+        header->updated = livestats_time();
+        livestats_write_end(&header->seq);
+
+        nanosleep(&pause, NULL);
+    }
+
+    return NULL;
+}
+
+livestats *livestats_create(const char *name, unsigned int workers) {
+    if (!name || name[0] != '/' || workers == 0) return NULL;
+
+    livestats *stats = calloc(1, sizeof(livestats));
+    if (!stats) return NULL;
+    if (!(stats->name = strdup(name))) goto error;
+
+    stats->size = livestats_header_size() + (size_t) workers * sizeof(struct livestats_worker);
+    int fd = shm_open(name, O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0644); // Readable by the other users, like top
+    if (fd == -1) goto error;
+    if (ftruncate(fd, (off_t) stats->size) == -1) {
+        close(fd);
+        shm_unlink(name);
+        goto error;
+    }
+    stats->header = mmap(NULL, stats->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (stats->header == MAP_FAILED) {
+        shm_unlink(name);
+        goto error;
+    }
+
+    // The segment is full of zeros, so only the description of the layout is written
+    struct livestats_header *header = stats->header;
+    header->version = LIVESTATS_VERSION;
+    header->header_size = (uint32_t) livestats_header_size();
+    header->worker_size = sizeof(struct livestats_worker);
+    header->workers = workers;
+    header->counters = METRICS;
+    header->pid = (int32_t) getpid();
+    header->started = livestats_time();
+    memcpy(header->magic, LIVESTATS_MAGIC, sizeof(header->magic)); // Last, so that readers only accept it when ready
+
+    if (pthread_create(&stats->publisher, NULL, livestats_publish, stats) != 0) {
+        munmap(stats->header, stats->size);
+        shm_unlink(name);
+        goto error;
+    }
+
+    return stats;
+
+    error:
+    free(stats->name);
+    free(stats);
+    return NULL;
+}
+
+void livestats_free(livestats *stats) {
+    if (!stats) return;
+
+    atomic_store(&stats->stop, 1);
+    pthread_join(stats->publisher, NULL);
+
+    shm_unlink(stats->name); // Readers that have it mapped keep their copy until they unmap it
+    munmap(stats->header, stats->size);
+    free(stats->name);
+    free(stats);
+}
+
+/**
+ * @brief Returns the slot of the calling thread, taking one the first time
+ * @param[in] stats The live statistics
+ * @return The slot, or NULL if there are no free slots
+ */
+struct livestats_worker *livestats_get_worker(livestats *stats) {
+    if (local_worker_taken) return local_worker;
+    local_worker_taken = 1;
+
+    unsigned int index = atomic_fetch_add(&stats->next_worker, 1);
+    if (index >= stats->header->workers) return NULL;
+
+    local_worker = livestats_worker_at(stats->header, index);
+    local_worker->tid = (int32_t) syscall(SYS_gettid); // Before the thread is counted in workers_used
+
+    return local_worker;
+}
+
+void livestats_set_state(livestats *stats, LIVESTATS_STATE state) {
+    if (!stats) return;
+
+    struct livestats_worker *worker = livestats_get_worker(stats);
+    if (!worker) return;
+
+    livestats_write_begin(&worker->seq);
+    worker->state = state;
+    worker->since = livestats_time();
+    livestats_write_end(&worker->seq);
+}
+
+void livestats_request_start(livestats *stats, const char *method, const char *path, unsigned long connection) {
+    if (!stats) return;
+
+    struct livestats_worker *worker = livestats_get_worker(stats);
+    if (!worker) return;
+
+    livestats_write_begin(&worker->seq);
+    worker->state = LIVESTATS_SERVING;
+    worker->since = livestats_time();
+    worker->connection = connection;
+    snprintf(worker->method, sizeof(worker->method), "%s", method ? method : "");
+    snprintf(worker->path, sizeof(worker->path), "%s", path ? path : "");
+    livestats_write_end(&worker->seq);
+}
+
+void livestats_request_end(livestats *stats) {
+    if (!stats) return;
+
+    struct livestats_worker *worker = livestats_get_worker(stats);
+    if (!worker) return;
+
+    livestats_write_begin(&worker->seq);
+    worker->state = LIVESTATS_IDLE;
+    worker->since = livestats_time();
+    worker->requests++;
+    livestats_write_end(&worker->seq);
+}
+
+const struct livestats_header *livestats_attach(const char *name, size_t *size) {
+    if (!name || !size) return NULL;
+
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd == -1) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(struct livestats_header)) {
+        close(fd);
+        return NULL;
+    }
+
+    const struct livestats_header *header = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED) return NULL;
+
+    // Only the layout written by this version is understood
+    if (memcmp(header->magic, LIVESTATS_MAGIC, sizeof(header->magic)) != 0 || header->version != LIVESTATS_VERSION ||
+        header->header_size != livestats_header_size() || header->worker_size != sizeof(struct livestats_worker) ||
+        header->counters != METRICS ||
+        header->header_size + (size_t) header->workers * header->worker_size > (size_t) st.st_size) {
+        munmap((void *) header, (size_t) st.st_size);
+        return NULL;
+    }
+
+    *size = (size_t) st.st_size;
+    return header;
+}
+
+void livestats_detach(const struct livestats_header *header, size_t size) {
+    if (header) munmap((void *) header, size);
+}
+
+void livestats_read_header(const struct livestats_header *header, struct livestats_header *copy) {
+    livestats_read(&header->seq, copy, header, sizeof(struct livestats_header));
+}
+
+STATUS livestats_read_worker(const struct livestats_header *header, unsigned int index, struct livestats_worker *copy) {
+    if (index >= header->workers) return ERROR;
+
+    const struct livestats_worker *worker = livestats_worker_at(header, index);
+    livestats_read(&worker->seq, copy, worker, sizeof(struct livestats_worker));
+
+    return SUCCESS;
+}
\ No newline at end of file
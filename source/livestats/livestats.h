@@ -0,0 +1,152 @@
+/**
+ * @file livestats.h
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Live statistics of the server, published in a POSIX shared memory segment
+ * @details The segment starts with a header holding the totals of the counters of the server, which a publisher thread
+ * copies from the metrics a few times per second, followed by a slot for each thread that serves requests. Each
+ * thread writes its own slot when it starts and finishes a request, so other processes can see what it's doing right
+ * now. Nothing is sent to the server to read them: tools like server-top map the segment read-only.
+ *
+ * The header and every slot are protected by their own sequence lock. The only writer increments the sequence before
+ * and after writing, so it's odd while the data is being changed. Readers copy the data and retry if the sequence was
+ * odd or changed meanwhile, so writers never wait for readers.
+ *
+ * The layout is versioned with \ref LIVESTATS_VERSION, and the sizes of the header and the slots are stored in the
+ * header, so that readers can reject segments they don't understand.
+ */
+
+#ifndef PRACTICA1_LIVESTATS_H
+#define PRACTICA1_LIVESTATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "constants.h"
+#include "metrics.h"
+
+#define LIVESTATS_MAGIC "HTTPSTAT" ///< First bytes of the segment
+#define LIVESTATS_VERSION 1 ///< Version of the layout of the segment
+#define LIVESTATS_METHOD_LEN 16 ///< Size of the method of the current request, including the null terminator
+#define LIVESTATS_PATH_LEN 104 ///< Size of the path of the current request, including the null terminator
+#define LIVESTATS_INTERVAL_MS 250 ///< Milliseconds between the updates of the counters
+
+/**
+ * @brief What the thread of a slot is doing
+ */
+typedef enum _LIVESTATS_STATE {
+    LIVESTATS_IDLE, ///< Waiting for a connection or a request
+    LIVESTATS_READING, ///< Reading and parsing a request
+    LIVESTATS_SERVING ///< Producing the response of a request
+} LIVESTATS_STATE;
+
+/**
+ * @struct livestats_header
+ * @brief Header of the segment, with the totals of the counters
+ */
+struct livestats_header {
+    char magic[8]; ///< \ref LIVESTATS_MAGIC, without null terminator
+    uint32_t version; ///< \ref LIVESTATS_VERSION
+    uint32_t header_size; ///< Size of this structure, rounded up to a cache line, where the first slot starts
+    uint32_t worker_size; ///< Size of a slot
+    uint32_t workers; ///< Number of slots
+    uint32_t counters; ///< Number of counters, which are the ones in \ref METRIC
+    int32_t pid; ///< Process ID of the server
+    uint64_t started; ///< Moment the server started, in microseconds since the epoch
+    atomic_uint seq; ///< Sequence lock of the fields below
+    uint32_t workers_used; ///< Number of slots taken by threads
+    uint64_t updated; ///< Moment the counters were updated, in microseconds since the epoch
+    uint64_t values[METRICS]; ///< Totals of the counters
+};
+
+/**
+ * @struct livestats_worker
+ * @brief Slot of a thread that serves requests, in its own cache lines
+ */
+struct livestats_worker {
+    atomic_uint seq; ///< Sequence lock of the fields below
+    uint32_t state; ///< A \ref LIVESTATS_STATE
+    int32_t tid; ///< ID of the thread, as seen by the kernel
+    uint32_t reserved; ///< Unused, keeps the next fields aligned
+    uint64_t requests; ///< Requests the thread has finished
+    uint64_t since; ///< Moment the current state started, in microseconds since the epoch
+    uint64_t connection; ///< Number of the connection of the current request
+    char method[LIVESTATS_METHOD_LEN]; ///< Method of the current request
+    char path[LIVESTATS_PATH_LEN]; ///< Path of the current request, truncated if it's too long
+} __attribute__((aligned(64)));
+
+/**
+ * @brief The live statistics type
+ */
+typedef struct _livestats livestats;
+
+/**
+ * @brief Creates the shared memory segment and starts the thread that publishes the counters
+ * @details An existing segment with the same name, like the one of a server that was killed, is replaced.
+ * @param[in] name Name of the segment, starting with a slash (as in shm_open())
+ * @param[in] workers Number of slots, which should be the number of threads that serve requests
+ * @return The live statistics, or NULL if an error occurs
+ */
+livestats *livestats_create(const char *name, unsigned int workers);
+
+/**
+ * @brief Stops publishing the counters, and deletes the segment
+ * @param[in] stats The live statistics
+ */
+void livestats_free(livestats *stats);
+
+/**
+ * @brief Records what the calling thread is doing, taking a slot the first time
+ * @details Threads that don't find a free slot aren't shown.
+ * @param[in] stats The live statistics, or NULL if they're disabled
+ * @param[in] state The state of the thread
+ */
+void livestats_set_state(livestats *stats, LIVESTATS_STATE state);
+
+/**
+ * @brief Records that the calling thread has started producing the response of a request
+ * @param[in] stats The live statistics, or NULL if they're disabled
+ * @param[in] method Method of the request
+ * @param[in] path Path of the request
+ * @param[in] connection Number of the connection of the request
+ */
+void livestats_request_start(livestats *stats, const char *method, const char *path, unsigned long connection);
+
+/**
+ * @brief Records that the calling thread has finished a request, and is idle again
+ * @param[in] stats The live statistics, or NULL if they're disabled
+ */
+void livestats_request_end(livestats *stats);
+
+/**
+ * @brief Maps the segment of a running server, read-only
+ * @param[in] name Name of the segment
+ * @param[out] size Size of the mapping, to be passed to livestats_detach()
+ * @return The segment, or NULL if it doesn't exist or its layout isn't supported
+ */
+const struct livestats_header *livestats_attach(const char *name, size_t *size);
+
+/**
+ * @brief Unmaps a segment mapped with livestats_attach()
+ * @param[in] header The segment
+ * @param[in] size Size of the mapping
+ */
+void livestats_detach(const struct livestats_header *header, size_t size);
+
+/**
+ * @brief Copies a consistent snapshot of the header of a segment
+ * @param[in] header The segment
+ * @param[out] copy Where the copy must be stored
+ */
+void livestats_read_header(const struct livestats_header *header, struct livestats_header *copy);
+
+/**
+ * @brief Copies a consistent snapshot of a slot of a segment
+ * @param[in] header The segment
+ * @param[in] index Index of the slot
+ * @param[out] copy Where the copy must be stored
+ * @return \ref STATUS.SUCCESS if the slot exists, \ref STATUS.ERROR otherwise
+ */
+STATUS livestats_read_worker(const struct livestats_header *header, unsigned int index, struct livestats_worker *copy);
+
+#endif //PRACTICA1_LIVESTATS_H
@@ -0,0 +1,193 @@
+/**
+ * @file servertop.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Shows what a running server is doing, like top, from its live statistics segment
+ * @details The segment is mapped read-only, so watching the server doesn't send it any request or make it do any work.
+ * Every update shows the rates of requests and traffic since the previous one, the state of the connection queue and
+ * the caches, and what each thread is doing. If the output isn't a terminal, updates are printed one after another.
+ * @see livestats.h
+ *
+ * Usage: server-top [-d seconds] [-n updates] [segment]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "livestats.h"
+
+#define TOP_DEFAULT_SEGMENT "/http-server" ///< Segment shown if none is given
+#define TOP_DEFAULT_DELAY 1.0 ///< Default seconds between updates
+#define TOP_STALE_US 2000000 ///< Microseconds after which counters that haven't been updated are marked as stale
+
+const char *state_names[] = {"idle", "reading", "serving"}; ///< Names of the states, in the order of LIVESTATS_STATE
+
+/**
+ * @brief Formats a number of bytes with the unit that suits it
+ * @param[out] buf Buffer where the amount must be written
+ * @param[in] buf_len Size of the buffer
+ * @param[in] bytes The amount
+ * @return @p buf
+ */
+char *format_bytes(char *buf, size_t buf_len, double bytes) {
+    const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+    size_t unit = 0;
+    while (bytes >= 1024 && unit < sizeof(units) / sizeof(units[0]) - 1) {
+        bytes /= 1024;
+        unit++;
+    }
+    snprintf(buf, buf_len, unit ? "%.1f %s" : "%.0f %s", bytes, units[unit]);
+
+    return buf;
+}
+
+/**
+ * @brief Formats a duration, in the way top shows times
+ * @param[out] buf Buffer where the duration must be written
+ * @param[in] buf_len Size of the buffer
+ * @param[in] us The duration in microseconds
+ * @return @p buf
+ */
+char *format_elapsed(char *buf, size_t buf_len, uint64_t us) {
+    if (us < 1000000) {
+        snprintf(buf, buf_len, "%.1fms", (double) us / 1e3);
+    } else if (us < 60000000) {
+        snprintf(buf, buf_len, "%.1fs", (double) us / 1e6);
+    } else {
+        uint64_t s = us / 1000000;
+        snprintf(buf, buf_len, "%lu:%02lu:%02lu", (unsigned long) (s / 3600), (unsigned long) (s / 60 % 60),
+                 (unsigned long) (s % 60));
+    }
+
+    return buf;
+}
+
+/**
+ * @brief Returns the ratio of hits of a cache, as a percentage
+ * @param[in] hits Lookups that found what they looked for
+ * @param[in] total All the lookups
+ * @return The percentage, or 0 if there were no lookups
+ */
+double hit_ratio(uint64_t hits, uint64_t total) {
+    return total ? 100.0 * (double) hits / (double) total : 0;
+}
+
+/**
+ * @brief Prints an update
+ * @param[in] segment The segment
+ * @param[in] now The counters now
+ * @param[in] before The counters in the previous update
+ */
+void show(const struct livestats_header *segment, const struct livestats_header *now,
+          const struct livestats_header *before) {
+    const uint64_t *v = now->values, *b = before->values;
+    double seconds = (double) (now->updated - before->updated) / 1e6;
+    if (seconds <= 0) seconds = 1; // The server hasn't updated them since the previous update
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t wall = (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+
+    const char *status = "";
+    if (kill(now->pid, 0) == -1 && errno == ESRCH) {
+        status = " (not running)";
+    } else if (wall > now->updated + TOP_STALE_US) {
+        status = " (not updating)";
+    }
+
+    // Workers are read first, so that the header can show how many are busy
+    struct livestats_worker workers[now->workers_used ? now->workers_used : 1];
+    unsigned int busy = 0;
+    for (unsigned int i = 0; i < now->workers_used; i++) {
+        livestats_read_worker(segment, i, &workers[i]);
+        if (workers[i].state != LIVESTATS_IDLE) busy++;
+    }
+
+    char uptime[32], in[32], out[32];
+    printf("server-top - pid %i%s, up %s, %u threads, %u busy\n", now->pid, status,
+           format_elapsed(uptime, sizeof(uptime), wall - now->started), now->workers_used, busy);
+
+    uint64_t accepted = v[METRIC_CONNECTIONS_ACCEPTED], finished = v[METRIC_CONNECTIONS_FINISHED];
+    uint64_t dequeued = v[METRIC_CONNECTIONS_DEQUEUED];
+    printf("Requests: %.1f/s, %lu in total | Connections: %lu active, %lu queued\n",
+           (double) (finished - b[METRIC_CONNECTIONS_FINISHED]) / seconds, (unsigned long) finished,
+           (unsigned long) (accepted > finished ? accepted - finished : 0),
+           (unsigned long) (accepted > dequeued ? accepted - dequeued : 0));
+
+    printf("Traffic: in %s/s, out %s/s\n",
+           format_bytes(in, sizeof(in), (double) (v[METRIC_BYTES_IN] - b[METRIC_BYTES_IN]) / seconds),
+           format_bytes(out, sizeof(out), (double) (v[METRIC_BYTES_OUT] - b[METRIC_BYTES_OUT]) / seconds));
+
+    uint64_t path_hits = v[METRIC_PATH_CACHE_HITS], path_total = path_hits + v[METRIC_PATH_CACHE_MISSES];
+    uint64_t script_hits = v[METRIC_SCRIPT_CACHE_HITS] + v[METRIC_SCRIPT_CACHE_STALE];
+    uint64_t script_total = script_hits + v[METRIC_SCRIPT_CACHE_MISSES] + v[METRIC_SCRIPT_CACHE_BYPASSES];
+    printf("Caches: paths %.1f%% hits | scripts %.1f%% hits, %lu stale\n", hit_ratio(path_hits, path_total),
+           hit_ratio(script_hits, script_total), (unsigned long) v[METRIC_SCRIPT_CACHE_STALE]);
+
+    printf("Scripts: %lu processes started | dynamic %lu queued, %lu rejected | admin %lu queued, %lu rejected\n",
+           (unsigned long) (v[METRIC_CGI_SPAWNS] + v[METRIC_POOL_SPAWNS]), (unsigned long) v[METRIC_DYNAMIC_QUEUED],
+           (unsigned long) v[METRIC_DYNAMIC_REJECTED], (unsigned long) v[METRIC_ADMIN_QUEUED],
+           (unsigned long) v[METRIC_ADMIN_REJECTED]);
+
+    printf("\n%4s %8s %-8s %9s %9s %9s  %s\n", "#", "TID", "STATE", "TIME", "REQUESTS", "CONN", "REQUEST");
+    for (unsigned int i = 0; i < now->workers_used; i++) {
+        const struct livestats_worker *worker = &workers[i];
+        char elapsed[32], connection[24] = "-";
+        if (worker->state == LIVESTATS_SERVING) {
+            snprintf(connection, sizeof(connection), "%lu", (unsigned long) worker->connection);
+        }
+
+        printf("%4u %8i %-8s %9s %9lu %9s", i, worker->tid,
+               worker->state <= LIVESTATS_SERVING ? state_names[worker->state] : "?",
+               format_elapsed(elapsed, sizeof(elapsed), wall > worker->since ? wall - worker->since : 0),
+               (unsigned long) worker->requests, connection);
+        if (worker->state == LIVESTATS_SERVING) printf("  %s %s", worker->method, worker->path);
+        printf("\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    double delay = TOP_DEFAULT_DELAY;
+    long updates = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:n:")) != -1) {
+        if (opt == 'd' && (delay = strtod(optarg, NULL)) > 0) continue;
+        if (opt == 'n' && (updates = strtol(optarg, NULL, 10)) > 0) continue;
+
+        fprintf(stderr, "Usage: %s [-d seconds] [-n updates] [segment]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *name = optind < argc ? argv[optind] : TOP_DEFAULT_SEGMENT;
+
+    size_t size;
+    const struct livestats_header *segment = livestats_attach(name, &size);
+    if (!segment) {
+        fprintf(stderr, "Could not open the statistics of the server in %s (is LIVE_STATS set to it?)\n", name);
+        return EXIT_FAILURE;
+    }
+
+    int terminal = isatty(STDOUT_FILENO);
+    struct timespec pause = {.tv_sec = (time_t) delay, .tv_nsec = (long) ((delay - (double) (time_t) delay) * 1e9)};
+    struct livestats_header before, now;
+    livestats_read_header(segment, &before);
+
+    for (long i = 0; updates == 0 || i < updates; i++) {
+        nanosleep(&pause, NULL);
+        livestats_read_header(segment, &now);
+
+        if (terminal) printf("\033[H\033[2J"); // Each update replaces the previous one
+        else if (i > 0) printf("\n");
+        show(segment, &now, &before);
+        fflush(stdout);
+
+        before = now;
+    }
+
+    livestats_detach(segment, size);
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,477 @@
+/**
+ * @file metrics.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Implementation of the per-thread counters
+ * @details A counter is only written by the thread that owns its block, so it's incremented with a relaxed load and
+ * store instead of an atomic read-modify-write, which would lock the bus. Readers may see a slightly old value, which
+ * is fine for metrics. When a thread exits, its block is marked as free, and the next thread that counts adopts it with
+ * the counts it has, which are still part of the totals.
+ */
+
+#include "metrics.h"
+#include "tsc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define METRICS_CACHE_LINE 64 ///< Size of a cache line, to which the blocks are aligned
+#define METRICS_SUB_BUCKETS (1 << METRICS_HISTOGRAM_SUB_BITS) ///< Buckets in which each power of two is split
+#define METRICS_CALIBRATION_MS 20 ///< Milliseconds during which the rate of the time stamp counter is measured
+
+/**
+ * @brief Names of the phases, in the order of \ref PHASE
+ */
+const char *metrics_phase_names[PHASES] = {"queue", "parse", "route", "open", "header", "send", "spawn", "script"};
+
+/**
+ * @brief Quantiles of the durations of the phases that are rendered
+ */
+const double metrics_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+/**
+ * @brief Methods counted separately, the rest are counted as "other"
+ */
+const char *metrics_methods[] = {"GET", "HEAD", "POST", "OPTIONS", "PUT", "DELETE", "PATCH"};
+
+/**
+ * @brief Codes counted separately, the rest are counted as "other"
+ */
+const int metrics_codes[] = {200, 204, 206, 301, 302, 304, 400, 403, 404, 405, 408, 413, 500, 501, 502, 503, 504};
+
+#define METRICS_METHODS (sizeof(metrics_methods) / sizeof(metrics_methods[0]) + 1) ///< Methods, including "other"
+#define METRICS_CODES (sizeof(metrics_codes) / sizeof(metrics_codes[0]) + 1) ///< Codes, including "other"
+
+/**
+ * @brief Families of the counters, in the order they're rendered
+ */
+typedef enum _METRICS_FAMILY {
+    FAMILY_ACCEPTED,
+    FAMILY_QUEUE_WAIT,
+    FAMILY_CLASS_QUEUED,
+    FAMILY_CLASS_REJECTED,
+    FAMILY_BYTES_IN,
+    FAMILY_BYTES_OUT,
+    FAMILY_PARSE_ERRORS,
+    FAMILY_SPAWNS,
+    FAMILY_CACHE,
+    FAMILIES
+} METRICS_FAMILY;
+
+/**
+ * @struct metrics_family_meta
+ * @brief Description of a family of counters
+ */
+struct metrics_family_meta {
+    const char *name; ///< Name of the family
+    const char *help; ///< Description of the family
+};
+
+/**
+ * @struct metrics_meta
+ * @brief Description of a counter
+ */
+struct metrics_meta {
+    METRICS_FAMILY family; ///< Family the counter belongs to
+    const char *labels; ///< Labels of the counter in its family, or NULL
+    double scale; ///< Divisor applied to the value when it's rendered
+};
+
+const struct metrics_family_meta metrics_families[FAMILIES] = {
+        {"http_connections_accepted_total", "Connections accepted"},
+        {"http_queue_wait_seconds_total", "Time requests waited in a queue for a thread"},
+        {"http_class_requests_queued_total", "Requests handed to the threads of a class"},
+        {"http_class_requests_rejected_total", "Requests rejected because the queue of their class was full"},
+        {"http_request_bytes_total", "Bytes of requests received"},
+        {"http_response_bytes_total", "Bytes of responses sent"},
+        {"http_parse_errors_total", "Requests that couldn't be parsed, by reason"},
+        {"http_script_processes_started_total", "Processes started to run scripts"},
+        {"http_cache_lookups_total", "Lookups in the caches of the server, by result"}
+};
+
+const struct metrics_meta metrics_meta[METRICS] = {
+        [METRIC_CONNECTIONS_ACCEPTED] = {FAMILY_ACCEPTED, NULL, 1},
+        [METRIC_CONNECTIONS_DEQUEUED] = {FAMILIES, NULL, 1}, // Only rendered as part of the gauges
+        [METRIC_CONNECTIONS_FINISHED] = {FAMILIES, NULL, 1},
+        [METRIC_QUEUE_WAIT] = {FAMILY_QUEUE_WAIT, "queue=\"connections\"", 1e6},
+        [METRIC_BYTES_IN] = {FAMILY_BYTES_IN, NULL, 1},
+        [METRIC_BYTES_OUT] = {FAMILY_BYTES_OUT, NULL, 1},
+        [METRIC_PARSE_ERROR] = {FAMILY_PARSE_ERRORS, "reason=\"malformed\"", 1},
+        [METRIC_PARSE_TOO_LONG] = {FAMILY_PARSE_ERRORS, "reason=\"too_long\"", 1},
+        [METRIC_PARSE_IO_ERROR] = {FAMILY_PARSE_ERRORS, "reason=\"io_error\"", 1},
+        [METRIC_PARSE_INTERNAL_ERROR] = {FAMILY_PARSE_ERRORS, "reason=\"internal_error\"", 1},
+        [METRIC_CGI_SPAWNS] = {FAMILY_SPAWNS, "kind=\"cgi\"", 1},
+        [METRIC_POOL_SPAWNS] = {FAMILY_SPAWNS, "kind=\"pool\"", 1},
+        [METRIC_PATH_CACHE_HITS] = {FAMILY_CACHE, "cache=\"path\",result=\"hit\"", 1},
+        [METRIC_PATH_CACHE_MISSES] = {FAMILY_CACHE, "cache=\"path\",result=\"miss\"", 1},
+        [METRIC_SCRIPT_CACHE_HITS] = {FAMILY_CACHE, "cache=\"script\",result=\"hit\"", 1},
+        [METRIC_SCRIPT_CACHE_STALE] = {FAMILY_CACHE, "cache=\"script\",result=\"stale\"", 1},
+        [METRIC_SCRIPT_CACHE_MISSES] = {FAMILY_CACHE, "cache=\"script\",result=\"miss\"", 1},
+        [METRIC_SCRIPT_CACHE_BYPASSES] = {FAMILY_CACHE, "cache=\"script\",result=\"bypass\"", 1},
+        [METRIC_DYNAMIC_QUEUED] = {FAMILY_CLASS_QUEUED, "class=\"dynamic\"", 1},
+        [METRIC_DYNAMIC_WAIT] = {FAMILY_QUEUE_WAIT, "queue=\"dynamic\"", 1e6},
+        [METRIC_DYNAMIC_REJECTED] = {FAMILY_CLASS_REJECTED, "class=\"dynamic\"", 1},
+        [METRIC_ADMIN_QUEUED] = {FAMILY_CLASS_QUEUED, "class=\"admin\"", 1},
+        [METRIC_ADMIN_WAIT] = {FAMILY_QUEUE_WAIT, "queue=\"admin\"", 1e6},
+        [METRIC_ADMIN_REJECTED] = {FAMILY_CLASS_REJECTED, "class=\"admin\"", 1}
+};
+
+/**
+ * @struct metrics_block
+ * @brief Counters of a thread, which start in their own cache line
+ */
+struct metrics_block {
+    atomic_ulong counters[METRICS]; ///< Values of the counters
+    atomic_ulong requests[METRICS_METHODS][METRICS_CODES]; ///< Requests answered, by method and code
+    atomic_ulong phases[PHASES][METRICS_HISTOGRAM_BUCKETS]; ///< Histograms of the durations of the phases
+    atomic_ulong phase_sums[PHASES]; ///< Sums of the durations of the phases, in nanoseconds
+    int in_use; ///< 1 while a thread owns the block, protected by the mutex
+    struct metrics_block *next; ///< Next block
+};
+
+struct metrics_block *metrics_blocks = NULL; ///< List of all the blocks
+pthread_mutex_t metrics_mutex = PTHREAD_MUTEX_INITIALIZER; ///< Protects the list of blocks and their owners
+
+pthread_key_t metrics_key; ///< Key whose destructor frees the block of an exiting thread
+pthread_once_t metrics_key_once = PTHREAD_ONCE_INIT; ///< Creates the key only once
+
+_Thread_local struct metrics_block *local_block = NULL; ///< Block of the thread
+_Thread_local struct metrics_trace local_trace; ///< Trace of the request being served by the thread
+
+double tsc_ns_per_cycle = 0; ///< Nanoseconds per cycle of the time stamp counter, or 0 if it isn't used
+uint64_t tsc_base = 0; ///< Value of the time stamp counter when it was calibrated
+
+/**
+ * @brief Destructor of the key, which lets another thread adopt the block of an exiting thread
+ * @param[in] block The block
+ */
+void metrics_release_block(void *block) {
+    pthread_mutex_lock(&metrics_mutex);
+    ((struct metrics_block *) block)->in_use = 0;
+    pthread_mutex_unlock(&metrics_mutex);
+}
+
+/**
+ * @brief Creates the key used to detect when threads exit
+ */
+void metrics_create_key() {
+    pthread_key_create(&metrics_key, metrics_release_block);
+}
+
+/**
+ * @brief Returns the block of the calling thread, adopting a free one or creating it the first time
+ * @return The block, or NULL if it can't be created
+ */
+struct metrics_block *metrics_get_block() {
+    if (local_block) return local_block;
+
+    pthread_once(&metrics_key_once, metrics_create_key);
+
+    pthread_mutex_lock(&metrics_mutex);
+    struct metrics_block *block = metrics_blocks;
+    while (block && block->in_use) block = block->next;
+
+    if (!block) {
+        size_t size = (sizeof(struct metrics_block) + METRICS_CACHE_LINE - 1) / METRICS_CACHE_LINE * METRICS_CACHE_LINE;
+        block = aligned_alloc(METRICS_CACHE_LINE, size); // No other thread writes to the cache lines of the block
+        if (!block) {
+            pthread_mutex_unlock(&metrics_mutex);
+            return NULL;
+        }
+        memset(block, 0, size);
+        block->next = metrics_blocks;
+        metrics_blocks = block;
+    }
+    block->in_use = 1;
+    pthread_mutex_unlock(&metrics_mutex);
+
+    pthread_setspecific(metrics_key, block);
+    local_block = block;
+
+    return block;
+}
+
+/**
+ * @brief Adds a value to a counter only written by the calling thread
+ * @param[in,out] counter The counter
+ * @param[in] value The value
+ */
+void metrics_increment(atomic_ulong *counter, unsigned long value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+void metrics_add(METRIC metric, unsigned long value) {
+    if (metric < 0 || metric >= METRICS) return;
+
+    struct metrics_block *block = metrics_get_block();
+    if (block) metrics_increment(&block->counters[metric], value);
+}
+
+void metrics_count_request(const char *method, int code) {
+    struct metrics_block *block = metrics_get_block();
+    if (!block) return;
+
+    size_t m = 0, c = 0;
+    while (m < METRICS_METHODS - 1 && (!method || strcmp(method, metrics_methods[m]) != 0)) m++;
+    while (c < METRICS_CODES - 1 && code != metrics_codes[c]) c++;
+
+    metrics_increment(&block->requests[m][c], 1);
+}
+
+STATUS metrics_clock_init() {
+    if (tsc_ns_per_cycle > 0) return SUCCESS;
+
+    uint64_t rate = tsc_calibrate(METRICS_CALIBRATION_MS);
+    if (rate == 0) return ERROR;
+
+    tsc_base = tsc_read();
+    tsc_ns_per_cycle = 1e9 / (double) rate; // Set last, since it's what tells metrics_now() to use the counter
+    return SUCCESS;
+}
+
+uint64_t metrics_now() {
+    if (tsc_ns_per_cycle > 0) return (uint64_t) ((double) (tsc_read() - tsc_base) * tsc_ns_per_cycle);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/**
+ * @brief Returns the bucket of a histogram where a duration is counted
+ * @param[in] ns Duration in nanoseconds
+ * @return Index of the bucket
+ */
+size_t metrics_bucket(uint64_t ns) {
+    if (ns < METRICS_SUB_BUCKETS) return (size_t) ns;
+
+    int exponent = 63 - __builtin_clzll(ns); // Position of the highest bit set
+    if (exponent > METRICS_HISTOGRAM_MAX_BITS) return METRICS_HISTOGRAM_BUCKETS - 1;
+
+    // The highest bits select the power of two, and the next ones the bucket inside it
+    int shift = exponent - METRICS_HISTOGRAM_SUB_BITS;
+    return (size_t) shift * METRICS_SUB_BUCKETS + (size_t) (ns >> shift);
+}
+
+/**
+ * @brief Returns the highest duration counted in a bucket of a histogram
+ * @param[in] bucket Index of the bucket
+ * @return The duration in nanoseconds
+ */
+uint64_t metrics_bucket_highest(size_t bucket) {
+    if (bucket < METRICS_SUB_BUCKETS) return bucket;
+
+    int shift = (int) (bucket / METRICS_SUB_BUCKETS) - 1;
+    uint64_t lowest = (uint64_t) (bucket % METRICS_SUB_BUCKETS + METRICS_SUB_BUCKETS) << shift;
+    return lowest + ((uint64_t) 1 << shift) - 1;
+}
+
+void metrics_observe(PHASE phase, uint64_t ns) {
+    if (phase < 0 || phase >= PHASES) return;
+
+    local_trace.phases[phase] += ns;
+
+    struct metrics_block *block = metrics_get_block();
+    if (!block) return;
+
+    metrics_increment(&block->phases[phase][metrics_bucket(ns)], 1);
+    metrics_increment(&block->phase_sums[phase], ns);
+}
+
+struct metrics_trace *metrics_trace() {
+    return &local_trace;
+}
+
+void metrics_trace_reset() {
+    memset(&local_trace, 0, sizeof(struct metrics_trace));
+}
+
+void metrics_observe_since(PHASE phase, uint64_t start) {
+    uint64_t now = metrics_now();
+    metrics_observe(phase, now > start ? now - start : 0);
+}
+
+void metrics_histogram_read(PHASE phase, struct metrics_histogram *histogram) {
+    memset(histogram, 0, sizeof(struct metrics_histogram));
+    if (phase < 0 || phase >= PHASES) return;
+
+    pthread_mutex_lock(&metrics_mutex);
+    for (struct metrics_block *block = metrics_blocks; block; block = block->next) {
+        for (size_t i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+            histogram->buckets[i] += atomic_load_explicit(&block->phases[phase][i], memory_order_relaxed);
+        }
+        histogram->sum += atomic_load_explicit(&block->phase_sums[phase], memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&metrics_mutex);
+
+    for (size_t i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) histogram->count += histogram->buckets[i];
+}
+
+void metrics_histogram_subtract(struct metrics_histogram *histogram, const struct metrics_histogram *previous) {
+    histogram->count = 0;
+    for (size_t i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+        // Buckets only grow, but the newer copy may have missed a store that the older one saw
+        histogram->buckets[i] = histogram->buckets[i] > previous->buckets[i] ?
+                                histogram->buckets[i] - previous->buckets[i] : 0;
+        histogram->count += histogram->buckets[i];
+    }
+    histogram->sum = histogram->sum > previous->sum ? histogram->sum - previous->sum : 0;
+}
+
+uint64_t metrics_histogram_quantile(const struct metrics_histogram *histogram, double quantile) {
+    if (histogram->count == 0) return 0;
+    if (quantile < 0) quantile = 0;
+    if (quantile > 1) quantile = 1;
+
+    // Rank of the duration, counting from 1, so that the quantile 1 is the highest one
+    unsigned long rank = (unsigned long) (quantile * (double) histogram->count + 0.5);
+    if (rank < 1) rank = 1;
+
+    unsigned long seen = 0;
+    for (size_t i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) return metrics_bucket_highest(i);
+    }
+
+    return metrics_bucket_highest(METRICS_HISTOGRAM_BUCKETS - 1);
+}
+
+const char *metrics_phase_name(PHASE phase) {
+    return phase >= 0 && phase < PHASES ? metrics_phase_names[phase] : "unknown";
+}
+
+unsigned long metrics_value(METRIC metric) {
+    if (metric < 0 || metric >= METRICS) return 0;
+
+    unsigned long value = 0;
+    pthread_mutex_lock(&metrics_mutex);
+    for (struct metrics_block *block = metrics_blocks; block; block = block->next) {
+        value += atomic_load_explicit(&block->counters[metric], memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&metrics_mutex);
+
+    return value;
+}
+
+void metrics_printf(struct metrics_text *text, const char *format, ...) {
+    if (!text || text->failed) return;
+
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (len < 0) return;
+
+    if (text->len + (size_t) len + 1 > text->cap) {
+        size_t cap = text->cap ? text->cap : 4096;
+        while (cap < text->len + (size_t) len + 1) cap *= 2;
+
+        char *data = realloc(text->data, cap);
+        if (!data) {
+            text->failed = 1;
+            return;
+        }
+        text->data = data;
+        text->cap = cap;
+    }
+
+    va_start(args, format);
+    vsnprintf(text->data + text->len, text->cap - text->len, format, args);
+    va_end(args);
+    text->len += (size_t) len;
+}
+
+void metrics_family(struct metrics_text *text, const char *name, const char *type, const char *help) {
+    metrics_printf(text, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void metrics_render(struct metrics_text *text) {
+    unsigned long values[METRICS] = {0};
+    unsigned long requests[METRICS_METHODS][METRICS_CODES] = {{0}};
+
+    // The blocks are summed first, so that the lock isn't held while formatting
+    pthread_mutex_lock(&metrics_mutex);
+    for (struct metrics_block *block = metrics_blocks; block; block = block->next) {
+        for (int i = 0; i < METRICS; i++) {
+            values[i] += atomic_load_explicit(&block->counters[i], memory_order_relaxed);
+        }
+        for (size_t m = 0; m < METRICS_METHODS; m++) {
+            for (size_t c = 0; c < METRICS_CODES; c++) {
+                requests[m][c] += atomic_load_explicit(&block->requests[m][c], memory_order_relaxed);
+            }
+        }
+    }
+    pthread_mutex_unlock(&metrics_mutex);
+
+    metrics_family(text, "http_requests_total", "counter", "Requests answered, by method and code");
+    for (size_t m = 0; m < METRICS_METHODS; m++) {
+        for (size_t c = 0; c < METRICS_CODES; c++) {
+            if (requests[m][c] == 0) continue;
+
+            char code[16] = "other";
+            if (c < METRICS_CODES - 1) snprintf(code, sizeof(code), "%i", metrics_codes[c]);
+            metrics_printf(text, "http_requests_total{method=\"%s\",code=\"%s\"} %lu\n",
+                           m < METRICS_METHODS - 1 ? metrics_methods[m] : "other", code, requests[m][c]);
+        }
+    }
+
+    // The counters of the connections are used by whoever is ahead, so they're clamped at zero
+    unsigned long accepted = values[METRIC_CONNECTIONS_ACCEPTED];
+    unsigned long dequeued = values[METRIC_CONNECTIONS_DEQUEUED], finished = values[METRIC_CONNECTIONS_FINISHED];
+    metrics_family(text, "http_connections_active", "gauge", "Connections accepted and not answered yet");
+    metrics_printf(text, "http_connections_active %lu\n", accepted > finished ? accepted - finished : 0);
+    metrics_family(text, "http_connection_queue_depth", "gauge", "Connections waiting for a connection thread");
+    metrics_printf(text, "http_connection_queue_depth %lu\n", accepted > dequeued ? accepted - dequeued : 0);
+
+    for (int family = 0; family < FAMILIES; family++) {
+        metrics_family(text, metrics_families[family].name, "counter", metrics_families[family].help);
+
+        for (int i = 0; i < METRICS; i++) {
+            if (metrics_meta[i].family != (METRICS_FAMILY) family) continue;
+
+            const char *labels = metrics_meta[i].labels;
+            if (metrics_meta[i].scale != 1) {
+                metrics_printf(text, "%s%s%s%s %.6f\n", metrics_families[family].name, labels ? "{" : "",
+                               labels ? labels : "", labels ? "}" : "", (double) values[i] / metrics_meta[i].scale);
+            } else {
+                metrics_printf(text, "%s%s%s%s %lu\n", metrics_families[family].name, labels ? "{" : "",
+                               labels ? labels : "", labels ? "}" : "", values[i]);
+            }
+        }
+    }
+
+    // The histograms are too detailed to be exposed bucket by bucket, so their quantiles are computed here
+    metrics_family(text, "http_request_phase_seconds", "summary", "Time spent in each phase of the requests");
+    struct metrics_histogram *histogram = malloc(sizeof(struct metrics_histogram));
+    if (!histogram) {
+        text->failed = 1;
+        return;
+    }
+    for (int phase = 0; phase < PHASES; phase++) {
+        metrics_histogram_read(phase, histogram);
+
+        for (size_t i = 0; i < sizeof(metrics_quantiles) / sizeof(metrics_quantiles[0]); i++) {
+            metrics_printf(text, "http_request_phase_seconds{phase=\"%s\",quantile=\"%g\"} %.9f\n",
+                           metrics_phase_names[phase], metrics_quantiles[i],
+                           (double) metrics_histogram_quantile(histogram, metrics_quantiles[i]) / 1e9);
+        }
+        metrics_printf(text, "http_request_phase_seconds_sum{phase=\"%s\"} %.9f\n", metrics_phase_names[phase],
+                       (double) histogram->sum / 1e9);
+        metrics_printf(text, "http_request_phase_seconds_count{phase=\"%s\"} %lu\n", metrics_phase_names[phase],
+                       histogram->count);
+    }
+    free(histogram);
+}
+
+void metrics_text_free(struct metrics_text *text) {
+    if (!text) return;
+
+    free(text->data);
+    memset(text, 0, sizeof(struct metrics_text));
+}
\ No newline at end of file
@@ -0,0 +1,232 @@
+/**
+ * @file metrics.h
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Counters of the activity of the server, exposed in the Prometheus text format
+ * @details Counting events in shared variables makes every thread that counts one fight for the cache line holding
+ * them, which slows down the threads more the more they count. Instead, each thread counts in its own block of
+ * counters, aligned to a cache line and only written by it, so counting is a plain addition. The blocks are only summed
+ * when the metrics are read, which is rare compared to the events counted.
+ *
+ * Blocks of threads that exit are reused by new threads, so that their counts are never lost.
+ *
+ * The durations of the phases of requests are recorded the same way, in per-thread histograms that are merged when
+ * read.
+ */
+
+#ifndef PRACTICA1_METRICS_H
+#define PRACTICA1_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "constants.h"
+
+#define METRICS_CONTENT_TYPE "text/plain; version=0.0.4" ///< Content type of the Prometheus text format
+
+#define METRICS_HISTOGRAM_SUB_BITS 4 ///< Each power of two is split in 2^4 buckets, so values are within 6.25%
+#define METRICS_HISTOGRAM_MAX_BITS 40 ///< Durations over 2^41 nanoseconds (about 36 minutes) share the last bucket
+#define METRICS_HISTOGRAM_BUCKETS ((METRICS_HISTOGRAM_MAX_BITS - METRICS_HISTOGRAM_SUB_BITS + 2) << \
+    METRICS_HISTOGRAM_SUB_BITS) ///< Number of buckets of a histogram
+
+/**
+ * @brief Events counted by the server
+ */
+typedef enum _METRIC {
+    METRIC_CONNECTIONS_ACCEPTED, ///< Connections accepted
+    METRIC_CONNECTIONS_DEQUEUED, ///< Connections taken from the queue by a connection thread
+    METRIC_CONNECTIONS_FINISHED, ///< Connections whose request has been answered
+    METRIC_QUEUE_WAIT, ///< Microseconds connections waited in the queue
+    METRIC_BYTES_IN, ///< Bytes of requests received
+    METRIC_BYTES_OUT, ///< Bytes of responses sent
+    METRIC_PARSE_ERROR, ///< Requests that couldn't be parsed
+    METRIC_PARSE_TOO_LONG, ///< Requests too long to be parsed
+    METRIC_PARSE_IO_ERROR, ///< Requests that couldn't be read
+    METRIC_PARSE_INTERNAL_ERROR, ///< Requests that couldn't be parsed because of an internal error
+    METRIC_CGI_SPAWNS, ///< Processes started for CGI scripts
+    METRIC_POOL_SPAWNS, ///< Worker processes started for pools
+    METRIC_PATH_CACHE_HITS, ///< Paths found in the path cache
+    METRIC_PATH_CACHE_MISSES, ///< Paths not found in the path cache
+    METRIC_SCRIPT_CACHE_HITS, ///< Script responses found in the cache
+    METRIC_SCRIPT_CACHE_STALE, ///< Stale script responses sent while they're refreshed
+    METRIC_SCRIPT_CACHE_MISSES, ///< Script responses not found in the cache
+    METRIC_SCRIPT_CACHE_BYPASSES, ///< Script responses that couldn't be cached
+    METRIC_DYNAMIC_QUEUED, ///< Requests handed to the threads of the dynamic class
+    METRIC_DYNAMIC_WAIT, ///< Microseconds requests waited for a thread of the dynamic class
+    METRIC_DYNAMIC_REJECTED, ///< Requests rejected because the queue of the dynamic class was full
+    METRIC_ADMIN_QUEUED, ///< Requests handed to the threads of the admin class
+    METRIC_ADMIN_WAIT, ///< Microseconds requests waited for a thread of the admin class
+    METRIC_ADMIN_REJECTED, ///< Requests rejected because the queue of the admin class was full
+    METRICS ///< Number of metrics
+} METRIC;
+
+/**
+ * @brief Phases of a request whose durations are recorded in histograms
+ */
+typedef enum _PHASE {
+    PHASE_QUEUE, ///< Waiting in the queue of connections
+    PHASE_PARSE, ///< Reading and parsing the request header
+    PHASE_ROUTE, ///< Resolving the request path to a file or script
+    PHASE_OPEN, ///< Opening the file to be sent
+    PHASE_HEADER, ///< Building the response header
+    PHASE_SEND, ///< Sending the response body
+    PHASE_SPAWN, ///< Starting the process of a CGI script
+    PHASE_SCRIPT, ///< Running a script, until its whole response has been sent
+    PHASES ///< Number of phases
+} PHASE;
+
+/**
+ * @struct metrics_histogram
+ * @brief Durations of a phase, merged from the histograms of all the threads
+ * @details The buckets are log-linear, like in HdrHistogram: durations under 2^5 nanoseconds have a bucket each, and
+ * every following power of two is split in 2^\ref METRICS_HISTOGRAM_SUB_BITS buckets of the same width. This keeps the
+ * same relative precision from nanoseconds to minutes, with a fixed number of buckets.
+ */
+struct metrics_histogram {
+    unsigned long buckets[METRICS_HISTOGRAM_BUCKETS]; ///< Number of durations in each bucket
+    unsigned long count; ///< Number of durations
+    unsigned long sum; ///< Sum of the durations, in nanoseconds
+};
+
+/**
+ * @struct metrics_trace
+ * @brief Durations of the phases of the request being served by a thread
+ * @details Every duration recorded by a thread is also added to its trace, which is reset when it starts serving a new
+ * connection. This lets the server tell where the time of a single request went.
+ */
+struct metrics_trace {
+    uint64_t phases[PHASES]; ///< Nanoseconds spent in each phase
+    uint64_t started[PHASES]; ///< Moment each unfinished phase started, as returned by metrics_now(), or 0
+};
+
+/**
+ * @struct metrics_text
+ * @brief Text of the metrics, which grows as it's written
+ */
+struct metrics_text {
+    char *data; ///< The text, null terminated
+    size_t len; ///< Length of the text
+    size_t cap; ///< Allocated size
+    int failed; ///< 1 if memory couldn't be allocated, so the text is incomplete
+};
+
+/**
+ * @brief Adds a value to a counter, in the block of the calling thread
+ * @param[in] metric The counter
+ * @param[in] value The value
+ */
+void metrics_add(METRIC metric, unsigned long value);
+
+/**
+ * @brief Counts a request answered
+ * @details Requests are counted by method and code. Uncommon methods and codes are counted as "other".
+ * @param[in] method Method of the request
+ * @param[in] code Code of the response
+ */
+void metrics_count_request(const char *method, int code);
+
+/**
+ * @brief Measures the rate of the time stamp counter of the processor, so that metrics_now() can use it
+ * @details Until this is called, or if the counter can't be used as a clock, metrics_now() uses the monotonic clock.
+ * The calling thread sleeps for a few milliseconds.
+ * @pre No other thread can be calling metrics_now(), since the calibration is read without synchronization
+ * @return \ref STATUS.SUCCESS if the time stamp counter is used, \ref STATUS.ERROR otherwise
+ */
+STATUS metrics_clock_init();
+
+/**
+ * @brief Returns the current time, to measure phases
+ * @return Nanoseconds since an arbitrary moment
+ */
+uint64_t metrics_now();
+
+/**
+ * @brief Returns the trace of the calling thread
+ * @return The trace, which the thread can modify, for example to continue the trace of another thread
+ */
+struct metrics_trace *metrics_trace();
+
+/**
+ * @brief Resets the trace of the calling thread, before serving a new connection
+ */
+void metrics_trace_reset();
+
+/**
+ * @brief Records the duration of a phase, in the histogram and the trace of the calling thread
+ * @param[in] phase The phase
+ * @param[in] ns Duration in nanoseconds
+ */
+void metrics_observe(PHASE phase, uint64_t ns);
+
+/**
+ * @brief Records the duration of a phase that started at the given moment and ends now
+ * @param[in] phase The phase
+ * @param[in] start Moment the phase started, as returned by metrics_now()
+ */
+void metrics_observe_since(PHASE phase, uint64_t start);
+
+/**
+ * @brief Merges the histograms of a phase of all the threads
+ * @param[in] phase The phase
+ * @param[out] histogram Where the merged histogram is stored
+ */
+void metrics_histogram_read(PHASE phase, struct metrics_histogram *histogram);
+
+/**
+ * @brief Subtracts an older copy of a histogram, leaving only the durations recorded since it was read
+ * @param[in,out] histogram The histogram
+ * @param[in] previous The older copy
+ */
+void metrics_histogram_subtract(struct metrics_histogram *histogram, const struct metrics_histogram *previous);
+
+/**
+ * @brief Returns a quantile of the durations of a histogram
+ * @param[in] histogram The histogram
+ * @param[in] quantile The quantile, between 0 and 1
+ * @return The highest duration that shares a bucket with the quantile, in nanoseconds, or 0 if it's empty
+ */
+uint64_t metrics_histogram_quantile(const struct metrics_histogram *histogram, double quantile);
+
+/**
+ * @brief Returns the name of a phase
+ * @param[in] phase The phase
+ * @return The name, which is also its label in the metrics
+ */
+const char *metrics_phase_name(PHASE phase);
+
+/**
+ * @brief Returns the value of a counter, summing the blocks of all the threads
+ * @param[in] metric The counter
+ * @return The value
+ */
+unsigned long metrics_value(METRIC metric);
+
+/**
+ * @brief Appends formatted text to the text of the metrics
+ * @param[in,out] text The text
+ * @param[in] format Format string
+ * @param[in] ... Parameters to be interpolated into the string
+ */
+void metrics_printf(struct metrics_text *text, const char *format, ...);
+
+/**
+ * @brief Appends the HELP and TYPE lines of a metric family
+ * @param[in,out] text The text
+ * @param[in] name Name of the family
+ * @param[in] type Type of the family ("counter" or "gauge")
+ * @param[in] help Description of the family
+ */
+void metrics_family(struct metrics_text *text, const char *name, const char *type, const char *help);
+
+/**
+ * @brief Appends all the counters, and the quantiles of the durations of each phase, to the text of the metrics
+ * @param[in,out] text The text
+ */
+void metrics_render(struct metrics_text *text);
+
+/**
+ * @brief Frees the text of the metrics
+ * @param[in,out] text The text
+ */
+void metrics_text_free(struct metrics_text *text);
+
+#endif //PRACTICA1_METRICS_H
@@ -0,0 +1,238 @@
+/**
+ * @file mimegen.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Build time generator of the built-in MIME table
+ * @details This program reads a MIME file (in the same tab separated format used by the server at runtime), and
+ * writes a C header containing a perfect hash table with its associations, which is compiled into the mimetable
+ * module. The displacement values of every bucket are searched for until no two extensions share a slot, growing the
+ * table if that isn't possible.
+ * @see mimehash.h
+ *
+ * Usage: mimegen <mime.tsv path> <output header path>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "mimehash.h"
+#include "mimetable.h"
+
+#define MAX_MIME_LINE 512 ///< Maximum length of a line in the MIME file
+#define MAX_DISPLACEMENT (1u << 20) ///< Number of displacement values tried for each bucket before growing the table
+
+/**
+ * @struct mimegen_entry
+ * @brief Association read from the MIME file
+ */
+struct mimegen_entry {
+    char *extension; ///< Lowercase extension
+    char *type; ///< MIME type
+    size_t bucket; ///< Bucket the extension belongs to
+};
+
+/**
+ * @brief Returns the smallest power of two bigger or equal than the provided number
+ * @param[in] n The number
+ * @return The power of two
+ */
+size_t next_pow2(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1u;
+    return p;
+}
+
+/**
+ * @brief Checks if a string can be written as a C string literal without escaping
+ * @param[in] str The string to check
+ * @return 1 if it can, 0 otherwise
+ */
+int is_plain(const char *str) {
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\' || (unsigned char) *str < ' ') return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Reads the associations of a MIME file
+ * @param[in] filename Path of the MIME file
+ * @param[out] entries Variable where the allocated array of associations must be stored
+ * @return Number of associations read, or -1 if an error occurs
+ */
+int read_entries(const char *filename, struct mimegen_entry **entries) {
+    FILE *f = fopen(filename, "r");
+    if (!f) {
+        fprintf(stderr, "mimegen: can't open %s: %s\n", filename, strerror(errno));
+        return -1;
+    }
+
+    int n = 0, capacity = 64, line_n = 0;
+    *entries = malloc(capacity * sizeof(struct mimegen_entry));
+
+    char line[MAX_MIME_LINE];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line_n++;
+        line[strcspn(line, "\r\n")] = '\0'; // Remove the line terminator
+        if (line[0] == '\0' || line[0] == '#') continue; // Skip empty lines and comments
+
+        char *extension = strtok(line, "\t");
+        char *type = strtok(NULL, "\t");
+        if (!extension || !type || !is_plain(extension) || !is_plain(type)) {
+            fprintf(stderr, "mimegen: %s:%i: invalid association\n", filename, line_n);
+            fclose(f);
+            return -1;
+        }
+        if (strlen(extension) >= MAX_EXTENSION) { // mime_get_type() never looks up extensions that long
+            fprintf(stderr, "mimegen: %s:%i: extension '%s' is longer than %i characters\n", filename, line_n,
+                    extension, MAX_EXTENSION - 1);
+            fclose(f);
+            return -1;
+        }
+
+        for (char *c = extension; *c; c++) *c = (char) mime_tolower((unsigned char) *c);
+
+        for (int i = 0; i < n; i++) { // Duplicated extensions would make the table ambiguous
+            if (strcmp((*entries)[i].extension, extension) == 0) {
+                fprintf(stderr, "mimegen: %s:%i: duplicated extension '%s'\n", filename, line_n, extension);
+                fclose(f);
+                return -1;
+            }
+        }
+
+        if (n == capacity) {
+            capacity *= 2;
+            *entries = realloc(*entries, capacity * sizeof(struct mimegen_entry));
+        }
+        (*entries)[n].extension = strdup(extension);
+        (*entries)[n].type = strdup(type);
+        n++;
+    }
+
+    fclose(f);
+    return n;
+}
+
+/**
+ * @brief Attempts to find displacement values that place every extension in a different slot
+ * @param[in,out] entries The associations (their buckets are filled in)
+ * @param[in] n Number of associations
+ * @param[in] n_buckets Number of buckets (power of two)
+ * @param[in] n_slots Number of slots of the table (power of two)
+ * @param[out] disp Array of \p n_buckets elements where the displacement values must be stored
+ * @param[out] slots Array of \p n_slots elements where the index of the entry in each slot must be stored (-1 if empty)
+ * @return 1 if a perfect assignment was found, 0 otherwise
+ */
+int find_displacements(struct mimegen_entry *entries, int n, size_t n_buckets, size_t n_slots, uint32_t *disp,
+                       int *slots) {
+    for (size_t i = 0; i < n_slots; i++) slots[i] = -1;
+
+    size_t *bucket_size = calloc(n_buckets, sizeof(size_t));
+    for (int i = 0; i < n; i++) {
+        entries[i].bucket = mime_hash(entries[i].extension, strlen(entries[i].extension), 0) & (n_buckets - 1);
+        bucket_size[entries[i].bucket]++;
+    }
+
+    int *members = malloc(n * sizeof(int));
+    size_t *candidate = malloc(n * sizeof(size_t));
+    int ok = 1;
+
+    // Buckets are placed from the biggest to the smallest, as the big ones are the hardest to fit
+    for (size_t size = (size_t) n; size > 0 && ok; size--) {
+        for (size_t b = 0; b < n_buckets && ok; b++) {
+            if (bucket_size[b] != size) continue;
+
+            int n_members = 0;
+            for (int i = 0; i < n; i++) {
+                if (entries[i].bucket == b) members[n_members++] = i;
+            }
+
+            uint32_t d;
+            for (d = 1; d < MAX_DISPLACEMENT; d++) {
+                int fits = 1;
+                for (int m = 0; m < n_members && fits; m++) {
+                    const char *ext = entries[members[m]].extension;
+                    candidate[m] = mime_hash(ext, strlen(ext), d) & (n_slots - 1);
+                    if (slots[candidate[m]] != -1) fits = 0; // The slot is already taken
+                    for (int o = 0; o < m && fits; o++) {
+                        if (candidate[o] == candidate[m]) fits = 0; // Two members of the bucket collide
+                    }
+                }
+                if (fits) break;
+            }
+
+            if (d == MAX_DISPLACEMENT) {
+                ok = 0;
+            } else {
+                disp[b] = d;
+                for (int m = 0; m < n_members; m++) slots[candidate[m]] = members[m];
+            }
+        }
+    }
+
+    free(candidate);
+    free(members);
+    free(bucket_size);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: mimegen <mime.tsv path> <output header path>\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct mimegen_entry *entries = NULL;
+    int n = read_entries(argv[1], &entries);
+    if (n <= 0) {
+        fprintf(stderr, "mimegen: no associations found in %s\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t n_buckets = next_pow2((size_t) n) / 4;
+    if (n_buckets == 0) n_buckets = 1;
+    size_t n_slots = next_pow2((size_t) n) * 2;
+
+    uint32_t *disp = calloc(n_buckets, sizeof(uint32_t));
+    int *slots = malloc(n_slots * sizeof(int));
+    while (!find_displacements(entries, n, n_buckets, n_slots, disp, slots)) { // Grow the table until it fits
+        n_slots *= 2;
+        slots = realloc(slots, n_slots * sizeof(int));
+    }
+
+    FILE *out = fopen(argv[2], "w");
+    if (!out) {
+        fprintf(stderr, "mimegen: can't open %s: %s\n", argv[2], strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(out, "// Generated by mimegen from %s, do not edit\n\n", argv[1]);
+    fprintf(out, "#include \"mimehash.h\"\n\n");
+    fprintf(out, "#define MIME_STATIC_COUNT %i ///< Number of built-in associations\n", n);
+    fprintf(out, "#define MIME_STATIC_BUCKETS %zu ///< Number of buckets of the first level hash\n", n_buckets);
+    fprintf(out, "#define MIME_STATIC_SLOTS %zu ///< Number of slots of the table\n\n", n_slots);
+
+    fprintf(out, "/// Displacement value (seed of the second level hash) of every bucket\n");
+    fprintf(out, "static const uint32_t mime_static_disp[MIME_STATIC_BUCKETS] = {");
+    for (size_t b = 0; b < n_buckets; b++) {
+        fprintf(out, "%s%uu", b == 0 ? "\n        " : (b % 8 ? ", " : ",\n        "), disp[b]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "/// Slots of the perfect hash table\n");
+    fprintf(out, "static const struct mime_static_entry mime_static_table[MIME_STATIC_SLOTS] = {\n");
+    for (size_t i = 0; i < n_slots; i++) {
+        if (slots[i] == -1) {
+            fprintf(out, "        {NULL, 0, NULL},\n");
+        } else {
+            fprintf(out, "        {\"%s\", %zu, \"%s\"},\n", entries[slots[i]].extension,
+                    strlen(entries[slots[i]].extension), entries[slots[i]].type);
+        }
+    }
+    fprintf(out, "};\n");
+
+    fclose(out);
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+/**
+ * @file mimehash.h
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Hash function and entry type shared by the MIME table generator and the MIME table itself
+ * @details The built-in MIME associations are stored in a perfect hash table generated at build time by
+ * mimegen.c. It uses the "hash and displace" scheme: the extension is first hashed into a bucket, whose displacement
+ * value is then used as the seed of a second hash which gives the final slot. The generator chooses the displacement
+ * values so that no two extensions end up in the same slot, so a lookup always needs a single comparison.
+ * Hashing is case-insensitive, so that the extensions can be looked up regardless of their case.
+ */
+
+#ifndef PRACTICA1_MIMEHASH_H
+#define PRACTICA1_MIMEHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @struct mime_static_entry
+ * @brief Slot of the generated perfect hash table
+ */
+struct mime_static_entry {
+    const char *extension; ///< Lowercase file extension, or NULL if the slot is empty
+    size_t length; ///< Length of the extension
+    const char *type; ///< Associated MIME type
+};
+
+/**
+ * @brief Converts an ASCII character to lowercase, independently of the locale
+ * @param[in] c The character to convert
+ * @return The lowercase character
+ */
+static inline unsigned char mime_tolower(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char) (c + ('a' - 'A')) : c;
+}
+
+/**
+ * @brief Case-insensitive hash of a file extension
+ * @details FNV-1a over the lowercase characters, followed by the murmur3 finalizer so that the low bits (the ones
+ * used to index the tables) depend on every character.
+ * @param[in] extension The extension to hash (not necessarily null-terminated)
+ * @param[in] length Length of the extension
+ * @param[in] seed Seed of the hash
+ * @return The hash value
+ */
+static inline uint32_t mime_hash(const char *extension, size_t length, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < length; i++) {
+        h ^= mime_tolower((unsigned char) extension[i]);
+        h *= 16777619u;
+    }
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+#endif //PRACTICA1_MIMEHASH_H
@@ -3,12 +3,16 @@
  * @author Diego Ortín Fernández
  * @date 5 April 2020
  * @brief Implementation of the functions for parsing a MIME file and retrieving its associations
- * @details This file contains the implementation for the MIME type hash table, which can be used to
- * retrieve the MIME type associated with certain file extension. It has been decided that having
- * different MIME tables for different servers doesn't make sense, so this hash table is global.
- * Therefor, all code using this module shares the same MIME type associations.
+ * @details This file contains the implementation for the MIME type table, which can be used to retrieve the MIME type
+ * associated with certain file extension. It has been decided that having different MIME tables for different servers
+ * doesn't make sense, so this table is global. Therefor, all code using this module shares the same MIME type
+ * associations.
  *
- * The dictionary is implemented as a hash table for better performance, using the uthash library.
+ * The table has two levels. The built-in associations are compiled into a static perfect hash table, generated at
+ * build time from the mime.tsv file of the project by mimegen.c. Associations added at runtime are stored in an
+ * overlay hash table, implemented with the uthash library, which is searched first. Extensions are stored and looked
+ * up in lowercase, so lookups are case-insensitive, and neither of them ever allocates memory.
+ * @see mimehash.h
  * @see https://troydhanson.github.io/uthash/
  */
 
@@ -17,9 +21,9 @@
 #include <stdio.h>
 #include <errno.h>
 #include "mimetable.h"
+#include "mime_static.h"
 
-#define MAX_EXTENSION 10 ///< Maximum length of a file extension
-#define MAX_MIMETYPE 30 ///< Maximum extension of a MIME type
+#define MAX_MIME_LINE 512 ///< Maximum length of a line of the MIME file
 
 #define TAB_DELIM "\t" ///< String representing a tab delimiter
 
@@ -28,35 +32,84 @@
  * @brief Contains an association between an extension and a MIME type
  */
 struct mime_association {
-    char extension[MAX_EXTENSION]; ///< File extension
-    char type[MAX_MIMETYPE]; ///< Associated MIME type
+    char *extension; ///< Lowercase file extension
+    char *type; ///< Associated MIME type
     struct UT_hash_handle hh; ///< Handle to be used by @a uthash
 };
 
-struct mime_association *mime_table = NULL; ///< Global hash table holding the extension-type associations
+struct mime_association *mime_table = NULL; ///< Global hash table holding the associations added at runtime
 
 STATUS mime_parse_line(char *line);
 
+/**
+ * @brief Looks up an extension in the built-in perfect hash table
+ * @param[in] extension The extension (not necessarily null-terminated, in any case)
+ * @param[in] length Length of the extension
+ * @return The associated MIME type, or NULL if there's no built-in association for the extension
+ */
+const char *mime_static_lookup(const char *extension, size_t length) {
+    uint32_t disp = mime_static_disp[mime_hash(extension, length, 0) & (MIME_STATIC_BUCKETS - 1)];
+    const struct mime_static_entry *entry = &mime_static_table[mime_hash(extension, length, disp) &
+                                                               (MIME_STATIC_SLOTS - 1)];
+
+    // Every extension can only be in one slot, so if it's not this one, it's not in the table
+    if (!entry->extension || entry->length != length) return NULL;
+    for (size_t i = 0; i < length; i++) {
+        if (mime_tolower((unsigned char) extension[i]) != (unsigned char) entry->extension[i]) return NULL;
+    }
+
+    return entry->type;
+}
+
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "hicpp-signed-bitwise"
 #pragma ide diagnostic ignored "hicpp-multiway-paths-covered"
 
 /**
- * @brief Adds a new extension-type association to the MIME hashtable
+ * @brief Looks up an extension in the overlay hash table
+ * @param[in] extension The extension (not necessarily null-terminated, in any case)
+ * @param[in] length Length of the extension
+ * @return The associated MIME type, or NULL if no association was added at runtime for the extension
+ */
+const char *mime_overlay_lookup(const char *extension, size_t length) {
+    if (!mime_table || length >= MAX_EXTENSION) return NULL;
+
+    char key[MAX_EXTENSION]; // The keys of the table are lowercase
+    for (size_t i = 0; i < length; i++) key[i] = (char) mime_tolower((unsigned char) extension[i]);
+
+    struct mime_association *association = NULL;
+    HASH_FIND(hh, mime_table, key, length, association);
+
+    return association ? association->type : NULL;
+}
+
+/**
+ * @brief Adds a new extension-type association to the MIME overlay table
+ * @details Associations identical to a built-in one aren't added, as they would only duplicate it.
  * @param[in] extension The extension to add
  * @param[in] type The associated MIME type
  * @return \ref STATUS.SUCCESS if everything goes well, \ref STATUS.ERROR otherwise
  */
 STATUS mime_add_association(char *extension, char *type) {
     if (!extension || !type) return ERROR;
+
+    size_t length = strlen(extension);
+    if (length == 0 || length >= MAX_EXTENSION) return ERROR;
+
+    for (char *c = extension; *c; c++) *c = (char) mime_tolower((unsigned char) *c);
+
+    const char *builtin = mime_static_lookup(extension, length);
+    if (builtin && strcmp(builtin, type) == 0) return SUCCESS; // Nothing to add
+
     struct mime_association *mime_association = NULL;
 
-    HASH_FIND_STR(mime_table, extension, mime_association); // Attempt to find an element with this key
+    HASH_FIND(hh, mime_table, extension, length, mime_association); // Attempt to find an element with this key
     if (mime_association == NULL) { // If an element with this key wasn't found
         mime_association = (struct mime_association *) malloc(sizeof *mime_association); // Create a new one
-        strcpy(mime_association->type, type);
-        strcpy(mime_association->extension, extension);
-        HASH_ADD_STR(mime_table, extension, mime_association); // Add the key for the hashtable
+        mime_association->type = strdup(type);
+        mime_association->extension = strdup(extension);
+        HASH_ADD_KEYPTR(hh, mime_table, mime_association->extension, length,
+                        mime_association); // Add the key for the hashtable
         return SUCCESS;
     } else { // If an element with this key already exists
         // TODO: Print to logs
@@ -67,27 +120,52 @@ STATUS mime_add_association(char *extension, char *type) {
 
 #pragma clang diagnostic pop
 
-#pragma clang diagnostic push
-#pragma ide diagnostic ignored "hicpp-signed-bitwise"
-#pragma ide diagnostic ignored "hicpp-multiway-paths-covered"
-
 const char *mime_get_association(const char *extension) {
-    if (!mime_table || !extension) return NULL;
-    struct mime_association *association = NULL;
+    if (!extension) return NULL;
+
+    size_t length = strlen(extension);
+    const char *type = mime_overlay_lookup(extension, length); // Runtime associations override the built-in ones
+    if (type) return type;
 
-    HASH_FIND_STR(mime_table, extension, association);
+    return mime_static_lookup(extension, length);
+}
+
+const char *mime_get_type(const char *filename) {
+    if (!filename) return NULL;
+
+    const char *name = strrchr(filename, '/'); // Only the last component of the path can have an extension
+    name = name ? name + 1 : filename;
+    size_t name_len = strlen(name);
 
-    if (!association) return NULL; // If no association exists for this extension
+    // The extensions are tried from the longest to the shortest, so that compound ones (tar.gz) take precedence
+    for (const char *dot = strchr(name, '.'); dot; dot = strchr(dot + 1, '.')) {
+        size_t length = name_len - (dot + 1 - name);
+        if (length == 0 || length >= MAX_EXTENSION) continue;
+
+        const char *type = mime_overlay_lookup(dot + 1, length);
+        if (!type) type = mime_static_lookup(dot + 1, length);
+        if (type) return type;
+    }
 
-    return association->type;
+    return NULL;
 }
 
-#pragma clang diagnostic pop
+void mime_foreach_type(void (*callback)(const char *type, void *arg), void *arg) {
+    if (!callback) return;
+
+    for (int i = 0; i < MIME_STATIC_SLOTS; i++) {
+        if (mime_static_table[i].extension) callback(mime_static_table[i].type, arg);
+    }
+
+    for (struct mime_association *association = mime_table; association; association = association->hh.next) {
+        callback(association->type, arg);
+    }
+}
 
 STATUS mime_add_from_file(const char *filename) {
     if (!filename) return ERROR;
 
-    FILE *mimefd = fopen(filename, "r");
+    FILE *mimefd = fopen(filename, "re");
     if (!mimefd) { // In case any error ocurred while opening the MIME file
         // TODO: Print to logs
 #if DEBUG >= 1
@@ -96,8 +174,7 @@ STATUS mime_add_from_file(const char *filename) {
         return ERROR;
     }
 
-    // Enough size for extension, type, tab separator, newline and null-terminator
-    char current_line[MAX_EXTENSION + MAX_MIMETYPE + 1 + 1 + 1];
+    char current_line[MAX_MIME_LINE];
     short int lines_parsed = 0;
     short int errors = 0;
 
@@ -106,8 +183,8 @@ STATUS mime_add_from_file(const char *filename) {
             // TODO: Print to logs
 #if DEBUG >= 1
             printf("Error while reading MIME file line: [%s]\n", current_line);
-            errors++;
 #endif
+            errors++;
         } else {
 #if DEBUG >= 2
             // TODO: Print to logs
@@ -117,8 +194,11 @@ STATUS mime_add_from_file(const char *filename) {
         }
     }
 
+    fclose(mimefd);
+
     // TODO: Print to logs
-    printf("%i MIME types loaded, %i errors\n", lines_parsed, errors);
+    printf("%i MIME types loaded (%i built-in, %u added), %i errors\n", lines_parsed, MIME_STATIC_COUNT,
+           HASH_COUNT(mime_table), errors);
 
     // If no lines were correctly parsed, it's better to return error, as the server won't correctly send
     // the Content-Type header
@@ -136,7 +216,7 @@ STATUS mime_add_from_file(const char *filename) {
 STATUS mime_parse_line(char *line) {
     if (!line) return ERROR;
 
-    line[strlen(line) - 1] = '\0'; // Remove the newline character
+    line[strcspn(line, "\r\n")] = '\0'; // Remove the line terminator
 
     char *extension = strtok(line, TAB_DELIM); // Store the extension part
     char *type = strtok(NULL, TAB_DELIM); // Store the mime type part
@@ -13,8 +13,13 @@
 
 #include "constants.h"
 
+#define MAX_EXTENSION 32 ///< Maximum length of a file extension (including compound ones such as tar.gz) plus one
+
 /**
  * @brief Parses a file containing extension-MIMEtype associations, and adds them to the MIME table
+ * @details The associations of the file are added on top of the built-in ones, which are generated from the mime.tsv
+ * file of the project at build time, and take precedence over them. This function isn't thread safe, so it must only
+ * be called before the table starts being used by several threads.
  * @author Diego Ortín Fernández
  * @date 5 April 2020
  * @pre File located in @p filename must contain one association per line, with the extension first, separated from the
@@ -27,12 +32,31 @@ STATUS mime_add_from_file(const char *filename);
 
 /**
  * @brief Retrieves the MIME type associated with the provided extension
+ * @details The extension is compared case-insensitively, and no memory is allocated.
  * @author Diego Ortín Fernández
  * @date 4 April 2020
- * @pre The association for the @p extension must exist in the table
  * @param[in] extension The extension whose corresponding MIME type must be retrieved
- * @return pointer to the string containing the MIME type
+ * @return pointer to the string containing the MIME type, or NULL if there's no association for the extension
  */
 const char *mime_get_association(const char *extension);
 
+/**
+ * @brief Retrieves the MIME type of a file from its name
+ * @details Compound extensions are taken into account: for "backup.tar.gz", the association for "tar.gz" is used if
+ * it exists, and the one for "gz" otherwise. Only the last component of the path is considered.
+ * @param[in] filename Name or path of the file
+ * @return pointer to the string containing the MIME type, or NULL if none of the extensions of the file has an
+ * association
+ */
+const char *mime_get_type(const char *filename);
+
+/**
+ * @brief Calls the provided function for every association in the table
+ * @details The strings passed to the function are the same ones returned by the lookup functions, so their addresses
+ * can be used to identify the MIME types. A type associated with several extensions is passed several times.
+ * @param[in] callback Function to call, receiving the type and \p arg
+ * @param[in] arg Argument passed to every call of \p callback
+ */
+void mime_foreach_type(void (*callback)(const char *type, void *arg), void *arg);
+
 #endif //PRACTICA1_MIMETABLE_H
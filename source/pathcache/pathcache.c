@@ -0,0 +1,175 @@
+/**
+ * @file pathcache.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Implementation of the cache of resolved request paths
+ * @details The cache is implemented as a hash table using the uthash library, protected by a read-write lock so that
+ * lookups from different threads don't block each other. Since uthash keeps its elements in insertion order, evicting
+ * the first element of the table always removes the oldest entry.
+ * @see https://troydhanson.github.io/uthash/
+ */
+
+#include "uthash.h"
+#include "pathcache.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+/**
+ * @struct pathcache_entry
+ * @brief Entry of the cache, associating a request path with the target it resolves to
+ */
+struct pathcache_entry {
+    char *path; ///< Request path, which acts as the key
+    char *fullpath; ///< Full path of the target in the file system
+    PATH_TARGET type; ///< Kind of target
+    int is_directory; ///< 1 if the request path is a directory
+    int data; ///< Value chosen by the user of the cache
+    struct stat st; ///< Metadata of the target
+    long expires; ///< Time (in milliseconds of the monotonic clock) at which the entry stops being valid
+    struct UT_hash_handle hh; ///< Handle to be used by @a uthash
+};
+
+/**
+ * @struct pathcache
+ * @brief Stores the cache entries together with its configuration
+ */
+struct pathcache {
+    struct pathcache_entry *entries; ///< Hash table containing the entries
+    int max_entries; ///< Maximum number of entries in the table
+    int ttl; ///< Validity time of found targets in milliseconds
+    int neg_ttl; ///< Validity time of not found targets in milliseconds
+    pthread_rwlock_t lock; ///< Lock protecting the hash table
+};
+
+/**
+ * @brief Returns the current time of a monotonic clock in milliseconds
+ * @details The coarse clock is used, as its precision is more than enough for the expiration times and reading it is
+ * much cheaper.
+ * @return Current time in milliseconds
+ */
+long pathcache_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Frees the memory associated with a cache entry
+ * @param[in] entry The entry to free
+ */
+void pathcache_entry_free(struct pathcache_entry *entry) {
+    free(entry->path);
+    free(entry->fullpath);
+    free(entry);
+}
+
+pathcache *pathcache_create(int max_entries, int ttl, int neg_ttl) {
+    if (max_entries <= 0) return NULL;
+
+    pathcache *new = calloc(1, sizeof(pathcache));
+    if (!new) return NULL;
+
+    new->entries = NULL;
+    new->max_entries = max_entries;
+    new->ttl = ttl;
+    new->neg_ttl = neg_ttl;
+
+    if (pthread_rwlock_init(&new->lock, NULL) != 0) {
+        free(new);
+        return NULL;
+    }
+
+    return new;
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "hicpp-signed-bitwise"
+#pragma ide diagnostic ignored "hicpp-multiway-paths-covered"
+
+void pathcache_free(pathcache *cache) {
+    if (!cache) return;
+
+    struct pathcache_entry *entry, *tmp;
+    HASH_ITER(hh, cache->entries, entry, tmp) {
+        HASH_DEL(cache->entries, entry);
+        pathcache_entry_free(entry);
+    }
+
+    pthread_rwlock_destroy(&cache->lock);
+    free(cache);
+}
+
+STATUS pathcache_get(pathcache *cache, const char *path, struct path_target *target) {
+    if (!cache || !path || !target) return ERROR;
+
+    STATUS ret = ERROR;
+    struct pathcache_entry *entry = NULL;
+
+    pthread_rwlock_rdlock(&cache->lock); // Lookups can happen in parallel
+    HASH_FIND_STR(cache->entries, path, entry);
+    if (entry && entry->expires > pathcache_now()) { // Expired entries are treated as missing
+        target->type = entry->type;
+        target->is_directory = entry->is_directory;
+        target->data = entry->data;
+        target->st = entry->st;
+        strncpy(target->fullpath, entry->fullpath, sizeof(target->fullpath) - 1);
+        target->fullpath[sizeof(target->fullpath) - 1] = '\0';
+        ret = SUCCESS;
+    }
+    pthread_rwlock_unlock(&cache->lock);
+
+    return ret;
+}
+
+STATUS pathcache_put(pathcache *cache, const char *path, const struct path_target *target) {
+    if (!cache || !path || !target) return ERROR;
+
+    struct pathcache_entry *new = calloc(1, sizeof(struct pathcache_entry));
+    if (!new) return ERROR;
+
+    new->path = strdup(path);
+    new->fullpath = strdup(target->fullpath);
+    if (!new->path || !new->fullpath) {
+        pathcache_entry_free(new);
+        return ERROR;
+    }
+    new->type = target->type;
+    new->is_directory = target->is_directory;
+    new->data = target->data;
+    new->st = target->st;
+    new->expires = pathcache_now() + (target->type == TARGET_NOT_FOUND ? cache->neg_ttl : cache->ttl);
+
+    pthread_rwlock_wrlock(&cache->lock);
+
+    struct pathcache_entry *old = NULL;
+    HASH_FIND_STR(cache->entries, path, old);
+    if (old) { // The previous entry is removed, so that the new one is placed at the end of the insertion order
+        HASH_DEL(cache->entries, old);
+        pathcache_entry_free(old);
+    } else if (HASH_COUNT(cache->entries) >= (unsigned int) cache->max_entries) {
+        old = cache->entries; // The first element of the table is always the oldest one
+        HASH_DEL(cache->entries, old);
+        pathcache_entry_free(old);
+    }
+
+    HASH_ADD_KEYPTR(hh, cache->entries, new->path, strlen(new->path), new);
+
+    pthread_rwlock_unlock(&cache->lock);
+
+    return SUCCESS;
+}
+
+#pragma clang diagnostic pop
+
+int pathcache_count(pathcache *cache) {
+    if (!cache) return -1;
+
+    pthread_rwlock_rdlock(&cache->lock);
+    int count = (int) HASH_COUNT(cache->entries);
+    pthread_rwlock_unlock(&cache->lock);
+
+    return count;
+}
\ No newline at end of file
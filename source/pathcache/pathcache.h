@@ -0,0 +1,87 @@
+/**
+ * @file pathcache.h
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Thread safe cache of the targets that request paths resolve to
+ * @details Resolving a request path involves building the full path inside the webroot, checking whether it's a
+ * directory, appending the index file and obtaining its metadata. This module caches the final result of that
+ * process, so that repeated requests for the same path (including the ones for paths that don't exist) resolve with
+ * a single hash table lookup. Entries expire after a configurable time, which is different for found and not found
+ * targets, and the cache never holds more than a fixed number of entries.
+ */
+
+#ifndef PRACTICA1_PATHCACHE_H
+#define PRACTICA1_PATHCACHE_H
+
+#include <limits.h>
+#include <sys/stat.h>
+#include "constants.h"
+
+/**
+ * @brief Kinds of targets a request path can resolve to
+ */
+typedef enum _PATH_TARGET {
+    TARGET_FILE, ///< A regular file that can be sent as is
+    TARGET_INDEX, ///< The index file of a directory
+    TARGET_EXECUTABLE, ///< A script that must be executed to produce the response
+    TARGET_NOT_FOUND ///< Nothing that can be served
+} PATH_TARGET;
+
+/**
+ * @struct path_target
+ * @brief Stores the result of resolving a request path
+ */
+struct path_target {
+    PATH_TARGET type; ///< Kind of target the path resolves to
+    int is_directory; ///< 1 if the request path itself is a directory, 0 otherwise
+    int data; ///< Value chosen by the user of the cache, such as the type of executable
+    struct stat st; ///< Metadata of the target (only meaningful if the target was found)
+    char fullpath[PATH_MAX]; ///< Full path of the target in the file system
+};
+
+/**
+ * @brief The path cache type
+ */
+typedef struct pathcache pathcache;
+
+/**
+ * @brief Creates a new path cache
+ * @param[in] max_entries Maximum number of entries the cache can hold. When it's full, the oldest entry is evicted.
+ * @param[in] ttl Time in milliseconds during which a found target stays valid
+ * @param[in] neg_ttl Time in milliseconds during which a not found target stays valid
+ * @return The newly created cache, or NULL if an error occurs
+ */
+pathcache *pathcache_create(int max_entries, int ttl, int neg_ttl);
+
+/**
+ * @brief Frees all the memory associated with a path cache
+ * @param[in] cache The cache to free
+ */
+void pathcache_free(pathcache *cache);
+
+/**
+ * @brief Looks up the target a request path resolves to
+ * @param[in] cache The cache to search
+ * @param[in] path The request path
+ * @param[out] target Structure where a copy of the cached target must be stored
+ * @return \ref STATUS.SUCCESS if a valid entry was found, \ref STATUS.ERROR if there's no entry or it has expired
+ */
+STATUS pathcache_get(pathcache *cache, const char *path, struct path_target *target);
+
+/**
+ * @brief Stores the target a request path resolves to, replacing any previous entry for that path
+ * @param[in,out] cache The cache where the target must be stored
+ * @param[in] path The request path
+ * @param[in] target The target the path resolves to
+ * @return \ref STATUS.SUCCESS if the target was stored, \ref STATUS.ERROR otherwise
+ */
+STATUS pathcache_put(pathcache *cache, const char *path, const struct path_target *target);
+
+/**
+ * @brief Returns the number of entries currently stored in the cache (including expired ones)
+ * @param[in] cache The cache to check
+ * @return Number of entries, or -1 if the cache is NULL
+ */
+int pathcache_count(pathcache *cache);
+
+#endif //PRACTICA1_PATHCACHE_H
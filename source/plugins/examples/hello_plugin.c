@@ -0,0 +1,43 @@
+/**
+ * @file hello_plugin.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Example plugin, which greets the client and says how many requests it has answered
+ * @details It can be bound to a path with a line such as `/hello	plugin	build/lib/hello_plugin.so` in the handlers
+ * file. A request with a `name` parameter in its querystring is greeted by that name.
+ */
+
+#include "httpplugin.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#define MAX_NAME 64 ///< Maximum length of the name of the client
+
+const int http_plugin_abi = HTTP_PLUGIN_ABI_VERSION; ///< Version of the interface the plugin was built with
+
+atomic_ulong requests; ///< Number of requests answered, shared by every thread
+
+int http_plugin_init(void) {
+    atomic_init(&requests, 0);
+    return 0;
+}
+
+int http_plugin_handle(const struct http_plugin_request *request, struct http_plugin_response *response) {
+    char name[MAX_NAME] = "world";
+
+    // Only alphanumeric names are used, so that they can be written to the body as they are
+    const char *param = request->querystring ? strstr(request->querystring, "name=") : NULL;
+    if (param && (param == request->querystring || param[-1] == '&')) {
+        size_t len = strspn(param + 5, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789");
+        if (len > 0 && len < sizeof(name)) snprintf(name, sizeof(name), "%.*s", (int) len, param + 5);
+    }
+
+    char body[128];
+    int len = snprintf(body, sizeof(body), "Hello, %s! This is request %lu\n", name, atomic_fetch_add(&requests, 1) + 1);
+
+    if (response->header(response, "Content-Type", "text/plain") != 0) return -1;
+    if (response->header(response, "Cache-Control", "no-store") != 0) return -1;
+    return response->write(response, body, (size_t) len);
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+/**
+ * @file httpplugin.h
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Interface between the server and the native plugins that produce dynamic responses
+ * @details A plugin is a shared object that the server loads with dlopen() at startup, and whose handler runs in the
+ * threads of the server, without starting any process. It must export:
+ * - \ref HTTP_PLUGIN_ABI_SYMBOL, an int holding the \ref HTTP_PLUGIN_ABI_VERSION it was built with
+ * - \ref HTTP_PLUGIN_HANDLER_SYMBOL, an \ref http_plugin_handler
+ * - optionally, \ref HTTP_PLUGIN_INIT_SYMBOL, an \ref http_plugin_initializer called once after loading it
+ *
+ * This is the only header plugins need: they don't link against the server, and everything they can do is reached
+ * through the structures below. The handler is called by several threads at once, so it must be thread safe, and it
+ * must not keep any pointer of the request or the response after returning.
+ */
+
+#ifndef PRACTICA1_HTTPPLUGIN_H
+#define PRACTICA1_HTTPPLUGIN_H
+
+#include <stddef.h>
+
+#define HTTP_PLUGIN_ABI_VERSION 1 ///< Version of this interface, increased whenever it changes incompatibly
+#define HTTP_PLUGIN_ABI_SYMBOL "http_plugin_abi" ///< Name of the exported ABI version
+#define HTTP_PLUGIN_HANDLER_SYMBOL "http_plugin_handle" ///< Name of the exported handler
+#define HTTP_PLUGIN_INIT_SYMBOL "http_plugin_init" ///< Name of the exported initialization function
+
+/**
+ * @struct http_plugin_header
+ * @brief A request header, whose strings aren't null terminated
+ */
+struct http_plugin_header {
+    const char *name; ///< Name of the header
+    size_t name_len; ///< Length of the name
+    const char *value; ///< Value of the header
+    size_t value_len; ///< Length of the value
+};
+
+/**
+ * @struct http_plugin_request
+ * @brief Read only view of a request, valid until the handler returns
+ */
+struct http_plugin_request {
+    const char *method; ///< Method of the request
+    const char *path; ///< Path of the request, without the querystring
+    const char *querystring; ///< Querystring of the request, or NULL
+    const char *body; ///< Body of the request, or NULL
+    size_t body_len; ///< Length of the body
+    const struct http_plugin_header *headers; ///< Headers of the request
+    size_t num_headers; ///< Number of headers
+};
+
+/**
+ * @struct http_plugin_response
+ * @brief Writer of the response, whose functions return 0 on success and -1 on error
+ * @details The response is sent once the handler returns, with the code and headers set through this writer (200 and
+ * text/html if none are set), and a Content-Length computed from what was written.
+ */
+struct http_plugin_response {
+    /**
+     * @brief Sets the code and message of the response
+     */
+    int (*status)(struct http_plugin_response *response, int code, const char *message);
+
+    /**
+     * @brief Adds a header to the response (Content-Length, Date and Server are set by the server)
+     */
+    int (*header)(struct http_plugin_response *response, const char *name, const char *value);
+
+    /**
+     * @brief Appends data to the body of the response
+     */
+    int (*write)(struct http_plugin_response *response, const void *data, size_t len);
+
+    void *server_data; ///< Used by the server, plugins must not touch it
+};
+
+/**
+ * @brief Handler of a plugin, which produces the response for a request
+ * @return 0 if the response was produced, -1 if the server must answer with an internal error instead
+ */
+typedef int (*http_plugin_handler)(const struct http_plugin_request *request, struct http_plugin_response *response);
+
+/**
+ * @brief Initialization function of a plugin, called once before its handler is used
+ * @return 0 if the plugin is ready, -1 if it can't be used
+ */
+typedef int (*http_plugin_initializer)(void);
+
+#endif //PRACTICA1_HTTPPLUGIN_H
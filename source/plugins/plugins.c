@@ -0,0 +1,210 @@
+/**
+ * @file plugins.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Implementation of the plugin loader
+ * @details The view of the request points to the buffers of the parsed request, so nothing is copied before calling a
+ * handler. Its headers are the headers parsed by picohttpparser, whose layout is the same as the one of
+ * \ref http_plugin_header.
+ */
+
+#include "plugins.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stddef.h>
+#include <dlfcn.h>
+
+// The request headers are passed to plugins without copying them
+_Static_assert(sizeof(struct http_plugin_header) == sizeof(struct phr_header) &&
+               offsetof(struct http_plugin_header, name_len) == offsetof(struct phr_header, name_len) &&
+               offsetof(struct http_plugin_header, value) == offsetof(struct phr_header, value) &&
+               offsetof(struct http_plugin_header, value_len) == offsetof(struct phr_header, value_len),
+               "http_plugin_header must have the layout of phr_header");
+
+/**
+ * @brief Headers of the response that only the server can set
+ */
+const char *plugin_reserved_headers[] = {HDR_CONTENT_LENGTH, HDR_DATE, HDR_SERVER_ORIGIN, HDR_TRANSFER_ENCODING,
+                                         "Connection"};
+
+/**
+ * @struct plugin
+ * @brief Stores a loaded plugin
+ */
+struct plugin {
+    void *object; ///< Handle of the shared object
+    http_plugin_handler handler; ///< Handler of the plugin
+};
+
+/**
+ * @struct plugin_response_data
+ * @brief State of a response while a plugin writes it
+ */
+struct plugin_response_data {
+    struct httpres_headers *headers; ///< Headers of the response
+    int code; ///< Code of the response
+    char message[PLUGIN_STATUS_MESSAGE]; ///< Message of the response code
+    int has_type; ///< 1 if the plugin set the Content-Type header, 0 otherwise
+    char *body; ///< Body written so far
+    size_t body_len; ///< Length of the body
+    size_t body_cap; ///< Allocated size of the body
+};
+
+plugin *plugin_load(const char *path) {
+    if (!path) return NULL;
+
+    void *object = dlopen(path, RTLD_NOW | RTLD_LOCAL); // Missing symbols must be found now, not while serving
+    if (!object) {
+        printf("Error while loading the plugin: %s\n", dlerror());
+        return NULL;
+    }
+
+    const int *abi = dlsym(object, HTTP_PLUGIN_ABI_SYMBOL);
+    http_plugin_handler handler;
+    *(void **) &handler = dlsym(object, HTTP_PLUGIN_HANDLER_SYMBOL); // Function pointers can't be cast from void *
+    http_plugin_initializer init;
+    *(void **) &init = dlsym(object, HTTP_PLUGIN_INIT_SYMBOL);
+
+    if (!abi || *abi != HTTP_PLUGIN_ABI_VERSION || !handler) {
+        printf("The plugin %s wasn't built for version %i of the plugin interface\n", path, HTTP_PLUGIN_ABI_VERSION);
+        dlclose(object);
+        return NULL;
+    }
+
+    if (init && init() != 0) {
+        printf("The plugin %s failed to initialize\n", path);
+        dlclose(object);
+        return NULL;
+    }
+
+    plugin *plugin = calloc(1, sizeof(struct plugin));
+    if (!plugin) {
+        dlclose(object);
+        return NULL;
+    }
+    plugin->object = object;
+    plugin->handler = handler;
+
+    return plugin;
+}
+
+void plugin_free(plugin *plugin) {
+    if (!plugin) return;
+
+    dlclose(plugin->object);
+    free(plugin);
+}
+
+/**
+ * @brief Checks whether a header name or value can be sent without altering the rest of the response
+ * @param[in] str The string
+ * @param[in] is_name 1 if it's a header name, 0 if it's a value
+ * @return 1 if it's valid, 0 otherwise
+ */
+int plugin_valid_header(const char *str, int is_name) {
+    if (is_name && str[0] == '\0') return 0;
+
+    for (const char *c = str; *c; c++) {
+        if (*c == '\r' || *c == '\n' || (is_name && (*c == ':' || *c == ' '))) return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Implementation of \ref http_plugin_response.status
+ */
+int plugin_response_status(struct http_plugin_response *response, int code, const char *message) {
+    struct plugin_response_data *data = response->server_data;
+    if (code < 100 || code > 999 || !message || !plugin_valid_header(message, 0)) return -1;
+
+    data->code = code;
+    snprintf(data->message, sizeof(data->message), "%s", message);
+
+    return 0;
+}
+
+/**
+ * @brief Implementation of \ref http_plugin_response.header
+ */
+int plugin_response_header(struct http_plugin_response *response, const char *name, const char *value) {
+    struct plugin_response_data *data = response->server_data;
+    if (!name || !value || !plugin_valid_header(name, 1) || !plugin_valid_header(value, 0)) return -1;
+
+    for (size_t i = 0; i < sizeof(plugin_reserved_headers) / sizeof(plugin_reserved_headers[0]); i++) {
+        if (strcasecmp(name, plugin_reserved_headers[i]) == 0) return -1;
+    }
+
+    if (set_header(data->headers, name, value) == ERROR) return -1;
+    if (strcasecmp(name, HDR_CONTENT_TYPE) == 0) data->has_type = 1;
+
+    return 0;
+}
+
+/**
+ * @brief Implementation of \ref http_plugin_response.write
+ */
+int plugin_response_write(struct http_plugin_response *response, const void *data, size_t len) {
+    struct plugin_response_data *res = response->server_data;
+    if (!data && len > 0) return -1;
+    if (len > PLUGIN_MAX_BODY - res->body_len) return -1;
+
+    if (res->body_len + len > res->body_cap) { // Grow the body geometrically
+        size_t cap = res->body_cap ? res->body_cap : 4096;
+        while (cap < res->body_len + len) cap *= 2;
+
+        char *body = realloc(res->body, cap);
+        if (!body) return -1;
+        res->body = body;
+        res->body_cap = cap;
+    }
+
+    memcpy(res->body + res->body_len, data, len);
+    res->body_len += len;
+
+    return 0;
+}
+
+HTTP_RESPONSE_CODE plugin_run(plugin *plugin, int socket, struct httpres_headers *headers,
+                              const struct request *request) {
+    if (!plugin) return respond(socket, INTERNAL_ERROR, "Internal error", headers, NULL, 0);
+
+    struct http_plugin_request view = {
+            .method = request->method,
+            .path = request->path,
+            .querystring = request->querystring,
+            .body = request->body,
+            .body_len = request->body ? request->body_len : 0,
+            .headers = (const struct http_plugin_header *) request->headers,
+            .num_headers = request->num_headers
+    };
+
+    struct plugin_response_data data = {.headers = headers, .code = OK, .message = "OK"};
+    struct http_plugin_response response = {
+            .status = plugin_response_status,
+            .header = plugin_response_header,
+            .write = plugin_response_write,
+            .server_data = &data
+    };
+
+    if (plugin->handler(&view, &response) != 0) {
+        free(data.body);
+        return respond(socket, INTERNAL_ERROR, "Internal error", headers, NULL, 0);
+    }
+
+    int has_body = data.code >= 200 && data.code != NO_CONTENT && data.code != NOT_MODIFIED;
+    if (has_body) {
+        if (!data.has_type) set_header(headers, HDR_CONTENT_TYPE, "text/html");
+        add_content_length((off_t) data.body_len, headers);
+    }
+
+    // A HEAD request receives the same headers, including the length of the body it doesn't receive
+    int ret = respond(socket, (HTTP_RESPONSE_CODE) data.code, data.message, headers,
+                      has_body && !request->headers_only ? data.body : NULL, data.body_len);
+    free(data.body);
+
+    return ret;
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+/**
+ * @file plugins.h
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Loads native plugins and answers requests with them
+ * @details Plugins are shared objects implementing the interface in httpplugin.h. Their handlers run directly in the
+ * thread that processes the request, and the response they write is sent in one go, with its length.
+ * @see httpplugin.h
+ */
+
+#ifndef PRACTICA1_PLUGINS_H
+#define PRACTICA1_PLUGINS_H
+
+#include "httputils.h"
+#include "httpplugin.h"
+#include "constants.h"
+
+#define PLUGIN_MAX_BODY (16 * 1024 * 1024) ///< Maximum length of the body of a response written by a plugin
+#define PLUGIN_STATUS_MESSAGE 64 ///< Maximum length of the message of a response code set by a plugin
+
+/**
+ * @brief A loaded plugin
+ */
+typedef struct plugin plugin;
+
+/**
+ * @brief Loads a plugin and initializes it
+ * @param[in] path Path of the shared object
+ * @return The plugin, or NULL if it can't be loaded, was built for another version of the interface or fails to
+ * initialize
+ */
+plugin *plugin_load(const char *path);
+
+/**
+ * @brief Unloads a plugin
+ * @pre Its handler can't be running
+ * @param[in] plugin The plugin
+ */
+void plugin_free(plugin *plugin);
+
+/**
+ * @brief Answers a request with a plugin
+ * @param[in] plugin The plugin
+ * @param[out] socket The socket to which the response must be sent
+ * @param[in] headers Structure containing the headers for the response
+ * @param[in] request The request
+ * @return code of the HTTP response sent to the socket
+ */
+HTTP_RESPONSE_CODE plugin_run(plugin *plugin, int socket, struct httpres_headers *headers,
+                              const struct request *request);
+
+#endif //PRACTICA1_PLUGINS_H
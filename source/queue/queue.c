@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <semaphore.h>
 #include <pthread.h>
+#include <time.h>
 
 /**
  * @struct queue
@@ -32,6 +33,7 @@ struct queue {
 struct queue_item {
     struct queue_item *next; ///< Pointer to the next item in the queue, or NULL if it's the last
     int value; ///< Value of the item
+    struct timespec added; ///< Moment (CLOCK_MONOTONIC) when the item was added
 };
 
 queue *queue_create(int max) {
@@ -85,13 +87,24 @@ int queue_isempty(queue *queue) {
 }
 
 int queue_pop(queue *queue) {
+    return queue_pop_waited(queue, NULL);
+}
+
+int queue_pop_waited(queue *queue, long *wait_us) {
     int ret;
+    if (wait_us) *wait_us = 0;
+
     sem_wait(queue->available_items); // Wait until there's an item available in the queue
     pthread_mutex_lock(queue->mutex); // Lock the mutex to protect the critical section
     if (queue->size > 0) {
 
         struct queue_item *first = queue->first;
         int val = first->value;
+        if (wait_us) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            *wait_us = (now.tv_sec - first->added.tv_sec) * 1000000L + (now.tv_nsec - first->added.tv_nsec) / 1000;
+        }
 
         queue->first = first->next;
         free(first);
@@ -115,6 +128,7 @@ void queue_add(queue *queue, int item) {
     if (queue->size < queue->max) {
         struct queue_item *new = calloc(1, sizeof(struct queue_item));
         new->value = item;
+        clock_gettime(CLOCK_MONOTONIC, &new->added);
 
         if (queue->size == 0) {
             queue->first = new;
@@ -42,6 +42,15 @@ int queue_isempty(queue *queue);
  */
 int queue_pop(queue *queue);
 
+/**
+ * @brief Extracts the first item from the queue, and tells how long it waited in it
+ * @details If there are no available items in the queue, this function blocks execution until a new item is added.
+ * @param[in,out] queue The queue to extract from
+ * @param[out] wait_us Microseconds the item spent in the queue (can be NULL)
+ * @return The value of the extracted item
+ */
+int queue_pop_waited(queue *queue, long *wait_us);
+
 /**
  * @brief Adds a new item to the queue
  * @details If the queue is full, this function blocks execution until a new slot is available.
@@ -173,7 +173,7 @@ STATUS config_add_parameter(const struct config_param **configuration, char *nam
 #pragma clang diagnostic pop
 
 STATUS config_addparam_int(const struct config_param **configuration, char *name, int value) {
-    if (!name || !value) return ERROR;
+    if (!name) return ERROR;
     union param_value val;
     val.integer = value;
 
@@ -256,7 +256,7 @@ int config_getparam_str(const struct config_param **configuration, enum USER_PAR
 int parseConfig(char *filename, const struct config_param **configuration) {
     if (!filename) return -1;
 
-    FILE *configFile = fopen(filename, "r"); // Open the configuration file
+    FILE *configFile = fopen(filename, "re"); // Open the configuration file
     if (!configFile) { // If the file couldn't be opened
         printf("Error while opening the configuration file at %s: %s\n", filename, strerror(errno));
         return -1;
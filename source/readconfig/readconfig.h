@@ -49,7 +49,36 @@ enum USER_PARAMS {
     PARAMS_WEBROOT,
     PARAMS_NTHREADS,
     PARAMS_QUEUE_SIZE,
-    PARAMS_MIME_FILE
+    PARAMS_MIME_FILE,
+    PARAMS_PATH_CACHE_SIZE,
+    PARAMS_PATH_CACHE_TTL,
+    PARAMS_PATH_CACHE_NEG_TTL,
+    PARAMS_CACHE_POLICY_FILE,
+    PARAMS_STREAM_RATE_LIMIT,
+    PARAMS_IO_THREADS,
+    PARAMS_POOL_MIN_WORKERS,
+    PARAMS_POOL_MAX_WORKERS,
+    PARAMS_POOL_MAX_REQUESTS,
+    PARAMS_FASTCGI_PHP,
+    PARAMS_CGI_CACHE_SIZE,
+    PARAMS_CGI_CACHE_TTL,
+    PARAMS_CGI_CACHE_STALE,
+    PARAMS_CGI_CACHE_VARY,
+    PARAMS_HANDLERS_FILE,
+    PARAMS_DYNAMIC_THREADS,
+    PARAMS_DYNAMIC_QUEUE,
+    PARAMS_ADMIN_PREFIX,
+    PARAMS_ADMIN_THREADS,
+    PARAMS_ADMIN_QUEUE,
+    PARAMS_LOG_BUFFER,
+    PARAMS_ACCESS_LOG,
+    PARAMS_ACCESS_LOG_SEGMENT,
+    PARAMS_ACCESS_LOG_SEGMENTS,
+    PARAMS_METRICS_PATH,
+    PARAMS_LATENCY_SUMMARY,
+    PARAMS_SERVER_TIMING,
+    PARAMS_SLOW_REQUEST_MS,
+    PARAMS_LIVE_STATS
 };
 
 /**
@@ -65,7 +94,36 @@ static const struct supported_param USERPARAMS_META[] = {
         {"WEBROOT",    PARTYPE_STRING},
         {"NTHREADS",   PARTYPE_INTEGER},
         {"QUEUE_SIZE", PARTYPE_INTEGER},
-        {"MIME_FILE",  PARTYPE_STRING}
+        {"MIME_FILE",  PARTYPE_STRING},
+        {"PATH_CACHE_SIZE", PARTYPE_INTEGER},
+        {"PATH_CACHE_TTL", PARTYPE_INTEGER},
+        {"PATH_CACHE_NEG_TTL", PARTYPE_INTEGER},
+        {"CACHE_POLICY_FILE", PARTYPE_STRING},
+        {"STREAM_RATE_LIMIT", PARTYPE_INTEGER},
+        {"IO_THREADS", PARTYPE_INTEGER},
+        {"POOL_MIN_WORKERS", PARTYPE_INTEGER},
+        {"POOL_MAX_WORKERS", PARTYPE_INTEGER},
+        {"POOL_MAX_REQUESTS", PARTYPE_INTEGER},
+        {"FASTCGI_PHP", PARTYPE_STRING},
+        {"CGI_CACHE_SIZE", PARTYPE_INTEGER},
+        {"CGI_CACHE_TTL", PARTYPE_INTEGER},
+        {"CGI_CACHE_STALE", PARTYPE_INTEGER},
+        {"CGI_CACHE_VARY", PARTYPE_STRING},
+        {"HANDLERS_FILE", PARTYPE_STRING},
+        {"DYNAMIC_THREADS", PARTYPE_INTEGER},
+        {"DYNAMIC_QUEUE", PARTYPE_INTEGER},
+        {"ADMIN_PREFIX", PARTYPE_STRING},
+        {"ADMIN_THREADS", PARTYPE_INTEGER},
+        {"ADMIN_QUEUE", PARTYPE_INTEGER},
+        {"LOG_BUFFER", PARTYPE_INTEGER},
+        {"ACCESS_LOG", PARTYPE_STRING},
+        {"ACCESS_LOG_SEGMENT", PARTYPE_INTEGER},
+        {"ACCESS_LOG_SEGMENTS", PARTYPE_INTEGER},
+        {"METRICS_PATH", PARTYPE_STRING},
+        {"LATENCY_SUMMARY", PARTYPE_INTEGER},
+        {"SERVER_TIMING", PARTYPE_INTEGER},
+        {"SLOW_REQUEST_MS", PARTYPE_INTEGER},
+        {"LIVE_STATS", PARTYPE_STRING}
 };
 
 #define USERPARAMS_NUM (sizeof(USERPARAMS_META) / sizeof(USERPARAMS_META[0])) ///< Number of supported parameters
@@ -0,0 +1,491 @@
+/**
+ * @file respcache.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Implementation of the cache of script responses
+ * @details The cache is a hash table using the uthash library, protected by a mutex. Entries are reference counted:
+ * an entry removed from the table (because it was evicted or replaced by a fresher one) is only freed once every
+ * request sending it has released it, so the responses never need to be copied out of the cache.
+ *
+ * An entry is created as soon as a request misses, before its response exists, so that identical requests find it and
+ * wait on a condition variable until the leader completes it. If the response turns out not to be cacheable, the entry
+ * is kept for the configured time as a marker, so that the following requests run the script right away instead of
+ * queueing behind each other.
+ * @see https://troydhanson.github.io/uthash/
+ */
+
+#define _GNU_SOURCE // Required for strcasestr()
+
+#include "uthash.h"
+#include "respcache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+/**
+ * @brief States of a cache entry
+ */
+typedef enum _ENTRY_STATE {
+    ENTRY_PENDING, ///< The leader is producing the response
+    ENTRY_READY, ///< The response is stored in the entry
+    ENTRY_UNCACHEABLE ///< The response couldn't be stored, so requests must produce it by themselves
+} ENTRY_STATE;
+
+/**
+ * @struct respcache_entry
+ * @brief Entry of the cache, associating a key with a response
+ */
+struct respcache_entry {
+    char *key; ///< Key of the entry (the script, the querystring and the chosen headers, separated by null characters)
+    size_t key_len; ///< Length of the key
+    ENTRY_STATE state; ///< State of the entry
+    int refreshing; ///< 1 if a request is refreshing the stale response
+    int refs; ///< Number of requests using the entry
+    int in_table; ///< 1 while the entry is in the hash table
+    HTTP_RESPONSE_CODE code; ///< Code of the response
+    char message[CGI_CAPTURE_MESSAGE]; ///< Message of the status line
+    char *head; ///< Headers of the response, each one ended by a CRLF
+    char *body; ///< Body of the response
+    size_t body_len; ///< Length of the body
+    long stored; ///< Time (in milliseconds of the monotonic clock) at which the response was stored
+    long expires; ///< Time at which the response stops being valid
+    long stale_until; ///< Time until which the response can still be sent while it's refreshed
+    struct UT_hash_handle hh; ///< Handle to be used by @a uthash
+};
+
+/**
+ * @struct respcache
+ * @brief Stores the cache entries together with its configuration
+ */
+struct respcache {
+    struct respcache_entry *entries; ///< Hash table containing the entries
+    int max_entries; ///< Maximum number of entries in the table
+    long ttl; ///< Validity time of responses without their own max-age, in milliseconds
+    long stale; ///< Time during which expired responses can still be sent, in milliseconds
+    char *vary[RESPCACHE_MAX_VARY]; ///< Request headers that are part of the key
+    int n_vary; ///< Number of request headers that are part of the key
+    size_t max_body; ///< Maximum length of a cached body
+    pthread_mutex_t mutex; ///< Mutex protecting the hash table and the entries
+    pthread_cond_t completed; ///< Signaled every time a leader completes an entry
+};
+
+/**
+ * @brief Returns the current time of a monotonic clock in milliseconds
+ * @return Current time in milliseconds
+ */
+long respcache_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Frees the memory associated with a cache entry
+ * @param[in] entry The entry to free
+ */
+void respcache_entry_free(struct respcache_entry *entry) {
+    free(entry->key);
+    free(entry->head);
+    free(entry->body);
+    free(entry);
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "hicpp-signed-bitwise"
+#pragma ide diagnostic ignored "hicpp-multiway-paths-covered"
+
+/**
+ * @brief Removes an entry from the hash table, freeing it if no request is using it
+ * @pre The mutex of the cache must be locked
+ * @param[in,out] cache The cache
+ * @param[in] entry The entry to remove
+ */
+void respcache_remove(respcache *cache, struct respcache_entry *entry) {
+    HASH_DEL(cache->entries, entry);
+    entry->in_table = 0;
+    if (entry->refs == 0) respcache_entry_free(entry);
+}
+
+/**
+ * @brief Adds an entry to the hash table, evicting the oldest one that isn't being produced if the table is full
+ * @pre The mutex of the cache must be locked
+ * @param[in,out] cache The cache
+ * @param[in] entry The entry to add
+ * @return \ref STATUS.SUCCESS if it was added, \ref STATUS.ERROR if every entry in the table is being produced
+ */
+STATUS respcache_add(respcache *cache, struct respcache_entry *entry) {
+    if (HASH_COUNT(cache->entries) >= (unsigned int) cache->max_entries) {
+        struct respcache_entry *old, *tmp, *victim = NULL;
+        HASH_ITER(hh, cache->entries, old, tmp) { // uthash keeps the insertion order, so the oldest ones come first
+            if (old->state != ENTRY_PENDING) {
+                victim = old;
+                break;
+            }
+        }
+        if (!victim) return ERROR;
+        respcache_remove(cache, victim);
+    }
+
+    HASH_ADD_KEYPTR(hh, cache->entries, entry->key, entry->key_len, entry);
+    entry->in_table = 1;
+    return SUCCESS;
+}
+
+respcache *respcache_create(int max_entries, int ttl, int stale, const char *vary, size_t max_body) {
+    if (max_entries <= 0) return NULL;
+
+    respcache *new = calloc(1, sizeof(respcache));
+    if (!new) return NULL;
+
+    new->entries = NULL;
+    new->max_entries = max_entries;
+    new->ttl = ttl * 1000L;
+    new->stale = stale * 1000L;
+    new->max_body = max_body;
+
+    if (vary) { // "Accept-Language,Cookie"
+        char *list = strdup(vary);
+        char *saveptr = NULL;
+        for (char *name = list ? strtok_r(list, ", ", &saveptr) : NULL; name && new->n_vary < RESPCACHE_MAX_VARY;
+             name = strtok_r(NULL, ", ", &saveptr)) {
+            new->vary[new->n_vary++] = strdup(name);
+        }
+        free(list);
+    }
+
+    // Waiting requests measure their timeout with the monotonic clock, so that it isn't affected by clock changes
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int ret = pthread_cond_init(&new->completed, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (ret != 0 || pthread_mutex_init(&new->mutex, NULL) != 0) {
+        if (ret == 0) pthread_cond_destroy(&new->completed);
+        for (int i = 0; i < new->n_vary; i++) free(new->vary[i]);
+        free(new);
+        return NULL;
+    }
+
+    return new;
+}
+
+void respcache_free(respcache *cache) {
+    if (!cache) return;
+
+    struct respcache_entry *entry, *tmp;
+    HASH_ITER(hh, cache->entries, entry, tmp) {
+        HASH_DEL(cache->entries, entry);
+        respcache_entry_free(entry);
+    }
+
+    for (int i = 0; i < cache->n_vary; i++) free(cache->vary[i]);
+    pthread_mutex_destroy(&cache->mutex);
+    pthread_cond_destroy(&cache->completed);
+    free(cache);
+}
+
+/**
+ * @brief Builds the key of a request, made of the script, the querystring and the values of the chosen headers
+ * @param[in] cache The cache
+ * @param[in] request The request
+ * @param[in] fullpath Full path of the script
+ * @param[out] key Buffer where the key must be written (of size \ref RESPCACHE_MAX_KEY)
+ * @return Length of the key, or 0 if it doesn't fit in the buffer
+ */
+size_t respcache_key(const respcache *cache, const struct request *request, const char *fullpath, char *key) {
+    const char *parts[RESPCACHE_MAX_VARY + 2] = {fullpath, request->querystring ? request->querystring : ""};
+    size_t lens[RESPCACHE_MAX_VARY + 2] = {strlen(parts[0]), strlen(parts[1])};
+    int n_parts = 2;
+
+    for (int i = 0; i < cache->n_vary; i++, n_parts++) {
+        parts[n_parts] = get_request_header(request, cache->vary[i], &lens[n_parts]);
+        if (!parts[n_parts]) { // A missing header is different from an empty one
+            parts[n_parts] = "\n";
+            lens[n_parts] = 1;
+        }
+    }
+
+    size_t len = 0;
+    for (int i = 0; i < n_parts; i++) {
+        if (len + lens[i] + 1 > RESPCACHE_MAX_KEY) return 0;
+        memcpy(key + len, parts[i], lens[i]);
+        len += lens[i];
+        key[len++] = '\0'; // Null characters can't appear in any part, so they separate them unambiguously
+    }
+
+    return len;
+}
+
+/**
+ * @brief Creates a new entry for a key, in the state of being produced by the calling request
+ * @param[in] key The key
+ * @param[in] key_len Length of the key
+ * @return The new entry, or NULL if an error occurs
+ */
+struct respcache_entry *respcache_entry_create(const char *key, size_t key_len) {
+    struct respcache_entry *new = calloc(1, sizeof(struct respcache_entry));
+    if (!new) return NULL;
+
+    if (!(new->key = malloc(key_len))) {
+        free(new);
+        return NULL;
+    }
+    memcpy(new->key, key, key_len);
+    new->key_len = key_len;
+    new->state = ENTRY_PENDING;
+    new->refs = 1;
+
+    return new;
+}
+
+RESPCACHE_RESULT respcache_lookup(respcache *cache, const struct request *request, const char *fullpath, int may_lead,
+                                  respcache_entry **entry) {
+    if (!cache || !request || !fullpath || !entry) return RESPCACHE_BYPASS;
+
+    char key[RESPCACHE_MAX_KEY];
+    size_t key_len = respcache_key(cache, request, fullpath, key);
+    if (key_len == 0) return RESPCACHE_BYPASS;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    struct respcache_entry *found = NULL;
+    HASH_FIND(hh, cache->entries, key, key_len, found);
+
+    if (found && found->state == ENTRY_PENDING) { // Another request is producing it, so wait for it
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += RESPCACHE_MAX_WAIT;
+
+        found->refs++;
+        int ret = 0;
+        while (found->state == ENTRY_PENDING && ret == 0) {
+            ret = pthread_cond_timedwait(&cache->completed, &cache->mutex, &deadline);
+        }
+
+        if (found->state == ENTRY_READY) {
+            *entry = found;
+            pthread_mutex_unlock(&cache->mutex);
+            return RESPCACHE_HIT;
+        }
+
+        // The leader failed, or is taking too long, so the response is produced without the cache
+        if (--found->refs == 0 && !found->in_table) respcache_entry_free(found);
+        pthread_mutex_unlock(&cache->mutex);
+        return RESPCACHE_BYPASS;
+    }
+
+    long now = respcache_now();
+    if (found && now < found->expires) {
+        if (found->state == ENTRY_UNCACHEABLE) {
+            pthread_mutex_unlock(&cache->mutex);
+            return RESPCACHE_BYPASS;
+        }
+
+        found->refs++;
+        *entry = found;
+        pthread_mutex_unlock(&cache->mutex);
+        return RESPCACHE_HIT;
+    }
+
+    if (found && found->state == ENTRY_READY && now < found->stale_until) {
+        found->refs++;
+        *entry = found;
+
+        RESPCACHE_RESULT result = RESPCACHE_HIT; // Only a single request refreshes it, the rest keep sending it
+        if (may_lead && !found->refreshing) {
+            found->refreshing = 1;
+            result = RESPCACHE_REFRESH;
+        }
+        pthread_mutex_unlock(&cache->mutex);
+        return result;
+    }
+
+    if (found) respcache_remove(cache, found); // Too old to be sent at all
+    if (!may_lead) {
+        pthread_mutex_unlock(&cache->mutex);
+        return RESPCACHE_BYPASS;
+    }
+
+    struct respcache_entry *new = respcache_entry_create(key, key_len);
+    if (!new || respcache_add(cache, new) == ERROR) {
+        if (new) respcache_entry_free(new);
+        pthread_mutex_unlock(&cache->mutex);
+        return RESPCACHE_BYPASS;
+    }
+
+    *entry = new;
+    pthread_mutex_unlock(&cache->mutex);
+    return RESPCACHE_LEAD;
+}
+
+/**
+ * @brief Obtains the time during which a captured response can be cached, from its headers or the configuration
+ * @details Responses setting cookies, or whose Cache-Control forbids shared caches from storing them, aren't cached.
+ * Otherwise, s-maxage takes precedence over max-age, which takes precedence over the configured time.
+ * @param[in] cache The cache
+ * @param[in] capture The captured response
+ * @return Validity time in milliseconds, or 0 if the response can't be cached
+ */
+long respcache_ttl(const respcache *cache, const struct cgi_capture *capture) {
+    if (capture->code != OK || capture->overflow || !capture->head) return 0;
+
+    long ttl = cache->ttl;
+    long max_age = -1, s_maxage = -1;
+
+    const char *line = capture->head;
+    const char *end = capture->head + capture->head_len;
+    while (line < end) {
+        const char *eol = strstr(line, "\r\n");
+        if (!eol) break;
+
+        if (strncasecmp(line, "Set-Cookie:", 11) == 0) return 0; // Responses for a single client must not be shared
+        if (strncasecmp(line, "Cache-Control:", 14) == 0) {
+            char value[MAX_HTTPREQ];
+            snprintf(value, sizeof(value), "%.*s", (int) (eol - line - 14), line + 14);
+
+            if (strcasestr(value, "no-store") || strcasestr(value, "private") || strcasestr(value, "no-cache")) {
+                return 0;
+            }
+
+            const char *directive;
+            if ((directive = strcasestr(value, "s-maxage="))) s_maxage = strtol(directive + 9, NULL, 10);
+            // The search for max-age would find it inside s-maxage, so it only counts if it's a different directive
+            for (directive = value; (directive = strcasestr(directive, "max-age=")); directive++) {
+                if (directive == value || directive[-1] != '-') {
+                    max_age = strtol(directive + 8, NULL, 10);
+                    break;
+                }
+            }
+        }
+
+        line = eol + 2;
+    }
+
+    if (s_maxage >= 0) {
+        ttl = s_maxage * 1000;
+    } else if (max_age >= 0) {
+        ttl = max_age * 1000;
+    }
+
+    return ttl > 0 ? ttl : 0;
+}
+
+void respcache_complete(respcache *cache, respcache_entry *entry, struct cgi_capture *capture) {
+    if (!cache || !entry || !capture) return;
+
+    long ttl = respcache_ttl(cache, capture);
+    long now = respcache_now();
+
+    pthread_mutex_lock(&cache->mutex);
+
+    // A refreshed response goes in a new entry, as other requests may still be sending the old one
+    struct respcache_entry *target = entry;
+    if (entry->state == ENTRY_READY) {
+        target = ttl > 0 ? respcache_entry_create(entry->key, entry->key_len) : NULL;
+        entry->refreshing = 0; // If it can't be refreshed, another request tries again later
+        if (target) {
+            target->refs = 0;
+            if (entry->in_table) respcache_remove(cache, entry);
+            if (respcache_add(cache, target) == ERROR) {
+                respcache_entry_free(target);
+                target = NULL;
+            }
+        }
+    }
+
+    if (target && ttl > 0) {
+        target->code = capture->code;
+        memcpy(target->message, capture->message, sizeof(target->message));
+        target->head = capture->head;
+        target->body = capture->body;
+        target->body_len = capture->body_len;
+        capture->head = capture->body = NULL; // The buffers belong to the entry now
+        capture->head_len = capture->body_len = capture->body_cap = 0;
+
+        target->stored = now;
+        target->expires = now + ttl;
+        target->stale_until = target->expires + cache->stale;
+        target->state = ENTRY_READY;
+    } else if (target) { // Produced by a leader, but not cacheable
+        target->expires = now + cache->ttl;
+        target->state = ENTRY_UNCACHEABLE;
+    }
+
+    pthread_cond_broadcast(&cache->completed);
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+#pragma clang diagnostic pop
+
+void respcache_release(respcache *cache, respcache_entry *entry) {
+    if (!cache || !entry) return;
+
+    pthread_mutex_lock(&cache->mutex);
+    if (--entry->refs == 0 && !entry->in_table) respcache_entry_free(entry);
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+RESPCACHE_RESULT respcache_peek(respcache *cache, const struct request *request, const char *fullpath,
+                                int may_refresh, respcache_entry **entry) {
+    if (!cache || !request || !fullpath || !entry) return RESPCACHE_BYPASS;
+
+    char key[RESPCACHE_MAX_KEY];
+    size_t key_len = respcache_key(cache, request, fullpath, key);
+    if (key_len == 0) return RESPCACHE_BYPASS;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    struct respcache_entry *found = NULL;
+    HASH_FIND(hh, cache->entries, key, key_len, found);
+
+    RESPCACHE_RESULT result = RESPCACHE_BYPASS;
+    long now = respcache_now();
+    if (found && found->state == ENTRY_READY && now < found->stale_until) {
+        found->refs++;
+        *entry = found;
+
+        result = RESPCACHE_HIT;
+        if (now >= found->expires && may_refresh && !found->refreshing) { // As in respcache_lookup()
+            found->refreshing = 1;
+            result = RESPCACHE_REFRESH;
+        }
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+    return result;
+}
+
+HTTP_RESPONSE_CODE respcache_send(respcache_entry *entry, int socket, struct httpres_headers *headers,
+                                  const struct request *request) {
+    if (!entry || !headers || !request) return respond(socket, INTERNAL_ERROR, "Internal error", NULL, NULL, 0);
+
+    // The headers are sent straight from the entry, which stays valid until it's released
+    const char *line = entry->head;
+    const char *eol;
+    while (line && (eol = strstr(line, "\r\n"))) {
+        set_header_preformatted(headers, line, eol - line);
+        line = eol + 2;
+    }
+
+    char age[RESPCACHE_AGE_LEN];
+    snprintf(age, sizeof(age), "%li", (respcache_now() - entry->stored) / 1000);
+    set_header(headers, HDR_AGE, age);
+    add_content_length((off_t) entry->body_len, headers);
+
+    return respond(socket, entry->code, entry->message[0] ? entry->message : NULL, headers,
+                   request->headers_only ? NULL : entry->body, entry->body_len);
+}
+
+int respcache_count(respcache *cache) {
+    if (!cache) return -1;
+
+    pthread_mutex_lock(&cache->mutex);
+    int count = (int) HASH_COUNT(cache->entries);
+    pthread_mutex_unlock(&cache->mutex);
+
+    return count;
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+/**
+ * @file respcache.h
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Thread safe cache of the responses produced by scripts
+ * @details Scripts whose output only depends on their path and querystring (and, optionally, on some request headers)
+ * don't need to run again for every request. This module stores their responses, keyed by the full path of the
+ * script, the querystring and the values of the chosen headers, for a time set by the configuration or by the
+ * Cache-Control header of the response itself.
+ *
+ * Identical requests that arrive while a response is being produced don't run the script again: only the first one
+ * (the leader) runs it, and the rest wait for its result. Once a response expires, it can still be served for a while
+ * (stale-while-revalidate), while a single request refreshes it after sending the old copy to its client.
+ */
+
+#ifndef PRACTICA1_RESPCACHE_H
+#define PRACTICA1_RESPCACHE_H
+
+#include "httputils.h"
+#include "cgi.h"
+#include "constants.h"
+
+#define RESPCACHE_MAX_KEY 4096 ///< Maximum length of a key (longer ones aren't cached)
+#define RESPCACHE_MAX_VARY 8 ///< Maximum number of request headers that can be part of the key
+#define RESPCACHE_MAX_WAIT 30 ///< Seconds a request waits for its leader before running the script by itself
+#define RESPCACHE_AGE_LEN 32 ///< Size of a buffer able to hold an Age header
+
+/**
+ * @brief Results of looking up a request in the cache
+ */
+typedef enum _RESPCACHE_RESULT {
+    RESPCACHE_HIT, ///< A valid response was found, and must be sent with respcache_send()
+    RESPCACHE_REFRESH, ///< A stale response was found, which must be sent and then refreshed by the caller
+    RESPCACHE_LEAD, ///< There's no response, so the caller must produce it capturing it, and store it
+    RESPCACHE_BYPASS ///< The response can't be obtained from the cache, so the caller must produce it normally
+} RESPCACHE_RESULT;
+
+/**
+ * @brief The response cache type
+ */
+typedef struct respcache respcache;
+
+/**
+ * @brief A response stored in the cache
+ */
+typedef struct respcache_entry respcache_entry;
+
+/**
+ * @brief Creates a new response cache
+ * @param[in] max_entries Maximum number of responses the cache can hold. When it's full, the oldest one is evicted.
+ * @param[in] ttl Seconds during which a response is valid, unless it sets its own max-age
+ * @param[in] stale Seconds after expiring during which a response is still sent while it's being refreshed
+ * @param[in] vary Comma separated list of request headers whose values are part of the key (can be NULL)
+ * @param[in] max_body Maximum length of the body of a cached response
+ * @return The newly created cache, or NULL if an error occurs
+ */
+respcache *respcache_create(int max_entries, int ttl, int stale, const char *vary, size_t max_body);
+
+/**
+ * @brief Frees all the memory associated with a response cache
+ * @pre No entries of the cache can be in use
+ * @param[in] cache The cache to free
+ */
+void respcache_free(respcache *cache);
+
+/**
+ * @brief Looks up the response for a request to a script
+ * @details If an identical request is already producing the response, this function waits until it's done. Every
+ * result except \ref RESPCACHE_RESULT.RESPCACHE_BYPASS gives an entry, which must be released with respcache_release()
+ * once the caller is done with it.
+ * @param[in] cache The cache to search
+ * @param[in] request The request
+ * @param[in] fullpath Full path of the script
+ * @param[in] may_lead 1 if the caller can produce the response if it's missing or stale, 0 if it can only use it
+ * @param[out] entry Variable where the entry must be stored
+ * @return The result of the lookup
+ */
+RESPCACHE_RESULT respcache_lookup(respcache *cache, const struct request *request, const char *fullpath, int may_lead,
+                                  respcache_entry **entry);
+
+/**
+ * @brief Looks up the response for a request to a script, only if it can be sent right away
+ * @details Unlike respcache_lookup(), this function never waits for another request nor makes the caller produce a
+ * missing response, so it can be used before deciding which thread must run the script.
+ * @param[in] cache The cache to search
+ * @param[in] request The request
+ * @param[in] fullpath Full path of the script
+ * @param[in] may_refresh 1 if the caller can refresh the response if it's stale, 0 if it can only use it
+ * @param[out] entry Variable where the entry must be stored, which must be released with respcache_release()
+ * @return \ref RESPCACHE_RESULT.RESPCACHE_HIT or \ref RESPCACHE_RESULT.RESPCACHE_REFRESH if a response was found, or
+ * \ref RESPCACHE_RESULT.RESPCACHE_BYPASS if respcache_lookup() must be used instead
+ */
+RESPCACHE_RESULT respcache_peek(respcache *cache, const struct request *request, const char *fullpath,
+                                int may_refresh, respcache_entry **entry);
+
+/**
+ * @brief Sends a cached response to a socket, adding the headers stored with it
+ * @param[in] entry The entry
+ * @param[out] socket The socket to which the response must be sent
+ * @param[in] headers Structure containing the headers for the response
+ * @param[in] request The request being answered
+ * @return code of the HTTP response sent to the socket
+ */
+HTTP_RESPONSE_CODE respcache_send(respcache_entry *entry, int socket, struct httpres_headers *headers,
+                                  const struct request *request);
+
+/**
+ * @brief Stores the response produced for an entry given by \ref RESPCACHE_RESULT.RESPCACHE_LEAD or
+ * \ref RESPCACHE_RESULT.RESPCACHE_REFRESH, and wakes up the requests waiting for it
+ * @details Only complete responses with a 200 code which don't forbid it through their headers are stored. Otherwise,
+ * the waiting requests produce their own responses, and a stale copy stays as it was. The buffers of the capture are
+ * taken over by the cache when it's stored.
+ * @param[in,out] cache The cache
+ * @param[in] entry The entry
+ * @param[in,out] capture The captured response
+ */
+void respcache_complete(respcache *cache, respcache_entry *entry, struct cgi_capture *capture);
+
+/**
+ * @brief Releases an entry obtained with respcache_lookup()
+ * @param[in,out] cache The cache
+ * @param[in] entry The entry
+ */
+void respcache_release(respcache *cache, respcache_entry *entry);
+
+/**
+ * @brief Returns the number of responses currently stored in the cache (including the ones being produced)
+ * @param[in] cache The cache to check
+ * @return Number of entries, or -1 if the cache is NULL
+ */
+int respcache_count(respcache *cache);
+
+#endif //PRACTICA1_RESPCACHE_H
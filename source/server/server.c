@@ -6,6 +6,8 @@
  * @date 7 March 2020
  */
 
+#define _GNU_SOURCE // Required for accept4()
+
 #include <stdlib.h>
 #include <netinet/in.h>
 #include <stdio.h>
@@ -15,23 +17,33 @@
 #include <arpa/inet.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <unistd.h>
 
 #include "server.h"
 #include "readconfig.h"
 #include "colorcodes.h"
 #include "queue.h"
 #include "mimetable.h"
+#include "asynclog.h"
+#include "metrics.h"
+#include "probes.h"
+
+asynclog *_Atomic server_logger = NULL; ///< Logger writing the lines in the background, or NULL to write them directly
 
 // Private functions
 
 /**
- * @brief Returns an allocated string representing the absolute path of the provided directory in relation to the
- * root folder of the project
- * @param srv The server whose root must be used
- * @param relative_path The relative path to that root
- * @return Allocated string representing the absolute path (user must free it)
+ * @brief Starts writing the log lines in the background, with the buffer size set in the configuration
+ * @param[in] srv The server
+ */
+void server_start_logger(Server *srv);
+
+/**
+ * @brief Writes the log lines still waiting in the background logger and stops it, when the program exits
  */
-char *get_absolute_path(Server *srv, const char *relative_path);
+void server_stop_logger();
 
 /**
  * @brief Prints the passed parameters into the server log
@@ -55,8 +67,6 @@ void server_thread_log(FILE *file, int thread_n, const char *format, ...);
 
 void server_http_log(FILE *file, const char *format, ...);
 
-char *get_time_str();
-
 char *get_full_webroot(const char *webroot, Server *srv);
 
 /**
@@ -79,6 +89,7 @@ struct _server {
     ///< processor function must accept two parameters: an integer (the socket descriptor) and a logging function that it
     ///< can use to produce logs.
     char *project_root; ///< Path to the root folder of the project
+    struct _srvutils utils; ///< Utilities passed to the request processor
 };
 
 /**
@@ -115,7 +126,7 @@ server_init(char *proj_root, SERVERCMD (*request_processor)(int, const struct _s
     srv->config = NULL;
 
     // Get the full path of the configuration file in relation to the project root
-    char *config_file_path = get_absolute_path(srv, CONFIG_FILENAME);
+    char *config_file_path = server_get_path(srv->project_root, CONFIG_FILENAME);
 
     if (parseConfig(config_file_path, &srv->config) != EXIT_SUCCESS) {
         server_log(stderr, "ERROR: couldn't read the configuration file %s", proj_root);
@@ -123,6 +134,8 @@ server_init(char *proj_root, SERVERCMD (*request_processor)(int, const struct _s
         return NULL;
     }
 
+    server_start_logger(srv);
+
     int ret;
     char *mimefile;
     if ((ret = config_getparam_str(&srv->config, PARAMS_MIME_FILE, &mimefile)) != 0) {
@@ -132,7 +145,7 @@ server_init(char *proj_root, SERVERCMD (*request_processor)(int, const struct _s
     }
 
     // Get the full path of the mime file in relation to the project root
-    char *mime_file_path = get_absolute_path(srv, mimefile);
+    char *mime_file_path = server_get_path(srv->project_root, mimefile);
 
     server_log(stdout, "Parsing the MIME file (%s)...", mime_file_path);
     if (mime_add_from_file(mime_file_path) == ERROR) {
@@ -194,12 +207,36 @@ server_init(char *proj_root, SERVERCMD (*request_processor)(int, const struct _s
         srv->threads[i] = calloc(1, sizeof(pthread_t));
     }
 
+    char *webroot;
+    if ((ret = config_getparam_str(&srv->config, PARAMS_WEBROOT, &webroot)) != 0) {
+        server_log(stderr, "ERROR: could not fetch webroot (%s)\n", readconfig_perror(ret));
+        free(srv);
+        return NULL;
+    }
+
+    // Fill in the structure holding the server utilities for the request processor
+    srv->utils.log = server_http_log;
+    srv->utils.webroot = get_full_webroot(webroot, srv);
+    srv->utils.config = &srv->config;
+    srv->utils.project_root = srv->project_root;
+
+#if DEBUG >= 1
+    server_log(stdout, "The full path for the webroot is '%s'", srv->utils.webroot);
+#endif
+
     return srv;
 }
 
+const struct _srvutils *server_get_utils(Server *srv) {
+    if (!srv) return NULL;
+
+    return &srv->utils;
+}
+
 STATUS server_free(Server *srv) {
     if (!srv) return ERROR;
 
+    free((char *) srv->utils.webroot);
     free(srv->project_root);
     free(srv);
     return SUCCESS;
@@ -244,7 +281,7 @@ STATUS server_start(Server *srv) {
     server_log(stdout, "\t-> port %i", port);
     server_log(stdout, "\t-> webroot %s", webroot);
 
-    if ((srv->socket_descriptor = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
+    if ((srv->socket_descriptor = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) == 0) {
         server_log(stderr, "Socket creation failed");
         perror("Socket creation failed");
         return ERROR;
@@ -269,23 +306,15 @@ STATUS server_start(Server *srv) {
 
     server_log(stdout, "Server listening on port %i", port);
 
-    char *full_webroot = get_full_webroot(webroot, srv);
-
-#if DEBUG >= 1
-    server_log(stdout, "The full path for the webroot is '%s'", full_webroot);
-#endif
-
-    // Create a structure holding the server utilities for the request processor
-    struct _srvutils utils;
-    utils.log = server_http_log;
-    utils.webroot = full_webroot;
+    // Clients closing the connection in the middle of a response must not kill the whole server
+    signal(SIGPIPE, SIG_IGN);
 
     server_log(stdout, "Starting %i threads...", srv->nthreads);
     for (int i = 0; i < srv->nthreads; i++) {
         struct handler_param *param = malloc(sizeof(struct handler_param));
         param->srv = srv;
         param->thread_id = i;
-        param->utils = &utils;
+        param->utils = &srv->utils;
         pthread_create(srv->threads[i], NULL, connectionHandler, param);
     }
 
@@ -293,12 +322,15 @@ STATUS server_start(Server *srv) {
 
     while (1) {
         int new_socket;
-        if ((new_socket = accept(srv->socket_descriptor, (struct sockaddr *) &srv->address,
-                                 (socklen_t *) &srv->addrlen)) == 0) {
+        // Connections are close-on-exec, so that scripts don't keep them open after the response has been sent
+        if ((new_socket = accept4(srv->socket_descriptor, (struct sockaddr *) &srv->address,
+                                  (socklen_t *) &srv->addrlen, SOCK_CLOEXEC)) == 0) {
             server_log(stderr, "Accept failed");
             perror(("Accept failed"));
             return ERROR;
         } else {
+            metrics_add(METRIC_CONNECTIONS_ACCEPTED, 1);
+            PROBE2(accept, new_socket, probe_tid());
             add_connection(srv, new_socket); // Add the socket of the new connection to the queue
             sem_post(srv->sem); // Increment the semaphore so that one thread is freed up to process the request
         }
@@ -309,7 +341,7 @@ STATUS server_start(Server *srv) {
 char *get_full_webroot(const char *webroot, Server *srv) {
     if (!webroot) return NULL;
 
-    char *full_webroot = get_absolute_path(srv, webroot);
+    char *full_webroot = server_get_path(srv->project_root, webroot);
 
     return full_webroot;
 }
@@ -322,7 +354,16 @@ char *get_full_webroot(const char *webroot, Server *srv) {
  * @return The integer that identifies the socket in which the connection has been established
  */
 int get_connection(Server *srv) {
-    return queue_pop(srv->queue);
+    long wait_us;
+    int socket = queue_pop_waited(srv->queue, &wait_us);
+
+    PROBE3(queue_pop, socket, probe_tid(), wait_us);
+    metrics_trace_reset(); // The phases of each connection are traced from scratch
+    metrics_add(METRIC_CONNECTIONS_DEQUEUED, 1);
+    metrics_add(METRIC_QUEUE_WAIT, (unsigned long) (wait_us > 0 ? wait_us : 0));
+    metrics_observe(PHASE_QUEUE, (uint64_t) (wait_us > 0 ? wait_us : 0) * 1000);
+
+    return socket;
 }
 
 /**
@@ -333,6 +374,7 @@ int get_connection(Server *srv) {
  * @param[in] socket The integer that identifies the socket in which the connection has been established
  */
 void add_connection(Server *srv, int socket) {
+    PROBE2(queue_push, socket, probe_tid());
     queue_add(srv->queue, socket);
 }
 
@@ -381,53 +423,76 @@ server_logv(FILE *file, const char *titlecolor, const char *subtitle, const char
             va_list args, const char *title) {
     if (!file || !titlecolor || !title) return;
 
-    char *timestr = get_time_str();
-    flockfile(file); // Lock the file so that the entire output is printed atomically
+    // The whole line is formatted first, so that it's written at once, without locking the file
+    char line[ASYNCLOG_MAX_LINE];
+    int len;
     if (subtitle && subtitlecolor) {
-        fprintf(file, "%s%s %s[%s]%s::[%s]%s ", YEL, timestr, titlecolor, title, subtitlecolor, subtitle,
-                reset); // TODO: Allow printing to other files (syslog?)
+        len = snprintf(line, sizeof(line), "%s%s %s[%s]%s::[%s]%s ", YEL, asynclog_timestamp(), titlecolor, title,
+                       subtitlecolor, subtitle, reset); // TODO: Allow printing to other files (syslog?)
     } else {
-        fprintf(file, "%s%s %s[%s]%s ", YEL, timestr, titlecolor, title,
-                reset); // TODO: Allow printing to other files (syslog?)
+        len = snprintf(line, sizeof(line), "%s%s %s[%s]%s ", YEL, asynclog_timestamp(), titlecolor, title,
+                       reset); // TODO: Allow printing to other files (syslog?)
     }
-    vfprintf(file, format, args);
-    printf("\n");
-    funlockfile(file); // Unlock the file
-    free(timestr);
-}
+    if (len < 0) return;
 
-void server_http_log(FILE *file, const char *format, ...) {
-    va_list args;
-    va_start(args, format);
-    server_logv(file, BLU, NULL, NULL, format, args, "HTTP");
-    va_end(args);
+    if ((size_t) len < sizeof(line)) {
+        int msg_len = vsnprintf(line + len, sizeof(line) - (size_t) len, format, args);
+        if (msg_len > 0) len += msg_len;
+    }
+    if ((size_t) len >= sizeof(line)) len = sizeof(line) - 1; // Truncated lines still end with their newline
+    line[len++] = '\n';
+
+    asynclog *logger = atomic_load(&server_logger);
+    if (logger) {
+        asynclog_write(logger, fileno(file), line, (size_t) len); // Dropped and counted if it can't keep up
+    } else {
+        fflush(file); // Anything printed to the file before must come first
+        ssize_t written = write(fileno(file), line, (size_t) len);
+        (void) written; // Nothing can be done if the log can't be written
+    }
 }
 
-char *get_time_str() {
-    time_t rawtime;
-    struct tm timeinfo;
+void server_start_logger(Server *srv) {
+    if (server_logger) return;
 
-    time(&rawtime);
-    localtime_r(&rawtime, &timeinfo);
+    int log_buffer;
+    if (config_getparam_int(&srv->config, PARAMS_LOG_BUFFER, &log_buffer) != 0) log_buffer = DEFAULT_LOG_BUFFER;
+    if (log_buffer <= 0) return; // Lines are written directly by the threads that log them
 
-    char *timestr = malloc(sizeof(char) * 100); // Allocate size for the time string
-    asctime_r(&timeinfo, timestr);
+    asynclog *logger = asynclog_create((size_t) log_buffer * 1024);
+    if (!logger) {
+        server_log(stderr, "Could not start the background logger, log lines will be written directly");
+        return;
+    }
+    atomic_store(&server_logger, logger);
 
-    timestr[strlen(timestr) - 1] = 0; // Remove the newline at the end
+    atexit(server_stop_logger);
+}
+
+void server_stop_logger() {
+    // Lines logged from now on are written directly. The connection threads are never joined, and may still be using
+    // the logger, so it's only stopped once everything logged is written, and never freed
+    asynclog_stop(atomic_exchange(&server_logger, NULL));
+}
 
-    return timestr;
+void server_http_log(FILE *file, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    server_logv(file, BLU, NULL, NULL, format, args, "HTTP");
+    va_end(args);
 }
 
-char *get_absolute_path(Server *srv, const char *relative_path) {
-    if (!relative_path) return NULL;
+char *server_get_path(const char *project_root, const char *relative_path) {
+    if (!project_root || !relative_path) return NULL;
     // Calculate the space needed for the full path and null terminator
-    size_t pathlen = snprintf(NULL, 0, "%s%s", srv->project_root, relative_path) + 1;
+    size_t pathlen = snprintf(NULL, 0, "%s%s", project_root, relative_path) + 1;
 
-    // Allocate space for the mime path
+    // Allocate space for the full path
     char *fullpath = malloc(sizeof(char) * pathlen);
+    if (!fullpath) return NULL;
 
-    // Print the mime path
-    snprintf(fullpath, pathlen, "%s%s", srv->project_root, relative_path);
+    // Print the full path
+    snprintf(fullpath, pathlen, "%s%s", project_root, relative_path);
 
     return fullpath;
 }
\ No newline at end of file
@@ -14,6 +14,7 @@
 
 #define DEFAULT_MAX_QUEUE 100 ///< Maximum amount of clients in the queue used by default
 #define DEFAULT_NTHREADS 2 ///< Number of threads used by default
+#define DEFAULT_LOG_BUFFER 64 ///< Kilobytes of log lines each thread can have waiting to be written by default
 
 #define CONFIG_FILENAME "server.cfg" ///< Name of the configuration file to open
 
@@ -34,6 +35,8 @@ typedef enum _SERVERCMD {
  */
 typedef struct _server Server;
 
+struct config_param;
+
 /**
  * @struct _srvutils
  * @brief This structure stores data and functions that the request processor can use during its execution
@@ -41,6 +44,8 @@ typedef struct _server Server;
 struct _srvutils {
     void (*log)(FILE *file, const char *fmt, ...); ///< Logger function from the #Server
     const char *webroot; ///< String containing the path of the webroot of the #Server
+    const char *project_root; ///< Path of the project root, where the configuration files of the #Server are
+    const struct config_param **config; ///< Configuration dictionary of the #Server, to read processor options
 };
 
 /**
@@ -60,6 +65,16 @@ struct _srvutils {
 Server *
 server_init(char *proj_root, SERVERCMD (*request_processor)(int socket, const struct _srvutils *utils));
 
+/**
+ * @brief Returns the utilities that the #Server passes to its request processor
+ * @details This allows the request processor to initialize its own structures from the server configuration
+ * before the #Server starts accepting connections.
+ * @pre @p srv must point to an initialized #Server
+ * @param[in] srv The #Server whose utilities must be returned
+ * @return Pointer to the utilities structure, or \a NULL if @p srv is \a NULL
+ */
+const struct _srvutils *server_get_utils(Server *srv);
+
 /**
  * @brief Frees all the associated memory of the provided #Server
  * @pre @p srv must point to an initialized #Server
@@ -77,4 +92,12 @@ STATUS server_free(Server *srv);
  */
 STATUS server_start(Server *srv);
 
+/**
+ * @brief Returns the full path of a file referenced by the configuration, which is relative to the project root
+ * @param[in] project_root Path of the root folder of the project, ending with a slash
+ * @param[in] relative_path Path of the file, relative to that root
+ * @return Allocated string with the full path (user must free it), or \a NULL if an error occurs
+ */
+char *server_get_path(const char *project_root, const char *relative_path);
+
 #endif //PRACTICA1_SERVER_H
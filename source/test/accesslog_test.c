@@ -0,0 +1,133 @@
+/**
+ * @file accesslog_test.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief File that tests writing requests to the binary access log, rotating its segments and decoding them.
+ */
+
+#include "accesslog.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glob.h>
+#include <sys/stat.h>
+
+#define TEST_PREFIX "/tmp/accesslog_test"
+#define TEST_SEGMENTS 3
+#define TEST_RECORDS 20000
+
+/**
+ * @brief Reads a whole segment
+ * @param[in] number Number of the segment
+ * @param[out] len Length of the segment
+ * @return The contents, or NULL if it doesn't exist
+ */
+unsigned char *read_segment(int number, size_t *len) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s.%i%s", TEST_PREFIX, number, ACCESSLOG_EXTENSION);
+
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    struct stat st;
+    assert(fstat(fileno(file), &st) == 0);
+    unsigned char *data = malloc((size_t) st.st_size);
+    assert(fread(data, 1, (size_t) st.st_size, file) == (size_t) st.st_size);
+    fclose(file);
+
+    *len = (size_t) st.st_size;
+    return data;
+}
+
+/**
+ * @brief Deletes the segments left by previous runs
+ */
+void remove_segments() {
+    glob_t found;
+    if (glob(TEST_PREFIX ".*" ACCESSLOG_EXTENSION, 0, NULL, &found) != 0) return;
+    for (size_t i = 0; i < found.gl_pathc; i++) unlink(found.gl_pathv[i]);
+    globfree(&found);
+}
+
+int main() {
+    remove_segments();
+    assert(accesslog_open(TEST_PREFIX, 1024, 0) == NULL); // Segments too small are rejected
+
+    accesslog *log = accesslog_open(TEST_PREFIX, ACCESSLOG_MIN_SEGMENT, TEST_SEGMENTS);
+    assert(log != NULL);
+
+    // Records are written until several segments have been filled
+    char path[32];
+    for (int i = 0; i < TEST_RECORDS; i++) {
+        struct accesslog_entry entry = {
+                .time = 1000000ull * 1800000000 + (uint64_t) i, .connection = (uint32_t) i, .status = 200,
+                .method = i % 2 ? "GET" : "PROPFIND", .method_len = i % 2 ? 3 : 8,
+                .path = path, .path_len = (size_t) snprintf(path, sizeof(path), "/file%i.html", i),
+                .querystring = i % 3 ? NULL : "a=1", .querystring_len = i % 3 ? 0 : 3,
+                .bytes_in = 78, .bytes_out = (uint64_t) i * 1000, .parse_time = 12, .response_time = (uint64_t) i
+        };
+        assert(accesslog_write(log, &entry) == SUCCESS);
+    }
+    accesslog_close(log);
+
+    // Only the last segments are kept, and they contain the last records in order
+    size_t len;
+    int first = -1, last = -1;
+    for (int number = 0; number < 1000; number++) {
+        unsigned char *data = read_segment(number, &len);
+        if (!data) continue;
+        if (first == -1) first = number;
+        last = number;
+        free(data);
+    }
+    assert(first != -1 && last - first + 1 == TEST_SEGMENTS);
+
+    int expected = -1;
+    for (int number = first; number <= last; number++) {
+        unsigned char *data = read_segment(number, &len);
+        assert(accesslog_check(data, len) == SUCCESS);
+
+        size_t pos = ACCESSLOG_HEADER_LEN;
+        struct accesslog_entry entry;
+        while (accesslog_decode(data, len, &pos, &entry) == SUCCESS) {
+            int i = (int) entry.connection;
+            if (expected != -1) assert(i == expected);
+            expected = i + 1;
+
+            snprintf(path, sizeof(path), "/file%i.html", i);
+            assert(entry.path_len == strlen(path) && memcmp(entry.path, path, entry.path_len) == 0);
+            assert(entry.method_len == (i % 2 ? 3u : 8u));
+            assert(memcmp(entry.method, i % 2 ? "GET" : "PROPFIND", entry.method_len) == 0);
+            assert(i % 3 ? entry.querystring == NULL : memcmp(entry.querystring, "a=1", 3) == 0);
+            assert(entry.status == 200 && entry.bytes_in == 78 && entry.bytes_out == (uint64_t) i * 1000);
+            assert(entry.parse_time == 12 && entry.response_time == (uint64_t) i);
+            assert(entry.time == 1000000ull * 1800000000 + (uint64_t) i);
+        }
+        assert(pos == len); // Finished segments are truncated to their records
+        free(data);
+    }
+    assert(expected == TEST_RECORDS);
+
+    // A new log continues after the existing segments
+    log = accesslog_open(TEST_PREFIX, ACCESSLOG_MIN_SEGMENT, TEST_SEGMENTS);
+    accesslog_close(log);
+    unsigned char *data = read_segment(last + 1, &len);
+    assert(data != NULL && len == ACCESSLOG_HEADER_LEN);
+    free(data);
+
+    // Corrupt data isn't decoded
+    unsigned char bad[ACCESSLOG_HEADER_LEN + 4] = "NOTALOG";
+    size_t pos = ACCESSLOG_HEADER_LEN;
+    struct accesslog_entry entry;
+    assert(accesslog_check(bad, sizeof(bad)) == ERROR);
+    bad[ACCESSLOG_HEADER_LEN] = 0x42; // Not a method, and truncated anyway
+    assert(accesslog_decode(bad, sizeof(bad), &pos, &entry) == ERROR);
+
+    remove_segments();
+
+    printf("Accesslog module tested correctly\n");
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,115 @@
+/**
+ * @file asynclog_test.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief File that tests logging lines from several threads and dropping them when the rings are full.
+ */
+
+#include "asynclog.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define TEST_FILE "/tmp/asynclog_test.log"
+#define TEST_THREADS 4
+#define TEST_LINES 1000
+
+asynclog *test_log;
+int test_fd;
+int logged[TEST_THREADS];
+
+void *log_lines(void *arg) {
+    int thread = *(int *) arg;
+    char line[64];
+
+    for (int i = 0; i < TEST_LINES; i++) {
+        int len = snprintf(line, sizeof(line), "%i %i\n", thread, i);
+        if (asynclog_write(test_log, test_fd, line, (size_t) len) == SUCCESS) logged[thread]++;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Logs from several threads at once, and checks that every line that wasn't dropped is written in order
+ * @param[in] ring_size Size of the rings of the threads
+ * @return Number of dropped lines
+ */
+unsigned long test_threads(size_t ring_size) {
+    test_fd = open(TEST_FILE, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    assert(test_fd != -1);
+    assert((test_log = asynclog_create(ring_size)) != NULL);
+
+    pthread_t threads[TEST_THREADS];
+    int ids[TEST_THREADS];
+    for (int i = 0; i < TEST_THREADS; i++) {
+        ids[i] = i;
+        logged[i] = 0;
+        assert(pthread_create(&threads[i], NULL, log_lines, &ids[i]) == 0);
+    }
+    for (int i = 0; i < TEST_THREADS; i++) pthread_join(threads[i], NULL);
+
+    unsigned long dropped = asynclog_dropped(test_log);
+    asynclog_free(test_log); // Everything logged must be written before it returns
+    close(test_fd);
+
+    FILE *file = fopen(TEST_FILE, "r");
+    assert(file != NULL);
+    int last[TEST_THREADS], written[TEST_THREADS] = {0};
+    for (int i = 0; i < TEST_THREADS; i++) last[i] = -1;
+
+    int thread, line;
+    while (fscanf(file, "%i %i", &thread, &line) == 2) {
+        assert(thread >= 0 && thread < TEST_THREADS);
+        assert(line > last[thread]); // Lines of the same thread keep their order
+        last[thread] = line;
+        written[thread]++;
+    }
+    fclose(file);
+
+    unsigned long total = 0;
+    for (int i = 0; i < TEST_THREADS; i++) {
+        assert(written[i] == logged[i]);
+        total += (unsigned long) logged[i];
+    }
+    assert(total + dropped == TEST_THREADS * TEST_LINES);
+
+    return dropped;
+}
+
+int main() {
+    // Rings too small for a line are rejected
+    assert(asynclog_create(16) == NULL);
+
+    // With big enough rings, nothing is dropped
+    assert(test_threads(1024 * 1024) == 0);
+
+    // With the smallest rings, lines may be dropped, but they're always counted
+    test_threads(2 * (ASYNCLOG_MAX_LINE + 64));
+
+    // A stopped logger has written everything, and threads can keep logging with it
+    test_fd = open(TEST_FILE, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    assert((test_log = asynclog_create(4096)) != NULL);
+    assert(asynclog_write(test_log, test_fd, "before\n", 7) == SUCCESS);
+    asynclog_stop(test_log);
+    char written[16] = {0};
+    assert(pread(test_fd, written, sizeof(written) - 1, 0) == 7 && strcmp(written, "before\n") == 0);
+    asynclog_write(test_log, test_fd, "after\n", 6);
+    asynclog_stop(test_log);
+    asynclog_free(test_log);
+    close(test_fd);
+
+    // Timestamps are cached, and formatted like asctime()
+    const char *timestamp = asynclog_timestamp();
+    assert(strlen(timestamp) == 24);
+    assert(asynclog_timestamp() == timestamp);
+
+    unlink(TEST_FILE);
+
+    printf("Asynclog module tested correctly\n");
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
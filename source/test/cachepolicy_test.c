@@ -0,0 +1,73 @@
+/**
+ * @file cachepolicy_test.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief File that tests loading caching rules and the precedence between their selectors.
+ */
+
+#include "cachepolicy.h"
+#include "mimetable.h"
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_RULES "/tmp/cachepolicy_test.tsv"
+
+int main() {
+    FILE *rules = fopen(TEST_RULES, "w");
+    assert(rules != NULL);
+    fputs("# comment\n"
+          "/static/*\tpublic, max-age=31536000, immutable\n"
+          ".HTML\tno-cache\n"
+          ".tar.gz\tpublic, max-age=60\n"
+          ".gz\tno-store\n"
+          "image/*\tpublic, max-age=604800\n"
+          "image/png\tprivate\n", rules);
+    fclose(rules);
+
+    policy_table *table = cachepolicy_load(TEST_RULES);
+    assert(table != NULL);
+    assert(cachepolicy_count(table) == 6);
+
+    size_t len;
+    const struct cache_policy *policy;
+
+    // Path globs win over extensions
+    policy = cachepolicy_find(table, "/static/index.html", "/www/static/index.html", mime_get_type("index.html"));
+    assert(strcmp(cachepolicy_cache_control(policy, &len), "Cache-Control: public, max-age=31536000, immutable") == 0);
+    assert(len == strlen("Cache-Control: public, max-age=31536000, immutable"));
+
+    // Extensions are case insensitive, and policies without max-age have no Expires
+    policy = cachepolicy_find(table, "/index.Html", "/www/index.Html", NULL);
+    assert(strcmp(cachepolicy_cache_control(policy, NULL), "Cache-Control: no-cache") == 0);
+    assert(cachepolicy_expires(policy, NULL) == NULL);
+
+    // The longest extension is tried first
+    policy = cachepolicy_find(table, "/a.tar.gz", "/www/a.tar.gz", NULL);
+    assert(strcmp(cachepolicy_cache_control(policy, NULL), "Cache-Control: public, max-age=60") == 0);
+    assert(strncmp(cachepolicy_expires(policy, &len), "Expires: ", 9) == 0 && len == 38);
+    policy = cachepolicy_find(table, "/a.gz", "/www/a.gz", NULL);
+    assert(strcmp(cachepolicy_cache_control(policy, NULL), "Cache-Control: no-store") == 0);
+
+    // MIME type rules apply to every type matching the prefix, and the first matching rule wins
+    policy = cachepolicy_find(table, "/a.png", "/www/a.png", mime_get_type("a.png"));
+    assert(strcmp(cachepolicy_cache_control(policy, NULL), "Cache-Control: public, max-age=604800") == 0);
+
+    // Files not matching anything have no policy
+    assert(cachepolicy_find(table, "/a.txt", "/www/a.txt", mime_get_type("a.txt")) == NULL);
+
+    cachepolicy_free(table);
+
+    // Files with invalid rules are rejected
+    rules = fopen(TEST_RULES, "w");
+    assert(rules != NULL);
+    fputs("nonsense\tpublic\n", rules);
+    fclose(rules);
+    assert(cachepolicy_load(TEST_RULES) == NULL);
+    remove(TEST_RULES);
+
+    printf("Cache policy module tested correctly\n");
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
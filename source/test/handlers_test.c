@@ -0,0 +1,84 @@
+/**
+ * @file handlers_test.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief File that tests loading handlers, resolving their interpreters and finding the handler of a request.
+ */
+
+#include "handlers.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define TEST_FILE "/tmp/handlers_test.tsv"
+
+int main() {
+    FILE *file = fopen(TEST_FILE, "w");
+    assert(file != NULL);
+    fprintf(file, "# Comment\n\n");
+    fprintf(file, ".py\tcgi\tsh\tmax=2 queue=0 timeout=5 cpu=2 memory=256 files=64\n");
+    fprintf(file, ".php\tfastcgi\tunix:/tmp/php.sock\n");
+    fprintf(file, "/cgi-bin/\tpool\t/bin/sh\tshim=scripts/worker.sh\n");
+    fprintf(file, "/cgi-bin/fast/\tcgi\tnot-an-installed-interpreter\n");
+    fclose(file);
+
+    handler_table *table = handlers_load(TEST_FILE, "/srv/");
+    assert(table != NULL && handlers_count(table) == 4);
+
+    // Interpreters are resolved to absolute paths, and relative shims to the project root
+    struct handler *handler = handlers_get(table, handlers_find(table, "/a.py", "/www/a.py"));
+    assert(handler && handler->kind == HANDLER_CGI && handler->target[0] == '/' && handler->max_concurrency == 2);
+    assert(strcmp(handler->target + strlen(handler->target) - 3, "/sh") == 0);
+    assert(handler->max_queue == 0 && handler->limits.timeout == 5 && handler->limits.cpu == 2);
+    assert(handler->limits.memory == 256 && handler->limits.files == 64);
+    handler = handlers_get(table, handlers_find(table, "/cgi-bin/x", "/www/cgi-bin/x"));
+    assert(handler && handler->kind == HANDLER_POOL && strcmp(handler->shim, "/srv/scripts/worker.sh") == 0);
+    assert(handler->max_queue == HANDLER_UNLIMITED_QUEUE && handler->limits.timeout == HANDLER_DEFAULT_TIMEOUT);
+    handler = handlers_get(table, handlers_find(table, "/t.php", "/www/t.php"));
+    assert(handler && handler->kind == HANDLER_FASTCGI && strcmp(handler->target, "unix:/tmp/php.sock") == 0);
+
+    // Missing interpreters are kept as they are
+    handler = handlers_get(table, handlers_find(table, "/cgi-bin/fast/x.py", "/www/cgi-bin/fast/x.py"));
+    assert(handler && strcmp(handler->target, "not-an-installed-interpreter") == 0); // The longest prefix wins
+
+    // Files that aren't scripts
+    assert(handlers_find(table, "/index.html", "/www/index.html") == HANDLER_NONE);
+    assert(handlers_find(table, "/a.py/x", "/www/a.py/x") == HANDLER_NONE);
+    assert(handlers_find(table, "/py", "/www/py") == HANDLER_NONE);
+    assert(handlers_get(table, HANDLER_NONE) == NULL);
+
+    // Concurrency slots, and requests rejected at once when there's no room for them in the queue
+    handler = handlers_get(table, handlers_find(table, "/a.py", "/www/a.py"));
+    assert(handler_acquire(handler) == SUCCESS);
+    assert(handler_acquire(handler) == SUCCESS);
+    int free_slots;
+    sem_getvalue(&handler->slots, &free_slots);
+    assert(free_slots == 0);
+    assert(handler_acquire(handler) == ERROR && handler->rejections == 1);
+    handler_release(handler);
+    assert(handler_acquire(handler) == SUCCESS);
+    handler_release(handler);
+    handler_release(handler);
+
+    // Repeated selectors and unknown kinds are errors
+    assert(handlers_add(table, ".py", HANDLER_CGI, "sh", NULL) == ERROR);
+    assert(handlers_add(table, "/cgi-bin/", HANDLER_CGI, "sh", NULL) == ERROR);
+    assert(handlers_add(table, "py", HANDLER_CGI, "sh", NULL) == ERROR);
+    assert(handlers_add(table, ".rb", HANDLER_POOL, "ruby", NULL) == ERROR); // Pools need a shim
+    handlers_free(table);
+
+    // Unknown kinds and invalid options make the whole file invalid
+    const char *invalid[] = {".py\tspawn\tpython\n", ".py\tcgi\tpython\ttimeout=soon\n", ".py\tcgi\tpython\tnice=5\n"};
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        file = fopen(TEST_FILE, "w");
+        fputs(invalid[i], file);
+        fclose(file);
+        assert(handlers_load(TEST_FILE, "/srv/") == NULL);
+    }
+    remove(TEST_FILE);
+
+    printf("Handlers module tested correctly\n");
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+/**
+ * @file iopool_test.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief File that tests running jobs in the I/O pool and detecting whether files are in the page cache.
+ */
+
+#include "iopool.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define TEST_FILE "/tmp/iopool_test.bin"
+#define TEST_JOBS 8
+
+pthread_mutex_t done_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+int done = 0;
+
+void job(void *arg) {
+    pthread_mutex_lock(&done_mutex);
+    done += *(int *) arg;
+    pthread_cond_signal(&done_cond);
+    pthread_mutex_unlock(&done_mutex);
+}
+
+int main() {
+    // Jobs are run by the pool, which never accepts more than its maximum
+    iopool *pool = iopool_create(2, TEST_JOBS);
+    assert(pool != NULL);
+    assert(iopool_create(0, TEST_JOBS) == NULL);
+
+    int one = 1;
+    for (int i = 0; i < TEST_JOBS; i++) {
+        assert(iopool_submit(pool, job, &one) == SUCCESS);
+    }
+    pthread_mutex_lock(&done_mutex);
+    while (done < TEST_JOBS) pthread_cond_wait(&done_cond, &done_mutex);
+    pthread_mutex_unlock(&done_mutex);
+    assert(iopool_pending(pool) == 0);
+    iopool_free(pool);
+
+    // Residency of a file before and after dropping it from the page cache
+    int fd = open(TEST_FILE, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    assert(fd != -1);
+    char block[4096] = {1};
+    for (int i = 0; i < 64; i++) assert(write(fd, block, sizeof(block)) == sizeof(block));
+    assert(iopool_is_resident(fd, 0, 64 * sizeof(block)) == 1);
+    assert(iopool_is_resident(fd, 100, 0) == 1);
+
+    fsync(fd); // Dirty pages can't be dropped
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    assert(iopool_is_resident(fd, 1000, 64 * sizeof(block) - 1000) == 0);
+
+    close(fd);
+    remove(TEST_FILE);
+
+    printf("I/O pool module tested correctly\n");
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+/**
+ * @file livestats_test.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief File that tests publishing the live statistics and reading them consistently from the segment.
+ */
+
+#include "livestats.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#define TEST_SEGMENT "/livestats_test"
+#define TEST_WORKERS 2
+#define TEST_REQUESTS 200000
+
+livestats *stats; ///< The statistics being tested
+
+/**
+ * @brief Serves fake requests whose method and path always match, so that torn copies can be detected
+ * @param[in] arg Unused
+ * @return NULL
+ */
+void *serve_requests(void *arg) {
+    (void) arg;
+    char path[LIVESTATS_PATH_LEN];
+    for (int i = 0; i < TEST_REQUESTS; i++) {
+        snprintf(path, sizeof(path), "/%i/%0*i", i % 10, i % 50 + 1, i % 10); // The length changes too
+        livestats_request_start(stats, i % 2 ? "GET" : "POST", path, (unsigned long) i);
+        metrics_add(METRIC_CONNECTIONS_FINISHED, 1);
+        livestats_request_end(stats);
+    }
+    livestats_set_state(stats, LIVESTATS_READING);
+    return NULL;
+}
+
+int main() {
+    assert(livestats_create("no_slash", 1) == NULL);
+    assert(livestats_create(TEST_SEGMENT, 0) == NULL);
+
+    stats = livestats_create(TEST_SEGMENT, TEST_WORKERS);
+    assert(stats != NULL);
+
+    size_t size;
+    const struct livestats_header *segment = livestats_attach(TEST_SEGMENT, &size);
+    assert(segment != NULL && segment->workers == TEST_WORKERS);
+
+    // Only the first threads get a slot, the rest are ignored
+    pthread_t threads[TEST_WORKERS + 1];
+    for (int i = 0; i < TEST_WORKERS + 1; i++) assert(pthread_create(&threads[i], NULL, serve_requests, NULL) == 0);
+
+    // While the slots are written, every copy read from them is consistent
+    struct livestats_worker worker;
+    for (int i = 0; i < TEST_REQUESTS / 10; i++) {
+        assert(livestats_read_worker(segment, (unsigned int) i % TEST_WORKERS, &worker) == SUCCESS);
+        if (worker.state != LIVESTATS_SERVING) continue;
+
+        unsigned long n = (unsigned long) worker.connection;
+        char path[LIVESTATS_PATH_LEN];
+        snprintf(path, sizeof(path), "/%lu/%0*lu", n % 10, (int) (n % 50 + 1), n % 10);
+        assert(strcmp(worker.path, path) == 0 && strcmp(worker.method, n % 2 ? "GET" : "POST") == 0);
+    }
+    assert(livestats_read_worker(segment, TEST_WORKERS, &worker) == ERROR);
+
+    for (int i = 0; i < TEST_WORKERS + 1; i++) pthread_join(threads[i], NULL);
+
+    for (unsigned int i = 0; i < TEST_WORKERS; i++) {
+        livestats_read_worker(segment, i, &worker);
+        assert(worker.state == LIVESTATS_READING && worker.requests == TEST_REQUESTS && worker.tid > 0);
+    }
+
+    // The counters are published a few times per second
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = LIVESTATS_INTERVAL_MS * 2 * 1000000L};
+    nanosleep(&pause, NULL);
+    struct livestats_header header;
+    livestats_read_header(segment, &header);
+    assert(header.values[METRIC_CONNECTIONS_FINISHED] == (uint64_t) (TEST_WORKERS + 1) * TEST_REQUESTS);
+    assert(header.workers_used == TEST_WORKERS && header.updated >= header.started);
+
+    livestats_detach(segment, size);
+    livestats_free(stats);
+    assert(livestats_attach(TEST_SEGMENT, &size) == NULL); // Deleted along with the statistics
+
+    printf("Livestats module tested correctly\n");
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+/**
+ * @file metrics_test.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief File that tests counting from several threads and rendering the counters and histograms in the
+ * Prometheus text format.
+ */
+
+#include "metrics.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#define TEST_THREADS 8
+#define TEST_EVENTS 100000
+
+/**
+ * @brief Counts events and requests, like a connection thread
+ * @param[in] arg Unused
+ * @return NULL
+ */
+void *count_events(void *arg) {
+    (void) arg;
+    for (int i = 0; i < TEST_EVENTS; i++) {
+        metrics_add(METRIC_CONNECTIONS_ACCEPTED, 1);
+        metrics_add(METRIC_BYTES_OUT, 10);
+        metrics_count_request(i % 2 ? "GET" : "BREW", i % 2 ? 200 : 418);
+    }
+    return NULL;
+}
+
+int main() {
+    // Threads are started twice, so that the second ones reuse the blocks of the first ones
+    for (int round = 0; round < 2; round++) {
+        pthread_t threads[TEST_THREADS];
+        for (int i = 0; i < TEST_THREADS; i++) assert(pthread_create(&threads[i], NULL, count_events, NULL) == 0);
+        for (int i = 0; i < TEST_THREADS; i++) pthread_join(threads[i], NULL);
+    }
+
+    // Counts from threads that have exited are kept
+    assert(metrics_value(METRIC_CONNECTIONS_ACCEPTED) == 2ul * TEST_THREADS * TEST_EVENTS);
+    assert(metrics_value(METRIC_BYTES_OUT) == 20ul * TEST_THREADS * TEST_EVENTS);
+    assert(metrics_value(METRIC_PARSE_ERROR) == 0);
+
+    struct metrics_text text = {0};
+    metrics_render(&text);
+    assert(!text.failed && text.len == strlen(text.data));
+
+    char line[128];
+    snprintf(line, sizeof(line), "http_requests_total{method=\"GET\",code=\"200\"} %lu\n",
+             (unsigned long) TEST_THREADS * TEST_EVENTS);
+    assert(strstr(text.data, line) != NULL);
+    snprintf(line, sizeof(line), "http_requests_total{method=\"other\",code=\"other\"} %lu\n",
+             (unsigned long) TEST_THREADS * TEST_EVENTS); // Uncommon methods and codes are grouped
+    assert(strstr(text.data, line) != NULL);
+    assert(strstr(text.data, "# TYPE http_requests_total counter\n") != NULL);
+
+    // Durations from 1ns to 1s are merged from all the threads, and their quantiles are within the bucket precision
+    struct metrics_histogram previous, histogram;
+    metrics_histogram_read(PHASE_SEND, &previous);
+    assert(previous.count == 0 && metrics_histogram_quantile(&previous, 0.99) == 0);
+    for (uint64_t ns = 1; ns <= 1000000000; ns *= 10) {
+        for (int i = 0; i < 10; i++) metrics_observe(PHASE_SEND, ns);
+    }
+    metrics_observe(PHASE_SEND, UINT64_MAX); // Too long for the histogram, so it's kept in the last bucket
+
+    metrics_histogram_read(PHASE_SEND, &histogram);
+    assert(histogram.count == 101);
+    for (uint64_t ns = 1, rank = 10; ns <= 1000000000; ns *= 10, rank += 10) {
+        uint64_t value = metrics_histogram_quantile(&histogram, (double) rank / 101);
+        assert(value >= ns && value <= ns + ns / 16);
+    }
+    assert(metrics_histogram_quantile(&histogram, 1) >= ((uint64_t) 1 << 41) - 1);
+
+    // Subtracting an older copy leaves only the newer durations
+    metrics_histogram_read(PHASE_SEND, &previous);
+    metrics_observe(PHASE_SEND, 12345);
+    metrics_histogram_read(PHASE_SEND, &histogram);
+    metrics_histogram_subtract(&histogram, &previous);
+    assert(histogram.count == 1 && histogram.sum == 12345);
+    uint64_t value = metrics_histogram_quantile(&histogram, 0.5);
+    assert(value >= 12345 && value <= 12345 + 12345 / 16);
+
+    metrics_text_free(&text);
+    metrics_render(&text);
+    assert(strstr(text.data, "http_request_phase_seconds_count{phase=\"send\"} 102\n") != NULL);
+    assert(strstr(text.data, "http_request_phase_seconds{phase=\"parse\",quantile=\"0.99\"} 0.000000000\n") != NULL);
+
+    // Families appended after rendering follow the same format
+    metrics_family(&text, "test_gauge", "gauge", "A gauge");
+    metrics_printf(&text, "test_gauge %i\n", 42);
+    assert(strstr(text.data, "# HELP test_gauge A gauge\n# TYPE test_gauge gauge\ntest_gauge 42\n") != NULL);
+    metrics_text_free(&text);
+
+    printf("Metrics module tested correctly\n");
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
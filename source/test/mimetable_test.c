@@ -38,5 +38,26 @@ int main(int argc, char *argv[]) {
     assert(mime_get_association("h12ml") == NULL);
     assert(mime_get_association("jpggg") == NULL);
 
+    // Lookups are case-insensitive
+    assert(strcmp(mime_get_association("JPG"), "image/jpeg") == 0);
+    assert(strcmp(mime_get_association("Html"), "text/html") == 0);
+
+    // Long types aren't truncated, both in the built-in table and in the runtime additions
+    assert(strcmp(mime_get_association("docx"),
+                  "application/vnd.openxmlformats-officedocument.wordprocessingml.document") == 0);
+    assert(strcmp(mime_get_association("custom"), "application/x-custom-type-much-longer-than-thirty-characters") == 0);
+
+    // Types from file names, taking compound extensions into account
+    assert(strcmp(mime_get_type("/www/index.html"), "text/html") == 0);
+    assert(strcmp(mime_get_type("/www/backup.tar.gz"), "application/x-compressed-tar") == 0);
+    assert(strcmp(mime_get_type("/www/BACKUP.TAR.GZ"), "application/x-compressed-tar") == 0);
+    assert(strcmp(mime_get_type("/www/drawing.svg.gz"), "application/gzip") == 0);
+    assert(strcmp(mime_get_type("/www/mytar.gz"), "application/gzip") == 0); // The compound one must be whole
+    assert(strcmp(mime_get_type("/www/tar.gz"), "application/gzip") == 0);
+    assert(strcmp(mime_get_type("/www/old.tar.gz/notes.gz"), "application/gzip") == 0);
+    assert(strcmp(mime_get_type("/www/some.dir/photo.JPEG"), "image/jpeg") == 0);
+    assert(mime_get_type("/www/some.dir/README") == NULL);
+    assert(mime_get_type("/www/file.") == NULL);
+
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,62 @@
+/**
+ * @file pathcache_test.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief File that tests storing, retrieving, expiring and evicting entries of the path cache.
+ */
+
+#include "pathcache.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+int main() {
+    pathcache *cache = pathcache_create(2, 10000, 50);
+    assert(cache != NULL);
+
+    struct path_target target, found;
+    memset(&target, 0, sizeof(target));
+
+    // Missing entries
+    assert(pathcache_get(cache, "/index.html", &found) == ERROR);
+
+    // Found targets are returned as stored
+    target.type = TARGET_INDEX;
+    target.is_directory = 1;
+    target.st.st_size = 1234;
+    strcpy(target.fullpath, "/www/dir/index.html");
+    assert(pathcache_put(cache, "/dir", &target) == SUCCESS);
+    assert(pathcache_get(cache, "/dir", &found) == SUCCESS);
+    assert(found.type == TARGET_INDEX && found.is_directory == 1 && found.st.st_size == 1234);
+    assert(strcmp(found.fullpath, "/www/dir/index.html") == 0);
+
+    // Not found targets expire after their own (shorter) time
+    target.type = TARGET_NOT_FOUND;
+    target.is_directory = 0;
+    strcpy(target.fullpath, "/www/nope");
+    assert(pathcache_put(cache, "/nope", &target) == SUCCESS);
+    assert(pathcache_get(cache, "/nope", &found) == SUCCESS && found.type == TARGET_NOT_FOUND);
+    usleep(100 * 1000);
+    assert(pathcache_get(cache, "/nope", &found) == ERROR);
+    assert(pathcache_get(cache, "/dir", &found) == SUCCESS);
+
+    // Replacing an entry doesn't increase the count
+    assert(pathcache_put(cache, "/nope", &target) == SUCCESS);
+    assert(pathcache_count(cache) == 2);
+
+    // When the cache is full, the oldest entry is evicted
+    target.type = TARGET_FILE;
+    strcpy(target.fullpath, "/www/a.txt");
+    assert(pathcache_put(cache, "/a.txt", &target) == SUCCESS);
+    assert(pathcache_count(cache) == 2);
+    assert(pathcache_get(cache, "/dir", &found) == ERROR);
+    assert(pathcache_get(cache, "/a.txt", &found) == SUCCESS && found.type == TARGET_FILE);
+
+    pathcache_free(cache);
+
+    printf("Path cache module tested correctly\n");
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
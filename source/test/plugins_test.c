@@ -0,0 +1,63 @@
+/**
+ * @file plugins_test.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief File that tests loading the example plugin and answering requests with it.
+ */
+
+#include "plugins.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+/**
+ * @brief Answers a request with a plugin, and reads the response it sends
+ */
+void run(plugin *plugin, struct request *request, char *response, size_t len) {
+    int sv[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+    struct httpres_headers *headers = create_header_struct();
+    plugin_run(plugin, sv[0], headers, request); // Closes its end of the connection
+    headers_free(headers);
+
+    memset(response, 0, len);
+    assert(recv(sv[1], response, len - 1, MSG_WAITALL) > 0);
+    close(sv[1]);
+}
+
+int main() {
+    assert(plugin_load("/nonexistent/plugin.so") == NULL);
+    assert(plugin_load("libm.so.6") == NULL); // A shared object that isn't a plugin
+
+    plugin *hello = plugin_load(HELLO_PLUGIN);
+    assert(hello != NULL);
+
+    struct request request;
+    memset(&request, 0, sizeof(request));
+    request.method = "GET";
+    request.path = "/hello";
+    request.querystring = "lang=en&name=Ada";
+
+    char response[1024];
+    run(hello, &request, response, sizeof(response));
+    assert(strncmp(response, "HTTP/1.1 200 OK\r\n", 17) == 0);
+    assert(strstr(response, "Content-Type: text/plain\r\n") && strstr(response, "Content-Length: 30\r\n"));
+    assert(strstr(response, "\r\n\r\nHello, Ada! This is request 1\n"));
+
+    // A HEAD request receives the length of the body, but not the body
+    request.querystring = "name=<script>";
+    request.headers_only = 1;
+    run(hello, &request, response, sizeof(response));
+    assert(strstr(response, "Content-Length: 32\r\n"));
+    assert(strcmp(response + strlen(response) - 4, "\r\n\r\n") == 0);
+
+    plugin_free(hello);
+
+    printf("Plugins module tested correctly\n");
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+/**
+ * @file range_test.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief File that tests the parsing of the Range header values used for partial content responses.
+ */
+
+#include "httputils.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/**
+ * @brief Parses a null-terminated Range header value for a file of 1000 bytes
+ * @param[in] value The Range header value
+ * @param[out] ranges Array where the ranges must be stored
+ * @return The result of parse_range()
+ */
+int parse(const char *value, struct byte_range *ranges) {
+    return parse_range(value, strlen(value), 1000, ranges, MAX_RANGES);
+}
+
+int main() {
+    struct byte_range r[MAX_RANGES];
+
+    // Single ranges
+    assert(parse("bytes=0-499", r) == 1 && r[0].first == 0 && r[0].last == 499);
+    assert(parse("bytes=500-", r) == 1 && r[0].first == 500 && r[0].last == 999);
+    assert(parse("bytes=-200", r) == 1 && r[0].first == 800 && r[0].last == 999);
+    assert(parse("bytes=-5000", r) == 1 && r[0].first == 0 && r[0].last == 999);
+    assert(parse("bytes=900-5000", r) == 1 && r[0].first == 900 && r[0].last == 999);
+
+    // Multiple ranges, with whitespace and empty elements
+    assert(parse("bytes=0-0, -1", r) == 2 && r[0].last == 0 && r[1].first == 999);
+    assert(parse("bytes=0-9,,20-29 ,40-", r) == 3 && r[1].first == 20 && r[2].first == 40);
+
+    // Unsatisfiable ranges are skipped
+    assert(parse("bytes=1000-", r) == 0);
+    assert(parse("bytes=-0", r) == 0);
+    assert(parse("bytes=2000-3000,0-1", r) == 1 && r[0].first == 0 && r[0].last == 1);
+
+    // Invalid headers must be ignored
+    assert(parse("bytes=10-5", r) == -1);
+    assert(parse("bytes=", r) == -1);
+    assert(parse("bytes=a-b", r) == -1);
+    assert(parse("items=0-5", r) == -1);
+    assert(parse("bytes=0-5;6-7", r) == -1);
+    assert(parse("bytes=99999999999999999999-", r) == -1);
+    assert(parse("bytes=0-0,1-1,2-2,3-3,4-4,5-5,6-6,7-7,8-8,9-9,10-10,11-11,12-12,13-13,14-14,15-15,16-16", r) == -1);
+
+    printf("Range parsing tested correctly\n");
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
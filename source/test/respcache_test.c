@@ -0,0 +1,145 @@
+/**
+ * @file respcache_test.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief File that tests storing, sending, coalescing and refreshing responses in the script response cache.
+ */
+
+#include "respcache.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+respcache *cache;
+struct request request;
+
+/**
+ * @brief Fills a capture as if a script had produced the provided headers and body
+ */
+void fake_capture(struct cgi_capture *capture, const char *head, const char *body) {
+    cgi_capture_init(capture, 1024);
+    capture->code = OK;
+    strcpy(capture->message, "OK");
+    capture->head = strdup(head);
+    capture->head_len = strlen(head);
+    capture->body = strdup(body);
+    capture->body_len = capture->body_cap = strlen(body);
+}
+
+/**
+ * @brief Looks up the request from another thread, which must wait for the leader
+ */
+void *waiter(void *arg) {
+    respcache_entry *entry;
+    *(RESPCACHE_RESULT *) arg = respcache_lookup(cache, &request, "/www/a.py", 1, &entry);
+    if (*(RESPCACHE_RESULT *) arg != RESPCACHE_BYPASS) respcache_release(cache, entry);
+    return NULL;
+}
+
+int main() {
+    cache = respcache_create(8, 60, 60, "Accept-Language", 1024);
+    assert(cache != NULL);
+
+    memset(&request, 0, sizeof(request));
+    request.querystring = "a=1";
+
+    // The first request leads, and identical requests wait for its response
+    respcache_entry *entry, *other;
+    assert(respcache_peek(cache, &request, "/www/a.py", 1, &entry) == RESPCACHE_BYPASS);
+    assert(respcache_lookup(cache, &request, "/www/a.py", 1, &entry) == RESPCACHE_LEAD);
+    assert(respcache_peek(cache, &request, "/www/a.py", 1, &other) == RESPCACHE_BYPASS); // Doesn't wait for it
+    RESPCACHE_RESULT waited = RESPCACHE_BYPASS;
+    pthread_t thread;
+    pthread_create(&thread, NULL, waiter, &waited);
+    usleep(50 * 1000);
+
+    struct cgi_capture capture;
+    fake_capture(&capture, "Content-Type: text/plain\r\n", "hello");
+    respcache_complete(cache, entry, &capture);
+    assert(capture.body == NULL); // Taken over by the cache
+    respcache_release(cache, entry);
+    pthread_join(thread, NULL);
+    assert(waited == RESPCACHE_HIT);
+    assert(respcache_peek(cache, &request, "/www/a.py", 1, &entry) == RESPCACHE_HIT);
+    respcache_release(cache, entry);
+
+    // The stored response is sent with its headers and its length
+    assert(respcache_lookup(cache, &request, "/www/a.py", 1, &entry) == RESPCACHE_HIT);
+    int sv[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    struct httpres_headers *headers = create_header_struct();
+    assert(respcache_send(entry, sv[0], headers, &request) == OK);
+    headers_free(headers);
+    respcache_release(cache, entry);
+    char response[1024] = {0};
+    assert(recv(sv[1], response, sizeof(response) - 1, MSG_WAITALL) > 0);
+    close(sv[1]);
+    assert(strstr(response, "200 OK") && strstr(response, "Content-Type: text/plain\r\n"));
+    assert(strstr(response, "Content-Length: 5\r\n") && strstr(response, "Age: 0\r\n"));
+    assert(strcmp(response + strlen(response) - 5, "hello") == 0);
+
+    // The querystring and the chosen headers are part of the key
+    request.querystring = "a=2";
+    assert(respcache_lookup(cache, &request, "/www/a.py", 0, &entry) == RESPCACHE_BYPASS); // HEAD can't lead
+    request.querystring = "a=1";
+    request.headers[0] = (struct phr_header) {"Accept-Language", 15, "es", 2};
+    request.num_headers = 1;
+    assert(respcache_lookup(cache, &request, "/www/a.py", 1, &entry) == RESPCACHE_LEAD);
+
+    // Responses that forbid caching aren't stored, and following requests don't wait for a leader
+    fake_capture(&capture, "Cache-Control: private\r\n", "personal");
+    respcache_complete(cache, entry, &capture);
+    respcache_release(cache, entry);
+    cgi_capture_free(&capture);
+    assert(respcache_lookup(cache, &request, "/www/a.py", 1, &entry) == RESPCACHE_BYPASS);
+
+    // Responses setting their own max-age expire after it, and are refreshed by a single request
+    request.num_headers = 0;
+    request.querystring = "b=1";
+    assert(respcache_lookup(cache, &request, "/www/a.py", 1, &entry) == RESPCACHE_LEAD);
+    fake_capture(&capture, "Cache-Control: public, max-age=1\r\n", "old");
+    respcache_complete(cache, entry, &capture);
+    respcache_release(cache, entry);
+    sleep(1);
+    usleep(100 * 1000);
+    assert(respcache_peek(cache, &request, "/www/a.py", 0, &other) == RESPCACHE_HIT); // It can't refresh it
+    respcache_release(cache, other);
+    assert(respcache_peek(cache, &request, "/www/a.py", 1, &entry) == RESPCACHE_REFRESH);
+    assert(respcache_lookup(cache, &request, "/www/a.py", 1, &other) == RESPCACHE_HIT); // Still the stale copy
+    respcache_release(cache, other);
+    fake_capture(&capture, "Cache-Control: s-maxage=60, max-age=1\r\n", "new");
+    respcache_complete(cache, entry, &capture);
+    respcache_release(cache, entry);
+    sleep(1);
+    usleep(100 * 1000);
+    assert(respcache_lookup(cache, &request, "/www/a.py", 1, &entry) == RESPCACHE_HIT); // s-maxage took precedence
+    respcache_release(cache, entry);
+
+    // When the cache is full, the oldest entry is evicted
+    assert(respcache_count(cache) == 3);
+    for (int i = 0; i < 8; i++) {
+        char querystring[16];
+        sprintf(querystring, "c=%i", i);
+        request.querystring = querystring;
+        assert(respcache_lookup(cache, &request, "/www/a.py", 1, &entry) == RESPCACHE_LEAD);
+        fake_capture(&capture, "", "x");
+        respcache_complete(cache, entry, &capture);
+        respcache_release(cache, entry);
+    }
+    assert(respcache_count(cache) == 8);
+    request.querystring = "a=1";
+    assert(respcache_lookup(cache, &request, "/www/a.py", 1, &entry) == RESPCACHE_LEAD);
+    cgi_capture_init(&capture, 1024); // A leader that produces nothing
+    respcache_complete(cache, entry, &capture);
+    respcache_release(cache, entry);
+
+    respcache_free(cache);
+
+    printf("Response cache module tested correctly\n");
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,120 @@
+/**
+ * @file spawn_bench.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Benchmark comparing the cost of launching a program with fork() + execve() and with posix_spawn()
+ * @details The cost of fork() grows with the size of the parent's address space and with the number of threads
+ * touching it, so the benchmark inflates its resident memory and keeps some busy threads around to resemble a
+ * loaded server. Usage: spawn_bench [iterations] [megabytes] [threads]
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#define DEFAULT_ITERATIONS 500
+#define DEFAULT_MEGABYTES 512
+#define DEFAULT_THREADS 4
+#define BENCH_PROGRAM "/bin/true"
+
+extern char **environ;
+
+volatile int running = 1; ///< Cleared to stop the busy threads
+
+/**
+ * @brief Keeps a thread busy writing to its own memory until the benchmark ends
+ * @param arg Unused
+ * @return NULL
+ */
+void *busy_thread(void *arg) {
+    (void) arg;
+    char scratch[4096];
+    while (running) {
+        memset(scratch, running, sizeof(scratch)); // Dirty pages keep copy-on-write busy
+    }
+    return NULL;
+}
+
+/**
+ * @brief Returns the current monotonic time in microseconds
+ */
+double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1e6 + (double) ts.tv_nsec / 1e3;
+}
+
+/**
+ * @brief Launches the program with fork() and execve() and waits for it
+ */
+void run_fork() {
+    char *const argv[] = {BENCH_PROGRAM, NULL};
+    pid_t pid = fork();
+    assert(pid != -1);
+    if (pid == 0) {
+        execve(BENCH_PROGRAM, argv, environ);
+        _exit(127);
+    }
+    int status;
+    assert(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+/**
+ * @brief Launches the program with posix_spawn() and waits for it
+ */
+void run_spawn() {
+    char *const argv[] = {BENCH_PROGRAM, NULL};
+    pid_t pid;
+    assert(posix_spawn(&pid, BENCH_PROGRAM, NULL, NULL, argv, environ) == 0);
+    int status;
+    assert(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+/**
+ * @brief Runs one of the launch methods repeatedly and returns the mean time per launch
+ * @param launch Launch method
+ * @param iterations Number of launches
+ * @return Mean microseconds per launch
+ */
+double bench(void (*launch)(), int iterations) {
+    double start = now_us();
+    for (int i = 0; i < iterations; i++) launch();
+    return (now_us() - start) / iterations;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+    size_t megabytes = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_MEGABYTES;
+    int nthreads = argc > 3 ? atoi(argv[3]) : DEFAULT_THREADS;
+    assert(iterations > 0);
+
+    size_t size = megabytes << 20;
+    char *ballast = size ? malloc(size) : NULL;
+    assert(!size || ballast);
+    memset(ballast, 1, size); // Make the memory resident so that fork() has page tables to copy
+
+    pthread_t threads[nthreads > 0 ? nthreads : 1];
+    for (int i = 0; i < nthreads; i++) {
+        assert(pthread_create(&threads[i], NULL, busy_thread, NULL) == 0);
+    }
+
+    double fork_us = bench(run_fork, iterations);
+    double spawn_us = bench(run_spawn, iterations);
+
+    running = 0;
+    for (int i = 0; i < nthreads; i++) pthread_join(threads[i], NULL);
+    free(ballast);
+
+    printf("%d launches of %s with %zu MB resident and %d busy threads\n", iterations, BENCH_PROGRAM, megabytes,
+           nthreads);
+    printf("fork + execve: %8.1f us per launch\n", fork_us);
+    printf("posix_spawn:   %8.1f us per launch\n", spawn_us);
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
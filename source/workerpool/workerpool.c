@@ -0,0 +1,402 @@
+/**
+ * @file workerpool.c
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Implementation of the pool of persistent interpreter processes
+ * @details The idle workers are kept in a linked list protected by a mutex, used as a stack so that the most recently
+ * used worker (whose memory is most likely to be warm) is picked first. Busy workers belong to the thread that is
+ * running a script in them, and go back to the list once the script finishes, unless they have to be replaced.
+ */
+
+#include "workerpool.h"
+#include "cgi.h"
+#include "metrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/pidfd.h>
+#include <sys/socket.h>
+
+/**
+ * @struct worker
+ * @brief A worker process of the pool
+ */
+struct worker {
+    pid_t pid; ///< Process ID of the worker
+    int pidfd; ///< Process file descriptor of the worker, used for killing it, or -1 if it couldn't be opened
+    int fd; ///< Socket connected to the worker
+    int requests; ///< Number of requests served by the worker
+    struct worker *next; ///< Next idle worker, if the worker is idle
+};
+
+/**
+ * @struct workerpool
+ * @brief Contains the configuration of the pool and its idle workers
+ */
+struct workerpool {
+    char interpreter[PATH_MAX]; ///< Absolute path of the interpreter
+    char *shim; ///< Path of the script run by the interpreter in each worker
+    int min_workers; ///< Number of workers that are always kept running
+    int max_workers; ///< Maximum number of workers running at once
+    int max_requests; ///< Number of requests served by each worker before being replaced (0 for no limit)
+    struct cgi_limits limits; ///< Bounds of the scripts run by the workers
+    int n_workers; ///< Number of workers running or being started
+    struct worker *idle; ///< List of idle workers
+    pthread_mutex_t mutex; ///< Mutex protecting the list of idle workers and the number of workers
+    pthread_cond_t available; ///< Condition signalled when a worker becomes idle or the pool can grow
+};
+
+/**
+ * @brief Starts a new worker process
+ * @param[in] pool The pool the worker belongs to
+ * @return The new worker, or NULL if it couldn't be started
+ */
+struct worker *worker_start(workerpool *pool) {
+    struct worker *worker = calloc(1, sizeof(struct worker));
+    if (!worker) return NULL;
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1) { // No other worker must inherit the sockets
+        free(worker);
+        return NULL;
+    }
+
+    if (sv[1] == WORKER_FD) { // Duplicating it onto itself wouldn't clear its close-on-exec flag
+        int moved = fcntl(sv[1], F_DUPFD_CLOEXEC, WORKER_FD + 1);
+        close(sv[1]);
+        sv[1] = moved;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, sv[1], WORKER_FD); // The only descriptor inherited from the server
+    // Scripts get their input from the requests, never from the server's stdin
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t signals;
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attr, &signals);
+    sigaddset(&signals, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &signals); // The server ignores it, but workers should die if it goes away
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    extern char **environ;
+    char *const argv[] = {pool->interpreter, pool->shim, NULL};
+    int ret = posix_spawn(&worker->pid, pool->interpreter, &actions, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if (ret != 0) {
+        close(sv[0]);
+        close(sv[1]);
+        free(worker);
+        return NULL;
+    }
+
+    close(sv[1]);
+    metrics_add(METRIC_POOL_SPAWNS, 1);
+    worker->fd = sv[0];
+    worker->pidfd = pidfd_open(worker->pid, 0);
+    cgi_limits_apply(worker->pid, &pool->limits, 0);
+
+    return worker;
+}
+
+/**
+ * @brief Stops a worker process and frees it
+ * @param[in] worker The worker to stop
+ * @param[in] force 1 if the worker must be killed, 0 if it can exit by itself once it notices the socket is closed
+ */
+void worker_stop(struct worker *worker, int force) {
+    if (force && (worker->pidfd == -1 || pidfd_send_signal(worker->pidfd, SIGKILL, NULL, 0) == -1)) {
+        kill(worker->pid, SIGKILL); // It hasn't been reaped yet, so its PID can't have been reused
+    }
+    if (worker->pidfd != -1) close(worker->pidfd);
+    close(worker->fd);
+    cgi_reap(worker->pid);
+    free(worker);
+}
+
+/**
+ * @brief Obtains an idle worker, starting a new one or waiting for one to be free if there's none
+ * @param[in] pool The pool from which the worker must be obtained
+ * @return The worker, or NULL if a new worker was required and it couldn't be started
+ */
+struct worker *workerpool_acquire(workerpool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    while (1) {
+        if (pool->idle) {
+            struct worker *worker = pool->idle;
+            pool->idle = worker->next;
+            pthread_mutex_unlock(&pool->mutex);
+            return worker;
+        }
+
+        if (pool->n_workers < pool->max_workers) { // The pool can grow, so there's no need to wait
+            pool->n_workers++;
+            pthread_mutex_unlock(&pool->mutex);
+
+            struct worker *worker = worker_start(pool); // Processes are started without holding the lock
+            if (!worker) {
+                pthread_mutex_lock(&pool->mutex);
+                pool->n_workers--;
+                pthread_cond_signal(&pool->available);
+                pthread_mutex_unlock(&pool->mutex);
+            }
+            return worker;
+        }
+
+        pthread_cond_wait(&pool->available, &pool->mutex);
+    }
+}
+
+/**
+ * @brief Returns a worker to the pool once it has finished running a script
+ * @details Workers that have crashed or reached their request limit are replaced, if needed to keep the minimum size.
+ * @param[in] pool The pool the worker belongs to
+ * @param[in] worker The worker
+ * @param[in] healthy 1 if the worker can keep running scripts, 0 if it crashed or misbehaved
+ */
+void workerpool_release(workerpool *pool, struct worker *worker, int healthy) {
+    worker->requests++;
+
+    if (healthy && (pool->max_requests <= 0 || worker->requests < pool->max_requests)) {
+        pthread_mutex_lock(&pool->mutex);
+        worker->next = pool->idle;
+        pool->idle = worker;
+        pthread_cond_signal(&pool->available);
+        pthread_mutex_unlock(&pool->mutex);
+        return;
+    }
+
+    worker_stop(worker, !healthy);
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->n_workers > pool->min_workers) { // The pool can shrink
+        pool->n_workers--;
+        pthread_cond_signal(&pool->available); // Waiting threads can now start a new worker
+        pthread_mutex_unlock(&pool->mutex);
+        return;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    // The replacement takes the place of the stopped worker, so the number of workers doesn't change
+    struct worker *replacement = worker_start(pool);
+    pthread_mutex_lock(&pool->mutex);
+    if (replacement) {
+        replacement->next = pool->idle;
+        pool->idle = replacement;
+    } else {
+        pool->n_workers--;
+    }
+    pthread_cond_signal(&pool->available);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+workerpool *workerpool_create(const char *interpreter, const char *shim, int min_workers, int max_workers,
+                              int max_requests, const struct cgi_limits *limits) {
+    if (!interpreter || !shim || max_workers <= 0 || access(shim, R_OK) != 0) return NULL;
+
+    workerpool *pool = calloc(1, sizeof(workerpool));
+    if (!pool) return NULL;
+
+    if (cgi_find_command(interpreter, pool->interpreter, sizeof(pool->interpreter)) == ERROR) {
+        free(pool);
+        return NULL;
+    }
+
+    pool->shim = strdup(shim);
+    pool->max_workers = max_workers;
+    pool->min_workers = min_workers < 0 ? 0 : (min_workers > max_workers ? max_workers : min_workers);
+    pool->max_requests = max_requests;
+    if (limits) pool->limits = *limits;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->available, NULL);
+
+    for (int i = 0; i < pool->min_workers; i++) {
+        struct worker *worker = worker_start(pool);
+        if (!worker) {
+            workerpool_free(pool);
+            return NULL;
+        }
+        worker->next = pool->idle;
+        pool->idle = worker;
+        pool->n_workers++;
+    }
+
+    return pool;
+}
+
+void workerpool_free(workerpool *pool) {
+    if (!pool) return;
+
+    while (pool->idle) {
+        struct worker *next = pool->idle->next;
+        worker_stop(pool->idle, 0);
+        pool->idle = next;
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->available);
+    free(pool->shim);
+    free(pool);
+}
+
+/**
+ * @brief Sends a request frame to a worker, asking it to run a script
+ * @param[in] worker The worker
+ * @param[in] request The request, whose querystring and body are the input of the script
+ * @param[in] fullpath Absolute path of the script
+ * @return \ref STATUS.SUCCESS if the frame was sent, \ref STATUS.ERROR otherwise
+ */
+STATUS worker_send_request(struct worker *worker, const struct request *request, const char *fullpath) {
+    size_t path_len = strlen(fullpath);
+    size_t qs_len = request->querystring ? strlen(request->querystring) : 0;
+
+    size_t payload_len = path_len + 1;
+    if (request->querystring) payload_len += qs_len + 2;
+    if (request->body) payload_len += request->body_len + 2;
+
+    // Requests are small (they have to fit in the request buffer), so the frame is built and sent at once
+    char *frame = malloc(FRAME_HEADER + payload_len);
+    if (!frame) return ERROR;
+
+    frame[0] = FRAME_REQUEST;
+    uint32_t len = htonl((uint32_t) payload_len);
+    memcpy(frame + 1, &len, sizeof(len));
+
+    size_t pos = FRAME_HEADER;
+    memcpy(frame + pos, fullpath, path_len + 1); // The null terminator separates the path from the input
+    pos += path_len + 1;
+    if (request->querystring) {
+        memcpy(frame + pos, request->querystring, qs_len);
+        memcpy(frame + pos + qs_len, "\r\n", 2);
+        pos += qs_len + 2;
+    }
+    if (request->body) {
+        memcpy(frame + pos, request->body, request->body_len);
+        memcpy(frame + pos + request->body_len, "\r\n", 2);
+        pos += request->body_len + 2;
+    }
+
+    ssize_t ret = send_all(worker->fd, frame, pos, 0);
+    free(frame);
+
+    return ret == -1 ? ERROR : SUCCESS;
+}
+
+/**
+ * @brief Relays the output frames produced by a worker running a script until the end frame
+ * @details If the client goes away, the rest of the output is still received and discarded, so that the worker can go
+ * on serving other requests.
+ * @pre The script must have been sent to the worker with worker_send_request()
+ * @param[in] worker The worker
+ * @param[in,out] out The response where the output must be relayed
+ * @param[in] deadline Moment by which the script must have finished
+ * @param[out] exit_status Variable where the exit status of the script must be stored
+ * @return \ref STATUS.SUCCESS if the worker ran the script, \ref STATUS.ERROR if it crashed, broke the protocol or ran
+ * out of time
+ */
+STATUS worker_execute(struct worker *worker, struct cgi_output *out, const struct timespec *deadline,
+                      int *exit_status) {
+    int client_gone = 0;
+    char buf[FRAME_BUFFER];
+    while (1) {
+        unsigned char header[FRAME_HEADER];
+        if (cgi_recv_all(worker->fd, header, sizeof(header), deadline) == ERROR) return ERROR;
+
+        uint32_t len;
+        memcpy(&len, header + 1, sizeof(len));
+        len = ntohl(len);
+
+        if (header[0] == FRAME_END) {
+            uint32_t status = 0;
+            if (len != sizeof(status) || cgi_recv_all(worker->fd, &status, sizeof(status), deadline) == ERROR) {
+                return ERROR;
+            }
+            *exit_status = (int) ntohl(status);
+            return SUCCESS;
+        } else if (header[0] != FRAME_OUTPUT) {
+            return ERROR;
+        }
+
+        while (len > 0) {
+            size_t piece = len < sizeof(buf) ? len : sizeof(buf);
+            if (cgi_recv_all(worker->fd, buf, piece, deadline) == ERROR) return ERROR;
+            len -= piece;
+
+            if (client_gone) continue;
+            // The response is only started once the headers are complete, so that failed scripts get an error
+            if (cgi_output_relay(out, buf, piece) == ERROR) client_gone = 1;
+        }
+    }
+}
+
+HTTP_RESPONSE_CODE workerpool_run(workerpool *pool, int socket, struct httpres_headers *headers,
+                                  struct request *request, const char *fullpath, struct cgi_capture *capture) {
+    if (!pool || !headers || !request || !fullpath) {
+        return respond(socket, INTERNAL_ERROR, "Internal error", NULL, NULL, 0);
+    }
+
+    struct cgi_output out;
+    cgi_output_init(&out, socket, headers, request, capture);
+
+    struct timespec deadline;
+    cgi_deadline_init(&deadline, &pool->limits);
+
+    // A worker that crashed before starting the response may have been broken before this request, so it's retried if
+    // the script can't have run yet, or if running it again is safe
+    int idempotent = strcmp(request->method, GET) == 0 || strcmp(request->method, HEAD) == 0;
+    for (int attempt = 0; attempt < 2 && !out.started; attempt++) {
+        struct worker *worker = workerpool_acquire(pool);
+        if (!worker) break;
+
+        cgi_output_init(&out, socket, headers, request, capture); // Discards the headers of the failed attempt
+        cgi_output_nph(&out, fullpath);
+
+        int exit_status = 0;
+        int delivered = 0;
+        STATUS ret = worker_send_request(worker, request, fullpath);
+        if (ret == SUCCESS) {
+            delivered = 1;
+            ret = worker_execute(worker, &out, &deadline, &exit_status);
+        }
+#if DEBUG >= 2
+        printf("Worker %i ran %s with exit status %i\n", worker->pid, fullpath, exit_status);
+#endif
+        workerpool_release(pool, worker, ret == SUCCESS); // A worker that ran out of time is killed
+
+        if (ret == ERROR && cgi_deadline_left(&deadline) == 0) return cgi_output_timeout(&out);
+        if (ret == SUCCESS) {
+            cgi_output_end(&out); // Output that ended in the middle of the headers still makes a response
+            break;
+        }
+        if (delivered && !idempotent) break;
+    }
+
+    if (!out.started) return respond(socket, INTERNAL_ERROR, "Execution error", headers, NULL, 0);
+
+    cgi_output_finish(&out);
+    return out.code;
+}
+
+int workerpool_size(workerpool *pool) {
+    if (!pool) return -1;
+
+    pthread_mutex_lock(&pool->mutex);
+    int size = pool->n_workers;
+    pthread_mutex_unlock(&pool->mutex);
+
+    return size;
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+/**
+ * @file workerpool.h
+ * @author Diego Ortín Fernández
+ * @date 18 October 2026
+ * @brief Pool of persistent interpreter processes that run scripts without starting a new interpreter each time
+ * @details Starting an interpreter for every request costs tens of milliseconds, far more than running most scripts.
+ * This module keeps a set of long-lived worker processes for an interpreter, each one running a small shim script
+ * (scripts/worker.py, scripts/worker.php) that executes the requested scripts inside the same interpreter.
+ *
+ * The server and each worker communicate through a Unix socket pair, which the worker finds as its file descriptor
+ * @ref WORKER_FD, using frames made of a one byte type, a four byte big-endian length and the payload:
+ * - @ref FRAME_REQUEST (server to worker): path of the script, a null byte, and the standard input of the script
+ * - @ref FRAME_OUTPUT (worker to server): a piece of the standard output of the script
+ * - @ref FRAME_END (worker to server): the script has finished, with its exit status as a four byte big-endian integer
+ *
+ * The pool starts with a minimum number of workers, and grows on demand up to a maximum. Workers are replaced after
+ * serving a number of requests, to contain leaks in long-running interpreters, and when they crash or run a script for
+ * longer than its timeout, in which case they're killed.
+ */
+
+#ifndef PRACTICA1_WORKERPOOL_H
+#define PRACTICA1_WORKERPOOL_H
+
+#include "httputils.h"
+#include "cgi.h"
+#include "constants.h"
+
+#define WORKER_FD 3 ///< File descriptor of the socket connected to the server, in the workers
+#define FRAME_HEADER 5 ///< Size of the header of a frame (type and length)
+#define FRAME_REQUEST 'R' ///< Type of the frames asking a worker to run a script
+#define FRAME_OUTPUT 'O' ///< Type of the frames containing output of a script
+#define FRAME_END 'E' ///< Type of the frame signalling that a script has finished
+#define FRAME_BUFFER (16 * 1024) ///< Size of the buffer used for relaying the output frames
+
+/**
+ * @brief The worker pool type
+ */
+typedef struct workerpool workerpool;
+
+/**
+ * @brief Creates a pool of workers for an interpreter, and starts its minimum number of workers
+ * @param[in] interpreter Command of the interpreter, which is searched in the PATH if it's not a path itself
+ * @param[in] shim Path of the script run by the interpreter in each worker
+ * @param[in] min_workers Number of workers that are always kept running
+ * @param[in] max_workers Maximum number of workers running at once
+ * @param[in] max_requests Number of requests served by each worker before being replaced (0 for no limit)
+ * @param[in] limits Bounds of the scripts (can be NULL). The memory and open files limits apply to each worker process
+ * as a whole, and the CPU time limit isn't applied, since it would accumulate over all the scripts run by a worker
+ * (the timeout bounds them instead).
+ * @return The new pool, or NULL if an error occurs, the interpreter or the shim don't exist, or @p max_workers isn't
+ * positive
+ */
+workerpool *workerpool_create(const char *interpreter, const char *shim, int min_workers, int max_workers,
+                              int max_requests, const struct cgi_limits *limits);
+
+/**
+ * @brief Stops all the workers of a pool and frees it
+ * @pre No requests can be running in the pool
+ * @param[in] pool The pool to free
+ */
+void workerpool_free(workerpool *pool);
+
+/**
+ * @brief Runs a script in one of the workers of the pool, relaying its output to the socket as an HTTP response
+ * @details If all the workers are busy and the pool has its maximum size, this function waits until one of them is
+ * free. The input of the script is the same as when it's run as a separate process: the querystring and the body of
+ * the request, each one followed by a CRLF.
+ * @param[in] pool The pool that must run the script
+ * @param[out] socket The socket to which the response must be sent
+ * @param[in] headers Structure containing the headers for the response
+ * @param[in] request Request from which the data must be obtained
+ * @param[in] fullpath Absolute path of the script
+ * @param[out] capture Where a copy of the response must be kept (can be NULL)
+ * @return code of the HTTP response sent to the socket, or \ref HTTP_RESPONSE_CODE.GATEWAY_TIMEOUT if the worker was
+ * killed because the script exceeded its timeout
+ */
+HTTP_RESPONSE_CODE workerpool_run(workerpool *pool, int socket, struct httpres_headers *headers,
+                                  struct request *request, const char *fullpath, struct cgi_capture *capture);
+
+/**
+ * @brief Returns the number of workers running in a pool
+ * @param[in] pool The pool to check
+ * @return Number of workers, or -1 if the pool is NULL
+ */
+int workerpool_size(workerpool *pool);
+
+#endif //PRACTICA1_WORKERPOOL_H